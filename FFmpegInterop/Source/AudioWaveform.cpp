@@ -0,0 +1,112 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "AudioWaveform.h"
+#include "WaveformGenerator.h"
+#include <cmath>
+
+using namespace concurrency;
+using namespace FFmpegInterop;
+using namespace Platform;
+
+AudioWaveform::AudioWaveform(TimeSpan duration, const std::vector<PeakAccumulator>& buckets)
+	: duration(duration)
+{
+	minimums.reserve(buckets.size());
+	maximums.reserve(buckets.size());
+	rms.reserve(buckets.size());
+	for (auto& bucket : buckets)
+	{
+		bool isEmpty = bucket.count == 0;
+		minimums.push_back(isEmpty ? 0.0f : bucket.minimum);
+		maximums.push_back(isEmpty ? 0.0f : bucket.maximum);
+		rms.push_back(isEmpty ? 0.0f : (float)sqrt(bucket.sumSquares / bucket.count));
+	}
+}
+
+static AudioWaveform^ CreateWaveform(IRandomAccessStream^ stream, const std::string& url, int bucketCount, FFmpegInteropConfig^ config, cancellation_token ct)
+{
+	AudioWaveform^ waveform = nullptr;
+	std::vector<PeakAccumulator> buckets;
+	int64_t duration = 0;
+
+	WaveformGenerator generator(stream, url, config != nullptr ? config : ref new FFmpegInteropConfig());
+	if (SUCCEEDED(generator.Generate(bucketCount, ct, buckets, &duration)))
+	{
+		TimeSpan waveformDuration = { av_rescale(duration, 10000000, AV_TIME_BASE) };
+		waveform = ref new AudioWaveform(waveformDuration, buckets);
+	}
+
+	if (ct.is_canceled())
+	{
+		cancel_current_task();
+	}
+
+	return waveform;
+}
+
+IAsyncOperation<AudioWaveform^>^ AudioWaveform::CreateFromStreamAsync(IRandomAccessStream^ stream, int bucketCount, FFmpegInteropConfig^ config)
+{
+	return create_async([stream, bucketCount, config](cancellation_token ct)
+	{
+		return stream != nullptr ? CreateWaveform(stream, "", bucketCount, config, ct) : nullptr;
+	});
+}
+
+IAsyncOperation<AudioWaveform^>^ AudioWaveform::CreateFromUriAsync(String^ uri, int bucketCount, FFmpegInteropConfig^ config)
+{
+	return create_async([uri, bucketCount, config](cancellation_token ct)
+	{
+		AudioWaveform^ waveform = nullptr;
+		if (uri)
+		{
+			std::vector<char> url(WideCharToMultiByte(CP_UTF8, 0, uri->Data(), -1, nullptr, 0, nullptr, nullptr));
+			WideCharToMultiByte(CP_UTF8, 0, uri->Data(), -1, url.data(), (int)url.size(), nullptr, nullptr);
+			waveform = CreateWaveform(nullptr, url.data(), bucketCount, config, ct);
+		}
+		return waveform;
+	});
+}
+
+Array<float>^ AudioWaveform::GetMinimums()
+{
+	return ref new Array<float>(minimums.data(), (unsigned int)minimums.size());
+}
+
+Array<float>^ AudioWaveform::GetMaximums()
+{
+	return ref new Array<float>(maximums.data(), (unsigned int)maximums.size());
+}
+
+Array<float>^ AudioWaveform::GetRms()
+{
+	return ref new Array<float>(rms.data(), (unsigned int)rms.size());
+}
+
+Array<float>^ AudioWaveform::GetPeaks()
+{
+	auto peaks = ref new Array<float>((unsigned int)minimums.size() * 3);
+	for (size_t i = 0; i < minimums.size(); i++)
+	{
+		peaks[(unsigned int)i * 3] = minimums[i];
+		peaks[(unsigned int)i * 3 + 1] = maximums[i];
+		peaks[(unsigned int)i * 3 + 2] = rms[i];
+	}
+	return peaks;
+}
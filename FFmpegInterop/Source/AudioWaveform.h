@@ -0,0 +1,80 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <vector>
+#include "FFmpegInteropConfig.h"
+#include "WaveformKernels.h"
+
+using namespace Platform;
+using namespace Windows::Foundation;
+using namespace Windows::Storage::Streams;
+
+namespace FFmpegInterop
+{
+	// Peaks of the audio of a media, for drawing its waveform. The media is cut into buckets of equal length, each
+	// with the minimum, maximum and RMS of the samples of every channel in it, in the range [-1, 1]. Buckets without
+	// any sample, e.g. past the end of a stream shorter than the media, are all zeros.
+	public ref class AudioWaveform sealed
+	{
+	public:
+		// Decode the best audio stream into bucketCount buckets, or return nullptr if the media has no audio or its
+		// duration can't be found. Only FFmpegOptions, OpenTimeout and ReadTimeout of the config are used.
+		static IAsyncOperation<AudioWaveform^>^ CreateFromStreamAsync(IRandomAccessStream^ stream, int bucketCount, FFmpegInteropConfig^ config);
+		static IAsyncOperation<AudioWaveform^>^ CreateFromUriAsync(String^ uri, int bucketCount, FFmpegInteropConfig^ config);
+
+		property int BucketCount
+		{
+			int get()
+			{
+				return (int)minimums.size();
+			}
+		}
+		property TimeSpan BucketDuration
+		{
+			TimeSpan get()
+			{
+				TimeSpan bucketDuration = { minimums.empty() ? 0 : duration.Duration / (int64)minimums.size() };
+				return bucketDuration;
+			}
+		}
+		property TimeSpan Duration
+		{
+			TimeSpan get()
+			{
+				return duration;
+			}
+		}
+
+		Array<float>^ GetMinimums();
+		Array<float>^ GetMaximums();
+		Array<float>^ GetRms();
+
+		// Minimum, maximum and RMS of each bucket one after the other, the most compact form to hand to a renderer
+		Array<float>^ GetPeaks();
+
+	internal:
+		AudioWaveform(TimeSpan duration, const std::vector<PeakAccumulator>& buckets);
+
+	private:
+		TimeSpan duration;
+		std::vector<float> minimums;
+		std::vector<float> maximums;
+		std::vector<float> rms;
+	};
+}
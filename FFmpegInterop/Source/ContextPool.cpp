@@ -0,0 +1,341 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "ContextPool.h"
+#include <deque>
+#include <map>
+#include <mutex>
+
+using namespace FFmpegInterop;
+
+// Maximum number of idle contexts of each kind kept in the pool
+const size_t MAXPOOLEDCONTEXTS = 4;
+
+// What avcodec_alloc_context3 sets up
+const DecoderSettings DEFAULTDECODERSETTINGS = { 0, 1, FF_THREAD_FRAME | FF_THREAD_SLICE };
+
+struct PooledCodecContext
+{
+	AVCodecParameters* codecpar;
+	DecoderSettings settings;
+	AVCodecContext* avCodecCtx;
+};
+
+struct PooledScaler
+{
+	ScalerKey key;
+	SwsContext* swsCtx;
+};
+
+struct PooledResampler
+{
+	ResamplerKey key;
+	SwrContext* swrCtx;
+};
+
+static std::mutex poolMutex;
+static std::deque<PooledCodecContext> idleCodecContexts;
+static std::deque<PooledScaler> idleScalers;
+static std::deque<PooledResampler> idleResamplers;
+
+// Settings of the scalers and resamplers handed out, needed to pool them again once released
+static std::map<SwsContext*, ScalerKey> borrowedScalers;
+static std::map<SwrContext*, ResamplerKey> borrowedResamplers;
+
+static int64_t reusedCodecContexts = 0;
+static int64_t reusedScalers = 0;
+
+static bool IsSameCodecParameters(const AVCodecParameters* a, const AVCodecParameters* b)
+{
+	return a->codec_type == b->codec_type
+		&& a->codec_id == b->codec_id
+		&& a->codec_tag == b->codec_tag
+		&& a->format == b->format
+		&& a->profile == b->profile
+		&& a->level == b->level
+		&& a->width == b->width
+		&& a->height == b->height
+		&& a->sample_aspect_ratio.num == b->sample_aspect_ratio.num
+		&& a->sample_aspect_ratio.den == b->sample_aspect_ratio.den
+		&& a->bits_per_coded_sample == b->bits_per_coded_sample
+		&& a->channel_layout == b->channel_layout
+		&& a->channels == b->channels
+		&& a->sample_rate == b->sample_rate
+		&& a->block_align == b->block_align
+		&& a->frame_size == b->frame_size
+		&& a->extradata_size == b->extradata_size
+		&& (a->extradata_size == 0 || memcmp(a->extradata, b->extradata, a->extradata_size) == 0);
+}
+
+static bool IsSameDecoderSettings(const DecoderSettings& a, const DecoderSettings& b)
+{
+	return a.lowres == b.lowres
+		&& a.threadCount == b.threadCount
+		&& a.threadType == b.threadType;
+}
+
+static bool IsSameScaler(const ScalerKey& a, const ScalerKey& b)
+{
+	return a.srcWidth == b.srcWidth
+		&& a.srcHeight == b.srcHeight
+		&& a.srcFormat == b.srcFormat
+		&& a.dstWidth == b.dstWidth
+		&& a.dstHeight == b.dstHeight
+		&& a.dstFormat == b.dstFormat
+		&& a.flags == b.flags;
+}
+
+static bool IsSameResampler(const ResamplerKey& a, const ResamplerKey& b)
+{
+	return a.outChannelLayout == b.outChannelLayout
+		&& a.outFormat == b.outFormat
+		&& a.outSampleRate == b.outSampleRate
+		&& a.inChannelLayout == b.inChannelLayout
+		&& a.inFormat == b.inFormat
+		&& a.inSampleRate == b.inSampleRate;
+}
+
+static void FreePooledCodecContext(PooledCodecContext& pooled)
+{
+	avcodec_free_context(&pooled.avCodecCtx);
+	avcodec_parameters_free(&pooled.codecpar);
+}
+
+AVCodecContext* ContextPool::AcquireCodecContext(const AVCodecParameters* codecpar, const DecoderSettings* settings)
+{
+	AVCodecContext* avCodecCtx = nullptr;
+	const DecoderSettings& decoderSettings = settings != nullptr ? *settings : DEFAULTDECODERSETTINGS;
+
+	std::lock_guard<std::mutex> lock(poolMutex);
+	for (auto it = idleCodecContexts.begin(); it != idleCodecContexts.end(); ++it)
+	{
+		if (IsSameCodecParameters(it->codecpar, codecpar) && IsSameDecoderSettings(it->settings, decoderSettings))
+		{
+			avCodecCtx = it->avCodecCtx;
+			avcodec_parameters_free(&it->codecpar);
+			idleCodecContexts.erase(it);
+			reusedCodecContexts++;
+			break;
+		}
+	}
+
+	return avCodecCtx;
+}
+
+void ContextPool::ReleaseCodecContext(AVCodecContext** avCodecCtx, const AVCodecParameters* codecpar, const DecoderSettings* settings)
+{
+	if (*avCodecCtx == nullptr)
+	{
+		return;
+	}
+
+	// Nothing is saved by pooling a decoder which was never opened
+	PooledCodecContext pooled = { nullptr, settings != nullptr ? *settings : DEFAULTDECODERSETTINGS, *avCodecCtx };
+	*avCodecCtx = nullptr;
+	if (!avcodec_is_open(pooled.avCodecCtx) || codecpar == nullptr)
+	{
+		FreePooledCodecContext(pooled);
+		return;
+	}
+
+	pooled.codecpar = avcodec_parameters_alloc();
+	if (pooled.codecpar == nullptr || avcodec_parameters_copy(pooled.codecpar, codecpar) < 0)
+	{
+		FreePooledCodecContext(pooled);
+		return;
+	}
+
+	// Drop the frames the decoder still holds so the next user starts clean
+	avcodec_flush_buffers(pooled.avCodecCtx);
+	pooled.avCodecCtx->skip_frame = AVDISCARD_DEFAULT;
+
+	std::lock_guard<std::mutex> lock(poolMutex);
+	idleCodecContexts.push_back(pooled);
+	if (idleCodecContexts.size() > MAXPOOLEDCONTEXTS)
+	{
+		FreePooledCodecContext(idleCodecContexts.front());
+		idleCodecContexts.pop_front();
+	}
+}
+
+SwsContext* ContextPool::AcquireScaler(const ScalerKey& key)
+{
+	SwsContext* swsCtx = nullptr;
+
+	poolMutex.lock();
+	for (auto it = idleScalers.begin(); it != idleScalers.end(); ++it)
+	{
+		if (IsSameScaler(it->key, key))
+		{
+			swsCtx = it->swsCtx;
+			idleScalers.erase(it);
+			reusedScalers++;
+			break;
+		}
+	}
+	poolMutex.unlock();
+
+	// Set up a new one outside of the lock, this is the expensive part the pool saves
+	if (swsCtx == nullptr)
+	{
+		swsCtx = sws_getContext(key.srcWidth, key.srcHeight, key.srcFormat, key.dstWidth, key.dstHeight, key.dstFormat, key.flags, NULL, NULL, NULL);
+	}
+
+	if (swsCtx != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		borrowedScalers[swsCtx] = key;
+	}
+
+	return swsCtx;
+}
+
+void ContextPool::ReleaseScaler(SwsContext** swsCtx)
+{
+	if (*swsCtx == nullptr)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(poolMutex);
+	auto borrowed = borrowedScalers.find(*swsCtx);
+	if (borrowed != borrowedScalers.end())
+	{
+		// Scalers don't keep any state between frames, they can be reused as they are
+		PooledScaler pooled = { borrowed->second, *swsCtx };
+		borrowedScalers.erase(borrowed);
+		idleScalers.push_back(pooled);
+		if (idleScalers.size() > MAXPOOLEDCONTEXTS)
+		{
+			sws_freeContext(idleScalers.front().swsCtx);
+			idleScalers.pop_front();
+		}
+	}
+	else
+	{
+		sws_freeContext(*swsCtx);
+	}
+	*swsCtx = nullptr;
+}
+
+SwrContext* ContextPool::AcquireResampler(const ResamplerKey& key)
+{
+	SwrContext* swrCtx = nullptr;
+
+	poolMutex.lock();
+	for (auto it = idleResamplers.begin(); it != idleResamplers.end(); ++it)
+	{
+		if (IsSameResampler(it->key, key))
+		{
+			swrCtx = it->swrCtx;
+			idleResamplers.erase(it);
+			break;
+		}
+	}
+	poolMutex.unlock();
+
+	// Set up a new one outside of the lock, this is the expensive part the pool saves
+	if (swrCtx == nullptr)
+	{
+		swrCtx = swr_alloc_set_opts(NULL, key.outChannelLayout, key.outFormat, key.outSampleRate, key.inChannelLayout, key.inFormat, key.inSampleRate, 0, NULL);
+		if (swrCtx != nullptr && swr_init(swrCtx) < 0)
+		{
+			swr_free(&swrCtx);
+		}
+	}
+
+	if (swrCtx != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		borrowedResamplers[swrCtx] = key;
+	}
+
+	return swrCtx;
+}
+
+void ContextPool::ReleaseResampler(SwrContext** swrCtx)
+{
+	if (*swrCtx == nullptr)
+	{
+		return;
+	}
+
+	poolMutex.lock();
+	auto borrowed = borrowedResamplers.find(*swrCtx);
+	bool isBorrowed = borrowed != borrowedResamplers.end();
+	ResamplerKey key = {};
+	if (isBorrowed)
+	{
+		key = borrowed->second;
+		borrowedResamplers.erase(borrowed);
+	}
+	poolMutex.unlock();
+
+	// Besides the buffered samples, the filter history and delay of the last stream would leak into the next
+	// one. Initializing the resampler again resets all of it while keeping its settings.
+	if (!isBorrowed || swr_init(*swrCtx) < 0)
+	{
+		swr_free(swrCtx);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(poolMutex);
+	PooledResampler pooled = { key, *swrCtx };
+	idleResamplers.push_back(pooled);
+	if (idleResamplers.size() > MAXPOOLEDCONTEXTS)
+	{
+		swr_free(&idleResamplers.front().swrCtx);
+		idleResamplers.pop_front();
+	}
+	*swrCtx = nullptr;
+}
+
+void ContextPool::Clear()
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	for (auto& pooled : idleCodecContexts)
+	{
+		FreePooledCodecContext(pooled);
+	}
+	idleCodecContexts.clear();
+
+	for (auto& pooled : idleScalers)
+	{
+		sws_freeContext(pooled.swsCtx);
+	}
+	idleScalers.clear();
+
+	for (auto& pooled : idleResamplers)
+	{
+		swr_free(&pooled.swrCtx);
+	}
+	idleResamplers.clear();
+}
+
+int64_t ContextPool::GetReusedCodecContexts()
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	return reusedCodecContexts;
+}
+
+int64_t ContextPool::GetReusedScalers()
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	return reusedScalers;
+}
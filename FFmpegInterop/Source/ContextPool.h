@@ -0,0 +1,97 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+#include <libswresample/swresample.h>
+}
+
+namespace FFmpegInterop
+{
+	// Settings a decoder was opened with which can't be changed afterwards, besides its parameters
+	struct DecoderSettings
+	{
+		int lowres;
+		int threadCount;
+		int threadType;
+	};
+
+	// Settings a scaler was created with
+	struct ScalerKey
+	{
+		int srcWidth;
+		int srcHeight;
+		AVPixelFormat srcFormat;
+		int dstWidth;
+		int dstHeight;
+		AVPixelFormat dstFormat;
+		int flags;
+	};
+
+	// Settings a resampler was created with
+	struct ResamplerKey
+	{
+		int64_t outChannelLayout;
+		AVSampleFormat outFormat;
+		int outSampleRate;
+		int64_t inChannelLayout;
+		AVSampleFormat inFormat;
+		int inSampleRate;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	//  ContextPool
+	//  Description: Process wide pool of opened decoders, scalers and
+	//               resamplers. Media opened one after the other with the
+	//               same format borrow the contexts of the previous one
+	//               instead of setting up new ones. Only an exact match of
+	//               the parameters is reused, anything else gets a fresh
+	//               context.
+	//////////////////////////////////////////////////////////////////////////
+
+	class ContextPool
+	{
+	public:
+		// Returns a flushed, opened decoder set up from the same parameters and settings, or nullptr if none is
+		// pooled. Without settings the ones of a new context are assumed. skip_frame is back at its default.
+		static AVCodecContext* AcquireCodecContext(const AVCodecParameters* codecpar, const DecoderSettings* settings = nullptr);
+
+		// Hands a decoder back to the pool, codecpar and settings must be the ones it was opened with.
+		// Decoders which were never opened are freed.
+		static void ReleaseCodecContext(AVCodecContext** avCodecCtx, const AVCodecParameters* codecpar, const DecoderSettings* settings = nullptr);
+
+		// Returns a pooled scaler with the same settings, or a new one
+		static SwsContext* AcquireScaler(const ScalerKey& key);
+		static void ReleaseScaler(SwsContext** swsCtx);
+
+		// Returns a pooled resampler with the same settings, or a new initialized one
+		static SwrContext* AcquireResampler(const ResamplerKey& key);
+		static void ReleaseResampler(SwrContext** swrCtx);
+
+		// Frees every pooled context
+		static void Clear();
+
+		// Decoders and scalers handed out from the pool instead of being set up, since the process started
+		static int64_t GetReusedCodecContexts();
+		static int64_t GetReusedScalers();
+	};
+}
@@ -0,0 +1,274 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "DurationScanner.h"
+#include <deque>
+#include <map>
+#include <mutex>
+
+extern "C"
+{
+#include <libavutil/crc.h>
+}
+
+using namespace FFmpegInterop;
+
+// Bytes read from the end of the file by the first tail scan, doubled on every retry
+const int64_t TAILSCANSIZE = 256 * 1024;
+const int TAILSCANATTEMPTS = 4;
+
+// Bytes at each end of the file used to recognize it again
+const int FINGERPRINTSIZE = 4096;
+
+// Maximum number of durations kept in the cache
+const size_t MAXCACHEDDURATIONS = 256;
+
+static std::mutex cacheMutex;
+static std::map<std::string, int64_t> cachedDurations;
+static std::deque<std::string> cacheOrder;
+
+HRESULT DurationScanner::UpdateDuration(AVFormatContext* avFormatCtx, DurationScanMode mode)
+{
+	HRESULT hr = S_OK;
+	int64_t duration = AV_NOPTS_VALUE;
+	std::string fingerprint;
+	bool isCached = false;
+
+	// In auto mode the header is only second-guessed when it has no duration or just an estimate from the bitrate
+	bool isHeaderReliable = avFormatCtx->duration > 0 && avFormatCtx->duration_estimation_method != AVFMT_DURATION_FROM_BITRATE;
+	if (mode == DurationScanMode::None || (mode == DurationScanMode::Auto && isHeaderReliable))
+	{
+		return S_FALSE;
+	}
+
+	// Live streams have no end to scan
+	if (avFormatCtx->pb == nullptr || !avFormatCtx->pb->seekable || avio_size(avFormatCtx->pb) <= 0)
+	{
+		return S_FALSE;
+	}
+
+	if (GetFingerprint(avFormatCtx, &fingerprint))
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto cached = cachedDurations.find(fingerprint);
+		if (cached != cachedDurations.end())
+		{
+			duration = cached->second;
+			isCached = true;
+		}
+	}
+
+	if (!isCached)
+	{
+		if (mode == DurationScanMode::Auto)
+		{
+			hr = ScanTail(avFormatCtx, &duration);
+			if (FAILED(hr))
+			{
+				DebugMessage(L"No timestamps at the end of the file, scanning all of it\n");
+				hr = SeekToStart(avFormatCtx) ? ScanAll(avFormatCtx, &duration) : E_FAIL;
+			}
+		}
+		else
+		{
+			// Right after opening the media, reading starts from the beginning
+			hr = ScanAll(avFormatCtx, &duration);
+		}
+
+		// The packets buffered while probing the streams are gone, start over from the beginning
+		if (!SeekToStart(avFormatCtx))
+		{
+			DebugMessage(L"Could not seek back to the start after scanning the duration\n");
+		}
+
+		if (SUCCEEDED(hr) && !fingerprint.empty())
+		{
+			std::lock_guard<std::mutex> lock(cacheMutex);
+			if (cachedDurations.insert(std::make_pair(fingerprint, duration)).second)
+			{
+				cacheOrder.push_back(fingerprint);
+				if (cacheOrder.size() > MAXCACHEDDURATIONS)
+				{
+					cachedDurations.erase(cacheOrder.front());
+					cacheOrder.pop_front();
+				}
+			}
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		avFormatCtx->duration = duration;
+	}
+
+	return hr;
+}
+
+// Size and checksums of both ends of the file. The read position of the I/O context is restored, so the
+// demuxer carries on where it was.
+bool DurationScanner::GetFingerprint(AVFormatContext* avFormatCtx, std::string* fingerprint)
+{
+	AVIOContext* avIOCtx = avFormatCtx->pb;
+	int64_t fileSize = avio_size(avIOCtx);
+	int64_t position = avio_tell(avIOCtx);
+	int length = (int)min(fileSize, (int64_t)FINGERPRINTSIZE);
+	std::vector<uint8_t> head(length);
+	std::vector<uint8_t> tail(length);
+
+	bool isRead = avio_seek(avIOCtx, 0, SEEK_SET) >= 0
+		&& avio_read(avIOCtx, head.data(), length) == length
+		&& avio_seek(avIOCtx, fileSize - length, SEEK_SET) >= 0
+		&& avio_read(avIOCtx, tail.data(), length) == length;
+
+	if (avio_seek(avIOCtx, position, SEEK_SET) < 0)
+	{
+		return false;
+	}
+
+	if (isRead)
+	{
+		const AVCRC* crcTable = av_crc_get_table(AV_CRC_32_IEEE);
+		*fingerprint = std::string(avFormatCtx->iformat->name)
+			+ ":" + std::to_string(fileSize)
+			+ ":" + std::to_string(av_crc(crcTable, 0, head.data(), length))
+			+ ":" + std::to_string(av_crc(crcTable, 0, tail.data(), length));
+	}
+
+	return isRead;
+}
+
+bool DurationScanner::SeekToStart(AVFormatContext* avFormatCtx)
+{
+	int64_t startTime = avFormatCtx->start_time != AV_NOPTS_VALUE ? avFormatCtx->start_time : 0;
+	return av_seek_frame(avFormatCtx, -1, startTime, AVSEEK_FLAG_BACKWARD) >= 0
+		|| av_seek_frame(avFormatCtx, -1, 0, AVSEEK_FLAG_BYTE) >= 0;
+}
+
+// Read the last packets of the file. Only containers which find the next packet from any byte position, such as
+// MP3 or MPEG-TS, can be scanned this way.
+HRESULT DurationScanner::ScanTail(AVFormatContext* avFormatCtx, int64_t* duration)
+{
+	if (avFormatCtx->iformat->flags & AVFMT_NO_BYTE_SEEK)
+	{
+		return E_FAIL;
+	}
+
+	int64_t fileSize = avio_size(avFormatCtx->pb);
+	int64_t tailSize = TAILSCANSIZE;
+	for (int attempt = 0; attempt < TAILSCANATTEMPTS; attempt++, tailSize *= 2)
+	{
+		int64_t offset = max(0LL, fileSize - tailSize);
+		if (av_seek_frame(avFormatCtx, -1, offset, AVSEEK_FLAG_BYTE) < 0)
+		{
+			return E_FAIL;
+		}
+
+		std::vector<int64_t> streamEnds;
+		if (SUCCEEDED(ReadEndTimestamps(avFormatCtx, streamEnds)))
+		{
+			*duration = GetDuration(avFormatCtx, streamEnds);
+			if (*duration > 0)
+			{
+				return S_OK;
+			}
+		}
+
+		if (offset == 0)
+		{
+			break;
+		}
+	}
+
+	return E_FAIL;
+}
+
+// Demux every packet up to the end, for files whose end is damaged or whose container can't seek by bytes
+HRESULT DurationScanner::ScanAll(AVFormatContext* avFormatCtx, int64_t* duration)
+{
+	std::vector<int64_t> streamEnds;
+	HRESULT hr = ReadEndTimestamps(avFormatCtx, streamEnds);
+
+	if (SUCCEEDED(hr))
+	{
+		*duration = GetDuration(avFormatCtx, streamEnds);
+		if (*duration <= 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	return hr;
+}
+
+// Read on to the end of the file and keep the end time of the last packet of each stream
+HRESULT DurationScanner::ReadEndTimestamps(AVFormatContext* avFormatCtx, std::vector<int64_t>& streamEnds)
+{
+	AVPacket avPacket;
+	av_init_packet(&avPacket);
+	avPacket.data = NULL;
+	avPacket.size = 0;
+
+	int readResult;
+	while ((readResult = av_read_frame(avFormatCtx, &avPacket)) >= 0)
+	{
+		if (streamEnds.size() <= (size_t)avPacket.stream_index)
+		{
+			streamEnds.resize(avPacket.stream_index + 1, AV_NOPTS_VALUE);
+		}
+
+		int64_t timestamp = avPacket.pts != AV_NOPTS_VALUE ? avPacket.pts : avPacket.dts;
+		if (timestamp != AV_NOPTS_VALUE)
+		{
+			int64_t end = timestamp + max(0LL, avPacket.duration);
+			streamEnds[avPacket.stream_index] = max(streamEnds[avPacket.stream_index], end);
+		}
+		av_packet_unref(&avPacket);
+	}
+
+	// Anything but the end of the file, such as a timeout, leaves the scan incomplete
+	return readResult == AVERROR_EOF ? S_OK : E_FAIL;
+}
+
+// The longest stream sets the duration, measured from the start of the media like the duration in the header
+int64_t DurationScanner::GetDuration(AVFormatContext* avFormatCtx, const std::vector<int64_t>& streamEnds)
+{
+	int64_t duration = AV_NOPTS_VALUE;
+	for (size_t i = 0; i < streamEnds.size(); i++)
+	{
+		if (streamEnds[i] == AV_NOPTS_VALUE)
+		{
+			continue;
+		}
+
+		AVStream* avStream = avFormatCtx->streams[i];
+		int64_t startTime = 0;
+		if (avStream->start_time != AV_NOPTS_VALUE)
+		{
+			startTime = avStream->start_time;
+		}
+		else if (avFormatCtx->start_time != AV_NOPTS_VALUE)
+		{
+			startTime = av_rescale_q(avFormatCtx->start_time, av_make_q(1, AV_TIME_BASE), avStream->time_base);
+		}
+
+		duration = max(duration, av_rescale_q(streamEnds[i] - startTime, avStream->time_base, av_make_q(1, AV_TIME_BASE)));
+	}
+
+	return duration;
+}
@@ -0,0 +1,56 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <string>
+#include <vector>
+#include "FFmpegInteropConfig.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  DurationScanner
+	//  Description: Works out the duration of media from the timestamps of
+	//               its packets, for containers whose header has a wrong
+	//               duration or none at all. Nothing is decoded. Results are
+	//               cached process wide, keyed on the size and the first and
+	//               last bytes of the file, so opening the same media again
+	//               doesn't scan it again.
+	//////////////////////////////////////////////////////////////////////////
+
+	class DurationScanner
+	{
+	public:
+		// Replace avFormatCtx->duration with the scanned one when the mode asks for it. The read position is moved
+		// back to the start of the media afterwards.
+		static HRESULT UpdateDuration(AVFormatContext* avFormatCtx, DurationScanMode mode);
+
+	private:
+		static bool GetFingerprint(AVFormatContext* avFormatCtx, std::string* fingerprint);
+		static bool SeekToStart(AVFormatContext* avFormatCtx);
+		static HRESULT ScanTail(AVFormatContext* avFormatCtx, int64_t* duration);
+		static HRESULT ScanAll(AVFormatContext* avFormatCtx, int64_t* duration);
+		static HRESULT ReadEndTimestamps(AVFormatContext* avFormatCtx, std::vector<int64_t>& streamEnds);
+		static int64_t GetDuration(AVFormatContext* avFormatCtx, const std::vector<int64_t>& streamEnds);
+	};
+}
@@ -0,0 +1,95 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+using namespace Platform;
+using namespace Windows::Foundation;
+using namespace Windows::Foundation::Collections;
+
+namespace FFmpegInterop
+{
+	// How the duration of the media is worked out when it is opened
+	public enum class DurationScanMode
+	{
+		// Use the duration in the header of the container
+		None,
+		// Read the timestamps at the end of the file when the header has no duration or only one estimated from
+		// the bitrate, e.g. VBR MP3 without a Xing header or an MPEG-TS recording. Falls back to a full scan.
+		Auto,
+		// Read the timestamps of every packet of the file, for truncated or damaged files
+		Full
+	};
+
+	// Settings used when creating an FFmpegInteropMSS
+	public ref class FFmpegInteropConfig sealed
+	{
+	public:
+		FFmpegInteropConfig()
+		{
+			ForceAudioDecode = false;
+			ForceVideoDecode = false;
+			ProgramId = -1;
+			AudioOnly = false;
+			OpenTimeout = { 0 };
+			ReadTimeout = { 0 };
+			DurationScan = DurationScanMode::None;
+			LatencyReportInterval = { 0 };
+			ScrubbingInterval = { 3000000 };
+			FrameStepCacheSize = 256 * 1024 * 1024;
+		}
+
+		// Decode the audio/video to PCM/NV12 instead of passing the compressed data through
+		property bool ForceAudioDecode;
+		property bool ForceVideoDecode;
+
+		// Options passed to avformat_open_input. List of options can be found in https://www.ffmpeg.org/ffmpeg-protocols.html
+		property PropertySet^ FFmpegOptions;
+
+		// Id of the program to play from a multi-program stream (e.g. an MPEG-TS mux), -1 for the default streams.
+		// Streams of every other program are discarded at the demuxer.
+		property int ProgramId;
+
+		// Don't create the video decoder and discard video at the demuxer, e.g. to play a music video in the background.
+		// This is for good, the instance has no video stream. Use FFmpegInteropMSS::AudioOnly to switch video off for
+		// a while.
+		property bool AudioOnly;
+
+		// Maximum time spent opening and probing the media, and reading a single packet during playback.
+		// A blocked network read is aborted once it runs out, zero waits forever. Media opened from a stream is
+		// only checked between the reads of the stream: a single read blocked in the stream itself (e.g. a stalled
+		// network share) can't be aborted and runs over the timeout until the stream returns.
+		property TimeSpan OpenTimeout;
+		property TimeSpan ReadTimeout;
+
+		// Scan the packets for the duration of local media whose header is unreliable. Only demuxes, nothing is
+		// decoded, and scanned durations are cached so reopening the file is free. The scan counts towards OpenTimeout.
+		property DurationScanMode DurationScan;
+
+		// Log the percentiles of every LatencyMetric through the log provider at this interval, zero never does
+		property TimeSpan LatencyReportInterval;
+
+		// Seeks which follow each other within this time are taken as scrubbing, e.g. dragging a seek bar. Decoded
+		// video then shows the keyframe before each position right away instead of decoding up to it. Zero turns
+		// the previews off.
+		property TimeSpan ScrubbingInterval;
+
+		// Bytes of decoded frames kept for FFmpegInteropMSS.StepBackward, the GOP of the current frame included. A GOP
+		// larger than this is decoded again up to every frame stepped to instead of being kept.
+		property int64 FrameStepCacheSize;
+	};
+}
@@ -19,6 +19,10 @@
 
 #include "pch.h"
 #include "FFmpegInteropLogging.h"
+#include "LogRecordQueue.h"
+#include <mutex>
+#include <system_error>
+#include <thread>
 
 using namespace FFmpegInterop;
 
@@ -27,7 +31,33 @@ extern "C"
 #include <libavutil/log.h>
 }
 
+// Number of lines waiting for the log provider before new ones are dropped
+const size_t LOGQUEUESIZE = 512;
+
+// Lines repeated within this many milliseconds are collapsed into one
+const ULONGLONG REPEATINTERVAL = 1000;
+
 ILogProvider^ FFmpegInteropLogging::s_pLogProvider = nullptr;
+std::atomic<int> FFmpegInteropLogging::s_logLevel((int)LogLevel::Info);
+
+static LogRecordQueue logQueue(LOGQUEUESIZE);
+static std::atomic<int64> droppedLogCount(0);
+static std::atomic<bool> isDrainWaiting(false);
+static std::atomic<bool> isDrainRunning(false);
+static HANDLE drainEvent = nullptr;
+static std::once_flag drainStarted;
+static std::mutex deliverMutex;
+
+// s_pLogProvider is replaced by SetLogProvider while the drain thread sends lines to it. Loggers only check the
+// flag, the provider itself is copied under the mutex by whoever calls it.
+static std::mutex logProviderMutex;
+static std::atomic<bool> hasLogProvider(false);
+
+// Only touched by the drain thread, or under deliverMutex when there is none
+static LogRecord lastRecord;
+static int repeatCount = 0;
+static ULONGLONG lastRecordTime = 0;
+static int64 reportedDroppedCount = 0;
 
 FFmpegInteropLogging::FFmpegInteropLogging()
 {
@@ -35,34 +65,221 @@ FFmpegInteropLogging::FFmpegInteropLogging()
 
 void FFmpegInteropLogging::SetLogLevel(LogLevel level)
 {
+	s_logLevel.store((int)level, std::memory_order_relaxed);
 	av_log_set_level((int)level);
 }
 
 void FFmpegInteropLogging::SetLogProvider(ILogProvider^ logProvider)
 {
-	s_pLogProvider = logProvider;
+	{
+		std::lock_guard<std::mutex> lock(logProviderMutex);
+		s_pLogProvider = logProvider;
+		hasLogProvider.store(logProvider != nullptr);
+	}
+	StartDrain();
+
+	// Runs on the decoder and reader threads, so it only formats the line into the queue and leaves
+	// calling the log provider to the drain thread
 	av_log_set_callback([](void*avcl, int level, const char *fmt, va_list vl)->void
 	{
-		if (level <= av_log_get_level())
+		if (level > s_logLevel.load(std::memory_order_relaxed) || !hasLogProvider.load())
+		{
+			return;
+		}
+
+		LogRecord localRecord;
+		LogRecord* record = BeginRecord(&localRecord);
+		if (record == nullptr)
 		{
-			if (s_pLogProvider != nullptr)
-			{
-				char pLine[1000];
-				int printPrefix = 1;
-				av_log_format_line(avcl, level, fmt, vl, pLine, sizeof(pLine), &printPrefix);
-
-				wchar_t wLine[sizeof(pLine)];
-				if (MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, pLine, -1, wLine, sizeof(pLine)) != 0)
-				{
-					s_pLogProvider->Log((LogLevel)level, ref new String(wLine));
-				}
-			}
+			return;
 		}
+
+		int printPrefix = 1;
+		record->level = level;
+		av_log_format_line(avcl, level, fmt, vl, record->text, sizeof(record->text), &printPrefix);
+		EndRecord(record, &localRecord);
 	});
 }
 
+void FFmpegInteropLogging::Log(LogLevel level, String^ message)
+{
+	if ((int)level > s_logLevel.load(std::memory_order_relaxed) || !hasLogProvider.load())
+	{
+		return;
+	}
+
+	LogRecord localRecord;
+	LogRecord* record = BeginRecord(&localRecord);
+	if (record == nullptr)
+	{
+		return;
+	}
+
+	record->level = (int)level;
+	if (WideCharToMultiByte(CP_ACP, 0, message->Data(), -1, record->text, sizeof(record->text), nullptr, nullptr) == 0)
+	{
+		// Too long, keep what fits
+		record->text[sizeof(record->text) - 1] = '\0';
+	}
+	EndRecord(record, &localRecord);
+}
+
 void FFmpegInteropLogging::SetDefaultLogProvider()
 {
 	av_log_set_callback(av_log_default_callback);
 }
 
+int64 FFmpegInteropLogging::DroppedMessageCount::get()
+{
+	return droppedLogCount.load(std::memory_order_relaxed);
+}
+
+// Returns the record to write the message into: a slot of the queue, or localRecord when there is no drain
+// thread. nullptr when the queue is full and the message is dropped.
+LogRecord* FFmpegInteropLogging::BeginRecord(LogRecord* localRecord)
+{
+	if (!isDrainRunning.load())
+	{
+		return localRecord;
+	}
+
+	LogRecord* record = logQueue.BeginPush();
+	if (record == nullptr)
+	{
+		droppedLogCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	return record;
+}
+
+void FFmpegInteropLogging::EndRecord(LogRecord* record, LogRecord* localRecord)
+{
+	if (record == localRecord)
+	{
+		// Nobody drains the queue, hand the message over right here, one caller at a time
+		std::lock_guard<std::mutex> lock(deliverMutex);
+		DeliverRecord(*record);
+		return;
+	}
+
+	logQueue.EndPush(record);
+
+	// Only wake the drain thread if it went to sleep, a busy one picks the line up by itself
+	if (isDrainWaiting.load() && isDrainWaiting.exchange(false))
+	{
+		SetEvent(drainEvent);
+	}
+}
+
+void FFmpegInteropLogging::StartDrain()
+{
+	std::call_once(drainStarted, []()
+	{
+		// Without the drain thread messages keep going to the log provider, from the threads logging them
+		drainEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+		if (drainEvent == nullptr)
+		{
+			DebugMessage(L"Failed to create the log event\n");
+			return;
+		}
+
+		// The drain waits on the queue for the lifetime of the process, so it gets a thread of its own
+		// rather than holding one of the thread pool
+		try
+		{
+			std::thread(DrainLog).detach();
+			isDrainRunning.store(true);
+		}
+		catch (const std::system_error&)
+		{
+			DebugMessage(L"Failed to start the log thread\n");
+		}
+	});
+}
+
+void FFmpegInteropLogging::DrainLog()
+{
+	LogRecord record;
+	for (;;)
+	{
+		if (logQueue.TryPop(&record))
+		{
+			DeliverRecord(record);
+			continue;
+		}
+
+		// Nothing queued, finish off the repeats which went quiet and tell about lines that didn't fit
+		if (repeatCount > 0 && GetTickCount64() - lastRecordTime >= REPEATINTERVAL)
+		{
+			FlushRepeats();
+		}
+
+		int64 droppedCount = droppedLogCount.load(std::memory_order_relaxed);
+		if (droppedCount != reportedDroppedCount)
+		{
+			wchar_t line[100];
+			swprintf_s(line, L"%I64d log messages dropped\n", droppedCount - reportedDroppedCount);
+			SendLine(LogLevel::Warning, line);
+			reportedDroppedCount = droppedCount;
+		}
+
+		// Check once more after announcing the wait, a line pushed in between would not wake us up
+		isDrainWaiting.store(true);
+		if (logQueue.TryPop(&record))
+		{
+			isDrainWaiting.store(false);
+			DeliverRecord(record);
+			continue;
+		}
+
+		WaitForSingleObjectEx(drainEvent, (DWORD)REPEATINTERVAL, FALSE);
+		isDrainWaiting.store(false);
+	}
+}
+
+void FFmpegInteropLogging::DeliverRecord(const LogRecord& record)
+{
+	ULONGLONG now = GetTickCount64();
+	if (record.level == lastRecord.level && strcmp(record.text, lastRecord.text) == 0 && now - lastRecordTime < REPEATINTERVAL)
+	{
+		// Decoders tend to report the same problem for every packet, only count those
+		repeatCount++;
+		lastRecordTime = now;
+		return;
+	}
+
+	FlushRepeats();
+
+	wchar_t line[LOGLINESIZE];
+	if (MultiByteToWideChar(CP_ACP, MB_PRECOMPOSED, record.text, -1, line, LOGLINESIZE) != 0)
+	{
+		SendLine((LogLevel)record.level, line);
+	}
+
+	lastRecord = record;
+	lastRecordTime = now;
+}
+
+void FFmpegInteropLogging::FlushRepeats()
+{
+	if (repeatCount > 0)
+	{
+		wchar_t line[100];
+		swprintf_s(line, L"Last message repeated %d times\n", repeatCount);
+		SendLine((LogLevel)lastRecord.level, line);
+		repeatCount = 0;
+	}
+}
+
+void FFmpegInteropLogging::SendLine(LogLevel level, const wchar_t* line)
+{
+	// Called outside the lock, a provider that logs from its callback would deadlock otherwise
+	ILogProvider^ logProvider;
+	{
+		std::lock_guard<std::mutex> lock(logProviderMutex);
+		logProvider = s_pLogProvider;
+	}
+	if (logProvider != nullptr)
+	{
+		logProvider->Log(level, ref new String(line));
+	}
+}
@@ -18,6 +18,8 @@
 
 #pragma once
 #include "ILogProvider.h"
+#include "LogRecordQueue.h"
+#include <atomic>
 
 namespace FFmpegInterop
 {
@@ -28,10 +30,28 @@ namespace FFmpegInterop
 		static void SetLogProvider(ILogProvider^ logProvider);
 		static void SetDefaultLogProvider();
 
+		// Number of messages lost because the log provider couldn't keep up
+		static property int64 DroppedMessageCount { int64 get(); }
+
+		// Send a message to the log provider along with the ones of FFmpeg, dropped when none is set
+		static void Log(LogLevel level, String^ message);
+
 	private:
 		FFmpegInteropLogging();
 
+		// Messages are queued by the thread logging them and handed to the log provider on a dedicated
+		// thread, so slow providers don't hold up decoding. Without that thread every caller hands over
+		// its own messages.
+		static LogRecord* BeginRecord(LogRecord* localRecord);
+		static void EndRecord(LogRecord* record, LogRecord* localRecord);
+		static void StartDrain();
+		static void DrainLog();
+		static void DeliverRecord(const LogRecord& record);
+		static void FlushRepeats();
+		static void SendLine(LogLevel level, const wchar_t* line);
+
 		static ILogProvider^ s_pLogProvider;
+		static std::atomic<int> s_logLevel;
 	};
 }
 
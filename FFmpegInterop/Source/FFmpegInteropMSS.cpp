@@ -23,6 +23,13 @@
 #include "H264SampleProvider.h"
 #include "UncompressedAudioSampleProvider.h"
 #include "UncompressedVideoSampleProvider.h"
+#include "ContextPool.h"
+#include "VideoFrameExtractor.h"
+#include "SpriteSheetGenerator.h"
+#include "FileStreamIO.h"
+#include "DurationScanner.h"
+#include "PipelineTrace.h"
+#include "FFmpegInteropLogging.h"
 #include "CritSec.h"
 #include "shcore.h"
 #include <mfapi.h>
@@ -37,29 +44,51 @@ using namespace FFmpegInterop;
 using namespace Platform;
 using namespace Windows::Storage::Streams;
 using namespace Windows::Media::MediaProperties;
-
-// Size of the buffer when reading a stream
-const int FILESTREAMBUFFERSZ = 16384;
+using namespace Windows::System::Threading;
 
 // Static functions passed to FFmpeg
-static int FileStreamRead(void* ptr, uint8_t* buf, int bufSize);
-static int64_t FileStreamSeek(void* ptr, int64_t pos, int whence);
 static int lock_manager(void **mtx, enum AVLockOp op);
 
+// Static helpers
+static LONGLONG GetTimeStamp();
+
 // Flag for ffmpeg global setup
 static bool isRegistered = false;
 
+// Shortest time a keyframe is shown in trick play, sets how far apart in the media the keyframes read are
+const LONGLONG TRICKPLAYFRAMEINTERVAL = 1000000;
+
 // Initialize an FFmpegInteropObject
-FFmpegInteropMSS::FFmpegInteropMSS()
-	: avDict(nullptr)
+FFmpegInteropMSS::FFmpegInteropMSS(FFmpegInteropConfig^ interopConfig)
+	: config(interopConfig)
+	, avDict(nullptr)
 	, avIOCtx(nullptr)
 	, avFormatCtx(nullptr)
 	, avAudioCodecCtx(nullptr)
 	, avVideoCodecCtx(nullptr)
+	, videoDecoderSettings()
 	, audioStreamIndex(AVERROR_STREAM_NOT_FOUND)
 	, videoStreamIndex(AVERROR_STREAM_NOT_FOUND)
 	, thumbnailStreamIndex(AVERROR_STREAM_NOT_FOUND)
+	, avProgram(nullptr)
+	, audioOnly(interopConfig->AudioOnly)
+	, openTimings(ref new MediaOpenTimings())
 	, fileStreamData(nullptr)
+	, countedFileStream()
+	, seekStartTicks(0)
+	, pendingSeekStreams(0)
+	, lastSeekTime(0)
+	, isScrubbing(false)
+	, isVideoDetached(false)
+	, audioPosition(-1)
+	, videoPosition(-1)
+	, requestedTrickPlayRate(1.0)
+	, startingTrickPlayRate(1.0)
+	, trickPlayRate(1.0)
+	, trickPlayOutputStart(0)
+	, trickPlaySourceStart(AV_NOPTS_VALUE)
+	, trickPlayPosition(0)
+	, frameStepper(nullptr)
 	, fileStreamBuffer(nullptr)
 {
 	if (!isRegistered)
@@ -72,11 +101,18 @@ FFmpegInteropMSS::FFmpegInteropMSS()
 
 FFmpegInteropMSS::~FFmpegInteropMSS()
 {
-	mutexGuard.lock();
+	if (latencyReportTimer != nullptr)
+	{
+		latencyReportTimer->Cancel();
+		latencyReportTimer = nullptr;
+	}
+
+	LockStreams();
 	if (mss)
 	{
 		mss->Starting -= startingRequestedToken;
 		mss->SampleRequested -= sampleRequestedToken;
+		mss->SwitchStreamsRequested -= switchStreamsRequestedToken;
 		mss = nullptr;
 	}
 
@@ -91,8 +127,20 @@ FFmpegInteropMSS::~FFmpegInteropMSS()
 		m_pReader = nullptr;
 	}
 
-	avcodec_close(avVideoCodecCtx);
-	avcodec_close(avAudioCodecCtx);
+	delete frameStepper;
+	frameStepper = nullptr;
+
+	// Opened decoders go back to the pool for the next media with the same format
+	if (avVideoCodecCtx != nullptr)
+	{
+		ContextPool::ReleaseCodecContext(&avVideoCodecCtx, avFormatCtx->streams[videoStreamIndex]->codecpar, &videoDecoderSettings);
+	}
+	for (auto& audioStream : audioStreams)
+	{
+		audioStream.sampleProvider = nullptr;
+		ContextPool::ReleaseCodecContext(&audioStream.avCodecCtx, avFormatCtx->streams[audioStream.streamIndex]->codecpar);
+	}
+	audioStreams.clear();
 	avformat_close_input(&avFormatCtx);
 	av_free(avIOCtx);
 	av_dict_free(&avDict);
@@ -101,13 +149,18 @@ FFmpegInteropMSS::~FFmpegInteropMSS()
 	{
 		fileStreamData->Release();
 	}
-	mutexGuard.unlock();
+	UnlockStreams();
 }
 
 FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, MediaStreamSource^ mss)
 {
-	auto interopMSS = ref new FFmpegInteropMSS();
-	if (FAILED(interopMSS->CreateMediaStreamSource(stream, forceAudioDecode, forceVideoDecode, ffmpegOptions, mss)))
+	auto config = ref new FFmpegInteropConfig();
+	config->ForceAudioDecode = forceAudioDecode;
+	config->ForceVideoDecode = forceVideoDecode;
+	config->FFmpegOptions = ffmpegOptions;
+
+	auto interopMSS = ref new FFmpegInteropMSS(config);
+	if (FAILED(interopMSS->CreateMediaStreamSource(stream, mss)))
 	{
 		// We failed to initialize, clear the variable to return failure
 		interopMSS = nullptr;
@@ -118,7 +171,7 @@ FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAcce
 
 FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions)
 {
-	return CreateFFmpegInteropMSSFromStream(stream, forceAudioDecode, forceVideoDecode, nullptr, nullptr);
+	return CreateFFmpegInteropMSSFromStream(stream, forceAudioDecode, forceVideoDecode, ffmpegOptions, nullptr);
 }
 
 FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode)
@@ -126,10 +179,10 @@ FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAcce
 	return CreateFFmpegInteropMSSFromStream(stream, forceAudioDecode, forceVideoDecode, nullptr);
 }
 
-FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions)
+FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, FFmpegInteropConfig^ config)
 {
-	auto interopMSS = ref new FFmpegInteropMSS();
-	if (FAILED(interopMSS->CreateMediaStreamSource(uri, forceAudioDecode, forceVideoDecode, ffmpegOptions)))
+	auto interopMSS = ref new FFmpegInteropMSS(config != nullptr ? config : ref new FFmpegInteropConfig());
+	if (FAILED(interopMSS->CreateMediaStreamSource(stream, nullptr)))
 	{
 		// We failed to initialize, clear the variable to return failure
 		interopMSS = nullptr;
@@ -138,19 +191,109 @@ FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(String^ uri, b
 	return interopMSS;
 }
 
+FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions)
+{
+	auto config = ref new FFmpegInteropConfig();
+	config->ForceAudioDecode = forceAudioDecode;
+	config->ForceVideoDecode = forceVideoDecode;
+	config->FFmpegOptions = ffmpegOptions;
+
+	return CreateFFmpegInteropMSSFromUri(uri, config);
+}
+
 FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode)
 {
 	return CreateFFmpegInteropMSSFromUri(uri, forceAudioDecode, forceVideoDecode, nullptr);
 }
 
+FFmpegInteropMSS^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(String^ uri, FFmpegInteropConfig^ config)
+{
+	auto interopMSS = ref new FFmpegInteropMSS(config != nullptr ? config : ref new FFmpegInteropConfig());
+	if (FAILED(interopMSS->CreateMediaStreamSource(uri)))
+	{
+		// We failed to initialize, clear the variable to return failure
+		interopMSS = nullptr;
+	}
+
+	return interopMSS;
+}
+
+IAsyncOperation<FFmpegInteropMSS^>^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromStreamAsync(IRandomAccessStream^ stream, FFmpegInteropConfig^ config)
+{
+	return create_async([stream, config](cancellation_token ct)
+	{
+		auto interopMSS = ref new FFmpegInteropMSS(config != nullptr ? config : ref new FFmpegInteropConfig());
+
+		// Let the interrupt callback abort the open as soon as the operation gets cancelled
+		auto registration = ct.register_callback([interopMSS]() { interopMSS->interruptHandler.Cancel(); });
+		HRESULT hr = interopMSS->CreateMediaStreamSource(stream, nullptr);
+		ct.deregister_callback(registration);
+
+		if (ct.is_canceled())
+		{
+			cancel_current_task();
+		}
+
+		if (FAILED(hr))
+		{
+			// We failed to initialize, clear the variable to return failure
+			interopMSS = nullptr;
+		}
+
+		return interopMSS;
+	});
+}
+
+IAsyncOperation<FFmpegInteropMSS^>^ FFmpegInteropMSS::CreateFFmpegInteropMSSFromUriAsync(String^ uri, FFmpegInteropConfig^ config)
+{
+	return create_async([uri, config](cancellation_token ct)
+	{
+		auto interopMSS = ref new FFmpegInteropMSS(config != nullptr ? config : ref new FFmpegInteropConfig());
+
+		// Let the interrupt callback abort the open as soon as the operation gets cancelled
+		auto registration = ct.register_callback([interopMSS]() { interopMSS->interruptHandler.Cancel(); });
+		HRESULT hr = interopMSS->CreateMediaStreamSource(uri);
+		ct.deregister_callback(registration);
+
+		if (ct.is_canceled())
+		{
+			cancel_current_task();
+		}
+
+		if (FAILED(hr))
+		{
+			// We failed to initialize, clear the variable to return failure
+			interopMSS = nullptr;
+		}
+
+		return interopMSS;
+	});
+}
+
+void FFmpegInteropMSS::ClearContextPool()
+{
+	ContextPool::Clear();
+}
+
+int64 FFmpegInteropMSS::ReusedDecoderCount::get()
+{
+	return ContextPool::GetReusedCodecContexts();
+}
+
+int64 FFmpegInteropMSS::ReusedScalerCount::get()
+{
+	return ContextPool::GetReusedScalers();
+}
+
 MediaStreamSource^ FFmpegInteropMSS::GetMediaStreamSource()
 {
 	return mss;
 }
 
-HRESULT FFmpegInteropMSS::CreateMediaStreamSource(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions)
+HRESULT FFmpegInteropMSS::CreateMediaStreamSource(String^ uri)
 {
 	HRESULT hr = S_OK;
+	LONGLONG phaseStart = GetTimeStamp();
 	const char* charStr = nullptr;
 	if (!uri)
 	{
@@ -169,7 +312,7 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(String^ uri, bool forceAudioDe
 	if (SUCCEEDED(hr))
 	{
 		// Populate AVDictionary avDict based on PropertySet ffmpegOptions. List of options can be found in https://www.ffmpeg.org/ffmpeg-protocols.html
-		hr = ParseOptions(ffmpegOptions);
+		hr = ParseOptions(config->FFmpegOptions, &avDict);
 	}
 
 	if (SUCCEEDED(hr))
@@ -178,6 +321,10 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(String^ uri, bool forceAudioDe
 		std::string uriA(uriW.begin(), uriW.end());
 		charStr = uriA.c_str();
 
+		// Open and probing are aborted on cancellation or once the open timeout runs out
+		interruptHandler.Attach(avFormatCtx);
+		interruptHandler.StartOperation(config->OpenTimeout.Duration);
+
 		// Open media in the given URI using the specified options
 		if (avformat_open_input(&avFormatCtx, charStr, NULL, &avDict) < 0)
 		{
@@ -191,20 +338,22 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(String^ uri, bool forceAudioDe
 			av_dict_free(&avDict);
 			avDict = nullptr;
 		}
+		openTimings->openInput.Duration = GetTimeStamp() - phaseStart;
 	}
 
 	if (SUCCEEDED(hr))
 	{
 		this->mss = nullptr;
-		hr = InitFFmpegContext(forceAudioDecode, forceVideoDecode);
+		hr = InitFFmpegContext();
 	}
 
 	return hr;
 }
 
-HRESULT FFmpegInteropMSS::CreateMediaStreamSource(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, MediaStreamSource^ mss)
+HRESULT FFmpegInteropMSS::CreateMediaStreamSource(IRandomAccessStream^ stream, MediaStreamSource^ mss)
 {
 	HRESULT hr = S_OK;
+	LONGLONG phaseStart = GetTimeStamp();
 	if (!stream)
 	{
 		hr = E_INVALIDARG;
@@ -229,7 +378,11 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(IRandomAccessStream^ stream, b
 
 	if (SUCCEEDED(hr))
 	{
-		avIOCtx = avio_alloc_context(fileStreamBuffer, FILESTREAMBUFFERSZ, 0, fileStreamData, FileStreamRead, 0, FileStreamSeek);
+		// The reads are counted into the statistics of the media, and stop once the open or read is interrupted
+		countedFileStream.stream = fileStreamData;
+		countedFileStream.counters = &counters;
+		countedFileStream.interruptHandler = &interruptHandler;
+		avIOCtx = avio_alloc_context(fileStreamBuffer, FILESTREAMBUFFERSZ, 0, &countedFileStream, CountedFileStreamRead, 0, CountedFileStreamSeek);
 		if (avIOCtx == nullptr)
 		{
 			hr = E_OUTOFMEMORY;
@@ -248,7 +401,7 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(IRandomAccessStream^ stream, b
 	if (SUCCEEDED(hr))
 	{
 		// Populate AVDictionary avDict based on PropertySet ffmpegOptions. List of options can be found in https://www.ffmpeg.org/ffmpeg-protocols.html
-		hr = ParseOptions(ffmpegOptions);
+		hr = ParseOptions(config->FFmpegOptions, &avDict);
 	}
 
 	if (SUCCEEDED(hr))
@@ -256,6 +409,10 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(IRandomAccessStream^ stream, b
 		avFormatCtx->pb = avIOCtx;
 		avFormatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
 
+		// Open and probing are aborted on cancellation or once the open timeout runs out
+		interruptHandler.Attach(avFormatCtx);
+		interruptHandler.StartOperation(config->OpenTimeout.Duration);
+
 		// Open media file using custom IO setup above instead of using file name. Opening a file using file name will invoke fopen C API call that only have
 		// access within the app installation directory and appdata folder. Custom IO allows access to file selected using FilePicker dialog.
 		if (avformat_open_input(&avFormatCtx, "", NULL, &avDict) < 0)
@@ -270,20 +427,22 @@ HRESULT FFmpegInteropMSS::CreateMediaStreamSource(IRandomAccessStream^ stream, b
 			av_dict_free(&avDict);
 			avDict = nullptr;
 		}
+		openTimings->openInput.Duration = GetTimeStamp() - phaseStart;
 	}
 
 	if (SUCCEEDED(hr))
 	{
 		this->mss = mss;
-		hr = InitFFmpegContext(forceAudioDecode, forceVideoDecode);
+		hr = InitFFmpegContext();
 	}
 
 	return hr;
 }
 
-HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVideoDecode)
+HRESULT FFmpegInteropMSS::InitFFmpegContext()
 {
 	HRESULT hr = S_OK;
+	LONGLONG phaseStart = GetTimeStamp();
 
 	if (SUCCEEDED(hr))
 	{
@@ -291,11 +450,26 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 		{
 			hr = E_FAIL; // Error finding info
 		}
+
+		// Headers of VBR MP3 without a Xing frame, MPEG-TS recordings or truncated files have a wrong duration or
+		// none, which also leaves the media unseekable. The scan runs under the same timeout as the probing.
+		if (SUCCEEDED(hr) && config->DurationScan != DurationScanMode::None)
+		{
+			if (FAILED(DurationScanner::UpdateDuration(avFormatCtx, config->DurationScan)))
+			{
+				DebugMessage(L"Duration scan failed, keeping the duration of the header\n");
+			}
+		}
+		interruptHandler.EndOperation();
+
+		LONGLONG now = GetTimeStamp();
+		openTimings->findStreamInfo.Duration = now - phaseStart;
+		phaseStart = now;
 	}
 
 	if (SUCCEEDED(hr))
 	{
-		m_pReader = ref new FFmpegReader(avFormatCtx);
+		m_pReader = ref new FFmpegReader(avFormatCtx, &interruptHandler, config->ReadTimeout.Duration, &counters);
 		if (m_pReader == nullptr)
 		{
 			hr = E_OUTOFMEMORY;
@@ -304,66 +478,92 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 
 	if (SUCCEEDED(hr))
 	{
-		// Find the audio stream and its decoder
+		// Restrict the stream selection to the requested program if any
+		hr = SelectProgram(config->ProgramId);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// Find the default audio stream
 		AVCodec* avAudioCodec = nullptr;
-		audioStreamIndex = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_AUDIO, -1, -1, &avAudioCodec, 0);
-		if (audioStreamIndex != AVERROR_STREAM_NOT_FOUND && avAudioCodec)
+		audioStreamIndex = FindBestStream(AVMEDIA_TYPE_AUDIO, &avAudioCodec);
+
+		// Create a descriptor for every audio stream so the pipeline can switch between them
+		for (unsigned int i = 0; SUCCEEDED(hr) && i < avFormatCtx->nb_streams; i++)
 		{
-			// allocate a new decoding context
-			avAudioCodecCtx = avcodec_alloc_context3(avAudioCodec);
-			if (!avAudioCodecCtx)
+			AVStream* avStream = avFormatCtx->streams[i];
+			if (avStream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO || !IsStreamInProgram(i))
 			{
-				hr = E_OUTOFMEMORY;
-				DebugMessage(L"Could not allocate a decoding context\n");
-				avformat_close_input(&avFormatCtx);
+				continue;
 			}
 
-			if (SUCCEEDED(hr))
+			AVCodec* avStreamCodec = avcodec_find_decoder(avStream->codecpar->codec_id);
+			if (avStreamCodec == nullptr)
 			{
-				// initialize the stream parameters with demuxer information
-				if (avcodec_parameters_to_context(avAudioCodecCtx, avFormatCtx->streams[audioStreamIndex]->codecpar) < 0)
+				DebugMessage(L"Skipping audio stream without decoder\n");
+				continue;
+			}
+
+			AudioStreamInfo audioStream = {};
+			audioStream.streamIndex = i;
+
+			// Borrow the opened decoder of a previous media with the same parameters if there is one
+			audioStream.avCodecCtx = ContextPool::AcquireCodecContext(avStream->codecpar);
+			if (!audioStream.avCodecCtx)
+			{
+				// allocate a new decoding context
+				audioStream.avCodecCtx = avcodec_alloc_context3(avStreamCodec);
+				if (!audioStream.avCodecCtx)
 				{
-					hr = E_FAIL;
-					avformat_close_input(&avFormatCtx);
-					avcodec_free_context(&avAudioCodecCtx);
+					hr = E_OUTOFMEMORY;
+					DebugMessage(L"Could not allocate a decoding context\n");
+					break;
 				}
 
-				if (SUCCEEDED(hr))
+				// initialize the stream parameters with demuxer information
+				if (avcodec_parameters_to_context(audioStream.avCodecCtx, avStream->codecpar) < 0)
 				{
-					if (avcodec_open2(avAudioCodecCtx, avAudioCodec, NULL) < 0)
-					{
-						avAudioCodecCtx = nullptr;
-						hr = E_FAIL;
-					}
-					else
-					{
-						// Detect audio format and create audio stream descriptor accordingly
-						hr = CreateAudioStreamDescriptor(forceAudioDecode);
-						if (SUCCEEDED(hr))
-						{
-							hr = audioSampleProvider->AllocateResources();
-							if (SUCCEEDED(hr))
-							{
-								m_pReader->SetAudioStream(audioStreamIndex, audioSampleProvider);
-							}
-						}
+					DebugMessage(L"Skipping audio stream with invalid parameters\n");
+					avcodec_free_context(&audioStream.avCodecCtx);
+					continue;
+				}
+			}
 
-						if (SUCCEEDED(hr))
-						{
-							// Convert audio codec name for property
-							hr = ConvertCodecName(avAudioCodec->name, &audioCodecName);
-						}
-					}
+			// Detect audio format and create audio stream descriptor accordingly
+			hr = CreateAudioStreamDescriptor(audioStream, config->ForceAudioDecode);
+			if (SUCCEEDED(hr))
+			{
+				audioStreams.push_back(audioStream);
+			}
+			else
+			{
+				ContextPool::ReleaseCodecContext(&audioStream.avCodecCtx, avStream->codecpar);
+			}
+		}
+
+		if (SUCCEEDED(hr) && audioStreamIndex >= 0)
+		{
+			for (auto& audioStream : audioStreams)
+			{
+				if (audioStream.streamIndex == audioStreamIndex)
+				{
+					hr = SetActiveAudioStream(audioStream);
+					break;
 				}
 			}
 		}
+
+		if (audioStreamDescriptor == nullptr)
+		{
+			audioStreamIndex = AVERROR_STREAM_NOT_FOUND;
+		}
 	}
 
 	if (SUCCEEDED(hr))
 	{
 		// Find the video stream and its decoder
 		AVCodec* avVideoCodec = nullptr;
-		videoStreamIndex = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, &avVideoCodec, 0);
+		videoStreamIndex = FindBestStream(AVMEDIA_TYPE_VIDEO, &avVideoCodec);
 		if (videoStreamIndex != AVERROR_STREAM_NOT_FOUND && avVideoCodec)
 		{
 			// FFmpeg identifies album/cover art from a music file as a video stream
@@ -374,6 +574,14 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 				videoStreamIndex = AVERROR_STREAM_NOT_FOUND;
 				avVideoCodec = nullptr;
 			}
+			else if (config->AudioOnly)
+			{
+				// Leave the video stream alone, it will be discarded at the demuxer
+				DebugMessage(L"Audio only, skipping video stream\n");
+				thumbnailStreamIndex = AVERROR_STREAM_NOT_FOUND;
+				videoStreamIndex = AVERROR_STREAM_NOT_FOUND;
+				avVideoCodec = nullptr;
+			}
 			else
 			{
 				thumbnailStreamIndex = AVERROR_STREAM_NOT_FOUND;
@@ -387,59 +595,53 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 				{
 					rotateVideo = false;
 				}
-				// allocate a new decoding context
-				avVideoCodecCtx = avcodec_alloc_context3(avVideoCodec);
+				// Decode with as many threads as there are cores, by frame and by slice
+				unsigned threads = std::thread::hardware_concurrency();
+				videoDecoderSettings.lowres = 0;
+				videoDecoderSettings.threadCount = threads > 0 ? (int)threads : 1;
+				videoDecoderSettings.threadType = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+				// Borrow the opened decoder of a previous media with the same parameters if there is one
+				avVideoCodecCtx = ContextPool::AcquireCodecContext(avFormatCtx->streams[videoStreamIndex]->codecpar, &videoDecoderSettings);
 				if (!avVideoCodecCtx)
 				{
-					DebugMessage(L"Could not allocate a decoding context\n");
-					avformat_close_input(&avFormatCtx);
-					hr = E_OUTOFMEMORY;
-				}
-
-				if (SUCCEEDED(hr))
-				{
-					// initialize the stream parameters with demuxer information
-					if (avcodec_parameters_to_context(avVideoCodecCtx, avFormatCtx->streams[videoStreamIndex]->codecpar) < 0)
+					// allocate a new decoding context
+					avVideoCodecCtx = avcodec_alloc_context3(avVideoCodec);
+					if (!avVideoCodecCtx)
 					{
-						avformat_close_input(&avFormatCtx);
-						avcodec_free_context(&avVideoCodecCtx);
-						hr = E_FAIL;
+						DebugMessage(L"Could not allocate a decoding context\n");
+						hr = E_OUTOFMEMORY;
 					}
-				}
 
-				if (SUCCEEDED(hr))
-				{
-					// enable multi threading
-					unsigned threads = std::thread::hardware_concurrency();
-					if (threads > 0)
+					if (SUCCEEDED(hr))
 					{
-						avVideoCodecCtx->thread_count = threads;
-						avVideoCodecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+						// initialize the stream parameters with demuxer information
+						if (avcodec_parameters_to_context(avVideoCodecCtx, avFormatCtx->streams[videoStreamIndex]->codecpar) < 0)
+						{
+							avcodec_free_context(&avVideoCodecCtx);
+							hr = E_FAIL;
+						}
 					}
 
-					if (avcodec_open2(avVideoCodecCtx, avVideoCodec, NULL) < 0)
+					if (SUCCEEDED(hr))
 					{
-						avVideoCodecCtx = nullptr;
-						hr = E_FAIL; // Cannot open the video codec
+						// enable multi threading
+						avVideoCodecCtx->thread_count = videoDecoderSettings.threadCount;
+						avVideoCodecCtx->thread_type = videoDecoderSettings.threadType;
 					}
-					else
+				}
+
+				if (SUCCEEDED(hr))
+				{
+					// Detect video format and create video stream descriptor accordingly. The decoder
+					// is only opened if needed, when the first sample is requested.
+					hr = CreateVideoStreamDescriptor(config->ForceVideoDecode);
+					if (SUCCEEDED(hr))
 					{
-						// Detect video format and create video stream descriptor accordingly
-						hr = CreateVideoStreamDescriptor(forceVideoDecode);
-						if (SUCCEEDED(hr))
-						{
-							hr = videoSampleProvider->AllocateResources();
-							if (SUCCEEDED(hr))
-							{
-								m_pReader->SetVideoStream(videoStreamIndex, videoSampleProvider);
-							}
-						}
+						m_pReader->SetVideoStream(videoStreamIndex, videoSampleProvider);
 
-						if (SUCCEEDED(hr))
-						{
-							// Convert video codec name for property
-							hr = ConvertCodecName(avVideoCodec->name, &videoCodecName);
-						}
+						// Convert video codec name for property
+						hr = ConvertCodecName(avVideoCodec->name, &videoCodecName);
 					}
 				}
 			}
@@ -448,6 +650,10 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 
 	if (SUCCEEDED(hr))
 	{
+		LONGLONG now = GetTimeStamp();
+		openTimings->streamSetup.Duration = now - phaseStart;
+		phaseStart = now;
+
 		// Convert media duration from AV_TIME_BASE to TimeSpan unit
 		mediaDuration = { LONGLONG(avFormatCtx->duration * 10000000 / double(AV_TIME_BASE)) };
 
@@ -490,6 +696,15 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 		}
 		if (mss)
 		{
+			// The default audio stream was added first, the other ones can be selected later on
+			for (auto& audioStream : audioStreams)
+			{
+				if (audioStreamDescriptor != nullptr && audioStream.descriptor != audioStreamDescriptor)
+				{
+					mss->AddStreamDescriptor(audioStream.descriptor);
+				}
+			}
+
 			if (mediaDuration.Duration > 0)
 			{
 				mss->Duration = mediaDuration;
@@ -503,6 +718,9 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 
 			startingRequestedToken = mss->Starting += ref new TypedEventHandler<MediaStreamSource ^, MediaStreamSourceStartingEventArgs ^>(this, &FFmpegInteropMSS::OnStarting);
 			sampleRequestedToken = mss->SampleRequested += ref new TypedEventHandler<MediaStreamSource ^, MediaStreamSourceSampleRequestedEventArgs ^>(this, &FFmpegInteropMSS::OnSampleRequested);
+			switchStreamsRequestedToken = mss->SwitchStreamsRequested += ref new TypedEventHandler<MediaStreamSource ^, MediaStreamSourceSwitchStreamsRequestedEventArgs ^>(this, &FFmpegInteropMSS::OnSwitchStreamsRequested);
+			openTimings->mediaStreamSourceSetup.Duration = GetTimeStamp() - phaseStart;
+			StartLatencyReports();
 		}
 		else
 		{
@@ -513,6 +731,98 @@ HRESULT FFmpegInteropMSS::InitFFmpegContext(bool forceAudioDecode, bool forceVid
 	return hr;
 }
 
+// Pick the program to play from a multi-program stream and let the demuxer skip all the other ones
+HRESULT FFmpegInteropMSS::SelectProgram(int programId)
+{
+	HRESULT hr = S_OK;
+
+	programs = ref new Vector<MediaProgramInfo^>();
+	avProgram = nullptr;
+
+	for (unsigned int i = 0; SUCCEEDED(hr) && i < avFormatCtx->nb_programs; i++)
+	{
+		AVProgram* program = avFormatCtx->programs[i];
+
+		String^ name;
+		AVDictionaryEntry* nameTag = av_dict_get(program->metadata, "service_name", NULL, 0);
+		if (nameTag != nullptr)
+		{
+			hr = ConvertCodecName(nameTag->value, &name);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			programs->Append(ref new MediaProgramInfo(program->id, name, program->nb_stream_indexes));
+
+			if (programId >= 0 && program->id == programId)
+			{
+				avProgram = program;
+			}
+		}
+	}
+
+	if (SUCCEEDED(hr) && programId >= 0)
+	{
+		if (avProgram == nullptr)
+		{
+			DebugMessage(L"Requested program not found\n");
+			hr = E_INVALIDARG;
+		}
+		else
+		{
+			for (unsigned int i = 0; i < avFormatCtx->nb_programs; i++)
+			{
+				avFormatCtx->programs[i]->discard = avFormatCtx->programs[i] == avProgram ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+			}
+		}
+	}
+
+	return hr;
+}
+
+bool FFmpegInteropMSS::IsStreamInProgram(unsigned int streamIndex)
+{
+	if (avProgram == nullptr)
+	{
+		return true;
+	}
+
+	for (unsigned int i = 0; i < avProgram->nb_stream_indexes; i++)
+	{
+		if (avProgram->stream_index[i] == streamIndex)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Find the best stream of the given type, limited to the selected program if any
+int FFmpegInteropMSS::FindBestStream(AVMediaType type, AVCodec** avCodec)
+{
+	int relatedStream = -1;
+	if (avProgram != nullptr)
+	{
+		if (avProgram->nb_stream_indexes == 0)
+		{
+			return AVERROR_STREAM_NOT_FOUND;
+		}
+		relatedStream = avProgram->stream_index[0];
+	}
+
+	int streamIndex = av_find_best_stream(avFormatCtx, type, -1, relatedStream, avCodec, 0);
+
+	// av_find_best_stream falls back to the streams of other programs when the related one has none of this type
+	if (streamIndex >= 0 && !IsStreamInProgram(streamIndex))
+	{
+		*avCodec = nullptr;
+		streamIndex = AVERROR_STREAM_NOT_FOUND;
+	}
+
+	return streamIndex;
+}
+
 MediaThumbnailData ^ FFmpegInterop::FFmpegInteropMSS::ExtractThumbnail()
 {
 	if (thumbnailStreamIndex != AVERROR_STREAM_NOT_FOUND)
@@ -546,6 +856,212 @@ MediaThumbnailData ^ FFmpegInterop::FFmpegInteropMSS::ExtractThumbnail()
 	return nullptr;
 }
 
+MediaThumbnailData^ FFmpegInteropMSS::ExtractVideoFrame(TimeSpan position, int width, int height, VideoFrameFormat format)
+{
+	MediaThumbnailData^ thumbnailData;
+	LockStreams();
+
+	int streamIndex = FindVideoFrameStream();
+	if (streamIndex >= 0 && m_pReader != nullptr)
+	{
+		// Convert TimeSpan unit to the time base of the stream
+		AVStream* avStream = avFormatCtx->streams[streamIndex];
+		int64_t seekTarget = av_rescale_q(position.Duration, av_make_q(1, 10000000), avStream->time_base);
+		if (avStream->start_time != AV_NOPTS_VALUE)
+		{
+			seekTarget += avStream->start_time;
+		}
+
+		if (FAILED(VideoFrameExtractor::ExtractFrame(avFormatCtx, m_pReader, streamIndex, seekTarget, width, height, format, &thumbnailData)))
+		{
+			thumbnailData = nullptr;
+		}
+
+		// The extraction moved the read position, what is queued doesn't follow it. Playback carries on where it
+		// was: the next sample request seeks back there, unless a seek of its own is already pending.
+		FlushSampleProviders();
+		if (!m_pReader->IsSeekPending())
+		{
+			LONGLONG currentPosition = audioOnly || videoPosition < 0 ? audioPosition : videoPosition;
+			isScrubbing = false;
+			m_pReader->RequestSeek(currentPosition > 0 ? currentPosition : 0);
+		}
+	}
+
+	UnlockStreams();
+	return thumbnailData;
+}
+
+IAsyncOperation<SpriteSheet^>^ FFmpegInteropMSS::ExtractSpriteSheetAsync(int tileCount, int columns, int tileWidth, int tileHeight, VideoFrameFormat format)
+{
+	FFmpegInteropMSS^ interopMSS = this;
+	return create_async([interopMSS, tileCount, columns, tileWidth, tileHeight, format](cancellation_token ct)
+	{
+		SpriteSheet^ spriteSheet;
+		interopMSS->LockStreams();
+
+		int streamIndex = interopMSS->FindVideoFrameStream();
+		if (streamIndex >= 0 && tileCount > 0 && interopMSS->mediaDuration.Duration > 0)
+		{
+			// Take the frame from the middle of each of the equal parts of the media
+			AVStream* avStream = interopMSS->avFormatCtx->streams[streamIndex];
+			int64_t startTime = avStream->start_time != AV_NOPTS_VALUE ? avStream->start_time : 0;
+			std::vector<int64_t> positions;
+			for (int i = 0; i < tileCount; i++)
+			{
+				int64_t position = av_rescale(interopMSS->mediaDuration.Duration, 2 * i + 1, 2 * (int64_t)tileCount);
+				positions.push_back(av_rescale_q(position, av_make_q(1, 10000000), avStream->time_base) + startTime);
+			}
+
+			SpriteSheetGenerator generator(interopMSS->avFormatCtx, streamIndex);
+			if (FAILED(generator.Generate(positions, columns, tileWidth, tileHeight, format, ct, &spriteSheet)))
+			{
+				spriteSheet = nullptr;
+			}
+
+			interopMSS->FlushSampleProviders();
+		}
+
+		interopMSS->UnlockStreams();
+
+		if (ct.is_canceled())
+		{
+			cancel_current_task();
+		}
+
+		return spriteSheet;
+	});
+}
+
+SteppedVideoFrame^ FFmpegInteropMSS::StepToFrame(TimeSpan position, int width, int height, VideoFrameFormat format)
+{
+	return StepFrame(0, position.Duration, width, height, format);
+}
+
+SteppedVideoFrame^ FFmpegInteropMSS::StepForward(int width, int height, VideoFrameFormat format)
+{
+	return StepFrame(1, 0, width, height, format);
+}
+
+SteppedVideoFrame^ FFmpegInteropMSS::StepBackward(int width, int height, VideoFrameFormat format)
+{
+	return StepFrame(-1, 0, width, height, format);
+}
+
+// Step to the frame at position (in TimeSpan units) for direction 0, otherwise to the next or previous frame
+SteppedVideoFrame^ FFmpegInteropMSS::StepFrame(int direction, int64_t position, int width, int height, VideoFrameFormat format)
+{
+	SteppedVideoFrame^ steppedFrame;
+	LockStreams();
+
+	int streamIndex = FindVideoFrameStream();
+	if (streamIndex >= 0 && m_pReader != nullptr)
+	{
+		AVStream* avStream = avFormatCtx->streams[streamIndex];
+		int64_t startTime = avStream->start_time != AV_NOPTS_VALUE ? avStream->start_time : 0;
+		if (frameStepper == nullptr)
+		{
+			frameStepper = new FrameStepper(avFormatCtx, m_pReader, streamIndex, config->FrameStepCacheSize > 0 ? (size_t)config->FrameStepCacheSize : 0);
+		}
+
+		HRESULT hr = S_OK;
+		AVFrame* avFrame = nullptr;
+		if (direction == 0)
+		{
+			hr = frameStepper->StepTo(av_rescale_q(position, av_make_q(1, 10000000), avStream->time_base) + startTime, &avFrame);
+		}
+		else if (direction > 0)
+		{
+			hr = frameStepper->StepForward(&avFrame);
+		}
+		else
+		{
+			hr = frameStepper->StepBackward(&avFrame);
+		}
+
+		MediaThumbnailData^ image;
+		if (hr == S_OK)
+		{
+			VideoFrameExtractor::GetOutputSize(avStream->codecpar, &width, &height);
+			hr = VideoFrameExtractor::ConvertFrame(avFrame, width, height, format, &image);
+		}
+
+		if (hr == S_OK)
+		{
+			TimeSpan framePosition = { av_rescale_q(avFrame->pts - startTime, avStream->time_base, av_make_q(1, 10000000)) };
+			steppedFrame = ref new SteppedVideoFrame(image, framePosition);
+		}
+
+		// The stepper moved the read position, what is queued doesn't follow it. Playback carries on from the
+		// current frame: the next sample request seeks back to its GOP and decodes up to it, audio included.
+		FlushSampleProviders();
+		int64_t currentPts = frameStepper->GetCurrentPosition();
+		if (currentPts != AV_NOPTS_VALUE)
+		{
+			LONGLONG currentPosition = av_rescale_q(currentPts - startTime, avStream->time_base, av_make_q(1, 10000000));
+			isScrubbing = false;
+			m_pReader->RequestSeek(currentPosition > 0 ? currentPosition : 0);
+		}
+	}
+
+	UnlockStreams();
+	return steppedFrame;
+}
+
+// The video stream isn't selected in audio only mode, look it up again
+int FFmpegInteropMSS::FindVideoFrameStream()
+{
+	int streamIndex = videoStreamIndex;
+	if (streamIndex < 0 && thumbnailStreamIndex < 0)
+	{
+		AVCodec* avVideoCodec = nullptr;
+		streamIndex = FindBestStream(AVMEDIA_TYPE_VIDEO, &avVideoCodec);
+		if (streamIndex >= 0 && avFormatCtx->streams[streamIndex]->disposition == AV_DISPOSITION_ATTACHED_PIC)
+		{
+			streamIndex = AVERROR_STREAM_NOT_FOUND;
+		}
+	}
+
+	return streamIndex;
+}
+
+// Whatever was queued doesn't follow the new read position anymore
+void FFmpegInteropMSS::FlushSampleProviders()
+{
+	if (audioSampleProvider != nullptr)
+	{
+		audioSampleProvider->Flush();
+	}
+	if (videoSampleProvider != nullptr)
+	{
+		videoSampleProvider->Flush();
+	}
+}
+
+void FFmpegInteropMSS::SetAudioOnly(bool value)
+{
+	// Media opened with FFmpegInteropConfig::AudioOnly has no video stream to switch back to
+	if (config->AudioOnly)
+	{
+		return;
+	}
+
+	LockStreams();
+	if (audioOnly != value)
+	{
+		audioOnly = value;
+		if (audioOnly && videoSampleProvider != nullptr)
+		{
+			// Stop demuxing video and drop whatever was already queued
+			m_pReader->SetVideoStream(AVERROR_STREAM_NOT_FOUND, nullptr);
+			videoSampleProvider->Flush();
+			isVideoDetached = true;
+		}
+		// The video stream is attached to the reader again on the next seek, which starts it at a keyframe
+	}
+	UnlockStreams();
+}
+
 HRESULT FFmpegInteropMSS::ConvertCodecName(const char* codecName, String^ *outputCodecName)
 {
 	HRESULT hr = S_OK;
@@ -570,48 +1086,105 @@ HRESULT FFmpegInteropMSS::ConvertCodecName(const char* codecName, String^ *outpu
 	return hr;
 }
 
-HRESULT FFmpegInteropMSS::CreateAudioStreamDescriptor(bool forceAudioDecode)
+HRESULT FFmpegInteropMSS::CreateAudioStreamDescriptor(AudioStreamInfo& audioStream, bool forceAudioDecode)
 {
-	if (avAudioCodecCtx->codec_id == AV_CODEC_ID_AAC && !forceAudioDecode)
+	AVCodecContext* avCodecCtx = audioStream.avCodecCtx;
+
+	// Describe the stream from the demuxer parameters. A decoder borrowed from the pool is already opened, and
+	// opening can change its sample rate and channels (e.g. HE-AAC), so they'd differ from a fresh decoder.
+	AVCodecParameters* codecpar = avFormatCtx->streams[audioStream.streamIndex]->codecpar;
+
+	if (codecpar->codec_id == AV_CODEC_ID_AAC && !forceAudioDecode)
 	{
-		if (avAudioCodecCtx->extradata_size == 0)
+		if (codecpar->extradata_size == 0)
 		{
-			audioStreamDescriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreateAacAdts(avAudioCodecCtx->sample_rate, avAudioCodecCtx->channels, (unsigned int)avAudioCodecCtx->bit_rate));
+			audioStream.descriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreateAacAdts(codecpar->sample_rate, codecpar->channels, (unsigned int)codecpar->bit_rate));
 		}
 		else
 		{
-			audioStreamDescriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreateAac(avAudioCodecCtx->sample_rate, avAudioCodecCtx->channels, (unsigned int)avAudioCodecCtx->bit_rate));
+			audioStream.descriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreateAac(codecpar->sample_rate, codecpar->channels, (unsigned int)codecpar->bit_rate));
 		}
-		audioSampleProvider = ref new MediaSampleProvider(m_pReader, avFormatCtx, avAudioCodecCtx);
+		audioStream.sampleProvider = ref new MediaSampleProvider(m_pReader, avFormatCtx, avCodecCtx);
 	}
-	else if (avAudioCodecCtx->codec_id == AV_CODEC_ID_MP3 && !forceAudioDecode)
+	else if (codecpar->codec_id == AV_CODEC_ID_MP3 && !forceAudioDecode)
 	{
-		audioStreamDescriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreateMp3(avAudioCodecCtx->sample_rate, avAudioCodecCtx->channels, (unsigned int)avAudioCodecCtx->bit_rate));
-		audioSampleProvider = ref new MediaSampleProvider(m_pReader, avFormatCtx, avAudioCodecCtx);
+		audioStream.descriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreateMp3(codecpar->sample_rate, codecpar->channels, (unsigned int)codecpar->bit_rate));
+		audioStream.sampleProvider = ref new MediaSampleProvider(m_pReader, avFormatCtx, avCodecCtx);
 	}
 	else
 	{
 		// We always convert to 16-bit audio so set the size here
-		audioStreamDescriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreatePcm(avAudioCodecCtx->sample_rate, avAudioCodecCtx->channels, 16));
-		audioSampleProvider = ref new UncompressedAudioSampleProvider(m_pReader, avFormatCtx, avAudioCodecCtx);
+		audioStream.descriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreatePcm(codecpar->sample_rate, codecpar->channels, 16));
+		UncompressedAudioSampleProvider^ uncompressedSampleProvider = ref new UncompressedAudioSampleProvider(m_pReader, avFormatCtx, avCodecCtx);
+
+		// Resample to what the descriptor says whatever the decoder ends up with
+		if (codecpar->sample_rate > 0 && codecpar->channels > 0)
+		{
+			uncompressedSampleProvider->SetOutputFormat(codecpar->sample_rate, codecpar->channels);
+		}
+		audioStream.sampleProvider = uncompressedSampleProvider;
+	}
+
+	AVDictionaryEntry* languageTag = av_dict_get(avFormatCtx->streams[audioStream.streamIndex]->metadata, "language", NULL, 0);
+	if (audioStream.descriptor != nullptr && languageTag != nullptr)
+	{
+		String^ language;
+		if (SUCCEEDED(ConvertCodecName(languageTag->value, &language)))
+		{
+			audioStream.descriptor->Language = language;
+		}
 	}
 
-	return (audioStreamDescriptor != nullptr && audioSampleProvider != nullptr) ? S_OK : E_OUTOFMEMORY;
+	return (audioStream.descriptor != nullptr && audioStream.sampleProvider != nullptr) ? S_OK : E_OUTOFMEMORY;
+}
+
+// Make the given audio stream the one being played. Its decoder is opened by the sample provider
+// on the first request, packets of the previous stream are dropped and the demuxer stops reading them.
+HRESULT FFmpegInteropMSS::SetActiveAudioStream(AudioStreamInfo& audioStream)
+{
+	// Drop any state left from the last time this stream was played
+	audioStream.sampleProvider->Flush();
+
+	MediaSampleProvider^ previousSampleProvider = audioSampleProvider;
+	if (previousSampleProvider != nullptr)
+	{
+		// Keep the timeline of the new stream aligned with the one played so far
+		if (previousSampleProvider->m_startOffset != AV_NOPTS_VALUE)
+		{
+			audioStream.sampleProvider->m_startOffset = av_rescale_q(previousSampleProvider->m_startOffset,
+				avFormatCtx->streams[audioStreamIndex]->time_base,
+				avFormatCtx->streams[audioStream.streamIndex]->time_base);
+		}
+		previousSampleProvider->Flush();
+	}
+
+	audioStreamIndex = audioStream.streamIndex;
+	avAudioCodecCtx = audioStream.avCodecCtx;
+	audioStreamDescriptor = audioStream.descriptor;
+	audioSampleProvider = audioStream.sampleProvider;
+	m_pReader->SetAudioStream(audioStreamIndex, audioSampleProvider);
+
+	// Convert audio codec name for property
+	return ConvertCodecName(avAudioCodecCtx->codec->name, &audioCodecName);
 }
 
 HRESULT FFmpegInteropMSS::CreateVideoStreamDescriptor(bool forceVideoDecode)
 {
 	VideoEncodingProperties^ videoProperties;
 
-	if (avVideoCodecCtx->codec_id == AV_CODEC_ID_H264 && !forceVideoDecode)
+	// Like audio, the stream is described from the demuxer parameters rather than a possibly opened decoder
+	AVStream* avStream = avFormatCtx->streams[videoStreamIndex];
+	AVCodecParameters* codecpar = avStream->codecpar;
+
+	if (codecpar->codec_id == AV_CODEC_ID_H264 && !forceVideoDecode)
 	{
 		videoProperties = VideoEncodingProperties::CreateH264();
-		videoProperties->ProfileId = avVideoCodecCtx->profile;
-		videoProperties->Height = avVideoCodecCtx->height;
-		videoProperties->Width = avVideoCodecCtx->width;
+		videoProperties->ProfileId = codecpar->profile;
+		videoProperties->Height = codecpar->height;
+		videoProperties->Width = codecpar->width;
 
 		// Check for H264 bitstream flavor. H.264 AVC extradata starts with 1 while non AVC one starts with 0
-		if (avVideoCodecCtx->extradata != nullptr && avVideoCodecCtx->extradata_size > 0 && avVideoCodecCtx->extradata[0] == 1)
+		if (codecpar->extradata != nullptr && codecpar->extradata_size > 0 && codecpar->extradata[0] == 1)
 		{
 			videoSampleProvider = ref new H264AVCSampleProvider(m_pReader, avFormatCtx, avVideoCodecCtx);
 		}
@@ -622,13 +1195,13 @@ HRESULT FFmpegInteropMSS::CreateVideoStreamDescriptor(bool forceVideoDecode)
 	}
 	else
 	{
-		videoProperties = VideoEncodingProperties::CreateUncompressed(MediaEncodingSubtypes::Nv12, avVideoCodecCtx->width, avVideoCodecCtx->height);
+		videoProperties = VideoEncodingProperties::CreateUncompressed(MediaEncodingSubtypes::Nv12, codecpar->width, codecpar->height);
 		videoSampleProvider = ref new UncompressedVideoSampleProvider(m_pReader, avFormatCtx, avVideoCodecCtx);
 
-		if (avVideoCodecCtx->sample_aspect_ratio.num > 0 && avVideoCodecCtx->sample_aspect_ratio.den != 0)
+		if (codecpar->sample_aspect_ratio.num > 0 && codecpar->sample_aspect_ratio.den != 0)
 		{
-			videoProperties->PixelAspectRatio->Numerator = avVideoCodecCtx->sample_aspect_ratio.num;
-			videoProperties->PixelAspectRatio->Denominator = avVideoCodecCtx->sample_aspect_ratio.den;
+			videoProperties->PixelAspectRatio->Numerator = codecpar->sample_aspect_ratio.num;
+			videoProperties->PixelAspectRatio->Denominator = codecpar->sample_aspect_ratio.den;
 		}
 
 		videoProperties->Properties->Insert(MF_MT_INTERLACE_MODE, (uint32)_MFVideoInterlaceMode::MFVideoInterlace_MixedInterlaceOrProgressive);
@@ -638,25 +1211,20 @@ HRESULT FFmpegInteropMSS::CreateVideoStreamDescriptor(bool forceVideoDecode)
 		Platform::Guid MF_MT_VIDEO_ROTATION(0xC380465D, 0x2271, 0x428C, 0x9B, 0x83, 0xEC, 0xEA, 0x3B, 0x4A, 0x85, 0xC1);
 		videoProperties->Properties->Insert(MF_MT_VIDEO_ROTATION, (uint32)rotationAngle);
 	}
-	// Detect the correct framerate
-	if (avVideoCodecCtx->framerate.num != 0 || avVideoCodecCtx->framerate.den != 1)
-	{
-		videoProperties->FrameRate->Numerator = avVideoCodecCtx->framerate.num;
-		videoProperties->FrameRate->Denominator = avVideoCodecCtx->framerate.den;
-	}
-	else if (avFormatCtx->streams[videoStreamIndex]->avg_frame_rate.num != 0 || avFormatCtx->streams[videoStreamIndex]->avg_frame_rate.den != 0)
+	// Detect the correct framerate. A decoder only knows its own once opened, so it comes from the stream.
+	if (avStream->avg_frame_rate.num != 0 || avStream->avg_frame_rate.den != 0)
 	{
-		videoProperties->FrameRate->Numerator = avFormatCtx->streams[videoStreamIndex]->avg_frame_rate.num;
-		videoProperties->FrameRate->Denominator = avFormatCtx->streams[videoStreamIndex]->avg_frame_rate.den;
+		videoProperties->FrameRate->Numerator = avStream->avg_frame_rate.num;
+		videoProperties->FrameRate->Denominator = avStream->avg_frame_rate.den;
 	}
 
-	videoProperties->Bitrate = (unsigned int)avVideoCodecCtx->bit_rate;
+	videoProperties->Bitrate = (unsigned int)codecpar->bit_rate;
 	videoStreamDescriptor = ref new VideoStreamDescriptor(videoProperties);
 
 	return (videoStreamDescriptor != nullptr && videoSampleProvider != nullptr) ? S_OK : E_OUTOFMEMORY;
 }
 
-HRESULT FFmpegInteropMSS::ParseOptions(PropertySet^ ffmpegOptions)
+HRESULT FFmpegInteropMSS::ParseOptions(PropertySet^ ffmpegOptions, AVDictionary** avDict)
 {
 	HRESULT hr = S_OK;
 
@@ -679,7 +1247,7 @@ HRESULT FFmpegInteropMSS::ParseOptions(PropertySet^ ffmpegOptions)
 			const char* valueChar = valueA.c_str();
 
 			// Add key and value pair entry
-			if (av_dict_set(&avDict, keyChar, valueChar, 0) < 0)
+			if (av_dict_set(avDict, keyChar, valueChar, 0) < 0)
 			{
 				hr = E_INVALIDARG;
 				break;
@@ -694,103 +1262,534 @@ HRESULT FFmpegInteropMSS::ParseOptions(PropertySet^ ffmpegOptions)
 
 void FFmpegInteropMSS::OnStarting(MediaStreamSource ^sender, MediaStreamSourceStartingEventArgs ^args)
 {
+	TraceSpan span("OnStarting");
 	MediaStreamSourceStartingRequest^ request = args->Request;
+	bool hasStartPosition = request->StartPosition && request->StartPosition->Value.Duration <= mediaDuration.Duration;
+	LONGLONG actualStartPosition = Start(hasStartPosition, hasStartPosition ? request->StartPosition->Value.Duration : 0);
+
+	// Set up the decoders before the first samples get requested. This blocks, which is fine on the worker thread
+	// raising Starting. Seek may be called from the UI thread, there the first sample requests set them up instead.
+	AllocateDecoders();
+
+	if (hasStartPosition)
+	{
+		TimeSpan startPosition = { actualStartPosition };
+		request->SetActualStartPosition(startPosition);
+	}
+}
+
+TimeSpan FFmpegInteropMSS::Seek(TimeSpan position)
+{
+	TraceSpan span("Seek");
+	LONGLONG target = position.Duration < 0 ? 0 : position.Duration;
+	TimeSpan startPosition = { Start(target <= mediaDuration.Duration, target) };
+	return startPosition;
+}
+
+// Prepare playback from position, or from where it is without a start position. Returns the position the samples
+// start at.
+LONGLONG FFmpegInteropMSS::Start(bool hasStartPosition, LONGLONG position)
+{
+	// A new trick play rate comes with a seek, there is nothing to play fast without video
+	bool hasVideo = videoSampleProvider != nullptr && !audioOnly;
+	double rate = hasStartPosition && hasVideo ? requestedTrickPlayRate.load() : hasVideo ? startingTrickPlayRate.load() : 1.0;
+	startingTrickPlayRate = rate;
+
+	// Measured until every played stream has handed out its first sample from the new position
+	seekStartTicks = GetPipelineTicks();
+	pendingSeekStreams = (audioSampleProvider != nullptr && rate == 1.0 ? 1 : 0) | (hasVideo ? 2 : 0);
+
+	// The seek is only carried out by the next sample request, so when seeks pile up while scrubbing only the
+	// last one of them reads anything. Requests still working towards the previous position give up right away.
+	if (hasStartPosition)
+	{
+		LONGLONG now = GetTimeStamp();
+		isScrubbing = config->ScrubbingInterval.Duration > 0 && lastSeekTime != 0 && now - lastSeekTime < config->ScrubbingInterval.Duration;
+		lastSeekTime = now;
+		m_pReader->RequestSeek(position);
+	}
+
+	return hasStartPosition ? GetTrickPlayStart(position, rate) : position;
+}
+
+// Carry out the latest seek requested by OnStarting, if any
+void FFmpegInteropMSS::ApplyPendingSeek()
+{
+	if (m_pReader == nullptr || !m_pReader->IsSeekPending())
+	{
+		return;
+	}
+
+	// Nothing may read or decode while the read position moves. A seek coming in meanwhile
+	// aborts this one and is taken right after it.
+	LockStreams();
+	LONGLONG position;
+	while ((position = m_pReader->TakeSeekRequest()) >= 0)
+	{
+		SeekTo(position);
+	}
+	UnlockStreams();
+}
+
+void FFmpegInteropMSS::SeekTo(LONGLONG position)
+{
+	TraceSpan span("seek");
+
+	// Select the first valid stream either from video or audio
+	int streamIndex = videoStreamIndex >= 0 ? videoStreamIndex : audioStreamIndex >= 0 ? audioStreamIndex : -1;
+	if (streamIndex < 0)
+	{
+		return;
+	}
+
+	// Convert TimeSpan unit to AV_TIME_BASE
+	int64_t seekTarget = static_cast<int64_t>(position / (av_q2d(avFormatCtx->streams[streamIndex]->time_base) * 10000000));
+
+	// Sample timestamps start at zero, the stream may not (e.g. MPEG-TS recordings)
+	if (avFormatCtx->streams[streamIndex]->start_time != AV_NOPTS_VALUE)
+	{
+		seekTarget += avFormatCtx->streams[streamIndex]->start_time;
+	}
+
+	// Resume video if it was turned off during playback. Until this seek nothing reads its packets, and it starts
+	// again from the keyframe the seek lands on.
+	bool isVideoResumed = isVideoDetached && !audioOnly && videoSampleProvider != nullptr;
+	if (isVideoResumed)
+	{
+		m_pReader->SetVideoStream(videoStreamIndex, videoSampleProvider);
+		isVideoDetached = false;
+	}
+
+	// Trick play reads keyframes only, the packets queued for either mode are of no use to the other
+	bool wasTrickPlay = trickPlayRate != 1.0;
+	trickPlayRate = startingTrickPlayRate.load();
+	bool isTrickPlay = trickPlayRate != 1.0;
+	if (isTrickPlay)
+	{
+		AVStream* avStream = avFormatCtx->streams[streamIndex];
+		int64_t step = static_cast<int64_t>(fabs(trickPlayRate) * TRICKPLAYFRAMEINTERVAL / (av_q2d(avStream->time_base) * 10000000));
+		m_pReader->SetTrickPlay(trickPlayRate > 0 ? 1 : -1, step > 0 ? step : 1);
+		trickPlayOutputStart = GetTrickPlayStart(position, trickPlayRate);
+		trickPlaySourceStart = AV_NOPTS_VALUE;
+	}
+	else if (wasTrickPlay)
+	{
+		m_pReader->SetTrickPlay(0, 0);
+	}
+
+	counters.seeks.Add(1);
+	audioPosition = position;
+	videoPosition = position;
+	if (!isTrickPlay && !wasTrickPlay && !isVideoResumed && SeekInQueuedPackets(position))
+	{
+		// Short skips forward land in what was already read, the demuxer and the decoders carry on as they are
+		counters.bufferedSeeks.Add(1);
+	}
+	else if (m_pReader->Seek(streamIndex, seekTarget) < 0)
+	{
+		DebugMessage(L" - ### Error while seeking\n");
+		return;
+	}
+	else
+	{
+		// Flush the AudioSampleProvider and its decoder
+		if (audioSampleProvider != nullptr)
+		{
+			audioSampleProvider->Flush();
+		}
+
+		// Flush the VideoSampleProvider and its decoder
+		if (videoSampleProvider != nullptr)
+		{
+			videoSampleProvider->Flush();
+		}
+	}
+
+	if (audioSampleProvider != nullptr)
+	{
+		audioSampleProvider->SetSeekTarget(position, false);
+	}
+	if (videoSampleProvider != nullptr)
+	{
+		// Every keyframe read in trick play is shown, nothing is dropped up to the position
+		videoSampleProvider->SetKeyFramesOnly(isTrickPlay);
+		if (!isTrickPlay)
+		{
+			videoSampleProvider->SetSeekTarget(position, isScrubbing);
+		}
+	}
+}
+
+// Time the retimed samples of trick play start at. Going backward from the seek position would run past the end of
+// the media before reaching its start, so those start earlier.
+LONGLONG FFmpegInteropMSS::GetTrickPlayStart(LONGLONG position, double rate)
+{
+	if (rate >= 0.0 || mediaDuration.Duration <= 0)
+	{
+		return position;
+	}
+
+	LONGLONG start = mediaDuration.Duration - static_cast<LONGLONG>(position / -rate);
+	return start < 0 ? 0 : start < position ? start : position;
+}
+
+// Move a keyframe read in trick play from its position in the media to the time it is shown at
+void FFmpegInteropMSS::RetimeTrickPlaySample(MediaStreamSample^ sample)
+{
+	LONGLONG position = sample->Timestamp.Duration;
+	trickPlayPosition = position;
+	if (trickPlaySourceStart == AV_NOPTS_VALUE)
+	{
+		trickPlaySourceStart = position;
+	}
+
+	LONGLONG distance = position >= trickPlaySourceStart ? position - trickPlaySourceStart : trickPlaySourceStart - position;
+	TimeSpan timestamp = { trickPlayOutputStart + static_cast<LONGLONG>(distance / fabs(trickPlayRate)) };
+	TimeSpan duration = { TRICKPLAYFRAMEINTERVAL };
+	sample->Timestamp = timestamp;
+	sample->Duration = duration;
+
+	// Consecutive samples are far apart in the media, the pipeline must not take them for a continuous stream
+	sample->Discontinuous = true;
+}
 
-	// Perform seek operation when MediaStreamSource received seek event from MediaElement
-	if (request->StartPosition && request->StartPosition->Value.Duration <= mediaDuration.Duration)
+// Drop the queued packets up to the keyframe at or before position if every played stream has one queued,
+// returns false without dropping anything otherwise
+bool FFmpegInteropMSS::SeekInQueuedPackets(LONGLONG position)
+{
+	MediaSampleProvider^ sampleProviders[] = { audioSampleProvider, audioOnly ? nullptr : videoSampleProvider };
+	int keyFrames[2] = { -1, -1 };
+	bool isCovered = false;
+	for (int i = 0; i < 2; i++)
 	{
-		// Select the first valid stream either from video or audio
-		int streamIndex = videoStreamIndex >= 0 ? videoStreamIndex : audioStreamIndex >= 0 ? audioStreamIndex : -1;
+		MediaSampleProvider^ sampleProvider = sampleProviders[i];
+		if (sampleProvider == nullptr)
+		{
+			continue;
+		}
+
+		AVStream* avStream = avFormatCtx->streams[sampleProvider->GetStreamIndex()];
+		int64_t target = static_cast<int64_t>(position / (av_q2d(avStream->time_base) * 10000000));
+		if (avStream->start_time != AV_NOPTS_VALUE)
+		{
+			target += avStream->start_time;
+		}
 
-		if (streamIndex >= 0)
+		keyFrames[i] = sampleProvider->FindQueuedKeyFrame(target);
+		if (keyFrames[i] < 0)
 		{
-			// Convert TimeSpan unit to AV_TIME_BASE
-			int64_t seekTarget = static_cast<int64_t>(request->StartPosition->Value.Duration / (av_q2d(avFormatCtx->streams[streamIndex]->time_base) * 10000000));
+			return false;
+		}
+		isCovered = true;
+	}
 
-			if (av_seek_frame(avFormatCtx, streamIndex, seekTarget, AVSEEK_FLAG_BACKWARD) < 0)
+	if (isCovered)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			if (sampleProviders[i] != nullptr)
 			{
-				DebugMessage(L" - ### Error while seeking\n");
+				sampleProviders[i]->DropQueuedPackets(keyFrames[i]);
 			}
-			else
-			{
-				// Add deferral
+		}
+	}
 
-				// Flush the AudioSampleProvider
-				if (audioSampleProvider != nullptr)
-				{
-					audioSampleProvider->Flush();
-					avcodec_flush_buffers(avAudioCodecCtx);
-				}
+	return isCovered;
+}
 
-				// Flush the VideoSampleProvider
-				if (videoSampleProvider != nullptr)
-				{
-					videoSampleProvider->Flush();
-					avcodec_flush_buffers(avVideoCodecCtx);
-				}
-			}
+// Open the decoders and converters of the active streams in parallel rather than one after the other
+// on the first sample requests. Passthrough streams have nothing to set up.
+void FFmpegInteropMSS::AllocateDecoders()
+{
+	std::vector<task<HRESULT>> allocateTasks;
+	std::vector<MediaSampleProvider^> sampleProviders;
+	sampleProviders.push_back(audioSampleProvider);
+	sampleProviders.push_back(audioOnly ? nullptr : videoSampleProvider);
+
+	LONGLONG phaseStart = GetTimeStamp();
+	std::recursive_mutex* streamMutexes[] = { &audioMutex, &videoMutex };
+	for (size_t i = 0; i < sampleProviders.size(); i++)
+	{
+		MediaSampleProvider^ sampleProvider = sampleProviders[i];
+		std::recursive_mutex* streamMutex = streamMutexes[i];
+		if (sampleProvider != nullptr && !sampleProvider->IsAllocated())
+		{
+			// A request abandoned for the seek may still be finishing up on the stream
+			allocateTasks.push_back(create_task([sampleProvider, streamMutex]()
+			{
+				std::lock_guard<std::recursive_mutex> lock(*streamMutex);
+				return sampleProvider->EnsureResourcesAllocated();
+			}));
 		}
+	}
 
-		request->SetActualStartPosition(request->StartPosition->Value);
+	if (!allocateTasks.empty())
+	{
+		// A stream that failed to set up is disabled on its next sample request
+		when_all(allocateTasks.begin(), allocateTasks.end()).wait();
+		openTimings->decoderSetup.Duration += GetTimeStamp() - phaseStart;
 	}
 }
 
 void FFmpegInteropMSS::OnSampleRequested(Windows::Media::Core::MediaStreamSource ^sender, MediaStreamSourceSampleRequestedEventArgs ^args)
 {
-	mutexGuard.lock();
+	TraceSpan span("OnSampleRequested");
+	args->Request->Sample = GetNextSample(args->Request->StreamDescriptor);
+}
+
+MediaStreamSample^ FFmpegInteropMSS::GetNextSample(IMediaStreamDescriptor^ streamDescriptor)
+{
+	int64 start = GetPipelineTicks();
+	MediaStreamSample^ sample;
+	bool isAborted;
+	do
+	{
+		// Taken before the pending seeks are carried out, so a seek coming in after them is noticed even when the
+		// request of the other stream carries it out before this one gets to look
+		unsigned int seekCount = m_pReader != nullptr ? m_pReader->GetSeekCount() : 0;
+		ApplyPendingSeek();
+		sample = GetNextSampleOfStream(streamDescriptor, start, seekCount);
+
+		// Abandoned for a seek which came in during the request, start over from the new position
+		isAborted = sample == nullptr && m_pReader != nullptr && m_pReader->GetSeekCount() != seekCount;
+	} while (isAborted);
+
+	return sample;
+}
+
+MediaStreamSample^ FFmpegInteropMSS::GetNextSampleOfStream(IMediaStreamDescriptor^ streamDescriptor, int64 start, unsigned int seekCount)
+{
+	// Audio and video are produced under their own lock, a slow video decode doesn't hold up audio.
+	// The video descriptor never changes, the audio one only while both locks are held.
+	bool isVideo = streamDescriptor != nullptr && streamDescriptor == videoStreamDescriptor;
+	std::recursive_mutex& streamMutex = isVideo ? videoMutex : audioMutex;
+	{
+		// Time the request waits on a seek, a stream switch or another request of the same stream
+		TraceSpan lockSpan("OnSampleRequested lock");
+		streamMutex.lock();
+	}
+
+	MediaStreamSample^ sample;
 	if (mss != nullptr)
 	{
-		if (args->Request->StreamDescriptor == audioStreamDescriptor && audioSampleProvider != nullptr)
+		int seekStream = 0;
+		LatencyHistogram* requestLatency = nullptr;
+		if (!isVideo && streamDescriptor == audioStreamDescriptor && audioSampleProvider != nullptr)
 		{
-			args->Request->Sample = audioSampleProvider->GetNextSample();
+			// Audio ends in trick play, the next seek at normal rate brings it back
+			if (trickPlayRate == 1.0)
+			{
+				sample = audioSampleProvider->GetNextSample();
+				requestLatency = &counters.audioRequestLatency;
+				seekStream = 1;
+			}
+			if (sample != nullptr)
+			{
+				audioPosition = sample->Timestamp.Duration + sample->Duration.Duration;
+			}
 		}
-		else if (args->Request->StreamDescriptor == videoStreamDescriptor && videoSampleProvider != nullptr)
+		else if (isVideo && videoSampleProvider != nullptr && !audioOnly && !isVideoDetached)
 		{
-			args->Request->Sample = videoSampleProvider->GetNextSample();
+			sample = videoSampleProvider->GetNextSample();
+			if (sample != nullptr && trickPlayRate != 1.0)
+			{
+				RetimeTrickPlaySample(sample);
+			}
+			if (sample != nullptr)
+			{
+				videoPosition = trickPlayRate != 1.0 ? trickPlayPosition.load() : sample->Timestamp.Duration + sample->Duration.Duration;
+			}
+			requestLatency = &counters.videoRequestLatency;
+			seekStream = 2;
 		}
-		else
+
+		// An abandoned request is retried, only the one that completes counts
+		if (requestLatency != nullptr && (sample != nullptr || m_pReader->GetSeekCount() == seekCount))
 		{
-			args->Request->Sample = nullptr;
+			requestLatency->Record(GetPipelineTicks() - start);
+
+			// The stream that hands out the last first sample after a seek records its latency
+			if ((pendingSeekStreams.load() & seekStream) != 0 && pendingSeekStreams.fetch_and(~seekStream) == seekStream)
+			{
+				counters.seekLatency.Record(GetPipelineTicks() - seekStartTicks);
+			}
 		}
 	}
+	streamMutex.unlock();
+
+	return sample;
+}
+
+// Take every lock, for anything that changes the streams or moves the read position
+void FFmpegInteropMSS::LockStreams()
+{
+	mutexGuard.lock();
+	audioMutex.lock();
+	videoMutex.lock();
+}
+
+void FFmpegInteropMSS::UnlockStreams()
+{
+	videoMutex.unlock();
+	audioMutex.unlock();
 	mutexGuard.unlock();
 }
 
-// Static function to read file stream and pass data to FFmpeg. Credit to Philipp Sch http://www.codeproject.com/Tips/489450/Creating-Custom-FFmpeg-IO-Context
-static int FileStreamRead(void* ptr, uint8_t* buf, int bufSize)
+LatencyDistribution^ FFmpegInteropMSS::GetLatencyDistribution(LatencyMetric metric)
+{
+	LatencyHistogram* histogram = GetLatencyHistogram(metric);
+	return histogram != nullptr ? ref new LatencyDistribution(*histogram) : nullptr;
+}
+
+void FFmpegInteropMSS::ResetLatencies()
+{
+	for (int metric = (int)LatencyMetric::AudioSampleRequest; metric <= (int)LatencyMetric::SeekToFirstSample; metric++)
+	{
+		GetLatencyHistogram((LatencyMetric)metric)->Reset();
+	}
+}
+
+LatencyHistogram* FFmpegInteropMSS::GetLatencyHistogram(LatencyMetric metric)
+{
+	switch (metric)
+	{
+	case LatencyMetric::AudioSampleRequest: return &counters.audioRequestLatency;
+	case LatencyMetric::VideoSampleRequest: return &counters.videoRequestLatency;
+	case LatencyMetric::IoWait: return &counters.ioWaitLatency;
+	case LatencyMetric::VideoDecodeIFrame: return &counters.videoDecodeLatency[0];
+	case LatencyMetric::VideoDecodePFrame: return &counters.videoDecodeLatency[1];
+	case LatencyMetric::VideoDecodeBFrame: return &counters.videoDecodeLatency[2];
+	case LatencyMetric::SeekToFirstSample: return &counters.seekLatency;
+	}
+	return nullptr;
+}
+
+void FFmpegInteropMSS::StartLatencyReports()
+{
+	if (config->LatencyReportInterval.Duration <= 0)
+	{
+		return;
+	}
+
+	// The timer only holds a weak reference, it doesn't keep the media alive
+	WeakReference weakThis(this);
+	latencyReportTimer = ThreadPoolTimer::CreatePeriodicTimer(ref new TimerElapsedHandler([weakThis](ThreadPoolTimer^ timer)
+	{
+		FFmpegInteropMSS^ interopMSS = weakThis.Resolve<FFmpegInteropMSS>();
+		if (interopMSS != nullptr)
+		{
+			interopMSS->LogLatencies();
+		}
+	}), config->LatencyReportInterval);
+}
+
+// One line per latency with values, e.g. "Latency VideoSampleRequest: 1200 values, p50 0.41 ms, ..."
+void FFmpegInteropMSS::LogLatencies()
+{
+	static const wchar_t* names[] = { L"AudioSampleRequest", L"VideoSampleRequest", L"IoWait", L"VideoDecodeIFrame", L"VideoDecodePFrame", L"VideoDecodeBFrame", L"SeekToFirstSample" };
+	for (int metric = (int)LatencyMetric::AudioSampleRequest; metric <= (int)LatencyMetric::SeekToFirstSample; metric++)
+	{
+		LatencyDistribution^ distribution = GetLatencyDistribution((LatencyMetric)metric);
+		if (distribution->Count == 0)
+		{
+			continue;
+		}
+
+		wchar_t line[256];
+		swprintf_s(line, L"Latency %s: %lld values, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.2f ms\n",
+			names[metric],
+			distribution->Count,
+			distribution->GetPercentile(50).Duration / 10000.0,
+			distribution->GetPercentile(90).Duration / 10000.0,
+			distribution->GetPercentile(99).Duration / 10000.0,
+			distribution->GetPercentile(99.9).Duration / 10000.0,
+			distribution->Maximum.Duration / 10000.0);
+		FFmpegInteropLogging::Log(LogLevel::Info, ref new String(line));
+	}
+}
+
+MediaStreamSample^ FFmpegInteropMSS::GetNextAudioSample()
+{
+	MediaStreamSample^ sample;
+	audioMutex.lock();
+	if (audioSampleProvider != nullptr)
+	{
+		sample = audioSampleProvider->GetNextSample();
+	}
+	audioMutex.unlock();
+	return sample;
+}
+
+HRESULT FFmpegInteropMSS::SetAudioOutputFormat(int sampleRate, int channels)
 {
-	IStream* pStream = reinterpret_cast<IStream*>(ptr);
-	ULONG bytesRead = 0;
-	HRESULT hr = pStream->Read(buf, bufSize, &bytesRead);
+	HRESULT hr = S_OK;
+	audioMutex.lock();
 
-	if (FAILED(hr))
+	// Only decoded audio can be resampled
+	UncompressedAudioSampleProvider^ uncompressedSampleProvider = dynamic_cast<UncompressedAudioSampleProvider^>(audioSampleProvider);
+	if (uncompressedSampleProvider == nullptr)
 	{
-		return -1;
+		hr = E_FAIL;
 	}
 
-	// If we succeed but don't have any bytes, assume end of file
-	if (bytesRead == 0)
+	if (SUCCEEDED(hr))
 	{
-		return AVERROR_EOF;  // Let FFmpeg know that we have reached eof
+		hr = uncompressedSampleProvider->SetOutputFormat(sampleRate, channels);
 	}
 
-	return bytesRead;
+	audioMutex.unlock();
+	return hr;
 }
 
-// Static function to seek in file stream. Credit to Philipp Sch http://www.codeproject.com/Tips/489450/Creating-Custom-FFmpeg-IO-Context
-static int64_t FileStreamSeek(void* ptr, int64_t pos, int whence)
+void FFmpegInteropMSS::OnSwitchStreamsRequested(MediaStreamSource ^sender, MediaStreamSourceSwitchStreamsRequestedEventArgs ^args)
 {
-	IStream* pStream = reinterpret_cast<IStream*>(ptr);
-	LARGE_INTEGER in;
-	in.QuadPart = pos;
-	ULARGE_INTEGER out = { 0 };
+	SwitchAudioStream(dynamic_cast<AudioStreamDescriptor^>(args->Request->NewStreamDescriptor));
+}
 
-	if (FAILED(pStream->Seek(in, whence, &out)))
+void FFmpegInteropMSS::SwitchAudioStream(AudioStreamDescriptor^ descriptor)
+{
+	LockStreams();
+	if (mss != nullptr && descriptor != nullptr && descriptor != audioStreamDescriptor)
 	{
-		return -1;
+		for (auto& audioStream : audioStreams)
+		{
+			if (audioStream.descriptor == descriptor)
+			{
+				if (FAILED(SetActiveAudioStream(audioStream)))
+				{
+					DebugMessage(L" - ### Error while switching audio stream\n");
+				}
+				else if (audioPosition >= 0 && trickPlayRate == 1.0)
+				{
+					// The demuxer is ahead of the audio played so far by whatever the video has queued, and the
+					// packets of the new stream were discarded up to there. Go back to where the played audio ends.
+					AVStream* avStream = avFormatCtx->streams[audioStreamIndex];
+					int64_t position = static_cast<int64_t>(audioPosition / (av_q2d(avStream->time_base) * 10000000));
+					if (avStream->start_time != AV_NOPTS_VALUE)
+					{
+						position += avStream->start_time;
+					}
+
+					if (m_pReader->ResumeAudioStream(position) < 0)
+					{
+						DebugMessage(L"Could not seek back, the new audio stream resumes at the demuxer position\n");
+					}
+				}
+				break;
+			}
+		}
 	}
+	UnlockStreams();
+}
 
-	return out.QuadPart; // Return the new position:
+// Current time in TimeSpan units, used to measure the open phases
+static LONGLONG GetTimeStamp()
+{
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (LONGLONG)(counter.QuadPart * 10000000.0 / frequency.QuadPart);
 }
 
 static int lock_manager(void **mtx, enum AVLockOp op)
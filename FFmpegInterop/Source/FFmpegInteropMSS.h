@@ -17,15 +17,29 @@
 //*****************************************************************************
 
 #pragma once
+#include <atomic>
 #include <queue>
 #include <mutex>
+#include <vector>
 #include "FFmpegReader.h"
+#include "InterruptHandler.h"
 #include "MediaSampleProvider.h"
 #include "MediaThumbnailData.h"
+#include "SpriteSheet.h"
+#include "SteppedVideoFrame.h"
+#include "FrameStepper.h"
+#include "ContextPool.h"
+#include "MediaProgramInfo.h"
+#include "MediaOpenTimings.h"
+#include "MediaPipelineStatistics.h"
+#include "LatencyDistribution.h"
+#include "FileStreamIO.h"
+#include "FFmpegInteropConfig.h"
 
 using namespace Platform;
 using namespace Windows::Foundation;
 using namespace Windows::Foundation::Collections;
+using namespace Platform::Collections;
 using namespace Windows::Media::Core;
 
 extern "C"
@@ -35,16 +49,77 @@ extern "C"
 
 namespace FFmpegInterop
 {
+	// State kept for every audio stream of the media. Only the selected stream is demuxed,
+	// the decoder of a stream is opened the first time a sample of it gets requested.
+	struct AudioStreamInfo
+	{
+		int streamIndex;
+		AVCodecContext* avCodecCtx;
+		AudioStreamDescriptor^ descriptor;
+		MediaSampleProvider^ sampleProvider;
+	};
+
 	public ref class FFmpegInteropMSS sealed
 	{
 	public:
 		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, MediaStreamSource^ mss);
 		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions);
 		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode);
+		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromStream(IRandomAccessStream^ stream, FFmpegInteropConfig^ config);
 		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions);
 		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromUri(String^ uri, bool forceAudioDecode, bool forceVideoDecode);
+		static FFmpegInteropMSS^ CreateFFmpegInteropMSSFromUri(String^ uri, FFmpegInteropConfig^ config);
+
+		// Open the media on a worker thread. Cancelling the operation aborts any blocking FFmpeg call, though a read
+		// already blocked in the stream passed in only gives up once the stream returns.
+		static IAsyncOperation<FFmpegInteropMSS^>^ CreateFFmpegInteropMSSFromStreamAsync(IRandomAccessStream^ stream, FFmpegInteropConfig^ config);
+		static IAsyncOperation<FFmpegInteropMSS^>^ CreateFFmpegInteropMSSFromUriAsync(String^ uri, FFmpegInteropConfig^ config);
 		MediaThumbnailData^ ExtractThumbnail();
 
+		// Decode the keyframe at or before the position and scale it to width x height, a size of 0 keeps the aspect ratio.
+		// Playback carries on from where it was afterwards. Reading is subject to ReadTimeout. To grab frames without
+		// playing the media, MediaMetadataProbe::ExtractVideoFrameFromStream doesn't set up the playback pipeline.
+		MediaThumbnailData^ ExtractVideoFrame(TimeSpan position, int width, int height, VideoFrameFormat format);
+
+		// Decode tileCount frames evenly spread over the media into a single image with the given number of columns.
+		// The media is read once from start to end, decoding only keyframes. This also moves the read position.
+		IAsyncOperation<SpriteSheet^>^ ExtractSpriteSheetAsync(int tileCount, int columns, int tileWidth, int tileHeight, VideoFrameFormat format);
+
+		// Frame by frame stepping, e.g. for review tools. StepToFrame goes to the frame shown at position, StepForward and
+		// StepBackward to the next and previous frame, nullptr past either end. Frames are decoded a GOP at a time and
+		// kept up to FrameStepCacheSize, so stepping back is instant within the recent GOPs. Images are sized and
+		// formatted like ExtractVideoFrame. Reading is subject to ReadTimeout, and this also moves the read position.
+		SteppedVideoFrame^ StepToFrame(TimeSpan position, int width, int height, VideoFrameFormat format);
+		SteppedVideoFrame^ StepForward(int width, int height, VideoFrameFormat format);
+		SteppedVideoFrame^ StepBackward(int width, int height, VideoFrameFormat format);
+
+		// Distribution of one of the latencies measured during playback
+		LatencyDistribution^ GetLatencyDistribution(LatencyMetric metric);
+
+		// Start every latency distribution over, e.g. once playback has warmed up
+		void ResetLatencies();
+
+		// Produce the next sample of the audio or video stream the way the MediaStreamSource requests it, for
+		// pipelines which pull samples themselves. Audio and video can be requested from different threads.
+		MediaStreamSample^ GetNextSample(IMediaStreamDescriptor^ streamDescriptor);
+
+		// Move to position the way the MediaStreamSource does on Starting, for pipelines which pull samples themselves.
+		// Returns the position the samples start at, earlier than position when rewinding in trick play. Positions
+		// past the Duration are ignored. This doesn't wait on a task and can be called from the UI thread, decoders
+		// not set up yet are opened by the first sample requests.
+		TimeSpan Seek(TimeSpan position);
+
+		// Play another one of the AudioDescriptors, as the MediaStreamSource does on SwitchStreamsRequested. The new
+		// stream resumes where the audio handed out so far ends.
+		void SwitchAudioStream(AudioStreamDescriptor^ descriptor);
+
+		// Free the decoders, scalers and resamplers kept around for reuse by media opened later on
+		static void ClearContextPool();
+
+		// Decoders and scalers the pool handed out instead of setting up new ones, since the process started
+		static property int64 ReusedDecoderCount { int64 get(); }
+		static property int64 ReusedScalerCount { int64 get(); }
+
 		// Contructor
 		MediaStreamSource^ GetMediaStreamSource();
 		virtual ~FFmpegInteropMSS();
@@ -57,6 +132,18 @@ namespace FFmpegInterop
 				return audioStreamDescriptor;
 			};
 		};
+		property IVectorView<AudioStreamDescriptor^>^ AudioDescriptors
+		{
+			IVectorView<AudioStreamDescriptor^>^ get()
+			{
+				auto descriptors = ref new Vector<AudioStreamDescriptor^>();
+				for (auto& audioStream : audioStreams)
+				{
+					descriptors->Append(audioStream.descriptor);
+				}
+				return descriptors->GetView();
+			};
+		};
 		property VideoStreamDescriptor^ VideoDescriptor
 		{
 			VideoStreamDescriptor^ get()
@@ -64,6 +151,28 @@ namespace FFmpegInterop
 				return videoStreamDescriptor;
 			};
 		};
+		property IVectorView<MediaProgramInfo^>^ Programs
+		{
+			IVectorView<MediaProgramInfo^>^ get()
+			{
+				return programs->GetView();
+			};
+		};
+		property MediaOpenTimings^ OpenTimings
+		{
+			MediaOpenTimings^ get()
+			{
+				return openTimings;
+			};
+		};
+		// Snapshot of the counters of every stage from reading the stream to handing out samples
+		property MediaPipelineStatistics^ Statistics
+		{
+			MediaPipelineStatistics^ get()
+			{
+				return ref new MediaPipelineStatistics(counters);
+			};
+		};
 		property TimeSpan Duration
 		{
 			TimeSpan get()
@@ -71,6 +180,44 @@ namespace FFmpegInterop
 				return mediaDuration;
 			};
 		};
+		// Skip all video processing, e.g. while the app plays in the background. Video delivery ends when this is
+		// turned on, turning it off again resumes video from the next seek. Only a switch made here can be undone:
+		// media opened with FFmpegInteropConfig::AudioOnly has no video stream to resume, this stays on for it.
+		property bool AudioOnly
+		{
+			bool get()
+			{
+				return audioOnly;
+			};
+			void set(bool value)
+			{
+				SetAudioOnly(value);
+			};
+		};
+		// Trick play, e.g. 8 or -4 for fast forward and rewind. Only the keyframes of the video are read and decoded,
+		// retimed so the pipeline playing at normal speed shows the video at this rate, backward for negative
+		// rates. Audio ends meanwhile. Rates up to 1 play every frame as usual. A new rate takes effect with the
+		// next seek, seek to TrickPlayPosition when going back to 1 to carry on from the frame shown last.
+		property double TrickPlayRate
+		{
+			double get()
+			{
+				return requestedTrickPlayRate.load();
+			};
+			void set(double value)
+			{
+				requestedTrickPlayRate = value > 1.0 || value < 0.0 ? value : 1.0;
+			};
+		};
+		// Position in the media of the last frame shown in trick play
+		property TimeSpan TrickPlayPosition
+		{
+			TimeSpan get()
+			{
+				TimeSpan position = { trickPlayPosition.load() };
+				return position;
+			};
+		};
 		property String^ VideoCodecName
 		{
 			String^ get()
@@ -89,22 +236,52 @@ namespace FFmpegInterop
 	internal:
 		int ReadPacket();
 
+		// Convert the options given in a PropertySet to an AVDictionary
+		static HRESULT ParseOptions(PropertySet^ ffmpegOptions, AVDictionary** avDict);
+
+		// Used by FFmpegInteropPlaylist, which plays the decoded audio of its items through its own MediaStreamSource
+		MediaStreamSample^ GetNextAudioSample();
+		HRESULT SetAudioOutputFormat(int sampleRate, int channels);
+
 	private:
-		FFmpegInteropMSS();
+		FFmpegInteropMSS(FFmpegInteropConfig^ interopConfig);
 
-		HRESULT CreateMediaStreamSource(IRandomAccessStream^ stream, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions, MediaStreamSource^ mss);
-		HRESULT CreateMediaStreamSource(String^ uri, bool forceAudioDecode, bool forceVideoDecode, PropertySet^ ffmpegOptions);
-		HRESULT InitFFmpegContext(bool forceAudioDecode, bool forceVideoDecode);
-		HRESULT CreateAudioStreamDescriptor(bool forceAudioDecode);
+		HRESULT CreateMediaStreamSource(IRandomAccessStream^ stream, MediaStreamSource^ mss);
+		HRESULT CreateMediaStreamSource(String^ uri);
+		HRESULT InitFFmpegContext();
+		HRESULT SelectProgram(int programId);
+		bool IsStreamInProgram(unsigned int streamIndex);
+		int FindBestStream(AVMediaType type, AVCodec** avCodec);
+		int FindVideoFrameStream();
+		void FlushSampleProviders();
+		SteppedVideoFrame^ StepFrame(int direction, int64_t position, int width, int height, VideoFrameFormat format);
+		HRESULT CreateAudioStreamDescriptor(AudioStreamInfo& audioStream, bool forceAudioDecode);
+		HRESULT SetActiveAudioStream(AudioStreamInfo& audioStream);
 		HRESULT CreateVideoStreamDescriptor(bool forceVideoDecode);
 		HRESULT ConvertCodecName(const char* codecName, String^ *outputCodecName);
-		HRESULT ParseOptions(PropertySet^ ffmpegOptions);
+		void SetAudioOnly(bool value);
+		LatencyHistogram* GetLatencyHistogram(LatencyMetric metric);
+		void StartLatencyReports();
+		void LogLatencies();
+		void AllocateDecoders();
+		LONGLONG Start(bool hasStartPosition, LONGLONG position);
+		void ApplyPendingSeek();
+		void SeekTo(LONGLONG position);
+		bool SeekInQueuedPackets(LONGLONG position);
+		LONGLONG GetTrickPlayStart(LONGLONG position, double rate);
+		void RetimeTrickPlaySample(MediaStreamSample^ sample);
+		MediaStreamSample^ GetNextSampleOfStream(IMediaStreamDescriptor^ streamDescriptor, int64 start, unsigned int seekCount);
+		void LockStreams();
+		void UnlockStreams();
 		void OnStarting(MediaStreamSource ^sender, MediaStreamSourceStartingEventArgs ^args);
 		void OnSampleRequested(MediaStreamSource ^sender, MediaStreamSourceSampleRequestedEventArgs ^args);
+		void OnSwitchStreamsRequested(MediaStreamSource ^sender, MediaStreamSourceSwitchStreamsRequestedEventArgs ^args);
 
+		FFmpegInteropConfig^ config;
 		MediaStreamSource^ mss;
 		EventRegistrationToken startingRequestedToken;
 		EventRegistrationToken sampleRequestedToken;
+		EventRegistrationToken switchStreamsRequestedToken;
 
 		internal:
 		AVDictionary* avDict;
@@ -114,15 +291,27 @@ namespace FFmpegInterop
 		AVCodecContext* avVideoCodecCtx;
 
 		private:
+		// Threading the video decoder is opened with, it goes back to the pool with them
+		DecoderSettings videoDecoderSettings;
+
 		AudioStreamDescriptor^ audioStreamDescriptor;
 		VideoStreamDescriptor^ videoStreamDescriptor;
+		Vector<MediaProgramInfo^>^ programs;
+		AVProgram* avProgram;
+		std::vector<AudioStreamInfo> audioStreams;
 		int audioStreamIndex;
 		int videoStreamIndex;
 		int thumbnailStreamIndex;
 		
+		bool audioOnly;
 		bool rotateVideo;
 		int rotationAngle;
+
+		// Requests for a sample only lock their own stream. Changing the streams or seeking
+		// takes all three through LockStreams, always in this order.
 		std::recursive_mutex mutexGuard;
+		std::recursive_mutex audioMutex;
+		std::recursive_mutex videoMutex;
 		
 		MediaSampleProvider^ audioSampleProvider;
 		MediaSampleProvider^ videoSampleProvider;
@@ -130,8 +319,41 @@ namespace FFmpegInterop
 		String^ videoCodecName;
 		String^ audioCodecName;
 		TimeSpan mediaDuration;
+		MediaOpenTimings^ openTimings;
 		IStream* fileStreamData;
+		CountedFileStream countedFileStream;
+		PipelineCounters counters;
+		Windows::System::Threading::ThreadPoolTimer^ latencyReportTimer;
+		FrameStepper* frameStepper;
+
+		// Start of the last seek and the streams which haven't handed out a sample since, audio 1 and video 2
+		std::atomic<int64> seekStartTicks;
+		std::atomic<int> pendingSeekStreams;
+
+		// Time of the last seek, seeks following each other within ScrubbingInterval show keyframe previews
+		LONGLONG lastSeekTime;
+		std::atomic<bool> isScrubbing;
+
+		// The video stream was taken off the reader by AudioOnly and waits for a seek to be attached again
+		bool isVideoDetached;
+
+		// End of the last audio sample handed out or the last seek position, TimeSpan units. -1 before either.
+		LONGLONG audioPosition;
+
+		// End of the last video sample handed out, the source position in trick play, or the last seek position.
+		// TimeSpan units, -1 before either.
+		LONGLONG videoPosition;
+
+		// Trick play rate set by the app, the one of the last Starting request and the one samples are read at,
+		// 1 for normal playback. Samples are retimed from the first one read after the seek on.
+		std::atomic<double> requestedTrickPlayRate;
+		std::atomic<double> startingTrickPlayRate;
+		double trickPlayRate;
+		LONGLONG trickPlayOutputStart;
+		LONGLONG trickPlaySourceStart;
+		std::atomic<LONGLONG> trickPlayPosition;
 		unsigned char* fileStreamBuffer;
 		FFmpegReader^ m_pReader;
+		InterruptHandler interruptHandler;
 	};
 }
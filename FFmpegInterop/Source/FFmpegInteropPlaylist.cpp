@@ -0,0 +1,294 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "FFmpegInteropPlaylist.h"
+
+using namespace concurrency;
+using namespace FFmpegInterop;
+using namespace Platform;
+using namespace Windows::Media::MediaProperties;
+
+FFmpegInteropPlaylist::FFmpegInteropPlaylist(FFmpegInteropConfig^ playlistConfig)
+	: isNextItemPending(false)
+	, sampleRate(0)
+	, channels(0)
+	, itemStartTime(0)
+	, nextSampleTime(0)
+{
+	// The items are decoded to PCM and only their audio is played
+	config = ref new FFmpegInteropConfig();
+	config->ForceAudioDecode = true;
+	config->AudioOnly = true;
+	if (playlistConfig != nullptr)
+	{
+		config->FFmpegOptions = playlistConfig->FFmpegOptions;
+		config->ProgramId = playlistConfig->ProgramId;
+		config->OpenTimeout = playlistConfig->OpenTimeout;
+		config->ReadTimeout = playlistConfig->ReadTimeout;
+	}
+
+	currentItem.index = -1;
+}
+
+FFmpegInteropPlaylist::~FFmpegInteropPlaylist()
+{
+	mutexGuard.lock();
+	if (mss)
+	{
+		mss->Starting -= startingRequestedToken;
+		mss->SampleRequested -= sampleRequestedToken;
+		mss = nullptr;
+	}
+
+	// Take the items out under the lock, a sample request still in flight then finds the playlist ended
+	bool isPending = isNextItemPending;
+	isNextItemPending = false;
+	FFmpegInteropMSS^ currentMSS = currentItem.interopMSS;
+	currentItem.index = -1;
+	currentItem.interopMSS = nullptr;
+	currentItem.firstSample = nullptr;
+	mutexGuard.unlock();
+
+	// The background task uses the item list, let it complete first. Opening its item can take up to the open
+	// timeout, so it isn't waited on with the lock held.
+	if (isPending)
+	{
+		PreparedPlaylistItem nextItem = nextItemTask.get();
+		delete nextItem.interopMSS;
+	}
+
+	// Release the decoders of the items right away so they go back to the context pool
+	delete currentMSS;
+}
+
+int FFmpegInteropPlaylist::CurrentIndex::get()
+{
+	std::lock_guard<std::mutex> lock(mutexGuard);
+	return currentItem.index;
+}
+
+bool FFmpegInteropPlaylist::IsNextItemReady::get()
+{
+	std::lock_guard<std::mutex> lock(mutexGuard);
+	return isNextItemPending && nextItemTask.is_done();
+}
+
+FFmpegInteropPlaylist^ FFmpegInteropPlaylist::CreateFromUris(IIterable<String^>^ uris, FFmpegInteropConfig^ config)
+{
+	auto playlist = ref new FFmpegInteropPlaylist(config);
+	if (uris != nullptr)
+	{
+		for (String^ uri : uris)
+		{
+			PlaylistItem item = { uri, nullptr };
+			playlist->items.push_back(item);
+		}
+	}
+
+	if (FAILED(playlist->CreateMediaStreamSource()))
+	{
+		// We failed to initialize, clear the variable to return failure
+		playlist = nullptr;
+	}
+
+	return playlist;
+}
+
+FFmpegInteropPlaylist^ FFmpegInteropPlaylist::CreateFromStreams(IIterable<IRandomAccessStream^>^ streams, FFmpegInteropConfig^ config)
+{
+	auto playlist = ref new FFmpegInteropPlaylist(config);
+	if (streams != nullptr)
+	{
+		for (IRandomAccessStream^ stream : streams)
+		{
+			PlaylistItem item = { nullptr, stream };
+			playlist->items.push_back(item);
+		}
+	}
+
+	if (FAILED(playlist->CreateMediaStreamSource()))
+	{
+		// We failed to initialize, clear the variable to return failure
+		playlist = nullptr;
+	}
+
+	return playlist;
+}
+
+MediaStreamSource^ FFmpegInteropPlaylist::GetMediaStreamSource()
+{
+	return mss;
+}
+
+HRESULT FFmpegInteropPlaylist::CreateMediaStreamSource()
+{
+	HRESULT hr = S_OK;
+
+	// The first playable item sets the format of the whole playlist
+	currentItem = PrepareItem(0);
+	if (currentItem.interopMSS == nullptr)
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		AudioStreamDescriptor^ audioStreamDescriptor = ref new AudioStreamDescriptor(AudioEncodingProperties::CreatePcm(sampleRate, channels, 16));
+		mss = ref new MediaStreamSource(audioStreamDescriptor);
+		if (mss)
+		{
+			startingRequestedToken = mss->Starting += ref new TypedEventHandler<MediaStreamSource ^, MediaStreamSourceStartingEventArgs ^>(this, &FFmpegInteropPlaylist::OnStarting);
+			sampleRequestedToken = mss->SampleRequested += ref new TypedEventHandler<MediaStreamSource ^, MediaStreamSourceSampleRequestedEventArgs ^>(this, &FFmpegInteropPlaylist::OnSampleRequested);
+		}
+		else
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		PrepareNextItem();
+	}
+
+	return hr;
+}
+
+// Open the first playable item from startIndex on and decode its first sample
+PreparedPlaylistItem FFmpegInteropPlaylist::PrepareItem(int startIndex)
+{
+	PreparedPlaylistItem preparedItem = { -1, nullptr, nullptr };
+
+	for (int i = startIndex; i < (int)items.size() && preparedItem.interopMSS == nullptr; i++)
+	{
+		FFmpegInteropMSS^ interopMSS = items[i].stream != nullptr
+			? FFmpegInteropMSS::CreateFFmpegInteropMSSFromStream(items[i].stream, config)
+			: FFmpegInteropMSS::CreateFFmpegInteropMSSFromUri(items[i].uri, config);
+		if (interopMSS == nullptr || interopMSS->AudioDescriptor == nullptr)
+		{
+			DebugMessage(L"Skipping playlist item without audio\n");
+			delete interopMSS;
+			continue;
+		}
+
+		if (sampleRate == 0)
+		{
+			AudioEncodingProperties^ encodingProperties = interopMSS->AudioDescriptor->EncodingProperties;
+			sampleRate = encodingProperties->SampleRate;
+			channels = encodingProperties->ChannelCount;
+		}
+
+		// The resampler converts the item to the format of the playlist if they differ
+		if (FAILED(interopMSS->SetAudioOutputFormat(sampleRate, channels)))
+		{
+			DebugMessage(L"Skipping playlist item which cannot be resampled\n");
+			delete interopMSS;
+			continue;
+		}
+
+		// Opens the decoder and decodes the start of the item, so switching to it doesn't wait on either
+		MediaStreamSample^ firstSample = interopMSS->GetNextAudioSample();
+		if (firstSample == nullptr)
+		{
+			DebugMessage(L"Skipping empty playlist item\n");
+			delete interopMSS;
+			continue;
+		}
+
+		preparedItem.index = i;
+		preparedItem.interopMSS = interopMSS;
+		preparedItem.firstSample = firstSample;
+	}
+
+	return preparedItem;
+}
+
+// Start preparing the item after the current one in the background
+void FFmpegInteropPlaylist::PrepareNextItem()
+{
+	if (currentItem.index >= 0 && currentItem.index + 1 < (int)items.size())
+	{
+		int nextIndex = currentItem.index + 1;
+		nextItemTask = create_task([this, nextIndex]()
+		{
+			return PrepareItem(nextIndex);
+		});
+		isNextItemPending = true;
+	}
+}
+
+void FFmpegInteropPlaylist::OnStarting(MediaStreamSource ^sender, MediaStreamSourceStartingEventArgs ^args)
+{
+	// The playlist can't seek, playback always continues from the last sample
+	MediaStreamSourceStartingRequest^ request = args->Request;
+	if (request->StartPosition)
+	{
+		mutexGuard.lock();
+		request->SetActualStartPosition({ nextSampleTime });
+		mutexGuard.unlock();
+	}
+}
+
+void FFmpegInteropPlaylist::OnSampleRequested(MediaStreamSource ^sender, MediaStreamSourceSampleRequestedEventArgs ^args)
+{
+	args->Request->Sample = GetNextSample();
+}
+
+MediaStreamSample^ FFmpegInteropPlaylist::GetNextSample()
+{
+	mutexGuard.lock();
+	MediaStreamSample^ sample;
+	while (sample == nullptr && currentItem.interopMSS != nullptr)
+	{
+		if (currentItem.firstSample != nullptr)
+		{
+			sample = currentItem.firstSample;
+			currentItem.firstSample = nullptr;
+		}
+		else
+		{
+			sample = currentItem.interopMSS->GetNextAudioSample();
+		}
+
+		if (sample == nullptr)
+		{
+			// End of the item, the next one starts right where its last sample ends
+			itemStartTime = nextSampleTime;
+			delete currentItem.interopMSS;
+			currentItem.interopMSS = nullptr;
+			currentItem.index = -1;
+			if (isNextItemPending)
+			{
+				currentItem = nextItemTask.get();
+				isNextItemPending = false;
+			}
+			PrepareNextItem();
+		}
+	}
+
+	if (sample != nullptr)
+	{
+		// Timestamps of every item start at zero, move them onto the timeline of the playlist
+		sample->Timestamp = { itemStartTime + sample->Timestamp.Duration };
+		nextSampleTime = sample->Timestamp.Duration + sample->Duration.Duration;
+	}
+
+	mutexGuard.unlock();
+	return sample;
+}
@@ -0,0 +1,99 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <mutex>
+#include <vector>
+#include "FFmpegInteropMSS.h"
+
+using namespace Platform;
+using namespace Windows::Foundation::Collections;
+using namespace Windows::Media::Core;
+using namespace Windows::Storage::Streams;
+
+namespace FFmpegInterop
+{
+	// Media of a playlist, either a URI or a stream
+	struct PlaylistItem
+	{
+		String^ uri;
+		IRandomAccessStream^ stream;
+	};
+
+	// A playlist item which is opened and has its first sample decoded, ready to be played
+	struct PreparedPlaylistItem
+	{
+		int index;
+		FFmpegInteropMSS^ interopMSS;
+		MediaStreamSample^ firstSample;
+	};
+
+	// Plays the audio of a list of media back to back through a single MediaStreamSource, without any gap
+	// between the items. While an item plays, the next one is opened and starts decoding in the background.
+	// All the items are resampled to the PCM format of the first one.
+	public ref class FFmpegInteropPlaylist sealed
+	{
+	public:
+		static FFmpegInteropPlaylist^ CreateFromUris(IIterable<String^>^ uris, FFmpegInteropConfig^ config);
+		static FFmpegInteropPlaylist^ CreateFromStreams(IIterable<IRandomAccessStream^>^ streams, FFmpegInteropConfig^ config);
+
+		MediaStreamSource^ GetMediaStreamSource();
+		virtual ~FFmpegInteropPlaylist();
+
+		// Next sample of the playlist as the MediaStreamSource plays it, nullptr once the end is reached
+		MediaStreamSample^ GetNextSample();
+
+		// Index of the item currently playing, -1 once the end of the playlist is reached
+		property int CurrentIndex { int get(); }
+
+		// Whether the item after the current one is opened in the background and ready to play
+		property bool IsNextItemReady { bool get(); }
+		property unsigned int ItemCount
+		{
+			unsigned int get()
+			{
+				return (unsigned int)items.size();
+			};
+		};
+
+	private:
+		FFmpegInteropPlaylist(FFmpegInteropConfig^ playlistConfig);
+
+		HRESULT CreateMediaStreamSource();
+		PreparedPlaylistItem PrepareItem(int startIndex);
+		void PrepareNextItem();
+		void OnStarting(MediaStreamSource ^sender, MediaStreamSourceStartingEventArgs ^args);
+		void OnSampleRequested(MediaStreamSource ^sender, MediaStreamSourceSampleRequestedEventArgs ^args);
+
+		FFmpegInteropConfig^ config;
+		std::vector<PlaylistItem> items;
+		MediaStreamSource^ mss;
+		EventRegistrationToken startingRequestedToken;
+		EventRegistrationToken sampleRequestedToken;
+
+		PreparedPlaylistItem currentItem;
+		concurrency::task<PreparedPlaylistItem> nextItemTask;
+		bool isNextItemPending;
+
+		int sampleRate;
+		int channels;
+		LONGLONG itemStartTime;
+		LONGLONG nextSampleTime;
+		std::mutex mutexGuard;
+	};
+}
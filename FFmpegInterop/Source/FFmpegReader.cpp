@@ -21,11 +21,28 @@
 
 using namespace FFmpegInterop;
 
-FFmpegReader::FFmpegReader(AVFormatContext* avFormatCtx)
+// Seeks back further in trick play before giving up on finding an earlier keyframe without an index
+const int MAXKEYFRAMESEEKS = 8;
+
+FFmpegReader::FFmpegReader(AVFormatContext* avFormatCtx, InterruptHandler* interruptHandler, LONGLONG readTimeout, PipelineCounters* counters)
 	: m_pAvFormatCtx(avFormatCtx)
+	, m_pInterruptHandler(interruptHandler)
+	, m_readTimeout(readTimeout)
 	, m_audioStreamIndex(AVERROR_STREAM_NOT_FOUND)
 	, m_videoStreamIndex(AVERROR_STREAM_NOT_FOUND)
+	, m_pCounters(counters)
+	, m_isIoWaitTimed((avFormatCtx->flags & AVFMT_FLAG_CUSTOM_IO) == 0)
+	, m_seekRequest(-1)
+	, m_seekCount(0)
+	, m_trickPlayDirection(0)
+	, m_trickPlayStep(0)
+	, m_trickPlayStart(0)
+	, m_lastKeyFrame(AV_NOPTS_VALUE)
+	, m_lastVideoTimestamp(AV_NOPTS_VALUE)
+	, m_skipVideoUntil(AV_NOPTS_VALUE)
+	, m_resumeAudioTarget(AV_NOPTS_VALUE)
 {
+	UpdateStreamDiscard();
 }
 
 FFmpegReader::~FFmpegReader()
@@ -42,47 +59,345 @@ int FFmpegReader::ReadPacket()
 	avPacket.data = NULL;
 	avPacket.size = 0;
 
-	ret = av_read_frame(m_pAvFormatCtx, &avPacket);
+	// Only held for the read itself, the caller decodes after releasing it
+	std::lock_guard<std::mutex> lock(m_readMutex);
+	if (m_trickPlayDirection != 0 && m_videoSampleProvider != nullptr)
+	{
+		return ReadKeyFrame();
+	}
+
+	// A read that runs over the timeout fails with AVERROR_EXIT, which ends the stream like any other read error
+	TraceSpan span("read");
+	ret = ReadFrame(&avPacket);
+	span.SetStream(avPacket.stream_index, avPacket.pts);
 	if (ret < 0)
 	{
 		return ret;
 	}
 
+	m_pCounters->packetsDemuxed.Add(1);
+
+	// After ResumeAudioStream the video packets come again up to the last one queued, and the new audio stream
+	// starts a little before the position it resumes at
+	int64_t timestamp = avPacket.dts != AV_NOPTS_VALUE ? avPacket.dts : avPacket.pts;
+	bool isRepeated = false;
+	if (avPacket.stream_index == m_videoStreamIndex && m_skipVideoUntil != AV_NOPTS_VALUE)
+	{
+		isRepeated = timestamp != AV_NOPTS_VALUE && timestamp <= m_skipVideoUntil;
+		if (!isRepeated)
+		{
+			m_skipVideoUntil = AV_NOPTS_VALUE;
+		}
+	}
+	else if (avPacket.stream_index == m_audioStreamIndex && m_resumeAudioTarget != AV_NOPTS_VALUE)
+	{
+		isRepeated = avPacket.pts != AV_NOPTS_VALUE && avPacket.pts + avPacket.duration <= m_resumeAudioTarget;
+		if (!isRepeated)
+		{
+			m_resumeAudioTarget = AV_NOPTS_VALUE;
+		}
+	}
+
 	// Push the packet to the appropriate
-	if (avPacket.stream_index == m_audioStreamIndex && m_audioSampleProvider != nullptr)
+	if (isRepeated)
+	{
+		m_pCounters->packetsDropped.Add(1);
+		m_pCounters->bytesDropped.Add(avPacket.size);
+		av_packet_unref(&avPacket);
+	}
+	else if (avPacket.stream_index == m_audioStreamIndex && m_audioSampleProvider != nullptr)
 	{
 		m_audioSampleProvider->QueuePacket(avPacket);
 	}
 	else if (avPacket.stream_index == m_videoStreamIndex && m_videoSampleProvider != nullptr)
 	{
+		if (timestamp != AV_NOPTS_VALUE)
+		{
+			m_lastVideoTimestamp = timestamp;
+		}
 		m_videoSampleProvider->QueuePacket(avPacket);
 	}
 	else
 	{
+		// Some demuxers can't skip discarded streams so their packets still end up here
 		DebugMessage(L"Ignoring unused stream\n");
+		m_pCounters->packetsDropped.Add(1);
+		m_pCounters->bytesDropped.Add(avPacket.size);
 		av_packet_unref(&avPacket);
 	}
 
 	return ret;
 }
 
+void FFmpegReader::RequestSeek(LONGLONG position)
+{
+	m_seekRequest.store(position);
+	m_seekCount++;
+	m_pInterruptHandler->AbortOperation();
+}
+
+LONGLONG FFmpegReader::TakeSeekRequest()
+{
+	return m_seekRequest.exchange(-1);
+}
+
+int FFmpegReader::ReadFrame(AVPacket* avPacket)
+{
+	int ret;
+	bool isAborted;
+	do
+	{
+		int64 start = GetPipelineTicks();
+		m_pInterruptHandler->StartOperation(m_readTimeout);
+		ret = av_read_frame(m_pAvFormatCtx, avPacket);
+		isAborted = m_pInterruptHandler->EndOperation();
+		RecordIoWait(start);
+	} while (IsStaleAbort(ret, isAborted));
+	return ret;
+}
+
+int FFmpegReader::SeekFrame(int streamIndex, int64_t timestamp, int flags)
+{
+	int ret;
+	bool isAborted;
+	do
+	{
+		int64 start = GetPipelineTicks();
+		m_pInterruptHandler->StartOperation(m_readTimeout);
+		ret = av_seek_frame(m_pAvFormatCtx, streamIndex, timestamp, flags);
+		isAborted = m_pInterruptHandler->EndOperation();
+		RecordIoWait(start);
+	} while (IsStaleAbort(ret, isAborted));
+	return ret;
+}
+
+// The reads of media opened from a URI go through the protocols of FFmpeg, which can't be timed on their own. The
+// whole demuxer call is recorded instead, which includes parsing but is dominated by the network when it blocks.
+// Media opened from a stream records each read of the stream itself.
+void FFmpegReader::RecordIoWait(int64 start)
+{
+	if (m_isIoWaitTimed)
+	{
+		m_pCounters->ioWaitLatency.Record(GetPipelineTicks() - start);
+	}
+}
+
+// RequestSeek records the seek before it aborts the operation in progress. If a sample request takes the seek and
+// starts reading in between, the abort hits that read. With no seek pending any more it is retried.
+bool FFmpegReader::IsStaleAbort(int ret, bool isAborted)
+{
+	if (ret != AVERROR_EXIT || !isAborted || IsSeekPending() || m_pInterruptHandler->IsCancelled())
+	{
+		return false;
+	}
+
+	// The aborted read leaves AVERROR_EXIT on the IO context, which would fail the retry too
+	if (m_pAvFormatCtx->pb != nullptr && m_pAvFormatCtx->pb->error == AVERROR_EXIT)
+	{
+		m_pAvFormatCtx->pb->error = 0;
+	}
+	return true;
+}
+
+int FFmpegReader::Seek(int streamIndex, int64_t seekTarget)
+{
+	// Seeking reads from the stream too, give it the same timeout as a read
+	std::lock_guard<std::mutex> lock(m_readMutex);
+
+	// A read aborted for this seek leaves AVERROR_EXIT on the IO context, which would fail every read after it
+	if (m_pAvFormatCtx->pb != nullptr && m_pAvFormatCtx->pb->error == AVERROR_EXIT)
+	{
+		m_pAvFormatCtx->pb->error = 0;
+	}
+
+	// Trick play seeks to every keyframe it reads anyway, it only needs to know where to start
+	if (m_trickPlayDirection != 0 && m_videoStreamIndex >= 0)
+	{
+		m_trickPlayStart = av_rescale_q(seekTarget, m_pAvFormatCtx->streams[streamIndex]->time_base, m_pAvFormatCtx->streams[m_videoStreamIndex]->time_base);
+		m_lastKeyFrame = AV_NOPTS_VALUE;
+		return 0;
+	}
+
+	int ret = SeekFrame(streamIndex, seekTarget, AVSEEK_FLAG_BACKWARD);
+
+	// Everything queued is flushed, nothing read from here on is a repeat
+	m_lastVideoTimestamp = AV_NOPTS_VALUE;
+	m_skipVideoUntil = AV_NOPTS_VALUE;
+	m_resumeAudioTarget = AV_NOPTS_VALUE;
+	return ret;
+}
+
+int FFmpegReader::ResumeAudioStream(int64_t position)
+{
+	std::lock_guard<std::mutex> lock(m_readMutex);
+	if (m_audioStreamIndex < 0 || m_trickPlayDirection != 0)
+	{
+		return AVERROR_STREAM_NOT_FOUND;
+	}
+
+	int ret = SeekFrame(m_audioStreamIndex, position, AVSEEK_FLAG_BACKWARD);
+	if (ret >= 0)
+	{
+		// The video stream already has its packets up to here, and the last one may still be repeated by an
+		// earlier ResumeAudioStream
+		if (m_skipVideoUntil == AV_NOPTS_VALUE || (m_lastVideoTimestamp != AV_NOPTS_VALUE && m_lastVideoTimestamp > m_skipVideoUntil))
+		{
+			m_skipVideoUntil = m_lastVideoTimestamp;
+		}
+		m_resumeAudioTarget = position;
+	}
+	return ret;
+}
+
+void FFmpegReader::SetTrickPlay(int direction, int64_t step)
+{
+	std::lock_guard<std::mutex> lock(m_readMutex);
+	m_trickPlayDirection = direction;
+	m_trickPlayStep = step;
+	m_lastKeyFrame = AV_NOPTS_VALUE;
+	UpdateStreamDiscard();
+}
+
+// Seek to the next keyframe of the video stream in the trick play direction and queue it, so the data read
+// scales with the number of keyframes shown rather than with the bitrate. Called with the read lock held.
+int FFmpegReader::ReadKeyFrame()
+{
+	AVStream* avStream = m_pAvFormatCtx->streams[m_videoStreamIndex];
+	bool isFirst = m_lastKeyFrame == AV_NOPTS_VALUE;
+	bool isForward = m_trickPlayDirection > 0;
+	int64_t target = isFirst ? m_trickPlayStart : m_lastKeyFrame + m_trickPlayDirection * m_trickPlayStep;
+
+	AVPacket avPacket;
+	av_init_packet(&avPacket);
+	avPacket.data = NULL;
+	avPacket.size = 0;
+
+	for (int seekCount = 0; seekCount < MAXKEYFRAMESEEKS; seekCount++)
+	{
+		if (IsSeekPending())
+		{
+			return AVERROR_EXIT;
+		}
+
+		// The index of the container tells where the keyframe is: going forward the first one at or after the
+		// target, otherwise the last one at or before it. The first one after a seek shows the seek position.
+		int flags = isForward && !isFirst ? 0 : AVSEEK_FLAG_BACKWARD;
+		int index = av_index_search_timestamp(avStream, target, flags);
+		if (index < 0 && isFirst)
+		{
+			index = av_index_search_timestamp(avStream, target, 0);
+		}
+		if (index < 0 && !isForward && avStream->nb_index_entries > 0)
+		{
+			// Nothing before the target, an index built while reading starts at the first keyframe as well
+			return AVERROR_EOF;
+		}
+
+		// Demuxers like Matroska without cues or FLV only index the keyframes read so far. Past the last of them
+		// the keyframe is not known yet, the demuxer seeks to the target itself and reads on as far as it takes.
+		bool isIndexed = index >= 0 && (index < avStream->nb_index_entries - 1 || avStream->index_entries[index].timestamp >= target);
+		int64_t seekTarget = isIndexed ? avStream->index_entries[index].timestamp : target;
+		int ret;
+		{
+			TraceSpan span("seek");
+			ret = SeekFrame(m_videoStreamIndex, seekTarget, flags);
+		}
+		if (ret < 0 && !isForward)
+		{
+			DebugMessage(L"Could not seek back to the previous keyframe\n");
+			return ret;
+		}
+
+		// Demuxers which can't skip the other packets still return them. Going forward past the index, or when
+		// the seek failed, they are read through up to the target and only the end of the stream stops it.
+		bool isFound = false;
+		bool isRetry = false;
+		while (!isFound && !isRetry)
+		{
+			TraceSpan span("read");
+			ret = ReadFrame(&avPacket);
+			span.SetStream(avPacket.stream_index, avPacket.pts);
+			if (ret < 0)
+			{
+				return ret;
+			}
+			m_pCounters->packetsDemuxed.Add(1);
+
+			if (avPacket.stream_index == m_videoStreamIndex && (avPacket.flags & AV_PKT_FLAG_KEY) != 0)
+			{
+				int64_t timestamp = avPacket.dts != AV_NOPTS_VALUE ? avPacket.dts : avPacket.pts;
+				if (isFirst || timestamp == AV_NOPTS_VALUE)
+				{
+					isFound = true;
+				}
+				else if (isForward)
+				{
+					isFound = timestamp > m_lastKeyFrame && (isIndexed || timestamp >= target);
+				}
+				else
+				{
+					// Without an index the seek may land on the keyframe shown last or after it
+					isFound = timestamp < m_lastKeyFrame;
+					isRetry = !isFound;
+				}
+			}
+
+			if (isFound)
+			{
+				int64_t timestamp = avPacket.dts != AV_NOPTS_VALUE ? avPacket.dts : avPacket.pts;
+				if (timestamp != AV_NOPTS_VALUE)
+				{
+					m_lastKeyFrame = timestamp;
+				}
+				m_videoSampleProvider->QueuePacket(avPacket);
+				return 0;
+			}
+
+			m_pCounters->packetsDropped.Add(1);
+			m_pCounters->bytesDropped.Add(avPacket.size);
+			av_packet_unref(&avPacket);
+		}
+
+		// Try again further back
+		target -= m_trickPlayStep;
+	}
+
+	DebugMessage(L"No earlier keyframe found\n");
+	return AVERROR_EOF;
+}
+
 void FFmpegReader::SetAudioStream(int audioStreamIndex, MediaSampleProvider^ audioSampleProvider)
 {
+	std::lock_guard<std::mutex> lock(m_readMutex);
 	m_audioStreamIndex = audioStreamIndex;
 	m_audioSampleProvider = audioSampleProvider;
 	if (audioSampleProvider != nullptr)
 	{
 		audioSampleProvider->SetCurrentStreamIndex(m_audioStreamIndex);
 	}
+	UpdateStreamDiscard();
 }
 
 void FFmpegReader::SetVideoStream(int videoStreamIndex, MediaSampleProvider^ videoSampleProvider)
 {
+	std::lock_guard<std::mutex> lock(m_readMutex);
 	m_videoStreamIndex = videoStreamIndex;
 	m_videoSampleProvider = videoSampleProvider;
 	if (videoSampleProvider != nullptr)
 	{
 		videoSampleProvider->SetCurrentStreamIndex(m_videoStreamIndex);
 	}
+	UpdateStreamDiscard();
 }
 
+// Only demux the selected audio and video streams. Demuxers which support it will
+// skip the data of every other stream instead of reading and allocating packets for it.
+void FFmpegReader::UpdateStreamDiscard()
+{
+	for (unsigned int i = 0; i < m_pAvFormatCtx->nb_streams; i++)
+	{
+		bool isSelected = ((int)i == m_audioStreamIndex && m_audioSampleProvider != nullptr && m_trickPlayDirection == 0)
+			|| ((int)i == m_videoStreamIndex && m_videoSampleProvider != nullptr);
+		m_pAvFormatCtx->streams[i]->discard = !isSelected ? AVDISCARD_ALL : m_trickPlayDirection != 0 ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+	}
+}
@@ -18,7 +18,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <mutex>
 #include "MediaSampleProvider.h"
+#include "InterruptHandler.h"
+#include "PipelineCounters.h"
 
 namespace FFmpegInterop
 {
@@ -32,13 +36,74 @@ namespace FFmpegInterop
 		void SetVideoStream(int videoStreamIndex, MediaSampleProvider^ videoSampleProvider);
 
 	internal:
-		FFmpegReader(AVFormatContext* avFormatCtx);
+		FFmpegReader(AVFormatContext* avFormatCtx, InterruptHandler* interruptHandler, LONGLONG readTimeout, PipelineCounters* counters);
+
+		// Statistics of the media, the sample providers count into them too
+		PipelineCounters* GetCounters() { return m_pCounters; }
+
+		// Ask for the read position to move to position (in TimeSpan units). A read in progress is aborted
+		// and the sample providers give up on requests for the old position, the seek itself is left to the
+		// next sample request. A newer request replaces one which hasn't been taken yet.
+		void RequestSeek(LONGLONG position);
+
+		// Returns the position of the latest seek request and clears it, -1 if there is none
+		LONGLONG TakeSeekRequest();
+		bool IsSeekPending() { return m_seekRequest.load() >= 0; }
+
+		// Number of seeks requested so far, counted after the request is recorded. A sample request which comes
+		// back empty while it changed was abandoned for a seek, even if another request has taken it meanwhile.
+		unsigned int GetSeekCount() { return m_seekCount.load(); }
+
+		// Move the read position to the keyframe at or before seekTarget, in the time base of the stream
+		int Seek(int streamIndex, int64_t seekTarget);
+
+		// Move the read position back to position, in the time base of the audio stream, after switching to an audio
+		// stream which wasn't demuxed so far. The video packets read again up to the last one already queued are
+		// dropped, as are the packets of the new stream which end before position.
+		int ResumeAudioStream(int64_t position);
+
+		// Read only keyframes of the video stream for trick play, direction 1 forward and -1 backward from the
+		// position of the next Seek, 0 to read everything again. Keyframes read follow each other at least step
+		// apart, in the time base of the video stream. Audio isn't read meanwhile.
+		void SetTrickPlay(int direction, int64_t step);
+
+		// av_read_frame and av_seek_frame under the read timeout. RequestSeek aborts them, but when that seek
+		// has been carried out before they started the abort came too late for the operation it was meant for,
+		// so they start over. Anything else reading from the format context goes through these as well, with
+		// the streams locked.
+		int ReadFrame(AVPacket* avPacket);
+		int SeekFrame(int streamIndex, int64_t timestamp, int flags);
 
 	private:
+		void UpdateStreamDiscard();
+		int ReadKeyFrame();
+		bool IsStaleAbort(int ret, bool isAborted);
+		void RecordIoWait(int64 start);
+
 		AVFormatContext* m_pAvFormatCtx;
+		InterruptHandler* m_pInterruptHandler;
+		LONGLONG m_readTimeout;
 		MediaSampleProvider^ m_audioSampleProvider;
 		int m_audioStreamIndex;
 		MediaSampleProvider^ m_videoSampleProvider;
 		int m_videoStreamIndex;
+		PipelineCounters* m_pCounters;
+		bool m_isIoWaitTimed;
+
+		// Audio and video requests both read from the demuxer, one at a time
+		std::mutex m_readMutex;
+		std::atomic<LONGLONG> m_seekRequest;
+		std::atomic<unsigned int> m_seekCount;
+
+		// Trick play state, positions in the time base of the video stream
+		int m_trickPlayDirection;
+		int64_t m_trickPlayStep;
+		int64_t m_trickPlayStart;
+		int64_t m_lastKeyFrame;
+
+		// Read position moved back by ResumeAudioStream, timestamps in the time base of each stream
+		int64_t m_lastVideoTimestamp;
+		int64_t m_skipVideoUntil;
+		int64_t m_resumeAudioTarget;
 	};
 }
@@ -0,0 +1,171 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "FileStreamIO.h"
+#include "shcore.h"
+
+// Read file stream and pass data to FFmpeg. Credit to Philipp Sch http://www.codeproject.com/Tips/489450/Creating-Custom-FFmpeg-IO-Context
+int FFmpegInterop::FileStreamRead(void* ptr, uint8_t* buf, int bufSize)
+{
+	IStream* pStream = reinterpret_cast<IStream*>(ptr);
+	ULONG bytesRead = 0;
+	HRESULT hr = pStream->Read(buf, bufSize, &bytesRead);
+
+	if (FAILED(hr))
+	{
+		return -1;
+	}
+
+	// If we succeed but don't have any bytes, assume end of file
+	if (bytesRead == 0)
+	{
+		return AVERROR_EOF;  // Let FFmpeg know that we have reached eof
+	}
+
+	return bytesRead;
+}
+
+// Seek in file stream. Credit to Philipp Sch http://www.codeproject.com/Tips/489450/Creating-Custom-FFmpeg-IO-Context
+int64_t FFmpegInterop::FileStreamSeek(void* ptr, int64_t pos, int whence)
+{
+	IStream* pStream = reinterpret_cast<IStream*>(ptr);
+	LARGE_INTEGER in;
+	in.QuadPart = pos;
+	ULARGE_INTEGER out = { 0 };
+
+	if (FAILED(pStream->Seek(in, whence, &out)))
+	{
+		return -1;
+	}
+
+	return out.QuadPart; // Return the new position:
+}
+
+int FFmpegInterop::CountedFileStreamRead(void* ptr, uint8_t* buf, int bufSize)
+{
+	CountedFileStream* countedStream = reinterpret_cast<CountedFileStream*>(ptr);
+	if (countedStream->interruptHandler != nullptr && countedStream->interruptHandler->IsInterrupted())
+	{
+		return AVERROR_EXIT;
+	}
+
+	int64 start = GetPipelineTicks();
+	int bytesRead = FileStreamRead(countedStream->stream, buf, bufSize);
+	countedStream->counters->ioWaitLatency.Record(GetPipelineTicks() - start);
+	countedStream->counters->readCalls.Add(1);
+	if (bytesRead > 0)
+	{
+		countedStream->counters->bytesRead.Add(bytesRead);
+	}
+
+	return bytesRead;
+}
+
+int64_t FFmpegInterop::CountedFileStreamSeek(void* ptr, int64_t pos, int whence)
+{
+	CountedFileStream* countedStream = reinterpret_cast<CountedFileStream*>(ptr);
+	return FileStreamSeek(countedStream->stream, pos, whence);
+}
+
+int FFmpegInterop::InterruptibleFileStreamRead(void* ptr, uint8_t* buf, int bufSize)
+{
+	InterruptibleFileStream* interruptibleStream = reinterpret_cast<InterruptibleFileStream*>(ptr);
+	if (interruptibleStream->interruptHandler->IsInterrupted())
+	{
+		return AVERROR_EXIT;
+	}
+
+	return FileStreamRead(interruptibleStream->stream, buf, bufSize);
+}
+
+int64_t FFmpegInterop::InterruptibleFileStreamSeek(void* ptr, int64_t pos, int whence)
+{
+	InterruptibleFileStream* interruptibleStream = reinterpret_cast<InterruptibleFileStream*>(ptr);
+	return FileStreamSeek(interruptibleStream->stream, pos, whence);
+}
+
+// Opaque of the context is the IStream itself unless another one is given
+static HRESULT CreateIOContext(Windows::Storage::Streams::IRandomAccessStream^ stream, int bufferSize, IStream** fileStreamData, void* opaque, int(*readPacket)(void*, uint8_t*, int), int64_t(*seek)(void*, int64_t, int), AVIOContext** avIOCtx)
+{
+	HRESULT hr = S_OK;
+	unsigned char* fileStreamBuffer = nullptr;
+
+	if (!stream)
+	{
+		hr = E_INVALIDARG;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// Convert asynchronous IRandomAccessStream to synchronous IStream. This API requires shcore.h and shcore.lib
+		hr = CreateStreamOverRandomAccessStream(reinterpret_cast<IUnknown*>(stream), IID_PPV_ARGS(fileStreamData));
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		fileStreamBuffer = (unsigned char*)av_malloc(bufferSize);
+		if (fileStreamBuffer == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		*avIOCtx = avio_alloc_context(fileStreamBuffer, bufferSize, 0, opaque != nullptr ? opaque : *fileStreamData, readPacket, 0, seek);
+		if (*avIOCtx == nullptr)
+		{
+			av_free(fileStreamBuffer);
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (FAILED(hr))
+	{
+		FFmpegInterop::FreeFileStreamIOContext(fileStreamData, avIOCtx);
+	}
+
+	return hr;
+}
+
+HRESULT FFmpegInterop::CreateFileStreamIOContext(Windows::Storage::Streams::IRandomAccessStream^ stream, int bufferSize, IStream** fileStreamData, AVIOContext** avIOCtx)
+{
+	return CreateIOContext(stream, bufferSize, fileStreamData, nullptr, FileStreamRead, FileStreamSeek, avIOCtx);
+}
+
+HRESULT FFmpegInterop::CreateFileStreamIOContext(Windows::Storage::Streams::IRandomAccessStream^ stream, int bufferSize, InterruptibleFileStream* fileStream, AVIOContext** avIOCtx)
+{
+	return CreateIOContext(stream, bufferSize, &fileStream->stream, fileStream, InterruptibleFileStreamRead, InterruptibleFileStreamSeek, avIOCtx);
+}
+
+void FFmpegInterop::FreeFileStreamIOContext(IStream** fileStreamData, AVIOContext** avIOCtx)
+{
+	if (*avIOCtx != nullptr)
+	{
+		// The buffer may have been reallocated by FFmpeg, free the current one
+		av_freep(&(*avIOCtx)->buffer);
+		av_freep(avIOCtx);
+	}
+
+	if (*fileStreamData != nullptr)
+	{
+		(*fileStreamData)->Release();
+		*fileStreamData = nullptr;
+	}
+}
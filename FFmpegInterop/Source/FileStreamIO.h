@@ -0,0 +1,72 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <objidl.h>
+#include "PipelineCounters.h"
+#include "InterruptHandler.h"
+
+extern "C"
+{
+#include <libavformat/avio.h>
+}
+
+namespace FFmpegInterop
+{
+	// Size of the buffer when reading a stream
+	const int FILESTREAMBUFFERSZ = 16384;
+
+	// Callbacks of the custom AVIOContext reading from an IStream, opaque is the IStream*
+	int FileStreamRead(void* ptr, uint8_t* buf, int bufSize);
+	int64_t FileStreamSeek(void* ptr, int64_t pos, int whence);
+
+	// IStream read through FileStreamRead, counting the reads into the statistics of a media. A read fails with
+	// AVERROR_EXIT once the interrupt handler of the media interrupts, but one already blocked in IStream::Read
+	// can't be interrupted and only returns when the stream does.
+	struct CountedFileStream
+	{
+		IStream* stream;
+		PipelineCounters* counters;
+		InterruptHandler* interruptHandler;
+	};
+
+	// Callbacks of the custom AVIOContext reading from a CountedFileStream, opaque is the CountedFileStream*
+	int CountedFileStreamRead(void* ptr, uint8_t* buf, int bufSize);
+	int64_t CountedFileStreamSeek(void* ptr, int64_t pos, int whence);
+
+	// IStream read through FileStreamRead, failing with AVERROR_EXIT once the interrupt handler interrupts. Like
+	// CountedFileStream it can't interrupt a read already blocked in IStream::Read.
+	struct InterruptibleFileStream
+	{
+		IStream* stream;
+		InterruptHandler* interruptHandler;
+	};
+
+	// Callbacks of the custom AVIOContext reading from an InterruptibleFileStream, opaque is the InterruptibleFileStream*
+	int InterruptibleFileStreamRead(void* ptr, uint8_t* buf, int bufSize);
+	int64_t InterruptibleFileStreamSeek(void* ptr, int64_t pos, int whence);
+
+	// Set up a custom AVIOContext reading the given stream through a synchronous IStream. This is necessary when
+	// accessing any file outside of app installation directory and appdata folder.
+	HRESULT CreateFileStreamIOContext(Windows::Storage::Streams::IRandomAccessStream^ stream, int bufferSize, IStream** fileStreamData, AVIOContext** avIOCtx);
+
+	// Same through an InterruptibleFileStream owned by the caller, which sets its interruptHandler. Free it with
+	// FreeFileStreamIOContext(&fileStream->stream, avIOCtx).
+	HRESULT CreateFileStreamIOContext(Windows::Storage::Streams::IRandomAccessStream^ stream, int bufferSize, InterruptibleFileStream* fileStream, AVIOContext** avIOCtx);
+	void FreeFileStreamIOContext(IStream** fileStreamData, AVIOContext** avIOCtx);
+}
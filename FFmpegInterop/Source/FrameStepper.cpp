@@ -0,0 +1,444 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "FrameStepper.h"
+#include "ContextPool.h"
+#include <algorithm>
+
+using namespace FFmpegInterop;
+
+static int64_t GetPacketTime(const AVPacket& avPacket)
+{
+	return avPacket.pts != AV_NOPTS_VALUE ? avPacket.pts : avPacket.dts;
+}
+
+static bool IsFrameBefore(const AVFrame* a, const AVFrame* b)
+{
+	return a->pts < b->pts;
+}
+
+static size_t GetFrameSize(const AVFrame* avFrame)
+{
+	size_t size = 0;
+	for (int i = 0; i < AV_NUM_DATA_POINTERS && avFrame->buf[i] != nullptr; i++)
+	{
+		size += avFrame->buf[i]->size;
+	}
+	return size;
+}
+
+FrameStepper::FrameStepper(AVFormatContext* avFormatCtx, FFmpegReader^ reader, int streamIndex, size_t cacheSize)
+	: m_pAvFormatCtx(avFormatCtx)
+	, m_pReader(reader)
+	, m_streamIndex(streamIndex)
+	, m_pAvCodecCtx(nullptr)
+	, m_cacheSize(cacheSize)
+	, m_currentPts(AV_NOPTS_VALUE)
+{
+}
+
+FrameStepper::~FrameStepper()
+{
+	for (auto& gop : m_gops)
+	{
+		FreeGop(gop);
+	}
+	m_gops.clear();
+
+	ContextPool::ReleaseCodecContext(&m_pAvCodecCtx, m_pAvFormatCtx->streams[m_streamIndex]->codecpar);
+}
+
+HRESULT FrameStepper::StepTo(int64_t position, AVFrame** avFrame)
+{
+	DecodedGop* gop = nullptr;
+	HRESULT hr = GetGop(position, &gop);
+	if (hr == S_OK)
+	{
+		// The frame shown at the position is the last one starting at or before it
+		auto frame = std::upper_bound(gop->frames.begin(), gop->frames.end(), position, [](int64_t pts, const AVFrame* avFrame) { return pts < avFrame->pts; });
+		*avFrame = frame != gop->frames.begin() ? *(frame - 1) : gop->frames.front();
+		m_currentPts = (*avFrame)->pts;
+	}
+
+	return hr;
+}
+
+HRESULT FrameStepper::StepForward(AVFrame** avFrame)
+{
+	// Start at the first frame of the video
+	if (m_currentPts == AV_NOPTS_VALUE)
+	{
+		AVStream* avStream = m_pAvFormatCtx->streams[m_streamIndex];
+		return StepTo(avStream->start_time != AV_NOPTS_VALUE ? avStream->start_time : 0, avFrame);
+	}
+
+	DecodedGop* gop = nullptr;
+	HRESULT hr = GetGop(m_currentPts, &gop);
+	while (hr == S_OK)
+	{
+		auto frame = std::upper_bound(gop->frames.begin(), gop->frames.end(), m_currentPts, [](int64_t pts, const AVFrame* avFrame) { return pts < avFrame->pts; });
+		if (frame != gop->frames.end())
+		{
+			*avFrame = *frame;
+			m_currentPts = (*avFrame)->pts;
+			break;
+		}
+
+		// Carry on with the next GOP, unless this was the last one
+		int64_t start = gop->start;
+		int64_t end = gop->end;
+		hr = end != INT64_MAX ? GetGop(end, &gop) : S_FALSE;
+		if (hr == S_OK && gop->start <= start)
+		{
+			DebugMessage(L"Could not get past the end of the GOP\n");
+			hr = S_FALSE;
+		}
+	}
+
+	return hr;
+}
+
+HRESULT FrameStepper::StepBackward(AVFrame** avFrame)
+{
+	if (m_currentPts == AV_NOPTS_VALUE)
+	{
+		return S_FALSE;
+	}
+
+	DecodedGop* gop = nullptr;
+	HRESULT hr = GetGop(m_currentPts, &gop);
+	while (hr == S_OK)
+	{
+		auto frame = std::lower_bound(gop->frames.begin(), gop->frames.end(), m_currentPts, [](const AVFrame* avFrame, int64_t pts) { return avFrame->pts < pts; });
+		if (frame != gop->frames.begin())
+		{
+			*avFrame = *(frame - 1);
+			m_currentPts = (*avFrame)->pts;
+			break;
+		}
+
+		// The previous GOP ends right before this one. Seeking there lands on this GOP again at the start of the video.
+		int64_t start = gop->start;
+		hr = GetGop(start - 1, &gop);
+		if (FAILED(hr) || (hr == S_OK && gop->start >= start))
+		{
+			hr = S_FALSE;
+		}
+	}
+
+	return hr;
+}
+
+// Returns the GOP covering position from the cache, or decodes it
+HRESULT FrameStepper::GetGop(int64_t position, DecodedGop** gop)
+{
+	for (auto it = m_gops.begin(); it != m_gops.end(); ++it)
+	{
+		if (it->start <= position && position < it->end)
+		{
+			m_gops.splice(m_gops.begin(), m_gops, it);
+			*gop = &m_gops.front();
+			return S_OK;
+		}
+	}
+
+	DecodedGop decodedGop = { AV_NOPTS_VALUE, INT64_MAX, std::vector<AVFrame*>(), 0, false };
+	HRESULT hr = DecodeGop(position, &decodedGop);
+	if (SUCCEEDED(hr) && decodedGop.frames.empty())
+	{
+		hr = S_FALSE;
+	}
+
+	if (hr == S_OK)
+	{
+		// A position before the first keyframe ends up at the first GOP, which may be cached already
+		for (auto it = m_gops.begin(); it != m_gops.end(); ++it)
+		{
+			if (it->start == decodedGop.start)
+			{
+				FreeGop(*it);
+				m_gops.erase(it);
+				break;
+			}
+		}
+
+		m_gops.push_front(decodedGop);
+		*gop = &m_gops.front();
+		TrimCache();
+	}
+	else
+	{
+		FreeGop(decodedGop);
+	}
+
+	return hr;
+}
+
+HRESULT FrameStepper::OpenDecoder()
+{
+	HRESULT hr = S_OK;
+	AVCodecParameters* codecpar = m_pAvFormatCtx->streams[m_streamIndex]->codecpar;
+
+	// A decoder left over from playing media of the same format will do
+	m_pAvCodecCtx = ContextPool::AcquireCodecContext(codecpar);
+	if (m_pAvCodecCtx != nullptr)
+	{
+		return hr;
+	}
+
+	AVCodec* avCodec = avcodec_find_decoder(codecpar->codec_id);
+	if (avCodec == nullptr)
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		m_pAvCodecCtx = avcodec_alloc_context3(avCodec);
+		if (m_pAvCodecCtx == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		if (avcodec_parameters_to_context(m_pAvCodecCtx, codecpar) < 0 || avcodec_open2(m_pAvCodecCtx, avCodec, NULL) < 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (FAILED(hr))
+	{
+		avcodec_free_context(&m_pAvCodecCtx);
+	}
+
+	return hr;
+}
+
+// Decode the GOP starting at the keyframe at or before position
+HRESULT FrameStepper::DecodeGop(int64_t position, DecodedGop* gop)
+{
+	HRESULT hr = S_OK;
+	if (m_pAvCodecCtx == nullptr)
+	{
+		hr = OpenDecoder();
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// Only demux the video stream
+		std::vector<AVDiscard> previousDiscard;
+		for (unsigned int i = 0; i < m_pAvFormatCtx->nb_streams; i++)
+		{
+			previousDiscard.push_back(m_pAvFormatCtx->streams[i]->discard);
+			m_pAvFormatCtx->streams[i]->discard = (int)i == m_streamIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+		}
+
+		if (m_pReader->SeekFrame(m_streamIndex, position, AVSEEK_FLAG_BACKWARD) < 0)
+		{
+			DebugMessage(L"Could not seek to the GOP\n");
+			hr = E_FAIL;
+		}
+		avcodec_flush_buffers(m_pAvCodecCtx);
+
+		AVPacket avPacket;
+		av_init_packet(&avPacket);
+		avPacket.data = NULL;
+		avPacket.size = 0;
+
+		bool isDone = false;
+		while (SUCCEEDED(hr) && !isDone)
+		{
+			// The end of the stream ends the last GOP, a timeout or an abort fails the step
+			int ret = m_pReader->ReadFrame(&avPacket);
+			if (ret == AVERROR_EXIT)
+			{
+				DebugMessage(L"Reading the GOP timed out or was aborted\n");
+				hr = E_ABORT;
+			}
+			if (ret < 0)
+			{
+				break;
+			}
+
+			int64_t pts = GetPacketTime(avPacket);
+			if (avPacket.stream_index != m_streamIndex || pts == AV_NOPTS_VALUE)
+			{
+				av_packet_unref(&avPacket);
+				continue;
+			}
+
+			if (gop->start == AV_NOPTS_VALUE)
+			{
+				// Frames before the first keyframe can't be decoded
+				if ((avPacket.flags & AV_PKT_FLAG_KEY) == 0)
+				{
+					av_packet_unref(&avPacket);
+					continue;
+				}
+				gop->start = pts;
+			}
+			else if (gop->end == INT64_MAX && (avPacket.flags & AV_PKT_FLAG_KEY) != 0 && pts > gop->start)
+			{
+				// The next keyframe ends the GOP. It is still decoded, frames shown before it (open GOP) may need it.
+				gop->end = pts;
+			}
+			else if (gop->end != INT64_MAX && pts >= gop->end)
+			{
+				isDone = true;
+			}
+
+			if (!isDone && avcodec_send_packet(m_pAvCodecCtx, &avPacket) >= 0)
+			{
+				ReceiveFrames(gop);
+				isDone = FitGop(position, gop);
+			}
+			av_packet_unref(&avPacket);
+		}
+
+		// Get whatever the decoder still holds, then make it ready for the next GOP
+		avcodec_send_packet(m_pAvCodecCtx, NULL);
+		ReceiveFrames(gop);
+		FitGop(position, gop);
+		avcodec_flush_buffers(m_pAvCodecCtx);
+
+		for (unsigned int i = 0; i < m_pAvFormatCtx->nb_streams; i++)
+		{
+			m_pAvFormatCtx->streams[i]->discard = previousDiscard[i];
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// Frames of the next GOP which were only decoded along the way don't belong to this one
+		std::sort(gop->frames.begin(), gop->frames.end(), IsFrameBefore);
+		while (!gop->frames.empty() && gop->frames.back()->pts >= gop->end)
+		{
+			gop->size -= GetFrameSize(gop->frames.back());
+			av_frame_free(&gop->frames.back());
+			gop->frames.pop_back();
+		}
+
+		// Stepping on from a partial GOP decodes it again for the next position
+		if (gop->isPartial && !gop->frames.empty())
+		{
+			gop->start = (std::max)(gop->start, gop->frames.front()->pts);
+			if (gop->frames.size() > 1)
+			{
+				gop->end = gop->frames[1]->pts;
+			}
+		}
+	}
+
+	return hr;
+}
+
+void FrameStepper::ReceiveFrames(DecodedGop* gop)
+{
+	for (;;)
+	{
+		AVFrame* avFrame = av_frame_alloc();
+		if (avFrame == nullptr || avcodec_receive_frame(m_pAvCodecCtx, avFrame) < 0)
+		{
+			av_frame_free(&avFrame);
+			break;
+		}
+
+		// Frames shown before the keyframe belong to the previous GOP
+		avFrame->pts = avFrame->best_effort_timestamp;
+		if (avFrame->pts == AV_NOPTS_VALUE || avFrame->pts < gop->start)
+		{
+			av_frame_free(&avFrame);
+			continue;
+		}
+		gop->size += GetFrameSize(avFrame);
+		gop->frames.push_back(avFrame);
+	}
+}
+
+// Keep the GOP being decoded within the cache size along with the cached ones. The least recently used GOPs make
+// room first. Once the GOP doesn't fit on its own, only the frame at position and the one after it are kept, which
+// is what stepping to, forward from or back from position takes. Returns true when both of them are there.
+bool FrameStepper::FitGop(int64_t position, DecodedGop* gop)
+{
+	size_t size = gop->size;
+	for (auto& cachedGop : m_gops)
+	{
+		size += cachedGop.size;
+	}
+
+	while (!m_gops.empty() && size > m_cacheSize)
+	{
+		size -= m_gops.back().size;
+		FreeGop(m_gops.back());
+		m_gops.pop_back();
+	}
+
+	if (size <= m_cacheSize && !gop->isPartial)
+	{
+		return false;
+	}
+
+	// The decoder hands out the frames in presentation order
+	gop->isPartial = true;
+	std::vector<AVFrame*>& frames = gop->frames;
+	while (frames.size() > 1 && frames[1]->pts <= position)
+	{
+		gop->size -= GetFrameSize(frames.front());
+		av_frame_free(&frames.front());
+		frames.erase(frames.begin());
+	}
+	while (frames.size() > 2)
+	{
+		gop->size -= GetFrameSize(frames.back());
+		av_frame_free(&frames.back());
+		frames.pop_back();
+	}
+
+	return frames.size() == 2;
+}
+
+// Drop the least recently used GOPs until all of them fit into the cache size, the one in use stays
+void FrameStepper::TrimCache()
+{
+	size_t size = 0;
+	for (auto& gop : m_gops)
+	{
+		size += gop.size;
+	}
+
+	while (m_gops.size() > 1 && size > m_cacheSize)
+	{
+		size -= m_gops.back().size;
+		FreeGop(m_gops.back());
+		m_gops.pop_back();
+	}
+}
+
+void FrameStepper::FreeGop(DecodedGop& gop)
+{
+	for (AVFrame* avFrame : gop.frames)
+	{
+		av_frame_free(&avFrame);
+	}
+	gop.frames.clear();
+	gop.size = 0;
+}
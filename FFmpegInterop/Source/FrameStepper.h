@@ -0,0 +1,100 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <list>
+#include <vector>
+#include "FFmpegReader.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+namespace FFmpegInterop
+{
+	// The decoded frames of one GOP, from its keyframe up to the next one
+	struct DecodedGop
+	{
+		// Presentation times covered, in the time base of the stream. end is INT64_MAX for the last GOP.
+		int64_t start;
+		int64_t end;
+
+		// In presentation order
+		std::vector<AVFrame*> frames;
+
+		// Bytes held by the frames
+		size_t size;
+
+		// The GOP didn't fit into the cache size, only the frame at the position it was decoded for and the one
+		// after it are kept. start and end cover just the first of them.
+		bool isPartial;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	//  FrameStepper
+	//  Description: Steps through the frames of a video stream one at a
+	//               time, in either direction. Frames are decoded a whole
+	//               GOP at a time with a decoder of its own, and the decoded
+	//               GOPs are kept in a cache bounded by memory, least
+	//               recently used GOP evicted first. Stepping back within a
+	//               cached GOP doesn't decode anything. A GOP too large for
+	//               the cache is decoded again up to each frame stepped to.
+	//////////////////////////////////////////////////////////////////////////
+
+	class FrameStepper
+	{
+	public:
+		// cacheSize is the memory kept for decoded GOPs, the one holding the current frame included. The packets are
+		// read through reader, under its read timeout and aborted by its seeks.
+		FrameStepper(AVFormatContext* avFormatCtx, FFmpegReader^ reader, int streamIndex, size_t cacheSize);
+		virtual ~FrameStepper();
+
+		// Each makes the returned frame the current one. The frame belongs to the cache and is only valid until the
+		// next call. Returns S_FALSE and no frame past either end of the video. Positions are in the time base of
+		// the stream, these read from the format context and move its read position.
+		HRESULT StepTo(int64_t position, AVFrame** avFrame);
+		HRESULT StepForward(AVFrame** avFrame);
+		HRESULT StepBackward(AVFrame** avFrame);
+
+		// Presentation time of the current frame in the time base of the stream, AV_NOPTS_VALUE before the first step
+		int64_t GetCurrentPosition() { return m_currentPts; }
+
+	private:
+		FrameStepper(const FrameStepper&);
+		FrameStepper& operator=(const FrameStepper&);
+
+		HRESULT OpenDecoder();
+		HRESULT GetGop(int64_t position, DecodedGop** gop);
+		HRESULT DecodeGop(int64_t position, DecodedGop* gop);
+		void ReceiveFrames(DecodedGop* gop);
+		bool FitGop(int64_t position, DecodedGop* gop);
+		void TrimCache();
+		static void FreeGop(DecodedGop& gop);
+
+		AVFormatContext* m_pAvFormatCtx;
+		FFmpegReader^ m_pReader;
+		int m_streamIndex;
+		AVCodecContext* m_pAvCodecCtx;
+		size_t m_cacheSize;
+
+		// Most recently used first
+		std::list<DecodedGop> m_gops;
+		int64_t m_currentPts;
+	};
+}
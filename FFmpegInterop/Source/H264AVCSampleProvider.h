@@ -27,10 +27,6 @@ namespace FFmpegInterop
 	public:
 		virtual ~H264AVCSampleProvider();
 
-	private:
-		HRESULT WriteNALPacket(DataWriter^ dataWriter, AVPacket* avPacket);
-		HRESULT GetSPSAndPPSBuffer(DataWriter^ dataWriter);
-
 	internal:
 		H264AVCSampleProvider(
 			FFmpegReader^ reader,
@@ -39,7 +39,8 @@ HRESULT H264SampleProvider::WriteAVPacketToStream(DataWriter^ dataWriter, AVPack
 	// On a KeyFrame, write the SPS and PPS
 	if (avPacket->flags & AV_PKT_FLAG_KEY)
 	{
-		hr = GetSPSAndPPSBuffer(dataWriter);
+		DataWriterSampleBuffer buffer(dataWriter);
+		hr = WriteAnnexBParameterSets(buffer, m_pAvCodecCtx);
 	}
 
 	if (SUCCEEDED(hr))
@@ -51,22 +52,3 @@ HRESULT H264SampleProvider::WriteAVPacketToStream(DataWriter^ dataWriter, AVPack
 	// We have a complete frame
 	return hr;
 }
-
-HRESULT H264SampleProvider::GetSPSAndPPSBuffer(DataWriter^ dataWriter)
-{
-	HRESULT hr = S_OK;
-
-	if (m_pAvCodecCtx->extradata == nullptr && m_pAvCodecCtx->extradata_size < 8)
-	{
-		// The data isn't present
-		hr = E_FAIL;
-	}
-	else
-	{
-		// Write both SPS and PPS sequence as is from extradata
-		auto vSPSPPS = ref new Platform::Array<uint8_t>(m_pAvCodecCtx->extradata, m_pAvCodecCtx->extradata_size);
-		dataWriter->WriteBytes(vSPSPPS);
-	}
-
-	return hr;
-}
\ No newline at end of file
@@ -27,9 +27,6 @@ namespace FFmpegInterop
 	public:
 		virtual ~H264SampleProvider();
 
-	private:
-		HRESULT GetSPSAndPPSBuffer(DataWriter^ dataWriter);
-
 	internal:
 		H264SampleProvider(
 			FFmpegReader^ reader,
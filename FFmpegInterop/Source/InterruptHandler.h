@@ -0,0 +1,114 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+
+#include <Windows.h>
+#include <atomic>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+//////////////////////////////////////////////////////////////////////////
+//  InterruptHandler
+//  Description: State behind the interrupt_callback of an AVFormatContext.
+//               Blocking FFmpeg calls return AVERROR_EXIT once the handler
+//               is cancelled, the running operation exceeds its timeout
+//               or it gets aborted.
+//////////////////////////////////////////////////////////////////////////
+
+class InterruptHandler
+{
+public:
+	InterruptHandler()
+		: m_isCancelled(false)
+		, m_deadline(0)
+		, m_operationState(OperationIdle)
+	{
+	}
+
+	// Hook the handler into the given format context, must be done before avformat_open_input
+	void Attach(AVFormatContext* avFormatCtx)
+	{
+		avFormatCtx->interrupt_callback.callback = InterruptHandler::OnInterrupt;
+		avFormatCtx->interrupt_callback.opaque = this;
+	}
+
+	void Cancel()
+	{
+		m_isCancelled = true;
+	}
+
+	bool IsCancelled() const
+	{
+		return m_isCancelled;
+	}
+
+	// Start a blocking operation which must complete within timeout (in 100ns units), 0 means no timeout
+	void StartOperation(LONGLONG timeout)
+	{
+		m_deadline = timeout > 0 ? GetTickCount64() + (ULONGLONG)(timeout / 10000) : 0;
+		m_operationState = OperationRunning;
+	}
+
+	// Returns true if the operation was aborted
+	bool EndOperation()
+	{
+		m_deadline = 0;
+		return m_operationState.exchange(OperationIdle) == OperationAborted;
+	}
+
+	// Make the running operation, if any, return early. Unlike Cancel this doesn't affect later operations.
+	void AbortOperation()
+	{
+		int running = OperationRunning;
+		m_operationState.compare_exchange_strong(running, OperationAborted);
+	}
+
+	// Whether a blocking call should give up now. FFmpeg only asks for its own protocols, custom IO callbacks
+	// have to check this themselves.
+	bool IsInterrupted() const
+	{
+		if (m_isCancelled || m_operationState == OperationAborted)
+		{
+			return true;
+		}
+
+		ULONGLONG deadline = m_deadline;
+		return deadline != 0 && GetTickCount64() > deadline;
+	}
+
+private:
+	static int OnInterrupt(void* ptr)
+	{
+		return reinterpret_cast<InterruptHandler*>(ptr)->IsInterrupted() ? 1 : 0;
+	}
+
+	enum
+	{
+		OperationIdle,
+		OperationRunning,
+		OperationAborted
+	};
+
+	std::atomic<bool> m_isCancelled;
+	std::atomic<ULONGLONG> m_deadline;
+	std::atomic<int> m_operationState;
+};
@@ -0,0 +1,79 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "LatencyDistribution.h"
+#include <math.h>
+
+using namespace FFmpegInterop;
+
+// The histograms are recorded in performance counter ticks
+LatencyDistribution::LatencyDistribution(const LatencyHistogram& histogram)
+	: buckets(LatencyHistogram::BUCKETCOUNT)
+	, count(0)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	timeSpanPerTick = 10000000.0 / frequency.QuadPart;
+
+	for (int i = 0; i < LatencyHistogram::BUCKETCOUNT; i++)
+	{
+		buckets[i] = histogram.GetBucketCount(i);
+		count += buckets[i];
+	}
+
+	maximumTicks = histogram.GetMaximum();
+	maximum = ToTimeSpan(maximumTicks);
+	mean = ToTimeSpan(count > 0 ? histogram.GetSum() / count : 0);
+}
+
+TimeSpan LatencyDistribution::ToTimeSpan(int64 ticks)
+{
+	TimeSpan timeSpan = { (LONGLONG)(ticks * timeSpanPerTick) };
+	return timeSpan;
+}
+
+TimeSpan LatencyDistribution::GetPercentile(double percentile)
+{
+	if (count == 0)
+	{
+		return ToTimeSpan(0);
+	}
+
+	// Nearest rank, reported as the top of the bucket the value falls in
+	double clamped = percentile < 0.0 ? 0.0 : percentile > 100.0 ? 100.0 : percentile;
+	int64 rank = (int64)ceil(clamped / 100.0 * count);
+	if (rank < 1)
+	{
+		rank = 1;
+	}
+
+	int64 seen = 0;
+	for (int i = 0; i < LatencyHistogram::BUCKETCOUNT; i++)
+	{
+		seen += buckets[i];
+		if (seen >= rank)
+		{
+			// The top of the bucket may lie above anything actually recorded
+			int64 upperBound = LatencyHistogram::GetBucketUpperBound(i);
+			return ToTimeSpan(upperBound < maximumTicks ? upperBound : maximumTicks);
+		}
+	}
+
+	return maximum;
+}
@@ -0,0 +1,87 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <vector>
+#include "LatencyHistogram.h"
+
+using namespace Platform;
+using namespace Windows::Foundation;
+
+namespace FFmpegInterop
+{
+	// Latencies measured for every media
+	public enum class LatencyMetric
+	{
+		// Time OnSampleRequested takes to hand out an audio or a video sample, waiting on the lock included
+		AudioSampleRequest,
+		VideoSampleRequest,
+		// Time blocked in each read of the IRandomAccessStream. For media opened from a URI, time of each packet read
+		// and seek of the demuxer, parsing included
+		IoWait,
+		// Time the video decoder takes to output an I, P or B frame, from the first packet sent for it
+		VideoDecodeIFrame,
+		VideoDecodePFrame,
+		VideoDecodeBFrame,
+		// Time from the start of a seek in OnStarting until every played stream has handed out a sample
+		SeekToFirstSample
+	};
+
+	// Snapshot of the distribution of a latency
+	public ref class LatencyDistribution sealed
+	{
+	public:
+		property int64 Count
+		{
+			int64 get()
+			{
+				return count;
+			}
+		}
+		property TimeSpan Mean
+		{
+			TimeSpan get()
+			{
+				return mean;
+			}
+		}
+		property TimeSpan Maximum
+		{
+			TimeSpan get()
+			{
+				return maximum;
+			}
+		}
+
+		// Latency under which percentile (0 to 100) percent of the values fall, within 3%
+		TimeSpan GetPercentile(double percentile);
+
+	internal:
+		LatencyDistribution(const LatencyHistogram& histogram);
+
+	private:
+		TimeSpan ToTimeSpan(int64 ticks);
+
+		std::vector<int64> buckets;
+		int64 count;
+		TimeSpan mean;
+		TimeSpan maximum;
+		int64 maximumTicks;
+		double timeSpanPerTick;
+	};
+}
@@ -0,0 +1,89 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "LatencyHistogram.h"
+
+using namespace FFmpegInterop;
+
+// Values below 2^LINEARBITS get a bucket each, above that each power of two has 2^SUBBUCKETBITS buckets
+const int LINEARBITS = 6;
+const int SUBBUCKETBITS = 5;
+
+// Largest power of two with its own buckets, larger values are counted in the last bucket
+const int MAXBIT = 46;
+
+LatencyHistogram::LatencyHistogram()
+{
+	Reset();
+}
+
+void LatencyHistogram::Reset()
+{
+	for (int i = 0; i < BUCKETCOUNT; i++)
+	{
+		m_buckets[i].store(0, std::memory_order_relaxed);
+	}
+	m_sum.store(0, std::memory_order_relaxed);
+	m_maximum.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::GetBucketIndex(int64_t value)
+{
+	if (value < (1 << LINEARBITS))
+	{
+		return value < 0 ? 0 : (int)value;
+	}
+
+	int highestBit = 0;
+	for (uint64_t rest = (uint64_t)value >> 1; rest != 0; rest >>= 1)
+	{
+		highestBit++;
+	}
+	if (highestBit > MAXBIT)
+	{
+		return BUCKETCOUNT - 1;
+	}
+
+	int subBucket = (int)(value >> (highestBit - SUBBUCKETBITS)) & ((1 << SUBBUCKETBITS) - 1);
+	return (1 << LINEARBITS) + ((highestBit - LINEARBITS) << SUBBUCKETBITS) + subBucket;
+}
+
+int64_t LatencyHistogram::GetBucketUpperBound(int index)
+{
+	if (index < (1 << LINEARBITS))
+	{
+		return index;
+	}
+
+	int highestBit = LINEARBITS + ((index - (1 << LINEARBITS)) >> SUBBUCKETBITS);
+	int64_t subBucket = (index - (1 << LINEARBITS)) & ((1 << SUBBUCKETBITS) - 1);
+	int64_t lowerBound = (((int64_t)1 << SUBBUCKETBITS) + subBucket) << (highestBit - SUBBUCKETBITS);
+	return lowerBound + ((int64_t)1 << (highestBit - SUBBUCKETBITS)) - 1;
+}
+
+void LatencyHistogram::Record(int64_t value)
+{
+	m_buckets[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(value, std::memory_order_relaxed);
+
+	int64_t maximum = m_maximum.load(std::memory_order_relaxed);
+	while (maximum < value && !m_maximum.compare_exchange_weak(maximum, value, std::memory_order_relaxed))
+	{
+	}
+}
@@ -0,0 +1,75 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  LatencyHistogram
+	//  Description: HDR style histogram of latencies. Values below 64 get a
+	//               bucket each, above that every power of two is split in
+	//               32 buckets, so any value is known within 3% whatever
+	//               its magnitude. Recording is lock free with relaxed
+	//               atomics and can stay on during playback. The unit is up
+	//               to the caller.
+	//////////////////////////////////////////////////////////////////////////
+
+	class LatencyHistogram
+	{
+	public:
+		static const int BUCKETCOUNT = 64 + (46 - 6 + 1) * 32;
+
+		LatencyHistogram();
+
+		void Record(int64_t value);
+
+		// Not synchronized with Record, values recorded meanwhile may be kept or lost
+		void Reset();
+
+		uint32_t GetBucketCount(int index) const
+		{
+			return m_buckets[index].load(std::memory_order_relaxed);
+		}
+
+		int64_t GetSum() const
+		{
+			return m_sum.load(std::memory_order_relaxed);
+		}
+
+		int64_t GetMaximum() const
+		{
+			return m_maximum.load(std::memory_order_relaxed);
+		}
+
+		// Highest value which falls in the bucket
+		static int64_t GetBucketUpperBound(int index);
+
+	private:
+		LatencyHistogram(const LatencyHistogram&);
+		LatencyHistogram& operator=(const LatencyHistogram&);
+
+		static int GetBucketIndex(int64_t value);
+
+		std::atomic<uint32_t> m_buckets[BUCKETCOUNT];
+		std::atomic<int64_t> m_sum;
+		std::atomic<int64_t> m_maximum;
+	};
+}
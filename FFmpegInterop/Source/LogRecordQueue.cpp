@@ -0,0 +1,109 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "LogRecordQueue.h"
+#include <string.h>
+
+using namespace FFmpegInterop;
+
+LogRecordQueue::LogRecordQueue(size_t capacity)
+	: m_pushPosition(0)
+	, m_popPosition(0)
+{
+	size_t size = 2;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	m_cells = std::vector<Cell>(size);
+	m_mask = size - 1;
+	for (size_t i = 0; i < size; i++)
+	{
+		m_cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+LogRecord* LogRecordQueue::BeginPush()
+{
+	size_t position = m_pushPosition.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Cell& cell = m_cells[position & m_mask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+		if (difference == 0)
+		{
+			// The cell is free, claim it unless another writer was faster
+			if (m_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				cell.position = position;
+				return &cell.record;
+			}
+		}
+		else if (difference < 0)
+		{
+			// The reader hasn't freed this cell yet, the queue is full
+			return nullptr;
+		}
+		else
+		{
+			position = m_pushPosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void LogRecordQueue::EndPush(LogRecord* record)
+{
+	Cell* cell = reinterpret_cast<Cell*>(reinterpret_cast<char*>(record) - offsetof(Cell, record));
+	cell->sequence.store(cell->position + 1, std::memory_order_release);
+}
+
+bool LogRecordQueue::TryPop(LogRecord* record)
+{
+	size_t position = m_popPosition.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Cell& cell = m_cells[position & m_mask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+		if (difference == 0)
+		{
+			if (m_popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				record->level = cell.record.level;
+				strncpy(record->text, cell.record.text, LOGLINESIZE - 1);
+				record->text[LOGLINESIZE - 1] = '\0';
+
+				// Hand the cell back to the writers for the next round
+				cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (difference < 0)
+		{
+			// Empty, or the oldest record is still being written
+			return false;
+		}
+		else
+		{
+			position = m_popPosition.load(std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,74 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+namespace FFmpegInterop
+{
+	// Longest log line kept, longer ones are cut
+	const int LOGLINESIZE = 512;
+
+	struct LogRecord
+	{
+		int level;
+		char text[LOGLINESIZE];
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	//  LogRecordQueue
+	//  Description: Bounded lock free queue of log records, any thread may
+	//               write and read. Writers reserve a record, format their
+	//               line straight into it and publish it, so nothing is
+	//               copied on their side. Once full, writes fail instead of
+	//               waiting. (Dmitry Vyukov's bounded MPMC queue.)
+	//////////////////////////////////////////////////////////////////////////
+
+	class LogRecordQueue
+	{
+	public:
+		// capacity is rounded up to a power of two
+		LogRecordQueue(size_t capacity);
+
+		// Returns the record to write, or nullptr if the queue is full. Every record returned must be published
+		// with EndPush, records are read in the order they were reserved.
+		LogRecord* BeginPush();
+		void EndPush(LogRecord* record);
+
+		// Copy out the oldest published record, false when there is none
+		bool TryPop(LogRecord* record);
+
+	private:
+		LogRecordQueue(const LogRecordQueue&);
+		LogRecordQueue& operator=(const LogRecordQueue&);
+
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			size_t position;
+			LogRecord record;
+		};
+
+		std::vector<Cell> m_cells;
+		size_t m_mask;
+		std::atomic<size_t> m_pushPosition;
+		std::atomic<size_t> m_popPosition;
+	};
+}
@@ -0,0 +1,122 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include "MediaThumbnailData.h"
+
+using namespace Platform;
+using namespace Windows::Foundation;
+using namespace Windows::Foundation::Collections;
+
+namespace FFmpegInterop
+{
+	public enum class MediaStreamKind
+	{
+		Unknown,
+		Audio,
+		Video,
+		Subtitle,
+		Data,
+		Attachment,
+		AttachedPicture
+	};
+
+	// Description of a stream as stored in the container, fields which don't apply to the stream are zero
+	public value struct MediaStreamMetadata
+	{
+		int Index;
+		MediaStreamKind Kind;
+		String^ CodecName;
+		String^ Language;
+		TimeSpan Duration;
+		int64 BitRate;
+		int Width;
+		int Height;
+		double FrameRate;
+		int SampleRate;
+		int Channels;
+	};
+
+	// Container level information of media, read without opening any decoder
+	public ref class MediaMetadata sealed
+	{
+		String^ _formatName;
+		TimeSpan _duration;
+		int64 _bitRate;
+		IVectorView<MediaStreamMetadata>^ _streams;
+		IMapView<String^, String^>^ _tags;
+		MediaThumbnailData^ _coverArt;
+
+	public:
+		property String^ FormatName
+		{
+			String^ get()
+			{
+				return _formatName;
+			}
+		}
+		property TimeSpan Duration
+		{
+			TimeSpan get()
+			{
+				return _duration;
+			}
+		}
+		property int64 BitRate
+		{
+			int64 get()
+			{
+				return _bitRate;
+			}
+		}
+		property IVectorView<MediaStreamMetadata>^ Streams
+		{
+			IVectorView<MediaStreamMetadata>^ get()
+			{
+				return _streams;
+			}
+		}
+		// Tags of the container such as title, artist or album
+		property IMapView<String^, String^>^ Tags
+		{
+			IMapView<String^, String^>^ get()
+			{
+				return _tags;
+			}
+		}
+		// Attached picture such as album art, nullptr if there is none
+		property MediaThumbnailData^ CoverArt
+		{
+			MediaThumbnailData^ get()
+			{
+				return _coverArt;
+			}
+		}
+
+	internal:
+		MediaMetadata(String^ formatName, TimeSpan duration, int64 bitRate, IVectorView<MediaStreamMetadata>^ streams, IMapView<String^, String^>^ tags, MediaThumbnailData^ coverArt)
+		{
+			this->_formatName = formatName;
+			this->_duration = duration;
+			this->_bitRate = bitRate;
+			this->_streams = streams;
+			this->_tags = tags;
+			this->_coverArt = coverArt;
+		}
+	};
+}
@@ -0,0 +1,455 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "MediaMetadataProbe.h"
+#include "FFmpegInteropMSS.h"
+#include "FileStreamIO.h"
+#include "InterruptHandler.h"
+#include "VideoFrameExtractor.h"
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+using namespace concurrency;
+using namespace FFmpegInterop;
+using namespace Platform;
+using namespace Platform::Collections;
+
+// Threads per core used when probing a list of files, most of their time is spent waiting on the disk
+const unsigned int PROBETHREADSPERCORE = 4;
+
+// Tags and paths are UTF-8 in FFmpeg
+static String^ ConvertString(const char* utf8)
+{
+	int length = MultiByteToWideChar(CP_UTF8, 0, utf8, -1, nullptr, 0);
+	if (length <= 1)
+	{
+		return nullptr;
+	}
+
+	std::vector<wchar_t> buffer(length);
+	MultiByteToWideChar(CP_UTF8, 0, utf8, -1, buffer.data(), length);
+	return ref new String(buffer.data());
+}
+
+static TimeSpan ConvertTime(int64_t timestamp, AVRational timeBase)
+{
+	TimeSpan time = { timestamp != AV_NOPTS_VALUE && timestamp > 0 ? av_rescale_q(timestamp, timeBase, av_make_q(1, 10000000)) : 0 };
+	return time;
+}
+
+// Containers such as MPEG-TS only describe their streams in the packets, those still have to be probed by decoding
+static bool IsStreamInfoMissing(AVFormatContext* avFormatCtx)
+{
+	if (avFormatCtx->ctx_flags & AVFMTCTX_NOHEADER)
+	{
+		return true;
+	}
+
+	for (unsigned int i = 0; i < avFormatCtx->nb_streams; i++)
+	{
+		AVCodecParameters* codecpar = avFormatCtx->streams[i]->codecpar;
+		if (codecpar->codec_id == AV_CODEC_ID_NONE
+			|| (codecpar->codec_type == AVMEDIA_TYPE_VIDEO && (codecpar->width <= 0 || codecpar->height <= 0))
+			|| (codecpar->codec_type == AVMEDIA_TYPE_AUDIO && (codecpar->sample_rate <= 0 || codecpar->channels <= 0)))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+MediaStreamKind FFmpegInterop::GetMediaStreamKind(const AVStream* avStream)
+{
+	switch (avStream->codecpar->codec_type)
+	{
+	case AVMEDIA_TYPE_VIDEO:
+		return (avStream->disposition & AV_DISPOSITION_ATTACHED_PIC) ? MediaStreamKind::AttachedPicture : MediaStreamKind::Video;
+	case AVMEDIA_TYPE_AUDIO:
+		return MediaStreamKind::Audio;
+	case AVMEDIA_TYPE_SUBTITLE:
+		return MediaStreamKind::Subtitle;
+	case AVMEDIA_TYPE_DATA:
+		return MediaStreamKind::Data;
+	case AVMEDIA_TYPE_ATTACHMENT:
+		return MediaStreamKind::Attachment;
+	default:
+		return MediaStreamKind::Unknown;
+	}
+}
+
+static MediaStreamMetadata ReadStreamMetadata(AVStream* avStream)
+{
+	AVCodecParameters* codecpar = avStream->codecpar;
+	MediaStreamMetadata streamMetadata = {};
+	streamMetadata.Index = avStream->index;
+	streamMetadata.CodecName = ConvertString(avcodec_get_name(codecpar->codec_id));
+	streamMetadata.Duration = ConvertTime(avStream->duration, avStream->time_base);
+	streamMetadata.BitRate = codecpar->bit_rate;
+
+	AVDictionaryEntry* languageTag = av_dict_get(avStream->metadata, "language", NULL, 0);
+	if (languageTag != nullptr)
+	{
+		streamMetadata.Language = ConvertString(languageTag->value);
+	}
+
+	streamMetadata.Kind = GetMediaStreamKind(avStream);
+	if (codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+	{
+		streamMetadata.Width = codecpar->width;
+		streamMetadata.Height = codecpar->height;
+		AVRational frameRate = avStream->avg_frame_rate.num > 0 ? avStream->avg_frame_rate : avStream->r_frame_rate;
+		streamMetadata.FrameRate = frameRate.num > 0 && frameRate.den > 0 ? av_q2d(frameRate) : 0.0;
+	}
+	else if (codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+	{
+		streamMetadata.SampleRate = codecpar->sample_rate;
+		streamMetadata.Channels = codecpar->channels;
+	}
+
+	return streamMetadata;
+}
+
+static MediaThumbnailData^ ReadCoverArt(AVStream* avStream)
+{
+	String^ extension = ".jpeg";
+	switch (avStream->codecpar->codec_id)
+	{
+	case AV_CODEC_ID_PNG: extension = ".png"; break;
+	case AV_CODEC_ID_BMP: extension = ".bmp"; break;
+	}
+
+	auto data = ref new Array<uint8_t>(avStream->attached_pic.data, avStream->attached_pic.size);
+	DataWriter^ writer = ref new DataWriter();
+	writer->WriteBytes(data);
+	return ref new MediaThumbnailData(writer->DetachBuffer(), extension, avStream->codecpar->width, avStream->codecpar->height);
+}
+
+static MediaMetadata^ ReadMetadata(AVFormatContext* avFormatCtx)
+{
+	auto streams = ref new Vector<MediaStreamMetadata>();
+	MediaThumbnailData^ coverArt;
+	int64_t bitRate = avFormatCtx->bit_rate;
+	int64_t streamsBitRate = 0;
+	int64_t streamsDuration = 0;
+
+	for (unsigned int i = 0; i < avFormatCtx->nb_streams; i++)
+	{
+		AVStream* avStream = avFormatCtx->streams[i];
+		MediaStreamMetadata streamMetadata = ReadStreamMetadata(avStream);
+		streams->Append(streamMetadata);
+
+		if (streamMetadata.Kind == MediaStreamKind::AttachedPicture && coverArt == nullptr && avStream->attached_pic.size > 0)
+		{
+			coverArt = ReadCoverArt(avStream);
+		}
+		streamsBitRate += streamMetadata.BitRate;
+		streamsDuration = max(streamsDuration, streamMetadata.Duration.Duration);
+	}
+
+	if (bitRate <= 0)
+	{
+		bitRate = streamsBitRate;
+	}
+
+	// The container duration is only filled in by stream probing, fall back to the streams and then to the bitrate
+	TimeSpan duration = ConvertTime(avFormatCtx->duration, av_make_q(1, AV_TIME_BASE));
+	if (duration.Duration == 0)
+	{
+		duration.Duration = streamsDuration;
+	}
+	if (duration.Duration == 0 && bitRate > 0 && avFormatCtx->pb != nullptr)
+	{
+		int64_t fileSize = avio_size(avFormatCtx->pb);
+		if (fileSize > 0)
+		{
+			duration.Duration = av_rescale(fileSize, 8 * 10000000LL, bitRate);
+		}
+	}
+
+	auto tags = ref new Map<String^, String^>();
+	AVDictionaryEntry* tag = nullptr;
+	while ((tag = av_dict_get(avFormatCtx->metadata, "", tag, AV_DICT_IGNORE_SUFFIX)) != nullptr)
+	{
+		String^ key = ConvertString(tag->key);
+		String^ value = ConvertString(tag->value);
+		if (key != nullptr && value != nullptr)
+		{
+			tags->Insert(key, value);
+		}
+	}
+
+	return ref new MediaMetadata(ConvertString(avFormatCtx->iformat->name), duration, bitRate, streams->GetView(), tags->GetView(), coverArt);
+}
+
+// Reads what the caller is after from the opened container
+typedef std::function<HRESULT(AVFormatContext* avFormatCtx, FFmpegInteropConfig^ config, InterruptHandler* interruptHandler)> ContainerReader;
+
+// Open the container within OpenTimeout and hand it to read. The format context is closed whatever happens.
+static HRESULT ProbeFormatContext(AVFormatContext** avFormatCtx, const char* url, FFmpegInteropConfig^ config, InterruptHandler* interruptHandler, const ContainerReader& read)
+{
+	HRESULT hr = S_OK;
+	AVDictionary* avDict = nullptr;
+
+	hr = FFmpegInteropMSS::ParseOptions(config->FFmpegOptions, &avDict);
+
+	if (SUCCEEDED(hr))
+	{
+		interruptHandler->Attach(*avFormatCtx);
+		interruptHandler->StartOperation(config->OpenTimeout.Duration);
+
+		if (avformat_open_input(avFormatCtx, url, NULL, &avDict) < 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr) && IsStreamInfoMissing(*avFormatCtx))
+	{
+		if (avformat_find_stream_info(*avFormatCtx, NULL) < 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+	interruptHandler->EndOperation();
+
+	if (SUCCEEDED(hr))
+	{
+		hr = read(*avFormatCtx, config, interruptHandler);
+	}
+
+	// The interrupt handler goes away with the caller, so does the context using it
+	avformat_close_input(avFormatCtx);
+	av_dict_free(&avDict);
+
+	return hr;
+}
+
+// Decode the keyframe at or before position of the first video stream, reading under ReadTimeout
+static HRESULT ExtractFormatContextFrame(AVFormatContext* avFormatCtx, FFmpegInteropConfig^ config, InterruptHandler* interruptHandler, TimeSpan position, int width, int height, VideoFrameFormat format, MediaThumbnailData^* thumbnailData)
+{
+	HRESULT hr = S_OK;
+	int streamIndex = -1;
+	for (unsigned int i = 0; i < avFormatCtx->nb_streams && streamIndex < 0; i++)
+	{
+		if (GetMediaStreamKind(avFormatCtx->streams[i]) == MediaStreamKind::Video)
+		{
+			streamIndex = i;
+		}
+	}
+
+	if (streamIndex < 0)
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// Convert TimeSpan unit to the time base of the stream
+		AVStream* avStream = avFormatCtx->streams[streamIndex];
+		int64_t seekTarget = av_rescale_q(position.Duration, av_make_q(1, 10000000), avStream->time_base);
+		if (avStream->start_time != AV_NOPTS_VALUE)
+		{
+			seekTarget += avStream->start_time;
+		}
+
+		// A reader without sample providers, only there for the read timeout of its seeks and reads
+		PipelineCounters counters;
+		FFmpegReader^ reader = ref new FFmpegReader(avFormatCtx, interruptHandler, config->ReadTimeout.Duration, &counters);
+		hr = VideoFrameExtractor::ExtractFrame(avFormatCtx, reader, streamIndex, seekTarget, width, height, format, thumbnailData);
+		delete reader;
+	}
+
+	return hr;
+}
+
+static HRESULT ProbeStreamContainer(IRandomAccessStream^ stream, FFmpegInteropConfig^ config, const ContainerReader& read)
+{
+	HRESULT hr = S_OK;
+	InterruptHandler interruptHandler;
+	AVIOContext* avIOCtx = nullptr;
+	AVFormatContext* avFormatCtx = nullptr;
+
+	// FFmpeg doesn't check the interrupt handler on custom IO, the reads of the stream check it themselves so
+	// OpenTimeout covers them as well
+	InterruptibleFileStream fileStream = { nullptr, &interruptHandler };
+	hr = CreateFileStreamIOContext(stream, FILESTREAMBUFFERSZ, &fileStream, &avIOCtx);
+
+	if (SUCCEEDED(hr))
+	{
+		avFormatCtx = avformat_alloc_context();
+		if (avFormatCtx == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		avFormatCtx->pb = avIOCtx;
+		avFormatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+		hr = ProbeFormatContext(&avFormatCtx, "", config != nullptr ? config : ref new FFmpegInteropConfig(), &interruptHandler, read);
+	}
+
+	FreeFileStreamIOContext(&fileStream.stream, &avIOCtx);
+
+	return hr;
+}
+
+static HRESULT ProbeUriContainer(String^ uri, FFmpegInteropConfig^ config, const ContainerReader& read)
+{
+	HRESULT hr = S_OK;
+	InterruptHandler interruptHandler;
+	AVFormatContext* avFormatCtx = nullptr;
+
+	if (!uri)
+	{
+		hr = E_INVALIDARG;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		avFormatCtx = avformat_alloc_context();
+		if (avFormatCtx == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		std::vector<char> url(WideCharToMultiByte(CP_UTF8, 0, uri->Data(), -1, nullptr, 0, nullptr, nullptr) + 1);
+		WideCharToMultiByte(CP_UTF8, 0, uri->Data(), -1, url.data(), (int)url.size(), nullptr, nullptr);
+		hr = ProbeFormatContext(&avFormatCtx, url.data(), config != nullptr ? config : ref new FFmpegInteropConfig(), &interruptHandler, read);
+	}
+
+	return hr;
+}
+
+MediaMetadata^ MediaMetadataProbe::ProbeStream(IRandomAccessStream^ stream, FFmpegInteropConfig^ config)
+{
+	MediaMetadata^ metadata;
+	HRESULT hr = ProbeStreamContainer(stream, config, [&metadata](AVFormatContext* avFormatCtx, FFmpegInteropConfig^, InterruptHandler*)
+	{
+		metadata = ReadMetadata(avFormatCtx);
+		return S_OK;
+	});
+
+	return SUCCEEDED(hr) ? metadata : nullptr;
+}
+
+MediaMetadata^ MediaMetadataProbe::ProbeUri(String^ uri, FFmpegInteropConfig^ config)
+{
+	MediaMetadata^ metadata;
+	HRESULT hr = ProbeUriContainer(uri, config, [&metadata](AVFormatContext* avFormatCtx, FFmpegInteropConfig^, InterruptHandler*)
+	{
+		metadata = ReadMetadata(avFormatCtx);
+		return S_OK;
+	});
+
+	return SUCCEEDED(hr) ? metadata : nullptr;
+}
+
+MediaThumbnailData^ MediaMetadataProbe::ExtractVideoFrameFromStream(IRandomAccessStream^ stream, TimeSpan position, int width, int height, VideoFrameFormat format, FFmpegInteropConfig^ config)
+{
+	MediaThumbnailData^ thumbnailData;
+	HRESULT hr = ProbeStreamContainer(stream, config, [&](AVFormatContext* avFormatCtx, FFmpegInteropConfig^ openConfig, InterruptHandler* interruptHandler)
+	{
+		return ExtractFormatContextFrame(avFormatCtx, openConfig, interruptHandler, position, width, height, format, &thumbnailData);
+	});
+
+	return SUCCEEDED(hr) ? thumbnailData : nullptr;
+}
+
+MediaThumbnailData^ MediaMetadataProbe::ExtractVideoFrameFromUri(String^ uri, TimeSpan position, int width, int height, VideoFrameFormat format, FFmpegInteropConfig^ config)
+{
+	MediaThumbnailData^ thumbnailData;
+	HRESULT hr = ProbeUriContainer(uri, config, [&](AVFormatContext* avFormatCtx, FFmpegInteropConfig^ openConfig, InterruptHandler* interruptHandler)
+	{
+		return ExtractFormatContextFrame(avFormatCtx, openConfig, interruptHandler, position, width, height, format, &thumbnailData);
+	});
+
+	return SUCCEEDED(hr) ? thumbnailData : nullptr;
+}
+
+IAsyncOperation<IVectorView<MediaMetadata^>^>^ MediaMetadataProbe::ProbeFilesAsync(IIterable<IStorageFile^>^ files, unsigned int maxConcurrency, TimeSpan timeout)
+{
+	// Take a copy, the caller may change the collection while the scan runs
+	std::vector<IStorageFile^> fileList;
+	if (files != nullptr)
+	{
+		for (IStorageFile^ file : files)
+		{
+			fileList.push_back(file);
+		}
+	}
+
+	if (maxConcurrency == 0)
+	{
+		maxConcurrency = max(1u, std::thread::hardware_concurrency()) * PROBETHREADSPERCORE;
+	}
+
+	return create_async([fileList, maxConcurrency, timeout](cancellation_token ct)
+	{
+		auto config = ref new FFmpegInteropConfig();
+		config->OpenTimeout = timeout;
+
+		std::vector<MediaMetadata^> results(fileList.size());
+		std::atomic<size_t> nextFile(0);
+
+		// Every thread takes the next file to probe until the list is done, so a slow file holds up only one of them
+		std::vector<task<void>> probes;
+		unsigned int threadCount = min(maxConcurrency, (unsigned int)fileList.size());
+		for (unsigned int i = 0; i < threadCount; i++)
+		{
+			probes.push_back(create_task([&]()
+			{
+				for (size_t index = nextFile++; index < fileList.size() && !ct.is_canceled(); index = nextFile++)
+				{
+					try
+					{
+						IRandomAccessStream^ stream = create_task(fileList[index]->OpenReadAsync()).get();
+						results[index] = ProbeStream(stream, config);
+						delete stream;
+					}
+					catch (Exception^)
+					{
+						DebugMessage(L"Could not open a file to probe\n");
+					}
+				}
+			}));
+		}
+		when_all(probes.begin(), probes.end()).wait();
+
+		if (ct.is_canceled())
+		{
+			cancel_current_task();
+		}
+
+		auto metadata = ref new Vector<MediaMetadata^>(results.begin(), results.end());
+		return metadata->GetView();
+	});
+}
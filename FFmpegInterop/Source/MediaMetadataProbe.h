@@ -0,0 +1,64 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include "MediaMetadata.h"
+#include "FFmpegInteropConfig.h"
+#include "MediaThumbnailData.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+using namespace Platform;
+using namespace Windows::Foundation;
+using namespace Windows::Foundation::Collections;
+using namespace Windows::Storage;
+using namespace Windows::Storage::Streams;
+
+namespace FFmpegInterop
+{
+	// Reads the metadata of media, or a single video frame, without creating an FFmpegInteropMSS. Only the container
+	// is opened and no sample provider is set up. Probing reads nothing past the header, unless the container doesn't
+	// describe its streams up front.
+	public ref class MediaMetadataProbe sealed
+	{
+	public:
+		// Return nullptr if the media can't be opened. Only FFmpegOptions and OpenTimeout of the config are used.
+		static MediaMetadata^ ProbeStream(IRandomAccessStream^ stream, FFmpegInteropConfig^ config);
+		static MediaMetadata^ ProbeUri(String^ uri, FFmpegInteropConfig^ config);
+
+		// Decode the keyframe at or before the position of the first video stream, like FFmpegInteropMSS::ExtractVideoFrame.
+		// Return nullptr if the media can't be opened, has no video or the frame can't be read within ReadTimeout.
+		// Only FFmpegOptions, OpenTimeout and ReadTimeout of the config are used.
+		static MediaThumbnailData^ ExtractVideoFrameFromStream(IRandomAccessStream^ stream, TimeSpan position, int width, int height, VideoFrameFormat format, FFmpegInteropConfig^ config);
+		static MediaThumbnailData^ ExtractVideoFrameFromUri(String^ uri, TimeSpan position, int width, int height, VideoFrameFormat format, FFmpegInteropConfig^ config);
+
+		// Probe a list of files on at most maxConcurrency threads, 0 picks a number suited to I/O bound work. Each file
+		// gets timeout to complete, zero waits forever. The results are in the order of the files, with nullptr for the
+		// ones which failed or timed out. The timeout starts once the file is open and is checked between reads, so
+		// opening the file and a single read blocked in the file system are not bounded by it.
+		static IAsyncOperation<IVectorView<MediaMetadata^>^>^ ProbeFilesAsync(IIterable<IStorageFile^>^ files, unsigned int maxConcurrency, TimeSpan timeout);
+
+	private:
+		MediaMetadataProbe() {}
+	};
+
+	MediaStreamKind GetMediaStreamKind(const AVStream* avStream);
+}
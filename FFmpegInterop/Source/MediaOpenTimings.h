@@ -0,0 +1,90 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+using namespace Platform;
+using namespace Windows::Foundation;
+
+namespace FFmpegInterop
+{
+	// Time spent in each phase of opening the media. The decoders are set up when playback first starts,
+	// so DecoderSetup stays zero until then.
+	public ref class MediaOpenTimings sealed
+	{
+	public:
+		property TimeSpan OpenInput
+		{
+			TimeSpan get()
+			{
+				return openInput;
+			}
+		}
+		property TimeSpan FindStreamInfo
+		{
+			TimeSpan get()
+			{
+				return findStreamInfo;
+			}
+		}
+		property TimeSpan StreamSetup
+		{
+			TimeSpan get()
+			{
+				return streamSetup;
+			}
+		}
+		property TimeSpan MediaStreamSourceSetup
+		{
+			TimeSpan get()
+			{
+				return mediaStreamSourceSetup;
+			}
+		}
+		property TimeSpan DecoderSetup
+		{
+			TimeSpan get()
+			{
+				return decoderSetup;
+			}
+		}
+		property TimeSpan Total
+		{
+			TimeSpan get()
+			{
+				TimeSpan total = { openInput.Duration + findStreamInfo.Duration + streamSetup.Duration + mediaStreamSourceSetup.Duration + decoderSetup.Duration };
+				return total;
+			}
+		}
+
+	internal:
+		MediaOpenTimings()
+		{
+			openInput.Duration = 0;
+			findStreamInfo.Duration = 0;
+			streamSetup.Duration = 0;
+			mediaStreamSourceSetup.Duration = 0;
+			decoderSetup.Duration = 0;
+		}
+
+		TimeSpan openInput;
+		TimeSpan findStreamInfo;
+		TimeSpan streamSetup;
+		TimeSpan mediaStreamSourceSetup;
+		TimeSpan decoderSetup;
+	};
+}
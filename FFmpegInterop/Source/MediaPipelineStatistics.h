@@ -0,0 +1,231 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include "PipelineCounters.h"
+
+using namespace Platform;
+using namespace Windows::Foundation;
+
+namespace FFmpegInterop
+{
+	// Snapshot of the counters of the audio or the video streams of a media
+	public ref class MediaStreamStatistics sealed
+	{
+	public:
+		// Packets demuxed for the stream and not yet decoded or sent on
+		property int64 QueuedPackets
+		{
+			int64 get()
+			{
+				return queuedPackets;
+			}
+		}
+		property int64 QueuedBytes
+		{
+			int64 get()
+			{
+				return queuedBytes;
+			}
+		}
+		// Highest number of packets ever queued at once
+		property int64 MaxQueuedPackets
+		{
+			int64 get()
+			{
+				return maxQueuedPackets;
+			}
+		}
+		property int64 Samples
+		{
+			int64 get()
+			{
+				return samples;
+			}
+		}
+		// Bytes written to the buffers of the samples
+		property int64 BytesCopied
+		{
+			int64 get()
+			{
+				return bytesCopied;
+			}
+		}
+		// Time spent in the decoder, zero for streams which are passed through
+		property TimeSpan DecodeTime
+		{
+			TimeSpan get()
+			{
+				return decodeTime;
+			}
+		}
+		// Time spent converting decoded frames with sws_scale or swr_convert
+		property TimeSpan ConvertTime
+		{
+			TimeSpan get()
+			{
+				return convertTime;
+			}
+		}
+		property int64 SkippedPackets
+		{
+			int64 get()
+			{
+				return skippedPackets;
+			}
+		}
+		// Streams which stopped delivering samples after too many broken packets or a failed decoder setup
+		property int DisabledStreams
+		{
+			int get()
+			{
+				return disabledStreams;
+			}
+		}
+
+	internal:
+		MediaStreamStatistics(const StreamCounters& counters, LONGLONG frequency)
+		{
+			queuedPackets = counters.queuedPackets.Get();
+			queuedBytes = counters.queuedBytes.Get();
+			maxQueuedPackets = counters.maxQueuedPackets.Get();
+			samples = counters.samples.Get();
+			bytesCopied = counters.bytesCopied.Get();
+			decodeTime.Duration = (LONGLONG)(counters.decodeTicks.Get() * 10000000.0 / frequency);
+			convertTime.Duration = (LONGLONG)(counters.convertTicks.Get() * 10000000.0 / frequency);
+			skippedPackets = counters.skippedPackets.Get();
+			disabledStreams = (int)counters.disabledStreams.Get();
+		}
+
+	private:
+		int64 queuedPackets;
+		int64 queuedBytes;
+		int64 maxQueuedPackets;
+		int64 samples;
+		int64 bytesCopied;
+		TimeSpan decodeTime;
+		TimeSpan convertTime;
+		int64 skippedPackets;
+		int disabledStreams;
+	};
+
+	// Snapshot of the counters of every stage of a media, from reading the stream to handing out samples.
+	// The counters are always on, taking a snapshot doesn't wait on playback.
+	public ref class MediaPipelineStatistics sealed
+	{
+	public:
+		// Bytes and calls of the reads from the IRandomAccessStream. Media opened from a URI is read by FFmpeg
+		// itself and leaves both at zero.
+		property int64 BytesRead
+		{
+			int64 get()
+			{
+				return bytesRead;
+			}
+		}
+		property int64 ReadCalls
+		{
+			int64 get()
+			{
+				return readCalls;
+			}
+		}
+		property int64 PacketsDemuxed
+		{
+			int64 get()
+			{
+				return packetsDemuxed;
+			}
+		}
+		// Packets the reader got from the demuxer and threw away: packets of streams which aren't played that the
+		// demuxer could not skip by itself, non-keyframes in trick play and packets read again after an audio stream
+		// switch. Packets the demuxer skips because of their discard setting never reach the reader and aren't
+		// counted, so this isn't the total of what the media holds for the unplayed streams.
+		property int64 PacketsDropped
+		{
+			int64 get()
+			{
+				return packetsDropped;
+			}
+		}
+		property int64 BytesDropped
+		{
+			int64 get()
+			{
+				return bytesDropped;
+			}
+		}
+		// Seeks carried out, and how many of them only skipped packets which were already queued
+		property int64 Seeks
+		{
+			int64 get()
+			{
+				return seeks;
+			}
+		}
+		property int64 BufferedSeeks
+		{
+			int64 get()
+			{
+				return bufferedSeeks;
+			}
+		}
+		property MediaStreamStatistics^ Audio
+		{
+			MediaStreamStatistics^ get()
+			{
+				return audio;
+			}
+		}
+		property MediaStreamStatistics^ Video
+		{
+			MediaStreamStatistics^ get()
+			{
+				return video;
+			}
+		}
+
+	internal:
+		MediaPipelineStatistics(const PipelineCounters& counters)
+		{
+			LARGE_INTEGER frequency;
+			QueryPerformanceFrequency(&frequency);
+
+			bytesRead = counters.bytesRead.Get();
+			readCalls = counters.readCalls.Get();
+			packetsDemuxed = counters.packetsDemuxed.Get();
+			packetsDropped = counters.packetsDropped.Get();
+			bytesDropped = counters.bytesDropped.Get();
+			seeks = counters.seeks.Get();
+			bufferedSeeks = counters.bufferedSeeks.Get();
+			audio = ref new MediaStreamStatistics(counters.audio, frequency.QuadPart);
+			video = ref new MediaStreamStatistics(counters.video, frequency.QuadPart);
+		}
+
+	private:
+		int64 bytesRead;
+		int64 readCalls;
+		int64 packetsDemuxed;
+		int64 packetsDropped;
+		int64 bytesDropped;
+		int64 seeks;
+		int64 bufferedSeeks;
+		MediaStreamStatistics^ audio;
+		MediaStreamStatistics^ video;
+	};
+}
@@ -0,0 +1,62 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+using namespace Platform;
+
+namespace FFmpegInterop
+{
+	// Description of a program from a multi-program stream, such as a DVB service in an MPEG-TS mux
+	public ref class MediaProgramInfo sealed
+	{
+		int _id;
+		String^ _name;
+		unsigned int _streamCount;
+
+	public:
+		property int Id
+		{
+			int get()
+			{
+				return _id;
+			}
+		}
+		property String^ Name
+		{
+			String^ get()
+			{
+				return _name;
+			}
+		}
+		property unsigned int StreamCount
+		{
+			unsigned int get()
+			{
+				return _streamCount;
+			}
+		}
+
+	internal:
+		MediaProgramInfo(int id, String^ name, unsigned int streamCount)
+		{
+			this->_id = id;
+			this->_name = name;
+			this->_streamCount = streamCount;
+		}
+	};
+}
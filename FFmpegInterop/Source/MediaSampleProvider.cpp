@@ -34,7 +34,10 @@ MediaSampleProvider::MediaSampleProvider(
 	, m_startOffset(AV_NOPTS_VALUE)
 	, m_nextFramePts(0)
 	, m_isEnabled(true)
+	, m_isAllocated(false)
 	, m_isDiscontinuous(false)
+	// Every audio stream of the media counts into the same statistics
+	, m_pCounters(avCodecCtx != nullptr && avCodecCtx->codec_type == AVMEDIA_TYPE_VIDEO ? &reader->GetCounters()->video : &reader->GetCounters()->audio)
 {
 	DebugMessage(L"MediaSampleProvider\n");
 }
@@ -42,11 +45,22 @@ MediaSampleProvider::MediaSampleProvider(
 HRESULT MediaSampleProvider::AllocateResources()
 {
 	DebugMessage(L"AllocateResources\n");
-	m_startOffset = AV_NOPTS_VALUE;
-	m_nextFramePts = 0;
 	return S_OK;
 }
 
+// Resources such as the decoder are only allocated when the first sample is requested,
+// so streams which are never played don't cost anything
+HRESULT MediaSampleProvider::EnsureResourcesAllocated()
+{
+	HRESULT hr = S_OK;
+	if (!m_isAllocated)
+	{
+		hr = AllocateResources();
+		m_isAllocated = SUCCEEDED(hr);
+	}
+	return hr;
+}
+
 MediaSampleProvider::~MediaSampleProvider()
 {
 	DebugMessage(L"~MediaSampleProvider\n");
@@ -70,8 +84,15 @@ MediaStreamSample^ MediaSampleProvider::GetNextSample()
 	DebugMessage(L"GetNextSample\n");
 
 	HRESULT hr = S_OK;
+	TraceSpan span("sample", m_streamIndex);
 
 	MediaStreamSample^ sample;
+	if (m_isEnabled && FAILED(EnsureResourcesAllocated()))
+	{
+		DebugMessage(L"Failed to allocate resources - disable stream\n");
+		DisableStream();
+	}
+
 	if (m_isEnabled)
 	{
 		DataWriter^ dataWriter = ref new DataWriter();
@@ -83,10 +104,23 @@ MediaStreamSample^ MediaSampleProvider::GetNextSample()
 
 		if (hr == S_OK)
 		{
+			m_pCounters->samples.Add(1);
+			m_pCounters->bytesCopied.Add(dataWriter->UnstoredBufferLength);
 			sample = MediaStreamSample::CreateFromBuffer(dataWriter->DetachBuffer(), { pts });
 			sample->Duration = { dur };
 			sample->Discontinuous = m_isDiscontinuous;
 			m_isDiscontinuous = false;
+			span.SetStream(m_streamIndex, pts);
+		}
+		else if (hr == E_ABORT)
+		{
+			// A newer seek made this request pointless, the caller asks again from the new position
+			DebugMessage(L"Sample request abandoned for a seek\n");
+		}
+		else if (hr == HRESULT_FROM_WIN32(ERROR_HANDLE_EOF))
+		{
+			// Trick play runs into either end of the video, a seek back plays the stream again
+			DebugMessage(L"End of stream\n");
 		}
 		else
 		{
@@ -133,9 +167,14 @@ void MediaSampleProvider::QueuePacket(AVPacket packet)
 {
 	DebugMessage(L" - QueuePacket\n");
 
+	std::lock_guard<std::mutex> lock(m_queueMutex);
 	if (m_isEnabled)
 	{
 		m_packetQueue.push_back(packet);
+		m_pCounters->queuedPackets.Add(1);
+		m_pCounters->queuedBytes.Add(packet.size);
+		m_pCounters->maxQueuedPackets.RaiseTo((int64)m_packetQueue.size());
+		PipelineTrace::AddCounter("queued packets", m_streamIndex, (int64)m_packetQueue.size());
 	}
 	else
 	{
@@ -143,22 +182,84 @@ void MediaSampleProvider::QueuePacket(AVPacket packet)
 	}
 }
 
-AVPacket MediaSampleProvider::PopPacket()
+// Returns false if the queue is empty
+bool MediaSampleProvider::PopPacket(AVPacket* avPacket)
 {
 	DebugMessage(L" - PopPacket\n");
 
-	AVPacket avPacket;
-	av_init_packet(&avPacket);
-	avPacket.data = NULL;
-	avPacket.size = 0;
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	if (m_packetQueue.empty())
+	{
+		return false;
+	}
+
+	*avPacket = m_packetQueue.front();
+	m_packetQueue.erase(m_packetQueue.begin());
+	m_pCounters->queuedPackets.Add(-1);
+	m_pCounters->queuedBytes.Add(-avPacket->size);
+	PipelineTrace::AddCounter("queued packets", m_streamIndex, (int64)m_packetQueue.size());
+	return true;
+}
+
+void MediaSampleProvider::RequeuePackets(std::vector<AVPacket>& packets)
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		if (m_isEnabled)
+		{
+			m_pCounters->queuedPackets.Add(1);
+			m_pCounters->queuedBytes.Add(packets[i].size);
+		}
+		else
+		{
+			av_packet_unref(&packets[i]);
+		}
+	}
+	if (m_isEnabled)
+	{
+		m_packetQueue.insert(m_packetQueue.begin(), packets.begin(), packets.end());
+		m_pCounters->maxQueuedPackets.RaiseTo((int64)m_packetQueue.size());
+		PipelineTrace::AddCounter("queued packets", m_streamIndex, (int64)m_packetQueue.size());
+	}
+	packets.clear();
+}
 
-	if (!m_packetQueue.empty())
+int MediaSampleProvider::FindQueuedKeyFrame(int64_t position)
+{
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	int keyFrame = -1;
+	bool isCovered = false;
+	for (size_t i = 0; i < m_packetQueue.size(); i++)
 	{
-		avPacket = m_packetQueue.front();
-		m_packetQueue.erase(m_packetQueue.begin());
+		const AVPacket& packet = m_packetQueue[i];
+		int64_t pts = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+		if (pts == AV_NOPTS_VALUE)
+		{
+			continue;
+		}
+
+		if (pts <= position && (packet.flags & AV_PKT_FLAG_KEY) != 0)
+		{
+			keyFrame = (int)i;
+		}
+		if (pts >= position)
+		{
+			isCovered = true;
+		}
 	}
 
-	return avPacket;
+	return isCovered ? keyFrame : -1;
+}
+
+void MediaSampleProvider::DropQueuedPackets(int count)
+{
+	AVPacket avPacket;
+	for (int i = 0; i < count && PopPacket(&avPacket); i++)
+	{
+		av_packet_unref(&avPacket);
+	}
+	m_isDiscontinuous = true;
 }
 
 HRESULT FFmpegInterop::MediaSampleProvider::GetNextPacket(DataWriter ^ writer, LONGLONG & pts, LONGLONG & dur, bool allowSkip)
@@ -177,21 +278,37 @@ HRESULT FFmpegInterop::MediaSampleProvider::GetNextPacket(DataWriter ^ writer, L
 
 	while (SUCCEEDED(hr) && !frameComplete)
 	{
-		// Continue reading until there is an appropriate packet in the stream
-		while (m_packetQueue.empty())
+		// Whatever is queued or decoded belongs to the old position once a seek comes in
+		if (m_pReader->IsSeekPending())
 		{
-			if (m_pReader->ReadPacket() < 0)
+			hr = E_ABORT;
+			break;
+		}
+
+		// Continue reading until there is an appropriate packet in the stream. The other stream
+		// may be reading at the same time and queue our packets, so look at the queue before every read.
+		bool hasPacket;
+		while (!(hasPacket = PopPacket(&avPacket)))
+		{
+			int readResult = m_pReader->ReadPacket();
+			if (readResult < 0)
 			{
+				// A read aborted for a seek isn't the end of the stream
+				if (m_pReader->IsSeekPending())
+				{
+					hr = E_ABORT;
+					break;
+				}
+
 				DebugMessage(L"GetNextSample reaching EOF\n");
-				hr = E_FAIL;
+				hr = readResult == AVERROR_EOF ? HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) : E_FAIL;
 				break;
 			}
 		}
 
-		if (!m_packetQueue.empty())
+		if (hasPacket)
 		{
 			// Pick the packets from the queue one at a time
-			avPacket = PopPacket();
 			framePts = avPacket.pts;
 			frameDuration = avPacket.duration;
 
@@ -206,6 +323,7 @@ HRESULT FFmpegInterop::MediaSampleProvider::GetNextPacket(DataWriter ^ writer, L
 				{
 					// skip a few broken packets (maybe make this configurable later)
 					DebugMessage(L"Skipping broken packet\n");
+					m_pCounters->skippedPackets.Add(1);
 					hr = S_OK;
 				}
 			}
@@ -239,9 +357,10 @@ HRESULT FFmpegInterop::MediaSampleProvider::GetNextPacket(DataWriter ^ writer, L
 void MediaSampleProvider::Flush()
 {
 	DebugMessage(L"Flush\n");
-	while (!m_packetQueue.empty())
+	AVPacket avPacket;
+	while (PopPacket(&avPacket))
 	{
-		av_packet_unref(&PopPacket());
+		av_packet_unref(&avPacket);
 	}
 	m_isDiscontinuous = true;
 }
@@ -250,5 +369,12 @@ void MediaSampleProvider::DisableStream()
 {
 	DebugMessage(L"DisableStream\n");
 	Flush();
+
+	// Packets the other stream reads for us from now on are dropped right away
+	std::lock_guard<std::mutex> lock(m_queueMutex);
+	if (m_isEnabled)
+	{
+		m_pCounters->disabledStreams.Add(1);
+	}
 	m_isEnabled = false;
 }
\ No newline at end of file
@@ -17,7 +17,11 @@
 //*****************************************************************************
 
 #pragma once
+#include <mutex>
 #include <queue>
+#include "PipelineCounters.h"
+#include "PipelineTrace.h"
+#include "SamplePayload.h"
 
 extern "C"
 {
@@ -32,6 +36,24 @@ namespace FFmpegInterop
 	ref class FFmpegInteropMSS;
 	ref class FFmpegReader;
 
+	// Hands the bytes written by the shared payload functions on to the DataWriter of a sample
+	class DataWriterSampleBuffer : public SampleBuffer
+	{
+	public:
+		explicit DataWriterSampleBuffer(DataWriter^ dataWriter)
+			: m_dataWriter(dataWriter)
+		{
+		}
+
+		virtual void Write(const uint8_t* data, size_t size) override
+		{
+			m_dataWriter->WriteBytes(Platform::ArrayReference<uint8_t>(const_cast<uint8_t*>(data), (unsigned int)size));
+		}
+
+	private:
+		DataWriter^ m_dataWriter;
+	};
+
 	ref class MediaSampleProvider
 	{
 	public:
@@ -42,15 +64,37 @@ namespace FFmpegInterop
 
 	internal:
 		void QueuePacket(AVPacket packet);
-		AVPacket PopPacket();
+		bool PopPacket(AVPacket* avPacket);
+
+		// Put packets taken from the queue back in front of it, in the same order, and clear packets
+		void RequeuePackets(std::vector<AVPacket>& packets);
+
+		// Number of queued packets before the last keyframe at or before position (in the time base of the
+		// stream), -1 if there is no such keyframe or nothing queued reaches position
+		int FindQueuedKeyFrame(int64_t position);
+		void DropQueuedPackets(int count);
 		void DisableStream();
+		HRESULT EnsureResourcesAllocated();
+		bool IsAllocated() { return m_isAllocated; }
+		int GetStreamIndex() { return m_streamIndex; }
+
+		// Called after a seek with the position the samples should start from, in TimeSpan units. Passthrough
+		// streams leave dropping the samples before it to the pipeline. With isKeyFramePreview the first
+		// sample may be the keyframe before the position, shown at the position.
+		virtual void SetSeekTarget(LONGLONG position, bool isKeyFramePreview) {}
+
+		// Trick play only queues keyframes, far apart and possibly in reverse. Decoders turn each into a frame on
+		// its own, passthrough streams leave that to the pipeline.
+		virtual void SetKeyFramesOnly(bool isKeyFramesOnly) {}
 
 	private:
+		// The queue is filled by whichever stream reads from the demuxer, so it has its own lock
+		std::mutex m_queueMutex;
 		std::vector<AVPacket> m_packetQueue;
 		int m_streamIndex;
-		int64 m_startOffset;
 		int64 m_nextFramePts;
 		bool m_isEnabled;
+		bool m_isAllocated;
 
 	internal:
 		// The FFmpeg context. Because they are complex types
@@ -60,6 +104,8 @@ namespace FFmpegInterop
 		AVFormatContext* m_pAvFormatCtx;
 		AVCodecContext* m_pAvCodecCtx;
 		bool m_isDiscontinuous;
+		int64 m_startOffset;
+		StreamCounters* m_pCounters;
 
 	internal:
 		MediaSampleProvider(
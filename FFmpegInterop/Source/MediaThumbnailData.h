@@ -22,10 +22,21 @@ using namespace Windows::Storage::Streams;
 
 namespace FFmpegInterop
 {
+	// Output of FFmpegInteropMSS::ExtractVideoFrame, either an encoded image or tightly packed raw pixels
+	public enum class VideoFrameFormat
+	{
+		Jpeg,
+		Png,
+		Bgra8,
+		Nv12
+	};
+
 	public ref class MediaThumbnailData sealed
 	{
 		IBuffer^ _buffer;
 		String^ _extension;
+		unsigned int _width;
+		unsigned int _height;
 
 	public:
 
@@ -43,11 +54,36 @@ namespace FFmpegInterop
 				return _extension;
 			}
 		}
+		// Size of the image, zero when unknown such as for attached cover art
+		property unsigned int Width
+		{
+			unsigned int get()
+			{
+				return _width;
+			}
+		}
+		property unsigned int Height
+		{
+			unsigned int get()
+			{
+				return _height;
+			}
+		}
 
 		MediaThumbnailData(IBuffer^ buffer, String^ extension)
 		{
 			this->_buffer = buffer;
 			this->_extension = extension;
+			this->_width = 0;
+			this->_height = 0;
+		}
+
+		MediaThumbnailData(IBuffer^ buffer, String^ extension, unsigned int width, unsigned int height)
+		{
+			this->_buffer = buffer;
+			this->_extension = extension;
+			this->_width = width;
+			this->_height = height;
 		}
 	private: ~MediaThumbnailData()
 		{
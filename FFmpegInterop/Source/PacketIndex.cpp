@@ -0,0 +1,349 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "PacketIndex.h"
+#include "MediaMetadataProbe.h"
+#include "FFmpegInteropMSS.h"
+#include "FileStreamIO.h"
+#include "InterruptHandler.h"
+
+using namespace concurrency;
+using namespace FFmpegInterop;
+using namespace Platform;
+using namespace Platform::Collections;
+
+// Size of the buffer when scanning a file. Large reads let the scan keep up with the disk.
+const int SCANBUFFERSZ = 1024 * 1024;
+
+static TimeSpan ConvertDuration(int64_t duration, AVRational timeBase)
+{
+	TimeSpan time = { av_rescale_q(duration, timeBase, av_make_q(1, 10000000)) };
+	return time;
+}
+
+PacketTable::PacketTable(int streamIndex, MediaStreamKind kind, AVRational timeBase)
+	: streamIndex(streamIndex)
+	, kind(kind)
+	, timeBase(timeBase)
+{
+}
+
+void PacketTable::Append(const AVPacket* avPacket)
+{
+	pts.push_back(avPacket->pts);
+	dts.push_back(avPacket->dts);
+	sizes.push_back(avPacket->size);
+	flags.push_back((uint8_t)avPacket->flags);
+	positions.push_back(avPacket->pos);
+}
+
+Array<int64>^ PacketTable::GetPresentationTimestamps()
+{
+	return ref new Array<int64>(pts.data(), (unsigned int)pts.size());
+}
+
+Array<int64>^ PacketTable::GetDecodeTimestamps()
+{
+	return ref new Array<int64>(dts.data(), (unsigned int)dts.size());
+}
+
+Array<int>^ PacketTable::GetSizes()
+{
+	return ref new Array<int>(sizes.data(), (unsigned int)sizes.size());
+}
+
+Array<uint8>^ PacketTable::GetFlags()
+{
+	return ref new Array<uint8>(flags.data(), (unsigned int)flags.size());
+}
+
+Array<int64>^ PacketTable::GetPositions()
+{
+	return ref new Array<int64>(positions.data(), (unsigned int)positions.size());
+}
+
+// Decode order timestamp of a packet, packets only get a presentation timestamp in some containers
+int64_t PacketTable::GetTimestamp(size_t packet)
+{
+	return dts[packet] != AV_NOPTS_VALUE ? dts[packet] : pts[packet];
+}
+
+Array<double>^ PacketTable::GetBitrates(TimeSpan window)
+{
+	int64_t firstTimestamp = AV_NOPTS_VALUE;
+	for (size_t i = 0; i < sizes.size() && firstTimestamp == AV_NOPTS_VALUE; i++)
+	{
+		firstTimestamp = GetTimestamp(i);
+	}
+
+	if (window.Duration <= 0 || firstTimestamp == AV_NOPTS_VALUE)
+	{
+		return ref new Array<double>(0);
+	}
+
+	std::vector<double> bitrates;
+	int64_t timestamp = firstTimestamp;
+	for (size_t i = 0; i < sizes.size(); i++)
+	{
+		// Packets without a timestamp count in the window of the packet before them
+		if (GetTimestamp(i) != AV_NOPTS_VALUE)
+		{
+			timestamp = GetTimestamp(i);
+		}
+
+		int64_t windowIndex = max(0LL, ConvertDuration(timestamp - firstTimestamp, timeBase).Duration / window.Duration);
+		if ((size_t)windowIndex >= bitrates.size())
+		{
+			bitrates.resize((size_t)windowIndex + 1, 0.0);
+		}
+		bitrates[(size_t)windowIndex] += sizes[i] * 8.0;
+	}
+
+	double windowSeconds = window.Duration / 10000000.0;
+	for (auto& bitrate : bitrates)
+	{
+		bitrate /= windowSeconds;
+	}
+
+	return ref new Array<double>(bitrates.data(), (unsigned int)bitrates.size());
+}
+
+GopStatistics PacketTable::GetGopStatistics()
+{
+	GopStatistics statistics = {};
+	int64_t totalLength = 0;
+	int64_t totalPackets = 0;
+	int measuredGops = 0;
+	int measuredLengths = 0;
+
+	size_t gopStart = 0;
+	auto measureGop = [&](size_t gopEnd, int64_t endTimestamp)
+	{
+		int packets = (int)(gopEnd - gopStart);
+		statistics.MinPackets = measuredGops == 0 ? packets : min(statistics.MinPackets, packets);
+		statistics.MaxPackets = max(statistics.MaxPackets, packets);
+		totalPackets += packets;
+		measuredGops++;
+
+		int64_t startTimestamp = GetTimestamp(gopStart);
+		if (startTimestamp != AV_NOPTS_VALUE && endTimestamp != AV_NOPTS_VALUE)
+		{
+			TimeSpan length = ConvertDuration(endTimestamp - startTimestamp, timeBase);
+			statistics.MinLength.Duration = measuredLengths == 0 ? length.Duration : min(statistics.MinLength.Duration, length.Duration);
+			statistics.MaxLength.Duration = max(statistics.MaxLength.Duration, length.Duration);
+			totalLength += length.Duration;
+			measuredLengths++;
+		}
+	};
+
+	for (size_t i = 0; i < sizes.size(); i++)
+	{
+		if (flags[i] & AV_PKT_FLAG_KEY)
+		{
+			if (statistics.GopCount > 0)
+			{
+				measureGop(i, GetTimestamp(i));
+			}
+			gopStart = i;
+			statistics.GopCount++;
+		}
+	}
+
+	// A single GOP runs up to the last packet
+	if (statistics.GopCount == 1)
+	{
+		measureGop(sizes.size(), GetTimestamp(sizes.size() - 1));
+	}
+
+	if (measuredGops > 0)
+	{
+		statistics.AveragePackets = (double)totalPackets / measuredGops;
+	}
+	if (measuredLengths > 0)
+	{
+		statistics.AverageLength.Duration = totalLength / measuredLengths;
+	}
+
+	return statistics;
+}
+
+PacketIndex::PacketIndex()
+	: tables(ref new Vector<PacketTable^>())
+{
+}
+
+IAsyncOperation<PacketIndex^>^ PacketIndex::CreateFromStreamAsync(IRandomAccessStream^ stream, FFmpegInteropConfig^ config)
+{
+	return create_async([stream, config](cancellation_token ct)
+	{
+		auto packetIndex = ref new PacketIndex();
+		IStream* fileStreamData = nullptr;
+		AVIOContext* avIOCtx = nullptr;
+		AVFormatContext* avFormatCtx = nullptr;
+
+		HRESULT hr = CreateFileStreamIOContext(stream, SCANBUFFERSZ, &fileStreamData, &avIOCtx);
+
+		if (SUCCEEDED(hr))
+		{
+			avFormatCtx = avformat_alloc_context();
+			if (avFormatCtx == nullptr)
+			{
+				hr = E_OUTOFMEMORY;
+			}
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			avFormatCtx->pb = avIOCtx;
+			avFormatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+			hr = packetIndex->Scan(&avFormatCtx, "", config != nullptr ? config : ref new FFmpegInteropConfig(), ct);
+		}
+
+		FreeFileStreamIOContext(&fileStreamData, &avIOCtx);
+
+		if (ct.is_canceled())
+		{
+			cancel_current_task();
+		}
+
+		return SUCCEEDED(hr) ? packetIndex : nullptr;
+	});
+}
+
+IAsyncOperation<PacketIndex^>^ PacketIndex::CreateFromUriAsync(String^ uri, FFmpegInteropConfig^ config)
+{
+	return create_async([uri, config](cancellation_token ct)
+	{
+		auto packetIndex = ref new PacketIndex();
+		AVFormatContext* avFormatCtx = nullptr;
+		HRESULT hr = S_OK;
+
+		if (!uri)
+		{
+			hr = E_INVALIDARG;
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			avFormatCtx = avformat_alloc_context();
+			if (avFormatCtx == nullptr)
+			{
+				hr = E_OUTOFMEMORY;
+			}
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			std::vector<char> url(WideCharToMultiByte(CP_UTF8, 0, uri->Data(), -1, nullptr, 0, nullptr, nullptr));
+			WideCharToMultiByte(CP_UTF8, 0, uri->Data(), -1, url.data(), (int)url.size(), nullptr, nullptr);
+			hr = packetIndex->Scan(&avFormatCtx, url.data(), config != nullptr ? config : ref new FFmpegInteropConfig(), ct);
+		}
+
+		if (ct.is_canceled())
+		{
+			cancel_current_task();
+		}
+
+		return SUCCEEDED(hr) ? packetIndex : nullptr;
+	});
+}
+
+// Open the container and read every packet of it. The format context is closed whatever happens.
+HRESULT PacketIndex::Scan(AVFormatContext** avFormatCtx, const char* url, FFmpegInteropConfig^ config, cancellation_token ct)
+{
+	HRESULT hr = S_OK;
+	AVDictionary* avDict = nullptr;
+	InterruptHandler interruptHandler;
+	std::vector<PacketTable^> streamTables;
+
+	// Let the interrupt callback abort the scan as soon as the operation gets cancelled
+	auto registration = ct.register_callback([&interruptHandler]() { interruptHandler.Cancel(); });
+
+	hr = FFmpegInteropMSS::ParseOptions(config->FFmpegOptions, &avDict);
+
+	if (SUCCEEDED(hr))
+	{
+		interruptHandler.Attach(*avFormatCtx);
+		interruptHandler.StartOperation(config->OpenTimeout.Duration);
+
+		// Only the header is read, the streams don't need to be probed as nothing gets decoded
+		if (avformat_open_input(avFormatCtx, url, NULL, &avDict) < 0)
+		{
+			hr = E_FAIL;
+		}
+		interruptHandler.EndOperation();
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		AVPacket avPacket;
+		av_init_packet(&avPacket);
+		avPacket.data = NULL;
+		avPacket.size = 0;
+
+		while (SUCCEEDED(hr))
+		{
+			interruptHandler.StartOperation(config->ReadTimeout.Duration);
+			int readResult = av_read_frame(*avFormatCtx, &avPacket);
+			interruptHandler.EndOperation();
+
+			if (readResult == AVERROR_EOF)
+			{
+				break;
+			}
+			else if (readResult < 0)
+			{
+				hr = interruptHandler.IsCancelled() ? E_ABORT : E_FAIL;
+				break;
+			}
+
+			// Streams can show up in the middle of containers such as MPEG-TS
+			while (streamTables.size() <= (size_t)avPacket.stream_index)
+			{
+				AVStream* avStream = (*avFormatCtx)->streams[streamTables.size()];
+				streamTables.push_back(ref new PacketTable(avStream->index, GetMediaStreamKind(avStream), avStream->time_base));
+			}
+
+			streamTables[avPacket.stream_index]->Append(&avPacket);
+			av_packet_unref(&avPacket);
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// Streams without any packet get an empty table
+		while (streamTables.size() < (*avFormatCtx)->nb_streams)
+		{
+			AVStream* avStream = (*avFormatCtx)->streams[streamTables.size()];
+			streamTables.push_back(ref new PacketTable(avStream->index, GetMediaStreamKind(avStream), avStream->time_base));
+		}
+
+		for (auto table : streamTables)
+		{
+			tables->Append(table);
+		}
+	}
+
+	// The interrupt handler goes away with this function, so does the context using it
+	ct.deregister_callback(registration);
+	avformat_close_input(avFormatCtx);
+	av_dict_free(&avDict);
+
+	return hr;
+}
@@ -0,0 +1,160 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <vector>
+#include "MediaMetadata.h"
+#include "FFmpegInteropConfig.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+using namespace Platform;
+using namespace Windows::Foundation;
+using namespace Windows::Foundation::Collections;
+using namespace Windows::Storage::Streams;
+
+namespace FFmpegInterop
+{
+	// Bits of the values returned by PacketTable::GetFlags, same as the AV_PKT_FLAG values of FFmpeg
+	[Platform::Metadata::Flags]
+	public enum class PacketFlags : unsigned int
+	{
+		None = 0,
+		KeyFrame = AV_PKT_FLAG_KEY,
+		Corrupt = AV_PKT_FLAG_CORRUPT,
+		Discard = AV_PKT_FLAG_DISCARD
+	};
+
+	// Keyframe spacing of a stream. Lengths are measured between consecutive keyframes, so the GOP cut off by the
+	// end of the stream only counts if it is the only one.
+	public value struct GopStatistics
+	{
+		int GopCount;
+		TimeSpan MinLength;
+		TimeSpan MaxLength;
+		TimeSpan AverageLength;
+		int MinPackets;
+		int MaxPackets;
+		double AveragePackets;
+	};
+
+	// Every packet of a stream in demuxing order, one array per field. Timestamps are in the time base of the
+	// stream, AV_NOPTS_VALUE (INT64_MIN) where the container doesn't give one. Positions are byte offsets in the
+	// file, -1 when unknown.
+	public ref class PacketTable sealed
+	{
+	public:
+		property int StreamIndex
+		{
+			int get()
+			{
+				return streamIndex;
+			}
+		}
+		property MediaStreamKind Kind
+		{
+			MediaStreamKind get()
+			{
+				return kind;
+			}
+		}
+		property int TimeBaseNumerator
+		{
+			int get()
+			{
+				return timeBase.num;
+			}
+		}
+		property int TimeBaseDenominator
+		{
+			int get()
+			{
+				return timeBase.den;
+			}
+		}
+		property unsigned int Count
+		{
+			unsigned int get()
+			{
+				return (unsigned int)sizes.size();
+			}
+		}
+
+		Array<int64>^ GetPresentationTimestamps();
+		Array<int64>^ GetDecodeTimestamps();
+		Array<int>^ GetSizes();
+		Array<uint8>^ GetFlags();
+		Array<int64>^ GetPositions();
+
+		// Average bitrate in bits per second of each window of the given length, from the first packet on
+		Array<double>^ GetBitrates(TimeSpan window);
+		GopStatistics GetGopStatistics();
+
+	internal:
+		PacketTable(int streamIndex, MediaStreamKind kind, AVRational timeBase);
+		void Append(const AVPacket* avPacket);
+
+	private:
+		int64_t GetTimestamp(size_t packet);
+
+		int streamIndex;
+		MediaStreamKind kind;
+		AVRational timeBase;
+		std::vector<int64_t> pts;
+		std::vector<int64_t> dts;
+		std::vector<int> sizes;
+		std::vector<uint8_t> flags;
+		std::vector<int64_t> positions;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	//  PacketIndex
+	//  Description: Demuxes a whole file without decoding anything and
+	//               keeps the timestamps, size, flags and position of every
+	//               packet. Only one packet is held at a time and the file is
+	//               read through a large buffer, so the scan runs at the
+	//               speed of the disk.
+	//////////////////////////////////////////////////////////////////////////
+
+	public ref class PacketIndex sealed
+	{
+	public:
+		// Only FFmpegOptions, OpenTimeout and ReadTimeout of the config are used
+		static IAsyncOperation<PacketIndex^>^ CreateFromStreamAsync(IRandomAccessStream^ stream, FFmpegInteropConfig^ config);
+		static IAsyncOperation<PacketIndex^>^ CreateFromUriAsync(String^ uri, FFmpegInteropConfig^ config);
+
+		// One table per stream of the container, in the order of the streams
+		property IVectorView<PacketTable^>^ Streams
+		{
+			IVectorView<PacketTable^>^ get()
+			{
+				return tables->GetView();
+			}
+		}
+
+	private:
+		PacketIndex();
+
+		HRESULT Scan(AVFormatContext** avFormatCtx, const char* url, FFmpegInteropConfig^ config, concurrency::cancellation_token ct);
+
+		Platform::Collections::Vector<PacketTable^>^ tables;
+	};
+}
@@ -0,0 +1,119 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <atomic>
+#include "LatencyHistogram.h"
+
+namespace FFmpegInterop
+{
+	// Counter updated with relaxed atomics, cheap enough to stay on during playback. It is written by the thread
+	// running its stage and read by whoever takes a snapshot, so a snapshot may mix values of slightly different
+	// moments, which is fine for statistics.
+	class PipelineCounter
+	{
+	public:
+		PipelineCounter() : m_value(0) {}
+
+		void Add(int64 value)
+		{
+			m_value.fetch_add(value, std::memory_order_relaxed);
+		}
+
+		// Raise the counter to value if it is lower, used for high water marks
+		void RaiseTo(int64 value)
+		{
+			int64 current = m_value.load(std::memory_order_relaxed);
+			while (current < value && !m_value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		int64 Get() const
+		{
+			return m_value.load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<int64> m_value;
+	};
+
+	// Clock of the timers and latencies, in performance counter ticks
+	inline int64 GetPipelineTicks()
+	{
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		return counter.QuadPart;
+	}
+
+	// Adds the time spent in the current scope to a counter
+	class ScopedPipelineTimer
+	{
+	public:
+		ScopedPipelineTimer(PipelineCounter& counter) : m_counter(counter), m_start(GetPipelineTicks())
+		{
+		}
+
+		~ScopedPipelineTimer()
+		{
+			m_counter.Add(GetPipelineTicks() - m_start);
+		}
+
+	private:
+		ScopedPipelineTimer& operator=(const ScopedPipelineTimer&);
+
+		PipelineCounter& m_counter;
+		int64 m_start;
+	};
+
+	// Counters of a MediaSampleProvider, all audio streams of a media share one set
+	struct StreamCounters
+	{
+		PipelineCounter queuedPackets;
+		PipelineCounter queuedBytes;
+		PipelineCounter maxQueuedPackets;
+		PipelineCounter samples;
+		PipelineCounter bytesCopied;
+		PipelineCounter decodeTicks;
+		PipelineCounter convertTicks;
+		PipelineCounter skippedPackets;
+		PipelineCounter disabledStreams;
+	};
+
+	// Counters of every stage of an FFmpegInteropMSS, from reading the stream to handing out samples
+	struct PipelineCounters
+	{
+		PipelineCounter bytesRead;
+		PipelineCounter readCalls;
+		PipelineCounter packetsDemuxed;
+		// Read but thrown away by the reader, what the demuxer skips by itself isn't counted
+		PipelineCounter packetsDropped;
+		PipelineCounter bytesDropped;
+		PipelineCounter seeks;
+		PipelineCounter bufferedSeeks;
+		StreamCounters audio;
+		StreamCounters video;
+
+		// Latencies in performance counter ticks, see LatencyMetric
+		LatencyHistogram audioRequestLatency;
+		LatencyHistogram videoRequestLatency;
+		LatencyHistogram ioWaitLatency;
+		LatencyHistogram videoDecodeLatency[3];
+		LatencyHistogram seekLatency;
+	};
+}
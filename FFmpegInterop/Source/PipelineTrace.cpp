@@ -0,0 +1,233 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "PipelineTrace.h"
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+#ifdef _WIN32
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+using namespace FFmpegInterop;
+
+struct TraceEvent
+{
+	const char* name;
+	char phase;
+	int stream;
+	int64_t start;
+	// Duration of spans, value of counters
+	int64_t value;
+	int64_t pts;
+};
+
+struct TraceBuffer
+{
+	int threadId;
+	std::vector<TraceEvent> events;
+	// Written by the owning thread only, read when the trace is dumped
+	std::atomic<size_t> count;
+	std::atomic<int64_t> dropped;
+};
+
+std::atomic<bool> PipelineTrace::isEnabled(false);
+
+static std::mutex traceMutex;
+static std::vector<TraceBuffer*> sessionBuffers;
+static std::vector<TraceBuffer*> retiredBuffers;
+static std::atomic<uint64_t> currentSession(0);
+static size_t eventsPerBuffer = 0;
+static int64_t sessionStart = 0;
+#ifdef _WIN32
+static double nanosecondsPerTick = 0.0;
+#endif
+
+// Buffer of the calling thread and the session it was created for. A thread which last recorded in an older
+// session gets a new buffer, so the pointer is never followed once the session is over.
+static TRACE_THREAD_LOCAL TraceBuffer* threadBuffer = nullptr;
+static TRACE_THREAD_LOCAL uint64_t threadBufferSession = 0;
+
+static int GetThreadId()
+{
+#ifdef _WIN32
+	return (int)GetCurrentThreadId();
+#else
+	return (int)syscall(SYS_gettid);
+#endif
+}
+
+static TraceBuffer* GetThreadBuffer()
+{
+	uint64_t session = currentSession.load(std::memory_order_acquire);
+	if (threadBuffer != nullptr && threadBufferSession == session)
+	{
+		return threadBuffer;
+	}
+
+	std::lock_guard<std::mutex> lock(traceMutex);
+	TraceBuffer* buffer = new TraceBuffer();
+	buffer->threadId = GetThreadId();
+	buffer->events.resize(eventsPerBuffer);
+	buffer->count.store(0);
+	buffer->dropped.store(0);
+	sessionBuffers.push_back(buffer);
+
+	threadBuffer = buffer;
+	threadBufferSession = session;
+	return buffer;
+}
+
+static void AddEvent(const TraceEvent& event)
+{
+	TraceBuffer* buffer = GetThreadBuffer();
+	size_t index = buffer->count.load(std::memory_order_relaxed);
+	if (index < buffer->events.size())
+	{
+		buffer->events[index] = event;
+		buffer->count.store(index + 1, std::memory_order_release);
+	}
+	else
+	{
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+static void FreeBuffers(std::vector<TraceBuffer*>& buffers)
+{
+	for (auto buffer : buffers)
+	{
+		delete buffer;
+	}
+	buffers.clear();
+}
+
+void PipelineTrace::Start(size_t eventsPerThread)
+{
+	std::lock_guard<std::mutex> lock(traceMutex);
+	isEnabled.store(false);
+
+	// A thread may still be writing the last event of the session which just ended, so its buffers are only
+	// freed when the next session starts
+	FreeBuffers(retiredBuffers);
+	retiredBuffers.swap(sessionBuffers);
+
+#ifdef _WIN32
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	nanosecondsPerTick = 1e9 / frequency.QuadPart;
+#endif
+	eventsPerBuffer = eventsPerThread;
+	sessionStart = GetTime();
+	currentSession.fetch_add(1, std::memory_order_release);
+	isEnabled.store(eventsPerThread > 0);
+}
+
+void PipelineTrace::Stop()
+{
+	isEnabled.store(false);
+}
+
+int64_t PipelineTrace::GetTime()
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (int64_t)(counter.QuadPart * nanosecondsPerTick);
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void PipelineTrace::AddSpan(const char* name, int64_t start, int64_t end, int stream, int64_t pts)
+{
+	TraceEvent event = { name, 'X', stream, start, end - start, pts };
+	AddEvent(event);
+}
+
+void PipelineTrace::RecordCounter(const char* name, int stream, int64_t value)
+{
+	TraceEvent event = { name, 'C', stream, GetTime(), value, INT64_MIN };
+	AddEvent(event);
+}
+
+int64_t PipelineTrace::GetDroppedEventCount()
+{
+	std::lock_guard<std::mutex> lock(traceMutex);
+	int64_t dropped = 0;
+	for (auto buffer : sessionBuffers)
+	{
+		dropped += buffer->dropped.load(std::memory_order_relaxed);
+	}
+	return dropped;
+}
+
+std::string PipelineTrace::GetJson()
+{
+	std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	char text[256];
+	bool isFirst = true;
+	int64_t dropped = 0;
+
+	std::lock_guard<std::mutex> lock(traceMutex);
+	for (auto buffer : sessionBuffers)
+	{
+		size_t count = buffer->count.load(std::memory_order_acquire);
+		dropped += buffer->dropped.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < count; i++)
+		{
+			const TraceEvent& event = buffer->events[i];
+			double timestamp = (event.start - sessionStart) / 1000.0;
+			if (event.phase == 'C')
+			{
+				// Chrome draws one track per counter name
+				snprintf(text, sizeof(text), "%s{\"name\":\"%s %d\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%lld}}",
+					isFirst ? "" : ",", event.name, event.stream, timestamp, buffer->threadId, (long long)event.value);
+			}
+			else
+			{
+				int length = snprintf(text, sizeof(text), "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{",
+					isFirst ? "" : ",", event.name, timestamp, event.value / 1000.0, buffer->threadId);
+				const char* separator = "";
+				if (event.stream >= 0)
+				{
+					length += snprintf(text + length, sizeof(text) - length, "\"stream\":%d", event.stream);
+					separator = ",";
+				}
+				if (event.pts != INT64_MIN)
+				{
+					length += snprintf(text + length, sizeof(text) - length, "%s\"pts\":%lld", separator, (long long)event.pts);
+				}
+				snprintf(text + length, sizeof(text) - length, "}}");
+			}
+			json += text;
+			isFirst = false;
+		}
+	}
+
+	snprintf(text, sizeof(text), "],\"otherData\":{\"droppedEvents\":%lld}}", (long long)dropped);
+	json += text;
+	return json;
+}
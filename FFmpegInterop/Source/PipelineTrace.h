@@ -0,0 +1,117 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  PipelineTrace
+	//  Description: Records spans of the sample pipeline (read, decode,
+	//               convert, deliver, ...) as Chrome trace events, which
+	//               chrome://tracing and Perfetto open as a timeline. Each
+	//               thread writes into its own fixed size buffer without
+	//               locking, a thread only takes a lock the first time it
+	//               records in a session. While tracing is off recording a
+	//               span is a single relaxed load.
+	//               Plain C++ so the Linux benchmark can record the same
+	//               spans.
+	//////////////////////////////////////////////////////////////////////////
+
+	class PipelineTrace
+	{
+	public:
+		// Start a new session, dropping the events of the previous one. Each thread keeps up to
+		// eventsPerThread events, later ones are counted as dropped.
+		static void Start(size_t eventsPerThread);
+		static void Stop();
+
+		static bool IsEnabled()
+		{
+			return isEnabled.load(std::memory_order_relaxed);
+		}
+
+		// Trace of the current or last session in the Chrome JSON format. Events still being recorded while
+		// this runs may be left out.
+		static std::string GetJson();
+
+		static int64_t GetDroppedEventCount();
+
+		// Time in nanoseconds on the clock of the events
+		static int64_t GetTime();
+
+		// name must outlive the session, pass string literals. stream and pts are -1 / AV_NOPTS_VALUE when unknown.
+		// pts is in the time base of the stream, except for delivered samples which carry their timestamp.
+		static void AddSpan(const char* name, int64_t start, int64_t end, int stream, int64_t pts);
+
+		// Value of a counter of the stream, e.g. the depth of its packet queue, drawn as a graph
+		static void AddCounter(const char* name, int stream, int64_t value)
+		{
+			if (IsEnabled())
+			{
+				RecordCounter(name, stream, value);
+			}
+		}
+
+	private:
+		static void RecordCounter(const char* name, int stream, int64_t value);
+
+		static std::atomic<bool> isEnabled;
+	};
+
+	// Records the scope as a span when tracing is on
+	class TraceSpan
+	{
+	public:
+		TraceSpan(const char* name, int stream = -1, int64_t pts = INT64_MIN)
+			: m_name(name)
+			, m_stream(stream)
+			, m_pts(pts)
+			, m_start(PipelineTrace::IsEnabled() ? PipelineTrace::GetTime() : 0)
+		{
+		}
+
+		~TraceSpan()
+		{
+			if (m_start != 0 && PipelineTrace::IsEnabled())
+			{
+				PipelineTrace::AddSpan(m_name, m_start, PipelineTrace::GetTime(), m_stream, m_pts);
+			}
+		}
+
+		// For spans which only learn their stream or timestamp on the way, e.g. reading a packet
+		void SetStream(int stream, int64_t pts)
+		{
+			m_stream = stream;
+			m_pts = pts;
+		}
+
+	private:
+		TraceSpan(const TraceSpan&);
+		TraceSpan& operator=(const TraceSpan&);
+
+		const char* m_name;
+		int m_stream;
+		int64_t m_pts;
+		int64_t m_start;
+	};
+}
@@ -0,0 +1,51 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "PipelineTracing.h"
+#include "PipelineTrace.h"
+
+using namespace FFmpegInterop;
+
+void PipelineTracing::Start(int maxEventsPerThread)
+{
+	PipelineTrace::Start(maxEventsPerThread > 0 ? maxEventsPerThread : 0);
+}
+
+void PipelineTracing::Stop()
+{
+	PipelineTrace::Stop();
+}
+
+String^ PipelineTracing::GetTraceJson()
+{
+	// The trace only holds ASCII
+	std::string json = PipelineTrace::GetJson();
+	std::wstring text(json.begin(), json.end());
+	return ref new String(text.c_str(), (unsigned int)text.size());
+}
+
+bool PipelineTracing::IsEnabled::get()
+{
+	return PipelineTrace::IsEnabled();
+}
+
+int64 PipelineTracing::DroppedEventCount::get()
+{
+	return PipelineTrace::GetDroppedEventCount();
+}
@@ -0,0 +1,52 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+
+using namespace Platform;
+
+namespace FFmpegInterop
+{
+	// Records the timeline of the sample pipeline of every media played in the process: reading, queueing,
+	// decoding, converting and delivering each sample, and the wait on the lock of OnSampleRequested. The
+	// trace opens in chrome://tracing or ui.perfetto.dev. Tracing is off by default and costs nothing then.
+	public ref class PipelineTracing sealed
+	{
+	public:
+		// Start a new trace, dropping the previous one. Each thread records up to maxEventsPerThread events.
+		static void Start(int maxEventsPerThread);
+		static void Stop();
+
+		// Trace in the Chrome trace event JSON format, also available while tracing goes on
+		static String^ GetTraceJson();
+
+		static property bool IsEnabled
+		{
+			bool get();
+		}
+
+		// Events which didn't fit in the buffer of their thread
+		static property int64 DroppedEventCount
+		{
+			int64 get();
+		}
+
+	private:
+		PipelineTracing() {}
+	};
+}
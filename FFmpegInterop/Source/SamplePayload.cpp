@@ -0,0 +1,236 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#include "pch.h"
+#include "SamplePayload.h"
+#include <algorithm>
+
+using namespace FFmpegInterop;
+
+static const uint8_t NALSTARTCODE[] = { 0, 0, 0, 1 };
+
+HRESULT FFmpegInterop::WriteAVCParameterSets(SampleBuffer& buffer, const AVCodecContext* avCodecCtx)
+{
+	HRESULT hr = S_OK;
+	int spsLength = 0;
+	int ppsLength = 0;
+
+	// Get the position of the SPS
+	if (avCodecCtx->extradata == nullptr && avCodecCtx->extradata_size < 8)
+	{
+		// The data isn't present
+		hr = E_FAIL;
+	}
+	if (SUCCEEDED(hr))
+	{
+		const uint8_t* spsPos = avCodecCtx->extradata + 8;
+		spsLength = spsPos[-1];
+
+		if (avCodecCtx->extradata_size < (8 + spsLength))
+		{
+			// We don't have a complete SPS
+			hr = E_FAIL;
+		}
+		else
+		{
+			// Write the NAL unit for the SPS, then the SPS
+			buffer.Write(NALSTARTCODE, sizeof(NALSTARTCODE));
+			buffer.Write(spsPos, spsLength);
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		if (avCodecCtx->extradata_size < (8 + spsLength + 3))
+		{
+			hr = E_FAIL;
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			const uint8_t* ppsPos = avCodecCtx->extradata + 8 + spsLength + 3;
+			ppsLength = ppsPos[-1];
+
+			if (avCodecCtx->extradata_size < (8 + spsLength + 3 + ppsLength))
+			{
+				hr = E_FAIL;
+			}
+			else
+			{
+				// Write the NAL unit for the PPS, then the PPS
+				buffer.Write(NALSTARTCODE, sizeof(NALSTARTCODE));
+				buffer.Write(ppsPos, ppsLength);
+			}
+		}
+	}
+
+	return hr;
+}
+
+HRESULT FFmpegInterop::WriteAVCPacket(SampleBuffer& buffer, const AVPacket* avPacket)
+{
+	HRESULT hr = S_OK;
+	uint32_t index = 0;
+	uint32_t size = 0;
+	uint32_t packetSize = (uint32_t)avPacket->size;
+
+	do
+	{
+		// Make sure we have enough data
+		if (packetSize < (index + 4))
+		{
+			hr = E_FAIL;
+			break;
+		}
+
+		// Grab the size of the blob
+		size = (avPacket->data[index] << 24) + (avPacket->data[index + 1] << 16) + (avPacket->data[index + 2] << 8) + avPacket->data[index + 3];
+
+		// Write the NAL unit to the stream
+		buffer.Write(NALSTARTCODE, sizeof(NALSTARTCODE));
+		index += 4;
+
+		// Stop if index and size goes beyond packet size or overflow
+		if (packetSize < (index + size) || (UINT32_MAX - index) < size)
+		{
+			hr = E_FAIL;
+			break;
+		}
+
+		// Write the rest of the packet to the stream
+		buffer.Write(avPacket->data + index, size);
+		index += size;
+	} while (index < packetSize);
+
+	return hr;
+}
+
+HRESULT FFmpegInterop::WriteAnnexBParameterSets(SampleBuffer& buffer, const AVCodecContext* avCodecCtx)
+{
+	HRESULT hr = S_OK;
+
+	if (avCodecCtx->extradata == nullptr && avCodecCtx->extradata_size < 8)
+	{
+		// The data isn't present
+		hr = E_FAIL;
+	}
+	else
+	{
+		// Write both SPS and PPS sequence as is from extradata
+		buffer.Write(avCodecCtx->extradata, avCodecCtx->extradata_size);
+	}
+
+	return hr;
+}
+
+HRESULT FFmpegInterop::WriteNV12Frame(SampleBuffer& buffer, SwsContext* swsCtx, const AVFrame* avFrame, int height, uint8_t* const imageData[4], const int imageLineSize[4])
+{
+	// Convert decoded video pixel format to NV12 using FFmpeg software scaler
+	if (sws_scale(swsCtx, (const uint8_t**)(avFrame->data), avFrame->linesize, 0, height, imageData, imageLineSize) < 0)
+	{
+		return E_FAIL;
+	}
+
+	buffer.Write(imageData[0], (size_t)imageLineSize[0] * height);
+	buffer.Write(imageData[1], (size_t)imageLineSize[1] * height / 2);
+	return S_OK;
+}
+
+HRESULT FFmpegInterop::WriteS16Samples(SampleBuffer& buffer, SwrContext* swrCtx, const AVFrame* avFrame, int outChannels)
+{
+	// Resample uncompressed frame to AV_SAMPLE_FMT_S16 PCM format that is expected by Media Element
+	uint8_t* resampledData = nullptr;
+	int outSamples = swr_get_out_samples(swrCtx, avFrame->nb_samples);
+	int bufferSize = av_samples_alloc(&resampledData, NULL, outChannels, outSamples, AV_SAMPLE_FMT_S16, 0);
+	if (bufferSize < 0)
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	int resampledSamples = swr_convert(swrCtx, &resampledData, outSamples, (const uint8_t**)avFrame->extended_data, avFrame->nb_samples);
+	if (resampledSamples > 0)
+	{
+		buffer.Write(resampledData, (std::min)(bufferSize, resampledSamples * outChannels * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16)));
+	}
+	av_freep(&resampledData);
+
+	return resampledSamples < 0 ? E_FAIL : S_OK;
+}
+
+// Return S_FALSE for an incomplete frame
+HRESULT FFmpegInterop::DecodeNextFrame(AVCodecContext* avCodecCtx, AVPacket* avPacket, bool isKeyFramesOnly, AVFrame** avFrame)
+{
+	HRESULT hr = S_OK;
+
+	if (avPacket != nullptr)
+	{
+		int sendPacketResult = avcodec_send_packet(avCodecCtx, avPacket);
+		if (sendPacketResult == AVERROR(EAGAIN))
+		{
+			// The decoder should have been drained and always ready to access input
+			_ASSERT(FALSE);
+			hr = E_UNEXPECTED;
+		}
+		else if (sendPacketResult < 0)
+		{
+			// We failed to send the packet
+			hr = E_FAIL;
+			DebugMessage(L"Decoder failed on the sample\n");
+		}
+		else if (isKeyFramesOnly)
+		{
+			// The keyframes don't reference each other, get the frame out right away
+			avcodec_send_packet(avCodecCtx, NULL);
+		}
+	}
+	if (SUCCEEDED(hr))
+	{
+		AVFrame* pFrame = av_frame_alloc();
+		// Try to get a frame from the decoder.
+		int decodeFrame = avcodec_receive_frame(avCodecCtx, pFrame);
+
+		// The decoder is empty, send a packet to it.
+		if (decodeFrame == AVERROR(EAGAIN))
+		{
+			// The decoder doesn't have enough data to produce a frame,
+			// return S_FALSE to indicate a partial frame
+			hr = S_FALSE;
+			av_frame_free(&pFrame);
+		}
+		else if (decodeFrame == AVERROR_EOF && isKeyFramesOnly)
+		{
+			// Drained, make the decoder take the next keyframe
+			hr = S_FALSE;
+			av_frame_free(&pFrame);
+			avcodec_flush_buffers(avCodecCtx);
+		}
+		else if (decodeFrame < 0)
+		{
+			hr = E_FAIL;
+			av_frame_free(&pFrame);
+			DebugMessage(L"Failed to get a frame from the decoder\n");
+		}
+		else
+		{
+			*avFrame = pFrame;
+		}
+	}
+
+	return hr;
+}
@@ -0,0 +1,64 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
+}
+
+// Platform neutral core of the sample providers: decoding a packet and turning packets and frames into the bytes
+// of a sample. It has no WinRT types, so the headless benchmark compiles these sources too and measures the same
+// code as the library ships. HRESULT comes from the precompiled header of whichever project builds it.
+namespace FFmpegInterop
+{
+	// Receives the bytes of a sample. The providers of the library hand them on to a DataWriter.
+	class SampleBuffer
+	{
+	public:
+		virtual ~SampleBuffer() {}
+		virtual void Write(const uint8_t* data, size_t size) = 0;
+	};
+
+	// Write the SPS and PPS of an avcC extradata, each behind a start code
+	HRESULT WriteAVCParameterSets(SampleBuffer& buffer, const AVCodecContext* avCodecCtx);
+
+	// Write an H.264 packet of length prefixed NAL units with start codes in place of the lengths
+	HRESULT WriteAVCPacket(SampleBuffer& buffer, const AVPacket* avPacket);
+
+	// Write the SPS and PPS of an Annex B extradata as they are
+	HRESULT WriteAnnexBParameterSets(SampleBuffer& buffer, const AVCodecContext* avCodecCtx);
+
+	// Convert the frame to NV12 into the image buffers, allocated with av_image_alloc for the frame size, and
+	// write both planes
+	HRESULT WriteNV12Frame(SampleBuffer& buffer, SwsContext* swsCtx, const AVFrame* avFrame, int height, uint8_t* const imageData[4], const int imageLineSize[4]);
+
+	// Resample the frame to 16 bit PCM of outChannels channels and write it
+	HRESULT WriteS16Samples(SampleBuffer& buffer, SwrContext* swrCtx, const AVFrame* avFrame, int outChannels);
+
+	// Send the packet to the decoder, if there is one, and take the next frame out into a new AVFrame. Returns
+	// S_FALSE when the decoder needs more input first. With isKeyFramesOnly every packet is drained right away,
+	// keyframes don't reference each other, and the decoder is flushed once empty so it takes the next one.
+	HRESULT DecodeNextFrame(AVCodecContext* avCodecCtx, AVPacket* avPacket, bool isKeyFramesOnly, AVFrame** avFrame);
+}
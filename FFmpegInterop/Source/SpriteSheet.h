@@ -0,0 +1,95 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include "MediaThumbnailData.h"
+
+using namespace Platform;
+using namespace Windows::Foundation;
+using namespace Windows::Foundation::Collections;
+
+namespace FFmpegInterop
+{
+	// Output of FFmpegInteropMSS::ExtractSpriteSheetAsync. The tiles are laid out left to right, top to bottom,
+	// Positions holds the time of the frame shown in each of them.
+	public ref class SpriteSheet sealed
+	{
+	public:
+		property MediaThumbnailData^ Image
+		{
+			MediaThumbnailData^ get()
+			{
+				return image;
+			}
+		}
+		property IVectorView<TimeSpan>^ Positions
+		{
+			IVectorView<TimeSpan>^ get()
+			{
+				return positions;
+			}
+		}
+		property int Columns
+		{
+			int get()
+			{
+				return columns;
+			}
+		}
+		property int Rows
+		{
+			int get()
+			{
+				return rows;
+			}
+		}
+		property int TileWidth
+		{
+			int get()
+			{
+				return tileWidth;
+			}
+		}
+		property int TileHeight
+		{
+			int get()
+			{
+				return tileHeight;
+			}
+		}
+
+	internal:
+		SpriteSheet(MediaThumbnailData^ image, IVectorView<TimeSpan>^ positions, int columns, int rows, int tileWidth, int tileHeight)
+			: image(image)
+			, positions(positions)
+			, columns(columns)
+			, rows(rows)
+			, tileWidth(tileWidth)
+			, tileHeight(tileHeight)
+		{
+		}
+
+	private:
+		MediaThumbnailData^ image;
+		IVectorView<TimeSpan>^ positions;
+		int columns;
+		int rows;
+		int tileWidth;
+		int tileHeight;
+	};
+}
@@ -0,0 +1,443 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "SpriteSheetGenerator.h"
+#include "VideoFrameExtractor.h"
+#include "ContextPool.h"
+#include <thread>
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+using namespace concurrency;
+using namespace FFmpegInterop;
+using namespace Platform;
+using namespace Platform::Collections;
+
+// Upper limit of decoding threads, the reading thread can't keep more of them busy
+const unsigned int MAXDECODERTHREADS = 8;
+
+SpriteSheetGenerator::SpriteSheetGenerator(AVFormatContext* avFormatCtx, int streamIndex)
+	: m_pAvFormatCtx(avFormatCtx)
+	, m_pAvStream(avFormatCtx->streams[streamIndex])
+	, m_streamIndex(streamIndex)
+	, m_pSheet(nullptr)
+	, m_columns(0)
+	, m_tileWidth(0)
+	, m_tileHeight(0)
+	, m_maxQueuedJobs(0)
+	, m_isReadDone(false)
+{
+}
+
+SpriteSheetGenerator::~SpriteSheetGenerator()
+{
+	for (auto& job : m_jobs)
+	{
+		av_packet_free(&job.avPacket);
+	}
+	av_frame_free(&m_pSheet);
+}
+
+HRESULT SpriteSheetGenerator::Generate(
+	const std::vector<int64_t>& positions,
+	int columns,
+	int tileWidth,
+	int tileHeight,
+	VideoFrameFormat format,
+	cancellation_token ct,
+	SpriteSheet^* spriteSheet)
+{
+	HRESULT hr = S_OK;
+	AVCodecParameters* codecpar = m_pAvStream->codecpar;
+	int tileCount = (int)positions.size();
+	int rows = 0;
+
+	if (tileCount == 0 || columns <= 0 || codecpar->width <= 0 || codecpar->height <= 0)
+	{
+		hr = E_INVALIDARG;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		VideoFrameExtractor::GetOutputSize(codecpar, &tileWidth, &tileHeight);
+		m_tileWidth = tileWidth;
+		m_tileHeight = tileHeight;
+		m_columns = min(columns, tileCount);
+		rows = (tileCount + m_columns - 1) / m_columns;
+		m_tileTimestamps.assign(tileCount, AV_NOPTS_VALUE);
+
+		// The sheet is the only allocation growing with the number of tiles
+		m_pSheet = av_frame_alloc();
+		if (m_pSheet == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		m_pSheet->format = VideoFrameExtractor::GetPixelFormat(format);
+		m_pSheet->width = m_columns * m_tileWidth;
+		m_pSheet->height = rows * m_tileHeight;
+		if (av_frame_get_buffer(m_pSheet, 32) < 0)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		ClearSheet();
+
+		// A few keyframes per decoding thread are read ahead at most, that bounds the memory used besides the sheet
+		unsigned int decoderCount = max(1u, min(std::thread::hardware_concurrency(), MAXDECODERTHREADS));
+		m_maxQueuedJobs = decoderCount * 2;
+		m_isReadDone = false;
+
+		std::vector<task<void>> decoders;
+		for (unsigned int i = 0; i < decoderCount; i++)
+		{
+			decoders.push_back(create_task([this]()
+			{
+				DecodeJobs();
+			}));
+		}
+
+		hr = ReadKeyFrames(positions, ct);
+
+		m_mutex.lock();
+		if (FAILED(hr))
+		{
+			// Don't bother decoding what is still queued
+			for (auto& job : m_jobs)
+			{
+				av_packet_free(&job.avPacket);
+			}
+			m_jobs.clear();
+		}
+		m_isReadDone = true;
+		m_mutex.unlock();
+		m_jobQueued.notify_all();
+
+		when_all(decoders.begin(), decoders.end()).wait();
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		IBuffer^ buffer;
+		String^ extension;
+		hr = VideoFrameExtractor::CreateImage(m_pSheet, format, &buffer, &extension);
+		if (SUCCEEDED(hr))
+		{
+			int64_t startTime = m_pAvStream->start_time != AV_NOPTS_VALUE ? m_pAvStream->start_time : 0;
+			auto tilePositions = ref new Vector<TimeSpan>();
+			for (int64_t timestamp : m_tileTimestamps)
+			{
+				TimeSpan position = { timestamp != AV_NOPTS_VALUE ? av_rescale_q(timestamp - startTime, m_pAvStream->time_base, av_make_q(1, 10000000)) : 0 };
+				tilePositions->Append(position);
+			}
+
+			auto image = ref new MediaThumbnailData(buffer, extension, m_pSheet->width, m_pSheet->height);
+			*spriteSheet = ref new SpriteSheet(image, tilePositions->GetView(), m_columns, rows, m_tileWidth, m_tileHeight);
+		}
+	}
+
+	return hr;
+}
+
+HRESULT SpriteSheetGenerator::ReadKeyFrames(const std::vector<int64_t>& positions, cancellation_token ct)
+{
+	HRESULT hr = S_OK;
+	SpriteSheetJob job = { nullptr };
+	int64_t jobTimestamp = AV_NOPTS_VALUE;
+	bool isEndOfFile = false;
+
+	AVPacket* avPacket = av_packet_alloc();
+	if (avPacket == nullptr)
+	{
+		hr = E_OUTOFMEMORY;
+	}
+
+	// Demux only the keyframes of the video stream, for the demuxers which can skip the others
+	std::vector<AVDiscard> previousDiscard;
+	for (unsigned int i = 0; i < m_pAvFormatCtx->nb_streams; i++)
+	{
+		previousDiscard.push_back(m_pAvFormatCtx->streams[i]->discard);
+		m_pAvFormatCtx->streams[i]->discard = (int)i == m_streamIndex ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+	}
+
+	for (int tile = 0; tile < (int)positions.size() && SUCCEEDED(hr); tile++)
+	{
+		if (ct.is_canceled())
+		{
+			hr = E_ABORT;
+			break;
+		}
+
+		// Tiles sharing the nearest keyframe reuse the one already read, the media is never read backward
+		int64_t keyFrameTimestamp = FindNearestKeyFrame(positions[tile]);
+		bool isNewKeyFrame = false;
+		if (!isEndOfFile && (job.avPacket == nullptr || keyFrameTimestamp > jobTimestamp))
+		{
+			if (av_seek_frame(m_pAvFormatCtx, m_streamIndex, keyFrameTimestamp, AVSEEK_FLAG_BACKWARD) < 0)
+			{
+				DebugMessage(L"Could not seek, reading on from the current position\n");
+			}
+
+			while (!isNewKeyFrame)
+			{
+				if (av_read_frame(m_pAvFormatCtx, avPacket) < 0)
+				{
+					isEndOfFile = true;
+					break;
+				}
+
+				if (avPacket->stream_index == m_streamIndex && (avPacket->flags & AV_PKT_FLAG_KEY))
+				{
+					int64_t timestamp = avPacket->dts != AV_NOPTS_VALUE ? avPacket->dts : avPacket->pts;
+					if (job.avPacket != nullptr && timestamp <= jobTimestamp)
+					{
+						// The seek went back to the keyframe of the previous tile, or before it
+						if (timestamp == jobTimestamp)
+						{
+							av_packet_unref(avPacket);
+							break;
+						}
+					}
+					else
+					{
+						jobTimestamp = timestamp;
+						isNewKeyFrame = true;
+						break;
+					}
+				}
+				av_packet_unref(avPacket);
+			}
+		}
+
+		if (isNewKeyFrame)
+		{
+			if (job.avPacket != nullptr)
+			{
+				QueueJob(job);
+			}
+
+			job.avPacket = avPacket;
+			job.tiles.clear();
+			avPacket = av_packet_alloc();
+			if (avPacket == nullptr)
+			{
+				hr = E_OUTOFMEMORY;
+			}
+		}
+
+		// Tiles past the last keyframe show the last one, tiles before the first one stay empty
+		if (job.avPacket != nullptr)
+		{
+			job.tiles.push_back(tile);
+			m_tileTimestamps[tile] = job.avPacket->pts != AV_NOPTS_VALUE ? job.avPacket->pts : job.avPacket->dts;
+		}
+	}
+
+	if (job.avPacket != nullptr)
+	{
+		if (SUCCEEDED(hr))
+		{
+			QueueJob(job);
+		}
+		else
+		{
+			av_packet_free(&job.avPacket);
+		}
+	}
+	av_packet_free(&avPacket);
+
+	for (unsigned int i = 0; i < m_pAvFormatCtx->nb_streams; i++)
+	{
+		m_pAvFormatCtx->streams[i]->discard = previousDiscard[i];
+	}
+
+	return hr;
+}
+
+int64_t SpriteSheetGenerator::FindNearestKeyFrame(int64_t position)
+{
+	// Without an index, seeking finds the keyframe at or before the position
+	int before = av_index_search_timestamp(m_pAvStream, position, AVSEEK_FLAG_BACKWARD);
+	int after = av_index_search_timestamp(m_pAvStream, position, 0);
+	if (before < 0 && after < 0)
+	{
+		return position;
+	}
+	else if (before < 0)
+	{
+		return m_pAvStream->index_entries[after].timestamp;
+	}
+	else if (after < 0)
+	{
+		return m_pAvStream->index_entries[before].timestamp;
+	}
+
+	int64_t beforeTimestamp = m_pAvStream->index_entries[before].timestamp;
+	int64_t afterTimestamp = m_pAvStream->index_entries[after].timestamp;
+	return position - beforeTimestamp <= afterTimestamp - position ? beforeTimestamp : afterTimestamp;
+}
+
+void SpriteSheetGenerator::QueueJob(SpriteSheetJob& job)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_jobs.size() >= m_maxQueuedJobs)
+	{
+		m_jobTaken.wait(lock);
+	}
+
+	m_jobs.push_back(job);
+	lock.unlock();
+	m_jobQueued.notify_one();
+
+	job.avPacket = nullptr;
+	job.tiles.clear();
+}
+
+bool SpriteSheetGenerator::DequeueJob(SpriteSheetJob& job)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_jobs.empty() && !m_isReadDone)
+	{
+		m_jobQueued.wait(lock);
+	}
+
+	if (m_jobs.empty())
+	{
+		return false;
+	}
+
+	job = m_jobs.front();
+	m_jobs.pop_front();
+	lock.unlock();
+	m_jobTaken.notify_one();
+
+	return true;
+}
+
+void SpriteSheetGenerator::DecodeJobs()
+{
+	AVCodecContext* avCodecCtx = nullptr;
+	SwsContext* swsCtx = nullptr;
+	ScalerKey scalerKey = { 0 };
+
+	// Keyframes are decoded in parallel by the threads, each decoder runs single threaded
+	AVFrame* avFrame = av_frame_alloc();
+	DecoderSettings settings = VideoFrameExtractor::GetKeyFrameDecoderSettings(m_pAvStream, m_tileWidth, m_tileHeight, 1);
+	HRESULT hr = avFrame != nullptr ? VideoFrameExtractor::OpenKeyFrameDecoder(m_pAvStream, settings, &avCodecCtx) : E_OUTOFMEMORY;
+
+	SpriteSheetJob job;
+	while (DequeueJob(job))
+	{
+		if (SUCCEEDED(hr))
+		{
+			int decodeResult = avcodec_send_packet(avCodecCtx, job.avPacket);
+			if (decodeResult >= 0)
+			{
+				decodeResult = avcodec_receive_frame(avCodecCtx, avFrame);
+				if (decodeResult == AVERROR(EAGAIN))
+				{
+					// Drain, reordering decoders hold the keyframe back otherwise
+					avcodec_send_packet(avCodecCtx, NULL);
+					decodeResult = avcodec_receive_frame(avCodecCtx, avFrame);
+				}
+			}
+
+			if (decodeResult >= 0)
+			{
+				// lowres and resolution changes alter the size of the decoded frames
+				if (swsCtx == nullptr || avFrame->width != scalerKey.srcWidth || avFrame->height != scalerKey.srcHeight || avFrame->format != scalerKey.srcFormat)
+				{
+					ContextPool::ReleaseScaler(&swsCtx);
+					ScalerKey frameScalerKey = { avFrame->width, avFrame->height, (AVPixelFormat)avFrame->format, m_tileWidth, m_tileHeight, (AVPixelFormat)m_pSheet->format, SWS_BILINEAR };
+					scalerKey = frameScalerKey;
+					swsCtx = ContextPool::AcquireScaler(scalerKey);
+				}
+
+				if (swsCtx != nullptr)
+				{
+					for (int tile : job.tiles)
+					{
+						DrawTile(avFrame, swsCtx, tile);
+					}
+				}
+				av_frame_unref(avFrame);
+			}
+			else
+			{
+				DebugMessage(L"Could not decode a sprite sheet keyframe\n");
+			}
+
+			// The decoder is at end of stream after draining, every keyframe starts from a clean state
+			avcodec_flush_buffers(avCodecCtx);
+		}
+		av_packet_free(&job.avPacket);
+	}
+
+	ContextPool::ReleaseScaler(&swsCtx);
+	ContextPool::ReleaseCodecContext(&avCodecCtx, m_pAvStream->codecpar, &settings);
+	av_frame_free(&avFrame);
+}
+
+void SpriteSheetGenerator::DrawTile(AVFrame* avFrame, SwsContext* swsCtx, int tile)
+{
+	const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)m_pSheet->format);
+	int pixelSteps[4];
+	av_image_fill_max_pixsteps(pixelSteps, NULL, desc);
+
+	int x = (tile % m_columns) * m_tileWidth;
+	int y = (tile / m_columns) * m_tileHeight;
+
+	// Point every plane at the top left corner of the tile, the tiles are disjoint so the threads never overlap
+	uint8_t* data[4] = { nullptr };
+	for (int plane = 0; plane < 4 && m_pSheet->data[plane] != nullptr; plane++)
+	{
+		bool isChroma = (plane == 1 || plane == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+		int planeX = isChroma ? x >> desc->log2_chroma_w : x;
+		int planeY = isChroma ? y >> desc->log2_chroma_h : y;
+		data[plane] = m_pSheet->data[plane] + planeY * m_pSheet->linesize[plane] + planeX * pixelSteps[plane];
+	}
+
+	sws_scale(swsCtx, avFrame->data, avFrame->linesize, 0, avFrame->height, data, m_pSheet->linesize);
+}
+
+void SpriteSheetGenerator::ClearSheet()
+{
+	// Tiles without a frame stay black, or transparent with BGRA
+	const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)m_pSheet->format);
+	bool isRgb = (desc->flags & AV_PIX_FMT_FLAG_RGB) != 0;
+	int lumaBlack = m_pSheet->format == AV_PIX_FMT_YUVJ420P ? 0 : 16;
+
+	for (int plane = 0; plane < 4 && m_pSheet->data[plane] != nullptr; plane++)
+	{
+		bool isChroma = plane > 0 && !isRgb;
+		int lines = isChroma ? AV_CEIL_RSHIFT(m_pSheet->height, desc->log2_chroma_h) : m_pSheet->height;
+		int value = isRgb ? 0 : isChroma ? 128 : lumaBlack;
+		memset(m_pSheet->data[plane], value, m_pSheet->linesize[plane] * lines);
+	}
+}
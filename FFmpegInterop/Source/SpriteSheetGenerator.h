@@ -0,0 +1,93 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "SpriteSheet.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+namespace FFmpegInterop
+{
+	// A keyframe waiting to be decoded and the tiles of the sprite sheet it goes into
+	struct SpriteSheetJob
+	{
+		AVPacket* avPacket;
+		std::vector<int> tiles;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	//  SpriteSheetGenerator
+	//  Description: Builds a grid of preview frames in a single forward pass
+	//               over the media. The reading thread only ever seeks ahead,
+	//               to the keyframe nearest to each position, and hands the
+	//               keyframes to a few decoding threads through a small
+	//               bounded queue. Each of them decodes with its own keyframe
+	//               only decoder and scales the frame straight into its tile.
+	//////////////////////////////////////////////////////////////////////////
+
+	class SpriteSheetGenerator
+	{
+	public:
+		SpriteSheetGenerator(AVFormatContext* avFormatCtx, int streamIndex);
+		virtual ~SpriteSheetGenerator();
+
+		// positions are in the time base of the stream, in ascending order. A tile width or height of 0 is computed
+		// from the display aspect ratio.
+		HRESULT Generate(
+			const std::vector<int64_t>& positions,
+			int columns,
+			int tileWidth,
+			int tileHeight,
+			VideoFrameFormat format,
+			concurrency::cancellation_token ct,
+			SpriteSheet^* spriteSheet);
+
+	private:
+		HRESULT ReadKeyFrames(const std::vector<int64_t>& positions, concurrency::cancellation_token ct);
+		int64_t FindNearestKeyFrame(int64_t position);
+		void QueueJob(SpriteSheetJob& job);
+		bool DequeueJob(SpriteSheetJob& job);
+		void DecodeJobs();
+		void DrawTile(AVFrame* avFrame, SwsContext* swsCtx, int tile);
+		void ClearSheet();
+
+		AVFormatContext* m_pAvFormatCtx;
+		AVStream* m_pAvStream;
+		int m_streamIndex;
+		AVFrame* m_pSheet;
+		int m_columns;
+		int m_tileWidth;
+		int m_tileHeight;
+		std::vector<int64_t> m_tileTimestamps;
+
+		std::mutex m_mutex;
+		std::condition_variable m_jobQueued;
+		std::condition_variable m_jobTaken;
+		std::deque<SpriteSheetJob> m_jobs;
+		size_t m_maxQueuedJobs;
+		bool m_isReadDone;
+	};
+}
@@ -0,0 +1,57 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include "MediaThumbnailData.h"
+
+using namespace Platform;
+using namespace Windows::Foundation;
+
+namespace FFmpegInterop
+{
+	// Output of FFmpegInteropMSS::StepForward and StepBackward, a single frame and the time it is shown at
+	public ref class SteppedVideoFrame sealed
+	{
+	public:
+		property MediaThumbnailData^ Image
+		{
+			MediaThumbnailData^ get()
+			{
+				return image;
+			}
+		}
+		property TimeSpan Position
+		{
+			TimeSpan get()
+			{
+				return position;
+			}
+		}
+
+	internal:
+		SteppedVideoFrame(MediaThumbnailData^ image, TimeSpan position)
+			: image(image)
+			, position(position)
+		{
+		}
+
+	private:
+		MediaThumbnailData^ image;
+		TimeSpan position;
+	};
+}
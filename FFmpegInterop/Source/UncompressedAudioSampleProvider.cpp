@@ -19,6 +19,7 @@
 #include "pch.h"
 
 #include "UncompressedAudioSampleProvider.h"
+#include "ContextPool.h"
 
 using namespace FFmpegInterop;
 
@@ -31,41 +32,54 @@ UncompressedAudioSampleProvider::UncompressedAudioSampleProvider(
 	AVCodecContext* avCodecCtx)
 	: UncompressedSampleProvider(reader, avFormatCtx, avCodecCtx)
 	, m_pSwrCtx(nullptr)
+	, m_outSampleRate(0)
+	, m_outChannels(0)
 {
 }
 
+// Resample to the given format instead of the one of the stream, e.g. to keep the format of a playlist
+// constant. Must be set before the resources get allocated.
+HRESULT UncompressedAudioSampleProvider::SetOutputFormat(int sampleRate, int channels)
+{
+	if (IsAllocated() || sampleRate <= 0 || channels <= 0)
+	{
+		return E_FAIL;
+	}
+
+	m_outSampleRate = sampleRate;
+	m_outChannels = channels;
+	return S_OK;
+}
+
 HRESULT UncompressedAudioSampleProvider::AllocateResources()
 {
 	HRESULT hr = S_OK;
 	hr = UncompressedSampleProvider::AllocateResources();
 	if (SUCCEEDED(hr))
 	{
+		// Keep the format of the stream unless another one was requested
+		if (m_outSampleRate == 0)
+		{
+			m_outSampleRate = m_pAvCodecCtx->sample_rate;
+			m_outChannels = m_pAvCodecCtx->channels;
+		}
+
 		// Set default channel layout when the value is unknown (0)
 		int64 inChannelLayout = m_pAvCodecCtx->channel_layout ? m_pAvCodecCtx->channel_layout : av_get_default_channel_layout(m_pAvCodecCtx->channels);
-		int64 outChannelLayout = av_get_default_channel_layout(m_pAvCodecCtx->channels);
+		int64 outChannelLayout = av_get_default_channel_layout(m_outChannels);
 
 		// Set up resampler to convert any PCM format (e.g. AV_SAMPLE_FMT_FLTP) to AV_SAMPLE_FMT_S16 PCM format that is expected by Media Element.
 		// Additional logic can be added to avoid resampling PCM data that is already in AV_SAMPLE_FMT_S16_PCM.
-		m_pSwrCtx = swr_alloc_set_opts(
-			NULL,
+		ResamplerKey resamplerKey = {
 			outChannelLayout,
 			AV_SAMPLE_FMT_S16,
-			m_pAvCodecCtx->sample_rate,
+			m_outSampleRate,
 			inChannelLayout,
 			m_pAvCodecCtx->sample_fmt,
-			m_pAvCodecCtx->sample_rate,
-			0,
-			NULL);
+			m_pAvCodecCtx->sample_rate };
+		m_pSwrCtx = ContextPool::AcquireResampler(resamplerKey);
 
 		if (!m_pSwrCtx)
-		{
-			hr = E_OUTOFMEMORY;
-		}
-	}
-
-	if (SUCCEEDED(hr))
-	{
-		if (swr_init(m_pSwrCtx) < 0)
 		{
 			hr = E_FAIL;
 		}
@@ -81,8 +95,8 @@ UncompressedAudioSampleProvider::~UncompressedAudioSampleProvider()
 		av_frame_free(&m_pAvFrame);
 	}
 
-	// Free 
-	swr_free(&m_pSwrCtx);
+	// Hand the resampler back for the next media with the same format
+	ContextPool::ReleaseResampler(&m_pSwrCtx);
 }
 
 HRESULT UncompressedAudioSampleProvider::WriteAVPacketToStream(DataWriter^ dataWriter, AVPacket* avPacket)
@@ -95,16 +109,17 @@ HRESULT UncompressedAudioSampleProvider::WriteAVPacketToStream(DataWriter^ dataW
 HRESULT UncompressedAudioSampleProvider::ProcessDecodedFrame(DataWriter^ dataWriter)
 {
 	// Resample uncompressed frame to AV_SAMPLE_FMT_S16 PCM format that is expected by Media Element
-	uint8_t *resampledData = nullptr;
-	unsigned int aBufferSize = av_samples_alloc(&resampledData, NULL, m_pAvFrame->channels, m_pAvFrame->nb_samples, AV_SAMPLE_FMT_S16, 0);
-	int resampledDataSize = swr_convert(m_pSwrCtx, &resampledData, aBufferSize, (const uint8_t **)m_pAvFrame->extended_data, m_pAvFrame->nb_samples);
-	auto aBuffer = ref new Platform::Array<uint8_t>(resampledData, min(aBufferSize, (unsigned int)(resampledDataSize * m_pAvFrame->channels * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16))));
-	dataWriter->WriteBytes(aBuffer);
-	av_freep(&resampledData);
+	HRESULT hr = S_OK;
+	{
+		ScopedPipelineTimer timer(m_pCounters->convertTicks);
+		TraceSpan span("convert", GetStreamIndex(), m_pAvFrame->pts);
+		DataWriterSampleBuffer buffer(dataWriter);
+		hr = WriteS16Samples(buffer, m_pSwrCtx, m_pAvFrame, m_outChannels);
+	}
 	av_frame_unref(m_pAvFrame);
 	av_frame_free(&m_pAvFrame);
 
-	return S_OK;
+	return hr;
 }
 
 MediaStreamSample^ UncompressedAudioSampleProvider::GetNextSample()
@@ -113,7 +128,9 @@ MediaStreamSample^ UncompressedAudioSampleProvider::GetNextSample()
 	// but we concatenate samples until reaching a minimum duration
 	DebugMessage(L"GetNextSample\n");
 
-	HRESULT hr = S_OK;
+	// Open the decoder and the resampler on the first request
+	HRESULT hr = EnsureResourcesAllocated();
+	TraceSpan span("sample", GetStreamIndex());
 
 	MediaStreamSample^ sample;
 	DataWriter^ dataWriter = ref new DataWriter();
@@ -121,9 +138,9 @@ MediaStreamSample^ UncompressedAudioSampleProvider::GetNextSample()
 	LONGLONG finalPts = -1;
 	LONGLONG finalDur = 0;
 	bool isFirstPacket = true;
-	bool isDiscontinuous;
+	bool isDiscontinuous = m_isDiscontinuous;
 
-	do
+	while (SUCCEEDED(hr) && finalDur < MINAUDIOSAMPLEDURATION)
 	{
 		LONGLONG pts = 0;
 		LONGLONG dur = 0;
@@ -143,14 +160,16 @@ MediaStreamSample^ UncompressedAudioSampleProvider::GetNextSample()
 			}
 			finalDur += dur;
 		}
-
-	} while (SUCCEEDED(hr) && finalDur < MINAUDIOSAMPLEDURATION);
+	}
 
 	if (finalDur > 0)
 	{
+		m_pCounters->samples.Add(1);
+		m_pCounters->bytesCopied.Add(dataWriter->UnstoredBufferLength);
 		sample = MediaStreamSample::CreateFromBuffer(dataWriter->DetachBuffer(), { finalPts });
 		sample->Duration = { finalDur };
 		sample->Discontinuous = isDiscontinuous;
+		span.SetStream(GetStreamIndex(), finalPts);
 		;
 		if (SUCCEEDED(hr))
 		{
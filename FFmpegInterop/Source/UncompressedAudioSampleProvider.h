@@ -40,9 +40,12 @@ namespace FFmpegInterop
 		virtual HRESULT WriteAVPacketToStream(DataWriter^ writer, AVPacket* avPacket) override;
 		virtual HRESULT ProcessDecodedFrame(DataWriter^ dataWriter) override;
 		virtual HRESULT AllocateResources() override;
+		HRESULT SetOutputFormat(int sampleRate, int channels);
 
 	private:
 		SwrContext* m_pSwrCtx;
+		int m_outSampleRate;
+		int m_outChannels;
 	};
 }
 
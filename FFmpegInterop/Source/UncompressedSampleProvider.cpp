@@ -24,9 +24,43 @@ using namespace FFmpegInterop;
 UncompressedSampleProvider::UncompressedSampleProvider(FFmpegReader^ reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx)
 	: MediaSampleProvider(reader, avFormatCtx, avCodecCtx)
 	, m_pAvFrame(nullptr)
+	, m_pendingDecodeTicks(0)
+	, m_isKeyFramesOnly(false)
 {
 }
 
+HRESULT UncompressedSampleProvider::AllocateResources()
+{
+	HRESULT hr = S_OK;
+	hr = MediaSampleProvider::AllocateResources();
+	if (SUCCEEDED(hr) && !avcodec_is_open(m_pAvCodecCtx))
+	{
+		// The decoder is only opened once the stream is actually played
+		if (avcodec_open2(m_pAvCodecCtx, m_pAvCodecCtx->codec, NULL) < 0)
+		{
+			hr = E_FAIL;
+			DebugMessage(L"Could not open the decoder\n");
+		}
+	}
+
+	return hr;
+}
+
+void UncompressedSampleProvider::Flush()
+{
+	MediaSampleProvider::Flush();
+	m_pendingDecodeTicks = 0;
+	if (avcodec_is_open(m_pAvCodecCtx))
+	{
+		avcodec_flush_buffers(m_pAvCodecCtx);
+	}
+}
+
+void UncompressedSampleProvider::SetKeyFramesOnly(bool isKeyFramesOnly)
+{
+	m_isKeyFramesOnly = isKeyFramesOnly;
+}
+
 HRESULT UncompressedSampleProvider::ProcessDecodedFrame(DataWriter^ dataWriter)
 {
 	return S_OK;
@@ -35,51 +69,22 @@ HRESULT UncompressedSampleProvider::ProcessDecodedFrame(DataWriter^ dataWriter)
 // Return S_FALSE for an incomplete frame
 HRESULT UncompressedSampleProvider::GetFrameFromFFmpegDecoder(AVPacket* avPacket)
 {
-	HRESULT hr = S_OK;
-	int decodeFrame = 0;
+	int64 start = GetPipelineTicks();
+	TraceSpan span("decode", GetStreamIndex(), avPacket != nullptr ? avPacket->pts : AV_NOPTS_VALUE);
+	HRESULT hr = DecodeNextFrame(m_pAvCodecCtx, avPacket, m_isKeyFramesOnly, &m_pAvFrame);
 
-	if (avPacket != nullptr)
-	{
-		int sendPacketResult = avcodec_send_packet(m_pAvCodecCtx, avPacket);
-		if (sendPacketResult == AVERROR(EAGAIN))
-		{
-			// The decoder should have been drained and always ready to access input
-			_ASSERT(FALSE);
-			hr = E_UNEXPECTED;
-		}
-		else if (sendPacketResult < 0)
-		{
-			// We failed to send the packet
-			hr = E_FAIL;
-			DebugMessage(L"Decoder failed on the sample\n");
-		}
-	}
-	if (SUCCEEDED(hr))
+	int64 elapsed = GetPipelineTicks() - start;
+	m_pCounters->decodeTicks.Add(elapsed);
+	m_pendingDecodeTicks += elapsed;
+	if (hr == S_OK)
 	{
-		AVFrame *pFrame = av_frame_alloc();
-		// Try to get a frame from the decoder.
-		decodeFrame = avcodec_receive_frame(m_pAvCodecCtx, pFrame);
-
-		// The decoder is empty, send a packet to it.
-		if (decodeFrame == AVERROR(EAGAIN))
-		{
-			// The decoder doesn't have enough data to produce a frame,
-			// return S_FALSE to indicate a partial frame
-			hr = S_FALSE;
-			av_frame_unref(pFrame);
-			av_frame_free(&pFrame);
-		}
-		else if (decodeFrame < 0)
-		{
-			hr = E_FAIL;
-			av_frame_unref(pFrame);
-			av_frame_free(&pFrame);
-			DebugMessage(L"Failed to get a frame from the decoder\n");
-		}
-		else
+		// A frame takes the time of every packet sent since the previous one, only video frames have a type
+		int typeIndex = m_pAvFrame->pict_type == AV_PICTURE_TYPE_I ? 0 : m_pAvFrame->pict_type == AV_PICTURE_TYPE_P ? 1 : m_pAvFrame->pict_type == AV_PICTURE_TYPE_B ? 2 : -1;
+		if (typeIndex >= 0 && m_pAvCodecCtx->codec_type == AVMEDIA_TYPE_VIDEO)
 		{
-			m_pAvFrame = pFrame;
+			m_pReader->GetCounters()->videoDecodeLatency[typeIndex].Record(m_pendingDecodeTicks);
 		}
+		m_pendingDecodeTicks = 0;
 	}
 
 	return hr;
@@ -28,11 +28,16 @@ namespace FFmpegInterop
 {
 	ref class UncompressedSampleProvider abstract : public MediaSampleProvider
 	{
+	public:
+		virtual void Flush() override;
+
 	internal:
 		// Try to get a frame from FFmpeg, otherwise, feed a frame to start decoding
 		virtual HRESULT GetFrameFromFFmpegDecoder(AVPacket* avPacket);
 		virtual HRESULT DecodeAVPacket(DataWriter^ dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration) override;
 		virtual HRESULT ProcessDecodedFrame(DataWriter^ dataWriter);
+		virtual HRESULT AllocateResources() override;
+		virtual void SetKeyFramesOnly(bool isKeyFramesOnly) override;
 		UncompressedSampleProvider(
 			FFmpegReader^ reader,
 			AVFormatContext* avFormatCtx,
@@ -40,6 +45,13 @@ namespace FFmpegInterop
 
 	internal:
 		AVFrame* m_pAvFrame;
+
+	private:
+		// Decoding time since the decoder last output a frame
+		int64 m_pendingDecodeTicks;
+
+		// Drain the decoder after every packet rather than let it hold frames back for reordering
+		bool m_isKeyFramesOnly;
 	};
 }
 
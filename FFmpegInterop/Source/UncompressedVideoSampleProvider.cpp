@@ -18,6 +18,7 @@
 
 #include "pch.h"
 #include "UncompressedVideoSampleProvider.h"
+#include "ContextPool.h"
 #include <mfapi.h>
 
 extern "C"
@@ -34,6 +35,9 @@ UncompressedVideoSampleProvider::UncompressedVideoSampleProvider(
 	AVCodecContext* avCodecCtx)
 	: UncompressedSampleProvider(reader, avFormatCtx, avCodecCtx)
 	, m_pSwsCtx(nullptr)
+	, m_seekTarget(-1)
+	, m_isKeyFramePreview(false)
+	, m_minFramePts(AV_NOPTS_VALUE)
 {
 	for (int i = 0; i < 4; i++)
 	{
@@ -49,17 +53,15 @@ HRESULT UncompressedVideoSampleProvider::AllocateResources()
 	if (SUCCEEDED(hr))
 	{
 		// Setup software scaler to convert any decoder pixel format (e.g. YUV420P) to NV12 that is supported in Windows & Windows Phone MediaElement
-		m_pSwsCtx = sws_getContext(
+		ScalerKey scalerKey = {
 			m_pAvCodecCtx->width,
 			m_pAvCodecCtx->height,
 			m_pAvCodecCtx->pix_fmt,
 			m_pAvCodecCtx->width,
 			m_pAvCodecCtx->height,
 			AV_PIX_FMT_NV12,
-			SWS_BICUBIC,
-			NULL,
-			NULL,
-			NULL);
+			SWS_BICUBIC };
+		m_pSwsCtx = ContextPool::AcquireScaler(scalerKey);
 
 		if (m_pSwsCtx == nullptr)
 		{
@@ -89,6 +91,8 @@ HRESULT UncompressedVideoSampleProvider::AllocateResources()
 
 UncompressedVideoSampleProvider::~UncompressedVideoSampleProvider()
 {
+	ClearPreviewPackets();
+
 	if (m_pAvFrame)
 	{
 		av_frame_free(&m_pAvFrame);
@@ -98,13 +102,103 @@ UncompressedVideoSampleProvider::~UncompressedVideoSampleProvider()
 	{
 		av_freep(m_rgVideoBufferData);
 	}
+
+	// Hand the scaler back for the next media with the same format
+	ContextPool::ReleaseScaler(&m_pSwsCtx);
+}
+
+void UncompressedVideoSampleProvider::Flush()
+{
+	UncompressedSampleProvider::Flush();
+	m_seekTarget = -1;
+	m_isKeyFramePreview = false;
+	m_minFramePts = AV_NOPTS_VALUE;
+	ClearPreviewPackets();
+}
+
+void UncompressedVideoSampleProvider::SetSeekTarget(LONGLONG position, bool isKeyFramePreview)
+{
+	// Timestamps are only known relative to the first sample, there is no preview before it
+	m_seekTarget = position;
+	m_isKeyFramePreview = isKeyFramePreview && m_startOffset != AV_NOPTS_VALUE;
+	m_minFramePts = AV_NOPTS_VALUE;
+	ClearPreviewPackets();
+
+	// A seek within the queued packets leaves the decoder as it is, the preview has to be the keyframe
+	if (m_isKeyFramePreview && IsAllocated())
+	{
+		avcodec_flush_buffers(m_pAvCodecCtx);
+	}
+}
+
+void UncompressedVideoSampleProvider::ClearPreviewPackets()
+{
+	for (size_t i = 0; i < m_previewPackets.size(); i++)
+	{
+		av_packet_unref(&m_previewPackets[i]);
+	}
+	m_previewPackets.clear();
 }
 
 HRESULT UncompressedVideoSampleProvider::DecodeAVPacket(DataWriter^ dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration)
 {
 	HRESULT hr = S_OK;
+
+	// Keep a reference to what the decoder gets until the preview is out
+	if (m_isKeyFramePreview && avPacket != nullptr)
+	{
+		AVPacket previewPacket;
+		av_init_packet(&previewPacket);
+		previewPacket.data = NULL;
+		previewPacket.size = 0;
+		if (av_packet_ref(&previewPacket, avPacket) == 0)
+		{
+			m_previewPackets.push_back(previewPacket);
+		}
+	}
+
 	hr = UncompressedSampleProvider::DecodeAVPacket(dataWriter, avPacket, framePts, frameDuration);
 
+	// Timestamps are only known relative to the first sample
+	if (hr == S_OK && m_seekTarget >= 0 && m_startOffset != AV_NOPTS_VALUE)
+	{
+		double timeBase = av_q2d(m_pAvFormatCtx->streams[GetStreamIndex()]->time_base) * 10000000;
+		if (m_isKeyFramePreview)
+		{
+			// While scrubbing show the first frame after the seek, the keyframe before the target, at the
+			// target right away. A frame threaded decoder already holds the packets after it, so it starts over
+			// from the keyframe and decodes up to the target again in case the scrubbing stops here.
+			framePts = m_startOffset + (int64_t)(m_seekTarget / timeBase);
+			m_minFramePts = framePts + 1;
+			m_isKeyFramePreview = false;
+			avcodec_flush_buffers(m_pAvCodecCtx);
+			RequeuePackets(m_previewPackets);
+		}
+		else if ((framePts + frameDuration - m_startOffset) * timeBase <= m_seekTarget)
+		{
+			// The pipeline would drop this frame for being before the start position, don't convert it
+			av_frame_free(&m_pAvFrame);
+			hr = S_FALSE;
+		}
+		else
+		{
+			m_seekTarget = -1;
+		}
+	}
+
+	// The frame reaching the target starts before the preview shown there, keep the timestamps going forward
+	if (hr == S_OK && m_minFramePts != AV_NOPTS_VALUE)
+	{
+		if (framePts < m_minFramePts)
+		{
+			framePts = m_minFramePts++;
+		}
+		else
+		{
+			m_minFramePts = AV_NOPTS_VALUE;
+		}
+	}
+
 	// Don't set a timestamp on S_FALSE
 	if (hr == S_OK)
 	{
@@ -141,15 +235,18 @@ MediaStreamSample^ UncompressedVideoSampleProvider::GetNextSample()
 HRESULT UncompressedVideoSampleProvider::WriteAVPacketToStream(DataWriter^ dataWriter, AVPacket* avPacket)
 {
 	// Convert decoded video pixel format to NV12 using FFmpeg software scaler
-	if (sws_scale(m_pSwsCtx, (const uint8_t **)(m_pAvFrame->data), m_pAvFrame->linesize, 0, m_pAvCodecCtx->height, m_rgVideoBufferData, m_rgVideoBufferLineSize) < 0)
+	HRESULT hr = S_OK;
+	{
+		ScopedPipelineTimer timer(m_pCounters->convertTicks);
+		TraceSpan span("convert", GetStreamIndex(), m_pAvFrame->pts);
+		DataWriterSampleBuffer buffer(dataWriter);
+		hr = WriteNV12Frame(buffer, m_pSwsCtx, m_pAvFrame, m_pAvCodecCtx->height, m_rgVideoBufferData, m_rgVideoBufferLineSize);
+	}
+	if (FAILED(hr))
 	{
-		return E_FAIL;
+		return hr;
 	}
 
-	auto YBuffer = ref new Platform::Array<uint8_t>(m_rgVideoBufferData[0], m_rgVideoBufferLineSize[0] * m_pAvCodecCtx->height);
-	auto UVBuffer = ref new Platform::Array<uint8_t>(m_rgVideoBufferData[1], m_rgVideoBufferLineSize[1] * m_pAvCodecCtx->height / 2);
-	dataWriter->WriteBytes(YBuffer);
-	dataWriter->WriteBytes(UVBuffer);
 	av_frame_unref(m_pAvFrame);
 	av_frame_free(&m_pAvFrame);
 
@@ -18,6 +18,7 @@
 
 #pragma once
 #include "UncompressedSampleProvider.h"
+#include <vector>
 
 extern "C"
 {
@@ -32,6 +33,7 @@ namespace FFmpegInterop
 	public:
 		virtual ~UncompressedVideoSampleProvider();
 		virtual MediaStreamSample^ GetNextSample() override;
+		virtual void Flush() override;
 	internal:
 		UncompressedVideoSampleProvider(
 			FFmpegReader^ reader,
@@ -40,8 +42,21 @@ namespace FFmpegInterop
 		virtual HRESULT WriteAVPacketToStream(DataWriter^ writer, AVPacket* avPacket) override;
 		virtual HRESULT DecodeAVPacket(DataWriter^ dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration) override;
 		virtual HRESULT AllocateResources() override;
+		virtual void SetSeekTarget(LONGLONG position, bool isKeyFramePreview) override;
 
 	private:
+		void ClearPreviewPackets();
+
+		// Frames before the target of the last seek are decoded but not converted, -1 once it is reached
+		LONGLONG m_seekTarget;
+		bool m_isKeyFramePreview;
+
+		// Packets sent to the decoder while the preview is pending, they are decoded again after it
+		std::vector<AVPacket> m_previewPackets;
+
+		// Frames decoded again after a preview are shown after it, AV_NOPTS_VALUE once they catch up
+		int64_t m_minFramePts;
+
 		SwsContext* m_pSwsCtx;
 		int m_rgVideoBufferLineSize[4];
 		uint8_t* m_rgVideoBufferData[4];
@@ -0,0 +1,473 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "VideoFrameExtractor.h"
+#include "ContextPool.h"
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+}
+
+using namespace FFmpegInterop;
+using namespace Platform;
+using namespace Windows::Storage::Streams;
+
+// Maximum number of packets read looking for a decodable keyframe
+const int MAXKEYFRAMEPACKETS = 256;
+
+HRESULT VideoFrameExtractor::ExtractFrame(
+	AVFormatContext* avFormatCtx,
+	FFmpegReader^ reader,
+	int streamIndex,
+	int64_t position,
+	int width,
+	int height,
+	VideoFrameFormat format,
+	MediaThumbnailData^* thumbnailData)
+{
+	HRESULT hr = S_OK;
+	AVCodecParameters* codecpar = avFormatCtx->streams[streamIndex]->codecpar;
+	AVFrame* avFrame = nullptr;
+
+	if (codecpar->width <= 0 || codecpar->height <= 0)
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		GetOutputSize(codecpar, &width, &height);
+
+		avFrame = av_frame_alloc();
+		if (avFrame == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = DecodeKeyFrame(avFormatCtx, reader, streamIndex, position, width, height, avFrame);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = ConvertFrame(avFrame, width, height, format, thumbnailData);
+	}
+
+	av_frame_free(&avFrame);
+
+	return hr;
+}
+
+HRESULT VideoFrameExtractor::ConvertFrame(AVFrame* avFrame, int width, int height, VideoFrameFormat format, MediaThumbnailData^* thumbnailData)
+{
+	HRESULT hr = S_OK;
+	AVFrame* scaledFrame = av_frame_alloc();
+	if (scaledFrame == nullptr)
+	{
+		hr = E_OUTOFMEMORY;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = ScaleFrame(avFrame, width, height, GetPixelFormat(format), scaledFrame);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		IBuffer^ buffer;
+		String^ extension;
+		hr = CreateImage(scaledFrame, format, &buffer, &extension);
+		if (SUCCEEDED(hr))
+		{
+			*thumbnailData = ref new MediaThumbnailData(buffer, extension, width, height);
+		}
+	}
+
+	av_frame_free(&scaledFrame);
+
+	return hr;
+}
+
+void VideoFrameExtractor::GetOutputSize(const AVCodecParameters* codecpar, int* width, int* height)
+{
+	// Size the output after the display aspect ratio of the video
+	int displayWidth = codecpar->width;
+	int displayHeight = codecpar->height;
+	if (codecpar->sample_aspect_ratio.num > 0 && codecpar->sample_aspect_ratio.den > 0)
+	{
+		displayWidth = (int)av_rescale(displayWidth, codecpar->sample_aspect_ratio.num, codecpar->sample_aspect_ratio.den);
+	}
+
+	if (*width <= 0 && *height <= 0)
+	{
+		*width = displayWidth;
+		*height = displayHeight;
+	}
+	else if (*width <= 0)
+	{
+		*width = (int)av_rescale(*height, displayWidth, displayHeight);
+	}
+	else if (*height <= 0)
+	{
+		*height = (int)av_rescale(*width, displayHeight, displayWidth);
+	}
+
+	// Chroma subsampled formats need an even size
+	*width = max(2, (*width + 1) & ~1);
+	*height = max(2, (*height + 1) & ~1);
+}
+
+AVPixelFormat VideoFrameExtractor::GetPixelFormat(VideoFrameFormat format)
+{
+	switch (format)
+	{
+	case VideoFrameFormat::Jpeg: return AV_PIX_FMT_YUVJ420P;
+	case VideoFrameFormat::Png: return AV_PIX_FMT_RGB24;
+	case VideoFrameFormat::Nv12: return AV_PIX_FMT_NV12;
+	default: return AV_PIX_FMT_BGRA;
+	}
+}
+
+DecoderSettings VideoFrameExtractor::GetKeyFrameDecoderSettings(AVStream* avStream, int width, int height, int threadCount)
+{
+	// Let the decoder downscale as far as the output size allows
+	AVCodec* avCodec = avcodec_find_decoder(avStream->codecpar->codec_id);
+	int maxLowres = avCodec != nullptr ? avCodec->max_lowres : 0;
+	int lowres = 0;
+	while (lowres < maxLowres
+		&& (avStream->codecpar->width >> (lowres + 1)) >= width
+		&& (avStream->codecpar->height >> (lowres + 1)) >= height)
+	{
+		lowres++;
+	}
+
+	// Only keyframes are needed. Frame threading would only delay them.
+	DecoderSettings settings = { lowres, threadCount, FF_THREAD_SLICE };
+	return settings;
+}
+
+HRESULT VideoFrameExtractor::OpenKeyFrameDecoder(AVStream* avStream, const DecoderSettings& settings, AVCodecContext** avCodecCtx)
+{
+	HRESULT hr = S_OK;
+
+	// A decoder left over from an earlier thumbnail of media with the same format will do
+	*avCodecCtx = ContextPool::AcquireCodecContext(avStream->codecpar, &settings);
+	if (*avCodecCtx != nullptr)
+	{
+		(*avCodecCtx)->skip_frame = AVDISCARD_NONKEY;
+		return hr;
+	}
+
+	AVCodec* avCodec = avcodec_find_decoder(avStream->codecpar->codec_id);
+	if (avCodec == nullptr)
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		*avCodecCtx = avcodec_alloc_context3(avCodec);
+		if (*avCodecCtx == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		if (avcodec_parameters_to_context(*avCodecCtx, avStream->codecpar) < 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		(*avCodecCtx)->lowres = settings.lowres;
+		(*avCodecCtx)->skip_frame = AVDISCARD_NONKEY;
+		(*avCodecCtx)->thread_count = settings.threadCount;
+		(*avCodecCtx)->thread_type = settings.threadType;
+
+		if (avcodec_open2(*avCodecCtx, avCodec, NULL) < 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (FAILED(hr))
+	{
+		avcodec_free_context(avCodecCtx);
+	}
+
+	return hr;
+}
+
+HRESULT VideoFrameExtractor::CreateImage(AVFrame* avFrame, VideoFrameFormat format, IBuffer^* buffer, String^* extension)
+{
+	HRESULT hr = S_OK;
+
+	switch (format)
+	{
+	case VideoFrameFormat::Jpeg:
+		hr = EncodeFrame(avFrame, AV_CODEC_ID_MJPEG, buffer);
+		*extension = ".jpeg";
+		break;
+	case VideoFrameFormat::Png:
+		hr = EncodeFrame(avFrame, AV_CODEC_ID_PNG, buffer);
+		*extension = ".png";
+		break;
+	case VideoFrameFormat::Nv12:
+		hr = CopyFrame(avFrame, buffer);
+		*extension = ".nv12";
+		break;
+	default:
+		hr = CopyFrame(avFrame, buffer);
+		*extension = ".bgra";
+		break;
+	}
+
+	return hr;
+}
+
+HRESULT VideoFrameExtractor::DecodeKeyFrame(AVFormatContext* avFormatCtx, FFmpegReader^ reader, int streamIndex, int64_t position, int width, int height, AVFrame* avFrame)
+{
+	HRESULT hr = S_OK;
+	AVStream* avStream = avFormatCtx->streams[streamIndex];
+	AVCodecContext* avCodecCtx = nullptr;
+
+	DecoderSettings settings = GetKeyFrameDecoderSettings(avStream, width, height, std::thread::hardware_concurrency());
+	hr = OpenKeyFrameDecoder(avStream, settings, &avCodecCtx);
+
+	if (SUCCEEDED(hr))
+	{
+		// Demux only the keyframes of the video stream, for the demuxers which can skip the others
+		std::vector<AVDiscard> previousDiscard;
+		for (unsigned int i = 0; i < avFormatCtx->nb_streams; i++)
+		{
+			previousDiscard.push_back(avFormatCtx->streams[i]->discard);
+			avFormatCtx->streams[i]->discard = (int)i == streamIndex ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+		}
+
+		// Jump to the keyframe at or before the position
+		int seekResult = reader->SeekFrame(streamIndex, position, AVSEEK_FLAG_BACKWARD);
+		if (seekResult == AVERROR_EXIT)
+		{
+			hr = E_ABORT;
+		}
+		else if (seekResult < 0)
+		{
+			DebugMessage(L"Could not seek, using the current position\n");
+		}
+
+		AVPacket avPacket;
+		av_init_packet(&avPacket);
+		avPacket.data = NULL;
+		avPacket.size = 0;
+
+		int decodeResult = AVERROR(EAGAIN);
+		for (int packetCount = 0; SUCCEEDED(hr) && decodeResult == AVERROR(EAGAIN) && packetCount < MAXKEYFRAMEPACKETS; )
+		{
+			int readResult = reader->ReadFrame(&avPacket);
+			if (readResult == AVERROR_EXIT)
+			{
+				// Interrupted or timed out, what was read so far isn't worth decoding
+				hr = E_ABORT;
+				break;
+			}
+			if (readResult < 0)
+			{
+				// End of the file, get whatever the decoder still holds
+				avcodec_send_packet(avCodecCtx, NULL);
+				decodeResult = avcodec_receive_frame(avCodecCtx, avFrame);
+				break;
+			}
+
+			if (avPacket.stream_index == streamIndex)
+			{
+				packetCount++;
+				if (avcodec_send_packet(avCodecCtx, &avPacket) >= 0)
+				{
+					decodeResult = avcodec_receive_frame(avCodecCtx, avFrame);
+					if (decodeResult == AVERROR(EAGAIN) && (avPacket.flags & AV_PKT_FLAG_KEY))
+					{
+						// Drain instead of feeding more packets, reordering decoders hold the keyframe back otherwise
+						avcodec_send_packet(avCodecCtx, NULL);
+						decodeResult = avcodec_receive_frame(avCodecCtx, avFrame);
+						if (decodeResult < 0)
+						{
+							// Incomplete keyframe, such as a single field, carry on with the next one
+							avcodec_flush_buffers(avCodecCtx);
+							decodeResult = AVERROR(EAGAIN);
+						}
+					}
+				}
+			}
+			av_packet_unref(&avPacket);
+		}
+
+		if (SUCCEEDED(hr) && decodeResult < 0)
+		{
+			DebugMessage(L"Could not decode a keyframe\n");
+			hr = E_FAIL;
+		}
+
+		for (unsigned int i = 0; i < avFormatCtx->nb_streams; i++)
+		{
+			avFormatCtx->streams[i]->discard = previousDiscard[i];
+		}
+	}
+
+	// The frame keeps a reference on its data, the decoder goes back to the pool
+	ContextPool::ReleaseCodecContext(&avCodecCtx, avStream->codecpar, &settings);
+
+	return hr;
+}
+
+HRESULT VideoFrameExtractor::ScaleFrame(AVFrame* avFrame, int width, int height, AVPixelFormat pixelFormat, AVFrame* scaledFrame)
+{
+	HRESULT hr = S_OK;
+
+	ScalerKey scalerKey = { avFrame->width, avFrame->height, (AVPixelFormat)avFrame->format, width, height, pixelFormat, SWS_BILINEAR };
+	SwsContext* swsCtx = ContextPool::AcquireScaler(scalerKey);
+	if (swsCtx == nullptr)
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		scaledFrame->format = pixelFormat;
+		scaledFrame->width = width;
+		scaledFrame->height = height;
+		if (av_frame_get_buffer(scaledFrame, 32) < 0)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		sws_scale(swsCtx, avFrame->data, avFrame->linesize, 0, avFrame->height, scaledFrame->data, scaledFrame->linesize);
+	}
+
+	ContextPool::ReleaseScaler(&swsCtx);
+
+	return hr;
+}
+
+HRESULT VideoFrameExtractor::EncodeFrame(AVFrame* avFrame, AVCodecID codecId, IBuffer^* buffer)
+{
+	HRESULT hr = S_OK;
+	AVCodecContext* avCodecCtx = nullptr;
+
+	AVCodec* avCodec = avcodec_find_encoder(codecId);
+	if (avCodec == nullptr)
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		avCodecCtx = avcodec_alloc_context3(avCodec);
+		if (avCodecCtx == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		avCodecCtx->width = avFrame->width;
+		avCodecCtx->height = avFrame->height;
+		avCodecCtx->pix_fmt = (AVPixelFormat)avFrame->format;
+		avCodecCtx->time_base.num = 1;
+		avCodecCtx->time_base.den = 1;
+
+		// Use a fixed, good quality instead of a bitrate for JPEG
+		avCodecCtx->flags |= AV_CODEC_FLAG_QSCALE;
+		avCodecCtx->global_quality = FF_QP2LAMBDA * 3;
+		avFrame->quality = avCodecCtx->global_quality;
+		avFrame->pts = 0;
+
+		if (avcodec_open2(avCodecCtx, avCodec, NULL) < 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		AVPacket avPacket;
+		av_init_packet(&avPacket);
+		avPacket.data = NULL;
+		avPacket.size = 0;
+
+		if (avcodec_send_frame(avCodecCtx, avFrame) < 0 || avcodec_send_frame(avCodecCtx, NULL) < 0 || avcodec_receive_packet(avCodecCtx, &avPacket) < 0)
+		{
+			hr = E_FAIL;
+		}
+		else
+		{
+			auto data = ref new Array<uint8_t>(avPacket.data, avPacket.size);
+			DataWriter^ writer = ref new DataWriter();
+			writer->WriteBytes(data);
+			*buffer = writer->DetachBuffer();
+		}
+		av_packet_unref(&avPacket);
+	}
+
+	avcodec_free_context(&avCodecCtx);
+
+	return hr;
+}
+
+HRESULT VideoFrameExtractor::CopyFrame(AVFrame* avFrame, IBuffer^* buffer)
+{
+	HRESULT hr = S_OK;
+	AVPixelFormat pixelFormat = (AVPixelFormat)avFrame->format;
+
+	// Pack the planes without any padding between the lines
+	int size = av_image_get_buffer_size(pixelFormat, avFrame->width, avFrame->height, 1);
+	if (size < 0)
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		auto data = ref new Array<uint8_t>(size);
+		if (av_image_copy_to_buffer(data->Data, size, avFrame->data, avFrame->linesize, pixelFormat, avFrame->width, avFrame->height, 1) < 0)
+		{
+			hr = E_FAIL;
+		}
+		else
+		{
+			DataWriter^ writer = ref new DataWriter();
+			writer->WriteBytes(data);
+			*buffer = writer->DetachBuffer();
+		}
+	}
+
+	return hr;
+}
@@ -0,0 +1,73 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include "MediaThumbnailData.h"
+#include "ContextPool.h"
+#include "FFmpegReader.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+namespace FFmpegInterop
+{
+	//////////////////////////////////////////////////////////////////////////
+	//  VideoFrameExtractor
+	//  Description: Grabs a single video frame without going through the
+	//               playback pipeline. Only the keyframe at or before the
+	//               requested position is decoded, at the lowest resolution
+	//               the decoder supports that still covers the output size.
+	//////////////////////////////////////////////////////////////////////////
+
+	class VideoFrameExtractor
+	{
+	public:
+		// position is in the time base of the stream. A width or height of 0 is computed from the display
+		// aspect ratio, both 0 keep the size of the video. Seeking and reading go through the reader, so they are
+		// subject to its read timeout and abort with E_ABORT when it is interrupted.
+		static HRESULT ExtractFrame(
+			AVFormatContext* avFormatCtx,
+			FFmpegReader^ reader,
+			int streamIndex,
+			int64_t position,
+			int width,
+			int height,
+			VideoFrameFormat format,
+			MediaThumbnailData^* thumbnailData);
+
+		// Helpers shared with SpriteSheetGenerator
+		static void GetOutputSize(const AVCodecParameters* codecpar, int* width, int* height);
+		static AVPixelFormat GetPixelFormat(VideoFrameFormat format);
+
+		// Keyframe decoders are borrowed from the ContextPool and go back to it with the same settings
+		static DecoderSettings GetKeyFrameDecoderSettings(AVStream* avStream, int width, int height, int threadCount);
+		static HRESULT OpenKeyFrameDecoder(AVStream* avStream, const DecoderSettings& settings, AVCodecContext** avCodecCtx);
+		static HRESULT CreateImage(AVFrame* avFrame, VideoFrameFormat format, IBuffer^* buffer, String^* extension);
+
+		// Scale a decoded frame to width x height, as computed by GetOutputSize, and turn it into an image
+		static HRESULT ConvertFrame(AVFrame* avFrame, int width, int height, VideoFrameFormat format, MediaThumbnailData^* thumbnailData);
+
+	private:
+		static HRESULT DecodeKeyFrame(AVFormatContext* avFormatCtx, FFmpegReader^ reader, int streamIndex, int64_t position, int width, int height, AVFrame* avFrame);
+		static HRESULT ScaleFrame(AVFrame* avFrame, int width, int height, AVPixelFormat pixelFormat, AVFrame* scaledFrame);
+		static HRESULT EncodeFrame(AVFrame* avFrame, AVCodecID codecId, IBuffer^* buffer);
+		static HRESULT CopyFrame(AVFrame* avFrame, IBuffer^* buffer);
+	};
+}
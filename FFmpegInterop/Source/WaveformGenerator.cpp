@@ -0,0 +1,550 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "WaveformGenerator.h"
+#include "DurationScanner.h"
+#include "FFmpegInteropMSS.h"
+#include "FileStreamIO.h"
+#include "ContextPool.h"
+#include <thread>
+
+using namespace concurrency;
+using namespace FFmpegInterop;
+
+// Size of the buffer of each input. Large reads let the demuxers keep up with the decoders.
+const int WAVEFORMBUFFERSZ = 256 * 1024;
+
+// Upper limit of decoding threads, and the shortest segment worth its own input and decoder (in seconds)
+const unsigned int MAXWAVEFORMTHREADS = 8;
+const int64_t MINSEGMENTDURATION = 60;
+
+// Audio decoded before the start of a segment and thrown away, so the decoder state has settled (in seconds)
+const double SEGMENTPREROLL = 0.5;
+
+WaveformGenerator::WaveformGenerator(IRandomAccessStream^ stream, const std::string& url, FFmpegInteropConfig^ config)
+	: m_stream(stream)
+	, m_url(url)
+	, m_config(config)
+	, m_streamIndex(AVERROR_STREAM_NOT_FOUND)
+	, m_pCodecpar(nullptr)
+	, m_startTime(0)
+	, m_duration(0)
+	, m_totalSamples(0)
+	, m_isSeekable(false)
+{
+}
+
+WaveformGenerator::~WaveformGenerator()
+{
+	avcodec_parameters_free(&m_pCodecpar);
+}
+
+HRESULT WaveformGenerator::Generate(int bucketCount, cancellation_token ct, std::vector<PeakAccumulator>& buckets, int64_t* duration)
+{
+	HRESULT hr = bucketCount > 0 ? S_OK : E_INVALIDARG;
+
+	if (SUCCEEDED(hr))
+	{
+		hr = Probe(ct);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		m_buckets.resize(bucketCount);
+		for (auto& bucket : m_buckets)
+		{
+			ResetPeaks(&bucket);
+		}
+
+		// Segments only pay off when they are long enough to hide the cost of opening and seeking
+		unsigned int segmentCount = 1;
+		if (m_isSeekable)
+		{
+			segmentCount = max(1u, min(std::thread::hardware_concurrency(), MAXWAVEFORMTHREADS));
+			segmentCount = (unsigned int)min((int64_t)segmentCount, max(1LL, m_duration / (MINSEGMENTDURATION * AV_TIME_BASE)));
+			segmentCount = min(segmentCount, (unsigned int)bucketCount);
+		}
+
+		std::vector<task<HRESULT>> segments;
+		for (unsigned int i = 0; i < segmentCount; i++)
+		{
+			int firstBucket = (int)((int64_t)bucketCount * i / segmentCount);
+			int endBucket = (int)((int64_t)bucketCount * (i + 1) / segmentCount);
+			segments.push_back(create_task([this, firstBucket, endBucket, ct]()
+			{
+				return RunSegment(firstBucket, endBucket, ct);
+			}));
+		}
+
+		for (auto& segment : segments)
+		{
+			HRESULT segmentResult = segment.get();
+			if (SUCCEEDED(hr) && FAILED(segmentResult))
+			{
+				hr = segmentResult;
+			}
+		}
+
+		// Some demuxers only pretend to seek, go through the media in one piece instead
+		if (FAILED(hr) && segmentCount > 1 && !ct.is_canceled())
+		{
+			DebugMessage(L"Decoding the waveform in segments failed, decoding it in one pass\n");
+			for (auto& bucket : m_buckets)
+			{
+				ResetPeaks(&bucket);
+			}
+			hr = RunSegment(0, bucketCount, ct);
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		buckets.swap(m_buckets);
+		*duration = m_duration;
+	}
+
+	return hr;
+}
+
+HRESULT WaveformGenerator::OpenInput(IRandomAccessStream^ stream, InterruptHandler* interruptHandler, AVFormatContext** avFormatCtx, IStream** fileStreamData, AVIOContext** avIOCtx)
+{
+	HRESULT hr = S_OK;
+	AVDictionary* avDict = nullptr;
+
+	if (stream != nullptr)
+	{
+		hr = CreateFileStreamIOContext(stream, WAVEFORMBUFFERSZ, fileStreamData, avIOCtx);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		*avFormatCtx = avformat_alloc_context();
+		if (*avFormatCtx == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = FFmpegInteropMSS::ParseOptions(m_config->FFmpegOptions, &avDict);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		if (stream != nullptr)
+		{
+			(*avFormatCtx)->pb = *avIOCtx;
+			(*avFormatCtx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+		}
+
+		interruptHandler->Attach(*avFormatCtx);
+		interruptHandler->StartOperation(m_config->OpenTimeout.Duration);
+		if (avformat_open_input(avFormatCtx, stream != nullptr ? "" : m_url.c_str(), NULL, &avDict) < 0)
+		{
+			hr = E_FAIL;
+		}
+		interruptHandler->EndOperation();
+	}
+
+	av_dict_free(&avDict);
+	return hr;
+}
+
+// Find the audio stream and the duration of the media, which the buckets are laid out on
+HRESULT WaveformGenerator::Probe(cancellation_token ct)
+{
+	HRESULT hr = S_OK;
+	InterruptHandler interruptHandler;
+	AVFormatContext* avFormatCtx = nullptr;
+	IStream* fileStreamData = nullptr;
+	AVIOContext* avIOCtx = nullptr;
+
+	auto registration = ct.register_callback([&interruptHandler]() { interruptHandler.Cancel(); });
+
+	hr = OpenInput(m_stream, &interruptHandler, &avFormatCtx, &fileStreamData, &avIOCtx);
+
+	if (SUCCEEDED(hr))
+	{
+		interruptHandler.StartOperation(m_config->OpenTimeout.Duration);
+		if (avformat_find_stream_info(avFormatCtx, NULL) < 0)
+		{
+			hr = E_FAIL;
+		}
+
+		// The buckets need the length of the media up front, the header may not have it
+		if (SUCCEEDED(hr))
+		{
+			DurationScanner::UpdateDuration(avFormatCtx, DurationScanMode::Auto);
+		}
+		interruptHandler.EndOperation();
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		m_streamIndex = av_find_best_stream(avFormatCtx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+		if (m_streamIndex < 0 || avFormatCtx->duration <= 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		AVStream* avStream = avFormatCtx->streams[m_streamIndex];
+		m_pCodecpar = avcodec_parameters_alloc();
+		if (m_pCodecpar == nullptr || avcodec_parameters_copy(m_pCodecpar, avStream->codecpar) < 0 || m_pCodecpar->sample_rate <= 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		AVStream* avStream = avFormatCtx->streams[m_streamIndex];
+		m_timeBase = avStream->time_base;
+		m_startTime = avStream->start_time != AV_NOPTS_VALUE ? avStream->start_time : 0;
+		m_duration = avFormatCtx->duration;
+		m_totalSamples = av_rescale(m_duration, m_pCodecpar->sample_rate, AV_TIME_BASE);
+
+		// Each segment opens the media again and seeks into it, which needs the streams to be in the header
+		m_isSeekable = avFormatCtx->pb != nullptr
+			&& (avFormatCtx->pb->seekable & AVIO_SEEKABLE_NORMAL) != 0
+			&& !(avFormatCtx->ctx_flags & AVFMTCTX_NOHEADER);
+	}
+
+	ct.deregister_callback(registration);
+	avformat_close_input(&avFormatCtx);
+	FreeFileStreamIOContext(&fileStreamData, &avIOCtx);
+
+	return SUCCEEDED(hr) && m_totalSamples <= 0 ? E_FAIL : hr;
+}
+
+// Open an input of its own and fill the buckets [firstBucket, endBucket) from it
+HRESULT WaveformGenerator::RunSegment(int firstBucket, int endBucket, cancellation_token ct)
+{
+	HRESULT hr = S_OK;
+	InterruptHandler interruptHandler;
+	AVFormatContext* avFormatCtx = nullptr;
+	IStream* fileStreamData = nullptr;
+	AVIOContext* avIOCtx = nullptr;
+
+	WaveformSegment segment;
+	segment.firstBucket = firstBucket;
+	segment.endBucket = endBucket;
+	segment.startSample = GetBucketStart(firstBucket);
+	segment.endSample = endBucket < (int)m_buckets.size() ? GetBucketStart(endBucket) : INT64_MAX;
+	segment.nextSample = 0;
+	segment.avCodecCtx = nullptr;
+	segment.avFrame = nullptr;
+	segment.swrCtx = nullptr;
+
+	auto registration = ct.register_callback([&interruptHandler]() { interruptHandler.Cancel(); });
+
+	// Every segment reads through its own clone of the stream, they can't share a read position
+	IRandomAccessStream^ stream = m_stream != nullptr ? m_stream->CloneStream() : nullptr;
+	if (m_stream != nullptr && stream == nullptr)
+	{
+		hr = E_OUTOFMEMORY;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = OpenInput(stream, &interruptHandler, &avFormatCtx, &fileStreamData, &avIOCtx);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = DecodeSegment(avFormatCtx, &interruptHandler, segment);
+	}
+
+	ct.deregister_callback(registration);
+	avcodec_free_context(&segment.avCodecCtx);
+	av_frame_free(&segment.avFrame);
+	ContextPool::ReleaseResampler(&segment.swrCtx);
+	avformat_close_input(&avFormatCtx);
+	FreeFileStreamIOContext(&fileStreamData, &avIOCtx);
+
+	return hr;
+}
+
+HRESULT WaveformGenerator::DecodeSegment(AVFormatContext* avFormatCtx, InterruptHandler* interruptHandler, WaveformSegment& segment)
+{
+	HRESULT hr = S_OK;
+
+	if ((unsigned int)m_streamIndex >= avFormatCtx->nb_streams)
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// Only the audio stream is demuxed
+		for (unsigned int i = 0; i < avFormatCtx->nb_streams; i++)
+		{
+			avFormatCtx->streams[i]->discard = (int)i == m_streamIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+		}
+
+		if (segment.startSample > 0)
+		{
+			int64_t preroll = max((int64_t)(SEGMENTPREROLL * m_pCodecpar->sample_rate), (int64_t)m_pCodecpar->seek_preroll);
+			int64_t seekTarget = m_startTime + av_rescale_q(segment.startSample - preroll, av_make_q(1, m_pCodecpar->sample_rate), m_timeBase);
+			if (av_seek_frame(avFormatCtx, m_streamIndex, seekTarget, AVSEEK_FLAG_BACKWARD) < 0)
+			{
+				hr = E_FAIL;
+			}
+
+			// Frames without a timestamp follow on from where the seek went, not from the start of the media
+			segment.nextSample = max(segment.startSample - preroll, 0LL);
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = OpenDecoder(&segment.avCodecCtx);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		segment.avFrame = av_frame_alloc();
+		if (segment.avFrame == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	AVPacket avPacket;
+	av_init_packet(&avPacket);
+	avPacket.data = NULL;
+	avPacket.size = 0;
+
+	bool isSegmentDone = false;
+	while (SUCCEEDED(hr) && !isSegmentDone)
+	{
+		interruptHandler->StartOperation(m_config->ReadTimeout.Duration);
+		int readResult = av_read_frame(avFormatCtx, &avPacket);
+		interruptHandler->EndOperation();
+
+		if (readResult == AVERROR_EOF)
+		{
+			// Drain the frames the decoder still holds
+			avcodec_send_packet(segment.avCodecCtx, NULL);
+			hr = DecodeFrames(segment, &isSegmentDone);
+			break;
+		}
+		else if (readResult < 0)
+		{
+			hr = interruptHandler->IsCancelled() ? E_ABORT : E_FAIL;
+			break;
+		}
+
+		if (avPacket.stream_index == m_streamIndex)
+		{
+			// Broken packets only leave a gap in the waveform
+			if (avcodec_send_packet(segment.avCodecCtx, &avPacket) < 0)
+			{
+				DebugMessage(L"Skipping a packet the decoder doesn't take\n");
+			}
+			else
+			{
+				hr = DecodeFrames(segment, &isSegmentDone);
+			}
+		}
+		av_packet_unref(&avPacket);
+	}
+
+	return hr;
+}
+
+HRESULT WaveformGenerator::OpenDecoder(AVCodecContext** avCodecCtx)
+{
+	HRESULT hr = S_OK;
+
+	AVCodec* avCodec = avcodec_find_decoder(m_pCodecpar->codec_id);
+	if (avCodec == nullptr)
+	{
+		hr = E_FAIL;
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		*avCodecCtx = avcodec_alloc_context3(avCodec);
+		if (*avCodecCtx == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		if (avcodec_parameters_to_context(*avCodecCtx, m_pCodecpar) < 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		// The segments already keep every core busy
+		(*avCodecCtx)->thread_count = 1;
+		(*avCodecCtx)->pkt_timebase = m_timeBase;
+
+		// Some decoders can output float directly, which the kernels take without a conversion
+		(*avCodecCtx)->request_sample_fmt = AV_SAMPLE_FMT_FLT;
+
+		if (avcodec_open2(*avCodecCtx, avCodec, NULL) < 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	return hr;
+}
+
+// Reduce every frame the decoder has ready, isSegmentDone is set once a frame starts past the end of the segment
+HRESULT WaveformGenerator::DecodeFrames(WaveformSegment& segment, bool* isSegmentDone)
+{
+	HRESULT hr = S_OK;
+
+	while (SUCCEEDED(hr))
+	{
+		int decodeResult = avcodec_receive_frame(segment.avCodecCtx, segment.avFrame);
+		if (decodeResult == AVERROR(EAGAIN) || decodeResult == AVERROR_EOF)
+		{
+			break;
+		}
+		else if (decodeResult < 0)
+		{
+			hr = E_FAIL;
+			break;
+		}
+
+		int64_t frameStart = segment.avFrame->pts != AV_NOPTS_VALUE
+			? av_rescale_q(segment.avFrame->pts - m_startTime, m_timeBase, av_make_q(1, m_pCodecpar->sample_rate))
+			: segment.nextSample;
+		segment.nextSample = frameStart + segment.avFrame->nb_samples;
+
+		if (frameStart >= segment.endSample)
+		{
+			*isSegmentDone = true;
+		}
+		else
+		{
+			hr = AccumulateFrame(segment);
+		}
+		av_frame_unref(segment.avFrame);
+
+		if (*isSegmentDone)
+		{
+			break;
+		}
+	}
+
+	return hr;
+}
+
+// Fold the part of the decoded frame inside the segment into its buckets
+HRESULT WaveformGenerator::AccumulateFrame(WaveformSegment& segment)
+{
+	AVFrame* avFrame = segment.avFrame;
+	AVSampleFormat format = (AVSampleFormat)avFrame->format;
+	uint8_t** data = avFrame->extended_data;
+	int64_t frameStart = segment.nextSample - avFrame->nb_samples;
+
+	// Samples before the segment are preroll, or priming samples ahead of the start of the media
+	int64_t position = max(max(frameStart, segment.startSample), 0LL);
+	int64_t end = min(segment.nextSample, segment.endSample);
+	if (position >= end)
+	{
+		return S_OK;
+	}
+
+	// The kernels take float and 16 bit samples, anything else is converted to planar float first
+	AVSampleFormat packedFormat = av_get_packed_sample_fmt(format);
+	if (packedFormat != AV_SAMPLE_FMT_FLT && packedFormat != AV_SAMPLE_FMT_S16)
+	{
+		if (segment.swrCtx == nullptr)
+		{
+			int64_t channelLayout = avFrame->channel_layout ? avFrame->channel_layout : av_get_default_channel_layout(avFrame->channels);
+			ResamplerKey key = { channelLayout, AV_SAMPLE_FMT_FLTP, avFrame->sample_rate, channelLayout, format, avFrame->sample_rate };
+			segment.swrCtx = ContextPool::AcquireResampler(key);
+			if (segment.swrCtx == nullptr)
+			{
+				return E_FAIL;
+			}
+		}
+
+		segment.convertedSamples.resize((size_t)avFrame->channels * avFrame->nb_samples);
+		segment.convertedPlanes.resize(avFrame->channels);
+		for (int channel = 0; channel < avFrame->channels; channel++)
+		{
+			segment.convertedPlanes[channel] = reinterpret_cast<uint8_t*>(segment.convertedSamples.data() + (size_t)channel * avFrame->nb_samples);
+		}
+
+		if (swr_convert(segment.swrCtx, segment.convertedPlanes.data(), avFrame->nb_samples, (const uint8_t**)avFrame->extended_data, avFrame->nb_samples) < 0)
+		{
+			return E_FAIL;
+		}
+
+		format = AV_SAMPLE_FMT_FLTP;
+		data = segment.convertedPlanes.data();
+	}
+
+	int lastBucket = (int)m_buckets.size() - 1;
+	while (position < end)
+	{
+		// Samples past the expected duration go into the last bucket
+		int bucket = (int)min((int64_t)lastBucket, position * (int64_t)m_buckets.size() / m_totalSamples);
+		int64_t bucketEnd = bucket < lastBucket ? GetBucketStart(bucket + 1) : INT64_MAX;
+		int64_t count = min(end, bucketEnd) - position;
+
+		AccumulateSamples(format, data, avFrame->channels, position - frameStart, count, &m_buckets[bucket]);
+		position += count;
+	}
+
+	return S_OK;
+}
+
+void WaveformGenerator::AccumulateSamples(AVSampleFormat format, uint8_t** data, int channels, int64_t offset, int64_t count, PeakAccumulator* peaks)
+{
+	// Channels are reduced together, interleaved ones in a single run
+	bool isPlanar = av_sample_fmt_is_planar(format) != 0;
+	int planes = isPlanar ? channels : 1;
+	int samplesPerFrame = isPlanar ? 1 : channels;
+	bool isFloat = av_get_packed_sample_fmt(format) == AV_SAMPLE_FMT_FLT;
+
+	for (int plane = 0; plane < planes; plane++)
+	{
+		if (isFloat)
+		{
+			AccumulateFloatPeaks(reinterpret_cast<const float*>(data[plane]) + offset * samplesPerFrame, (size_t)(count * samplesPerFrame), peaks);
+		}
+		else
+		{
+			AccumulateS16Peaks(reinterpret_cast<const int16_t*>(data[plane]) + offset * samplesPerFrame, (size_t)(count * samplesPerFrame), peaks);
+		}
+	}
+}
+
+// First sample of the bucket, counted from the start of the media
+int64_t WaveformGenerator::GetBucketStart(int bucket)
+{
+	int64_t bucketCount = (int64_t)m_buckets.size();
+	return (bucket * m_totalSamples + bucketCount - 1) / bucketCount;
+}
@@ -0,0 +1,94 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <string>
+#include <vector>
+#include "FFmpegInteropConfig.h"
+#include "InterruptHandler.h"
+#include "WaveformKernels.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+}
+
+using namespace Windows::Storage::Streams;
+
+namespace FFmpegInterop
+{
+	// State of one decoding thread, which fills the buckets [firstBucket, endBucket)
+	struct WaveformSegment
+	{
+		int firstBucket;
+		int endBucket;
+		int64_t startSample;
+		int64_t endSample;
+		int64_t nextSample;
+		AVCodecContext* avCodecCtx;
+		AVFrame* avFrame;
+		SwrContext* swrCtx;
+		std::vector<float> convertedSamples;
+		std::vector<uint8_t*> convertedPlanes;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	//  WaveformGenerator
+	//  Description: Reduces the audio of a media to the minimum, maximum and
+	//               RMS of each bucket of time. Decoded frames are reduced
+	//               straight from the output format of the decoder, no
+	//               samples are built. When the container can seek, the
+	//               media is split into segments which are demuxed and
+	//               decoded in parallel, each from its own input.
+	//////////////////////////////////////////////////////////////////////////
+
+	class WaveformGenerator
+	{
+	public:
+		// Reads the stream, or opens the url when stream is nullptr
+		WaveformGenerator(IRandomAccessStream^ stream, const std::string& url, FFmpegInteropConfig^ config);
+		virtual ~WaveformGenerator();
+
+		// duration is in AV_TIME_BASE units
+		HRESULT Generate(int bucketCount, concurrency::cancellation_token ct, std::vector<PeakAccumulator>& buckets, int64_t* duration);
+
+	private:
+		HRESULT OpenInput(IRandomAccessStream^ stream, InterruptHandler* interruptHandler, AVFormatContext** avFormatCtx, IStream** fileStreamData, AVIOContext** avIOCtx);
+		HRESULT Probe(concurrency::cancellation_token ct);
+		HRESULT RunSegment(int firstBucket, int endBucket, concurrency::cancellation_token ct);
+		HRESULT DecodeSegment(AVFormatContext* avFormatCtx, InterruptHandler* interruptHandler, WaveformSegment& segment);
+		HRESULT OpenDecoder(AVCodecContext** avCodecCtx);
+		HRESULT DecodeFrames(WaveformSegment& segment, bool* isSegmentDone);
+		HRESULT AccumulateFrame(WaveformSegment& segment);
+		void AccumulateSamples(AVSampleFormat format, uint8_t** data, int channels, int64_t offset, int64_t count, PeakAccumulator* peaks);
+		int64_t GetBucketStart(int bucket);
+
+		IRandomAccessStream^ m_stream;
+		std::string m_url;
+		FFmpegInteropConfig^ m_config;
+		int m_streamIndex;
+		AVCodecParameters* m_pCodecpar;
+		AVRational m_timeBase;
+		int64_t m_startTime;
+		int64_t m_duration;
+		int64_t m_totalSamples;
+		bool m_isSeekable;
+		std::vector<PeakAccumulator> m_buckets;
+	};
+}
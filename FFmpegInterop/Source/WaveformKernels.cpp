@@ -0,0 +1,203 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "pch.h"
+#include "WaveformKernels.h"
+#include <algorithm>
+#include <float.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define WAVEFORM_SSE2
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define WAVEFORM_NEON
+#endif
+
+using namespace FFmpegInterop;
+
+// Scale of 16 bit samples to [-1, 1]
+const float S16SCALE = 1.0f / 32768.0f;
+
+void FFmpegInterop::ResetPeaks(PeakAccumulator* peaks)
+{
+	peaks->minimum = FLT_MAX;
+	peaks->maximum = -FLT_MAX;
+	peaks->sumSquares = 0.0;
+	peaks->count = 0;
+}
+
+void FFmpegInterop::AccumulateFloatPeaks(const float* samples, size_t count, PeakAccumulator* peaks)
+{
+	float minimum = peaks->minimum;
+	float maximum = peaks->maximum;
+	float sumSquares = 0.0f;
+	size_t i = 0;
+
+#if defined(WAVEFORM_SSE2)
+	if (count >= 4)
+	{
+		__m128 minimums = _mm_set1_ps(minimum);
+		__m128 maximums = _mm_set1_ps(maximum);
+		__m128 sums = _mm_setzero_ps();
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 values = _mm_loadu_ps(samples + i);
+			minimums = _mm_min_ps(minimums, values);
+			maximums = _mm_max_ps(maximums, values);
+			sums = _mm_add_ps(sums, _mm_mul_ps(values, values));
+		}
+
+		float lanes[3][4];
+		_mm_storeu_ps(lanes[0], minimums);
+		_mm_storeu_ps(lanes[1], maximums);
+		_mm_storeu_ps(lanes[2], sums);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			minimum = (std::min)(minimum, lanes[0][lane]);
+			maximum = (std::max)(maximum, lanes[1][lane]);
+			sumSquares += lanes[2][lane];
+		}
+	}
+#elif defined(WAVEFORM_NEON)
+	if (count >= 4)
+	{
+		float32x4_t minimums = vdupq_n_f32(minimum);
+		float32x4_t maximums = vdupq_n_f32(maximum);
+		float32x4_t sums = vdupq_n_f32(0.0f);
+		for (; i + 4 <= count; i += 4)
+		{
+			float32x4_t values = vld1q_f32(samples + i);
+			minimums = vminq_f32(minimums, values);
+			maximums = vmaxq_f32(maximums, values);
+			sums = vmlaq_f32(sums, values, values);
+		}
+
+		float lanes[3][4];
+		vst1q_f32(lanes[0], minimums);
+		vst1q_f32(lanes[1], maximums);
+		vst1q_f32(lanes[2], sums);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			minimum = (std::min)(minimum, lanes[0][lane]);
+			maximum = (std::max)(maximum, lanes[1][lane]);
+			sumSquares += lanes[2][lane];
+		}
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		float value = samples[i];
+		minimum = (std::min)(minimum, value);
+		maximum = (std::max)(maximum, value);
+		sumSquares += value * value;
+	}
+
+	// A single float sum is precise enough for one frame, the total is kept in a double
+	peaks->minimum = minimum;
+	peaks->maximum = maximum;
+	peaks->sumSquares += sumSquares;
+	peaks->count += count;
+}
+
+void FFmpegInterop::AccumulateS16Peaks(const int16_t* samples, size_t count, PeakAccumulator* peaks)
+{
+	int minimum = INT16_MAX;
+	int maximum = INT16_MIN;
+	uint64_t sumSquares = 0;
+	size_t i = 0;
+
+#if defined(WAVEFORM_SSE2)
+	if (count >= 8)
+	{
+		__m128i minimums = _mm_set1_epi16(INT16_MAX);
+		__m128i maximums = _mm_set1_epi16(INT16_MIN);
+		__m128i sums = _mm_setzero_si128();
+		__m128i zero = _mm_setzero_si128();
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+			minimums = _mm_min_epi16(minimums, values);
+			maximums = _mm_max_epi16(maximums, values);
+
+			// Each pair of squares adds up to at most 2^31, which only fits when read as unsigned
+			__m128i squares = _mm_madd_epi16(values, values);
+			sums = _mm_add_epi64(sums, _mm_unpacklo_epi32(squares, zero));
+			sums = _mm_add_epi64(sums, _mm_unpackhi_epi32(squares, zero));
+		}
+
+		int16_t minimumLanes[8];
+		int16_t maximumLanes[8];
+		uint64_t sumLanes[2];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(minimumLanes), minimums);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(maximumLanes), maximums);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(sumLanes), sums);
+		for (int lane = 0; lane < 8; lane++)
+		{
+			minimum = (std::min)(minimum, (int)minimumLanes[lane]);
+			maximum = (std::max)(maximum, (int)maximumLanes[lane]);
+		}
+		sumSquares += sumLanes[0] + sumLanes[1];
+	}
+#elif defined(WAVEFORM_NEON)
+	if (count >= 8)
+	{
+		int16x8_t minimums = vdupq_n_s16(INT16_MAX);
+		int16x8_t maximums = vdupq_n_s16(INT16_MIN);
+		int64x2_t sums = vdupq_n_s64(0);
+		for (; i + 8 <= count; i += 8)
+		{
+			int16x8_t values = vld1q_s16(samples + i);
+			minimums = vminq_s16(minimums, values);
+			maximums = vmaxq_s16(maximums, values);
+			sums = vpadalq_s32(sums, vmull_s16(vget_low_s16(values), vget_low_s16(values)));
+			sums = vpadalq_s32(sums, vmull_s16(vget_high_s16(values), vget_high_s16(values)));
+		}
+
+		int16_t minimumLanes[8];
+		int16_t maximumLanes[8];
+		int64_t sumLanes[2];
+		vst1q_s16(minimumLanes, minimums);
+		vst1q_s16(maximumLanes, maximums);
+		vst1q_s64(sumLanes, sums);
+		for (int lane = 0; lane < 8; lane++)
+		{
+			minimum = (std::min)(minimum, (int)minimumLanes[lane]);
+			maximum = (std::max)(maximum, (int)maximumLanes[lane]);
+		}
+		sumSquares += (uint64_t)(sumLanes[0] + sumLanes[1]);
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		int value = samples[i];
+		minimum = (std::min)(minimum, value);
+		maximum = (std::max)(maximum, value);
+		sumSquares += (uint64_t)(value * value);
+	}
+
+	if (count > 0)
+	{
+		peaks->minimum = (std::min)(peaks->minimum, minimum * S16SCALE);
+		peaks->maximum = (std::max)(peaks->maximum, maximum * S16SCALE);
+		peaks->sumSquares += sumSquares * (double)S16SCALE * S16SCALE;
+		peaks->count += count;
+	}
+}
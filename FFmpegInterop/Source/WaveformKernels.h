@@ -0,0 +1,40 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+namespace FFmpegInterop
+{
+	// Running peaks of a range of samples, in the range [-1, 1]
+	struct PeakAccumulator
+	{
+		float minimum;
+		float maximum;
+		double sumSquares;
+		int64_t count;
+	};
+
+	void ResetPeaks(PeakAccumulator* peaks);
+
+	// Fold count samples into the peaks. Both run four or eight samples at a time with SSE2 or NEON where the
+	// target has them. Channels are not told apart, interleaved samples can be passed as they are.
+	void AccumulateFloatPeaks(const float* samples, size_t count, PeakAccumulator* peaks);
+	void AccumulateS16Peaks(const int16_t* samples, size_t count, PeakAccumulator* peaks);
+}
@@ -0,0 +1,493 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "BenchmarkSampleProviders.h"
+#include "BenchmarkStats.h"
+#include "FFmpegCompat.h"
+#include "PipelineTrace.h"
+#include "SyntheticMedia.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using namespace FFmpegInterop;
+using namespace FFmpegInteropBenchmark;
+
+// Same buffer size as FileStreamIO of the library
+const int FILESTREAMBUFFERSZ = 16384;
+
+struct BenchmarkCase
+{
+	const char* name;
+	const char* media;
+	AVMediaType mediaType;
+	SampleProviderKind kind;
+};
+
+struct BenchmarkOptions
+{
+	int seconds = 20;
+	int width = 1280;
+	int height = 720;
+	int iterations = 3;
+	std::string filter;
+	bool isCsv = false;
+	bool keepMedia = false;
+	std::string tracePath;
+};
+
+struct BenchmarkResult
+{
+	uint64_t samples = 0;
+	uint64_t outputBytes = 0;
+	uint64_t inputBytes = 0;
+	double seconds = 0.0;
+	AllocationCounts allocations = {};
+	LatencyRecorder latencies;
+};
+
+// Media file in memory, read through a custom AVIOContext like the IStream of FileStreamIO
+struct MemoryInput
+{
+	std::vector<uint8_t> data;
+	int64_t position = 0;
+	uint64_t bytesRead = 0;
+
+	static int Read(void* opaque, uint8_t* buffer, int bufferSize)
+	{
+		MemoryInput* input = reinterpret_cast<MemoryInput*>(opaque);
+		int64_t remaining = (int64_t)input->data.size() - input->position;
+		if (remaining <= 0)
+		{
+			return AVERROR_EOF;
+		}
+
+		int size = (int)std::min((int64_t)bufferSize, remaining);
+		memcpy(buffer, input->data.data() + input->position, size);
+		input->position += size;
+		input->bytesRead += size;
+		return size;
+	}
+
+	static int64_t Seek(void* opaque, int64_t offset, int whence)
+	{
+		MemoryInput* input = reinterpret_cast<MemoryInput*>(opaque);
+		switch (whence & ~AVSEEK_FORCE)
+		{
+		case SEEK_SET: input->position = offset; break;
+		case SEEK_CUR: input->position += offset; break;
+		case SEEK_END: input->position = (int64_t)input->data.size() + offset; break;
+		case AVSEEK_SIZE: return (int64_t)input->data.size();
+		default: return AVERROR(EINVAL);
+		}
+		return input->position;
+	}
+};
+
+static const std::map<std::string, SyntheticMediaSpec>& GetMediaSpecs()
+{
+	static const std::map<std::string, SyntheticMediaSpec> specs =
+	{
+		{ "h264.mp4", { "h264.mp4", "mp4", "mp4", { "libx264", "libopenh264" }, "yuv420p", {} } },
+		{ "h264.ts", { "h264.ts", "mpegts", "ts", { "libx264", "libopenh264" }, "yuv420p", {} } },
+		{ "hevc.mp4", { "hevc.mp4", "mp4", "mp4", { "libx265" }, "yuv420p", {} } },
+		{ "10bit.mkv", { "10bit.mkv", "matroska", "mkv", { "libx265", "libx264", "ffv1" }, "yuv420p10le", {} } },
+		{ "aac.m4a", { "aac.m4a", "mp4", "m4a", {}, nullptr, { "aac" } } },
+		{ "mp3.mp3", { "mp3.mp3", "mp3", "mp3", {}, nullptr, { "libmp3lame", "libshine" } } },
+		{ "pcm.wav", { "pcm.wav", "wav", "wav", {}, nullptr, { "pcm_s16le" } } },
+	};
+	return specs;
+}
+
+// Each sample provider of the library, with the media which takes it down that path in the MSS
+static const BenchmarkCase Cases[] =
+{
+	{ "h264-avcc", "h264.mp4", AVMEDIA_TYPE_VIDEO, SampleProviderKind::H264AVC },
+	{ "h264-annexb", "h264.ts", AVMEDIA_TYPE_VIDEO, SampleProviderKind::H264 },
+	{ "h264-decode", "h264.mp4", AVMEDIA_TYPE_VIDEO, SampleProviderKind::UncompressedVideo },
+	{ "hevc-decode", "hevc.mp4", AVMEDIA_TYPE_VIDEO, SampleProviderKind::UncompressedVideo },
+	{ "10bit-decode", "10bit.mkv", AVMEDIA_TYPE_VIDEO, SampleProviderKind::UncompressedVideo },
+	{ "aac-passthrough", "aac.m4a", AVMEDIA_TYPE_AUDIO, SampleProviderKind::Passthrough },
+	{ "aac-decode", "aac.m4a", AVMEDIA_TYPE_AUDIO, SampleProviderKind::UncompressedAudio },
+	{ "mp3-passthrough", "mp3.mp3", AVMEDIA_TYPE_AUDIO, SampleProviderKind::Passthrough },
+	{ "mp3-decode", "mp3.mp3", AVMEDIA_TYPE_AUDIO, SampleProviderKind::UncompressedAudio },
+	{ "pcm-decode", "pcm.wav", AVMEDIA_TYPE_AUDIO, SampleProviderKind::UncompressedAudio },
+};
+
+static const char* GetProviderName(SampleProviderKind kind)
+{
+	switch (kind)
+	{
+	case SampleProviderKind::Passthrough: return "MediaSampleProvider";
+	case SampleProviderKind::H264AVC: return "H264AVCSampleProvider";
+	case SampleProviderKind::H264: return "H264SampleProvider";
+	case SampleProviderKind::UncompressedVideo: return "UncompressedVideoSampleProvider";
+	case SampleProviderKind::UncompressedAudio: return "UncompressedAudioSampleProvider";
+	}
+	return "";
+}
+
+// Open the stream the same way FFmpegInteropMSS does, up to the decoder which the provider opens itself
+static int OpenMedia(MemoryInput& input, AVMediaType mediaType, AVFormatContext** avFormatCtx, AVCodecContext** avCodecCtx, int* streamIndex)
+{
+	uint8_t* buffer = (uint8_t*)av_malloc(FILESTREAMBUFFERSZ);
+	AVIOContext* avIOCtx = buffer != nullptr ? avio_alloc_context(buffer, FILESTREAMBUFFERSZ, 0, &input, MemoryInput::Read, NULL, MemoryInput::Seek) : nullptr;
+	*avFormatCtx = avformat_alloc_context();
+	if (avIOCtx == nullptr || *avFormatCtx == nullptr)
+	{
+		av_free(buffer);
+		return AVERROR(ENOMEM);
+	}
+
+	(*avFormatCtx)->pb = avIOCtx;
+	(*avFormatCtx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	int ret = avformat_open_input(avFormatCtx, "", NULL, NULL);
+	if (ret >= 0)
+	{
+		ret = avformat_find_stream_info(*avFormatCtx, NULL);
+	}
+
+	const AVCodec* avCodec = nullptr;
+	if (ret >= 0)
+	{
+		ret = av_find_best_stream(*avFormatCtx, mediaType, -1, -1, NULL, 0);
+		*streamIndex = ret;
+	}
+
+	if (ret >= 0)
+	{
+		avCodec = avcodec_find_decoder((*avFormatCtx)->streams[*streamIndex]->codecpar->codec_id);
+		ret = avCodec != nullptr ? 0 : AVERROR_DECODER_NOT_FOUND;
+	}
+
+	if (ret >= 0)
+	{
+		*avCodecCtx = avcodec_alloc_context3(avCodec);
+		ret = *avCodecCtx != nullptr ? avcodec_parameters_to_context(*avCodecCtx, (*avFormatCtx)->streams[*streamIndex]->codecpar) : AVERROR(ENOMEM);
+	}
+
+	if (ret >= 0 && mediaType == AVMEDIA_TYPE_VIDEO)
+	{
+		unsigned threads = std::thread::hardware_concurrency();
+		if (threads > 0)
+		{
+			(*avCodecCtx)->thread_count = threads;
+			(*avCodecCtx)->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+		}
+	}
+
+	return ret;
+}
+
+static void CloseMedia(AVFormatContext** avFormatCtx, AVCodecContext** avCodecCtx)
+{
+	avcodec_free_context(avCodecCtx);
+	if (*avFormatCtx != nullptr)
+	{
+		AVIOContext* avIOCtx = (*avFormatCtx)->pb;
+		avformat_close_input(avFormatCtx);
+		if (avIOCtx != nullptr)
+		{
+			av_freep(&avIOCtx->buffer);
+			avio_context_free(&avIOCtx);
+		}
+	}
+}
+
+// Play the stream to its end through the provider, like the MSS answering SampleRequested
+static int RunCase(const BenchmarkCase& benchmarkCase, const std::vector<uint8_t>& media, BenchmarkResult& result)
+{
+	MemoryInput input;
+	input.data = media;
+
+	AVFormatContext* avFormatCtx = nullptr;
+	AVCodecContext* avCodecCtx = nullptr;
+	int streamIndex = -1;
+	int ret = OpenMedia(input, benchmarkCase.mediaType, &avFormatCtx, &avCodecCtx, &streamIndex);
+
+	if (ret >= 0)
+	{
+		FFmpegReader reader(avFormatCtx);
+		std::unique_ptr<MediaSampleProvider> sampleProvider(CreateSampleProvider(benchmarkCase.kind, &reader, avFormatCtx, avCodecCtx));
+		reader.SetStream(streamIndex, sampleProvider.get());
+
+		// Opening is not part of the measurement, the bytes read while probing aren't either
+		uint64_t probeBytes = input.bytesRead;
+		MediaStreamSample sample;
+		StartCountingAllocations();
+		auto start = std::chrono::steady_clock::now();
+		auto requested = start;
+		while (sampleProvider->GetNextSample(&sample))
+		{
+			auto delivered = std::chrono::steady_clock::now();
+			result.latencies.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(delivered - requested).count());
+			result.samples++;
+			result.outputBytes += sample.buffer.size();
+
+			// The sink only looks at the sample and lets it go, like the pipeline does once it has rendered it
+			sample.buffer = std::vector<uint8_t>();
+			requested = std::chrono::steady_clock::now();
+		}
+		auto end = std::chrono::steady_clock::now();
+		AllocationCounts allocations = StopCountingAllocations();
+
+		result.seconds += std::chrono::duration<double>(end - start).count();
+		result.inputBytes += input.bytesRead - probeBytes;
+		result.allocations.count += allocations.count;
+		result.allocations.bytes += allocations.bytes;
+	}
+
+	CloseMedia(&avFormatCtx, &avCodecCtx);
+	return ret;
+}
+
+static bool ReadFile(const std::string& path, std::vector<uint8_t>& data)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+static void PrintHeader(const BenchmarkOptions& options)
+{
+	if (options.isCsv)
+	{
+		printf("case,provider,samples,samples_per_s,output_mb_per_s,input_mb_per_s,allocs_per_sample,alloc_kb_per_sample,p50_us,p90_us,p99_us,p999_us,max_us\n");
+	}
+	else
+	{
+		printf("%-16s %-32s %8s %10s %9s %9s %9s %10s %8s %8s %8s %8s %8s\n",
+			"case", "provider", "samples", "samples/s", "out MB/s", "in MB/s", "allocs/s.", "alloc KB/s.", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+	}
+}
+
+static void PrintResult(const BenchmarkCase& benchmarkCase, BenchmarkResult& result, const BenchmarkOptions& options)
+{
+	double samples = (double)std::max<uint64_t>(result.samples, 1);
+	double seconds = std::max(result.seconds, 1e-9);
+	const char* format = options.isCsv
+		? "%s,%s,%llu,%.1f,%.2f,%.2f,%.2f,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f\n"
+		: "%-16s %-32s %8llu %10.1f %9.2f %9.2f %9.2f %10.2f %8.1f %8.1f %8.1f %8.1f %8.1f\n";
+
+	printf(format,
+		benchmarkCase.name,
+		GetProviderName(benchmarkCase.kind),
+		(unsigned long long)result.samples,
+		result.samples / seconds,
+		result.outputBytes / seconds / 1e6,
+		result.inputBytes / seconds / 1e6,
+		result.allocations.count / samples,
+		result.allocations.bytes / samples / 1024.0,
+		result.latencies.GetPercentile(0.5) / 1e3,
+		result.latencies.GetPercentile(0.9) / 1e3,
+		result.latencies.GetPercentile(0.99) / 1e3,
+		result.latencies.GetPercentile(0.999) / 1e3,
+		result.latencies.GetPercentile(1.0) / 1e3);
+}
+
+static void PrintUsage()
+{
+	printf("Usage: FFmpegInteropBenchmark [options]\n"
+		"  --seconds N      length of the generated media (default 20)\n"
+		"  --size WxH       size of the generated video (default 1280x720)\n"
+		"  --iterations N   plays of each case, the results add up (default 3)\n"
+		"  --filter TEXT    only run the cases whose name contains TEXT\n"
+		"  --csv            print comma separated values\n"
+		"  --keep           keep the generated media in the temporary folder\n"
+		"  --trace FILE     write a Chrome trace of the pipeline spans of every case to FILE\n");
+}
+
+static bool ParseOptions(int argc, char** argv, BenchmarkOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (option == "--seconds" && hasValue)
+		{
+			options.seconds = atoi(argv[++i]);
+		}
+		else if (option == "--size" && hasValue)
+		{
+			if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2)
+			{
+				return false;
+			}
+		}
+		else if (option == "--iterations" && hasValue)
+		{
+			options.iterations = atoi(argv[++i]);
+		}
+		else if (option == "--filter" && hasValue)
+		{
+			options.filter = argv[++i];
+		}
+		else if (option == "--csv")
+		{
+			options.isCsv = true;
+		}
+		else if (option == "--keep")
+		{
+			options.keepMedia = true;
+		}
+		else if (option == "--trace" && hasValue)
+		{
+			options.tracePath = argv[++i];
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	// The 4:2:0 test pattern needs even sizes
+	return options.seconds > 0 && options.iterations > 0 && options.width > 0 && options.height > 0
+		&& options.width % 2 == 0 && options.height % 2 == 0;
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	av_log_set_level(AV_LOG_ERROR);
+
+	char folderTemplate[] = "/tmp/ffmpeginterop-benchmark-XXXXXX";
+	const char* folder = mkdtemp(folderTemplate);
+	if (folder == nullptr)
+	{
+		fprintf(stderr, "Could not create a temporary folder\n");
+		return 1;
+	}
+
+	if (!IsCountingLibraryAllocations())
+	{
+		fprintf(stderr, "Allocations of the FFmpeg libraries are not counted on this platform\n");
+	}
+
+	// Tracing slows the cases down a little, the numbers of a traced run don't compare with others
+	if (!options.tracePath.empty())
+	{
+		PipelineTrace::Start(1 << 20);
+	}
+
+	int failures = 0;
+	std::map<std::string, std::vector<uint8_t>> generatedMedia;
+	std::vector<std::string> generatedFiles;
+	PrintHeader(options);
+
+	for (const BenchmarkCase& benchmarkCase : Cases)
+	{
+		if (!options.filter.empty() && strstr(benchmarkCase.name, options.filter.c_str()) == nullptr)
+		{
+			continue;
+		}
+
+		// Each media is generated once, for the first case which plays it
+		auto media = generatedMedia.find(benchmarkCase.media);
+		if (media == generatedMedia.end())
+		{
+			const SyntheticMediaSpec& spec = GetMediaSpecs().at(benchmarkCase.media);
+			std::string path = std::string(folder) + "/" + spec.name;
+			int ret = GenerateSyntheticMedia(spec, options.seconds, options.width, options.height, path);
+			generatedFiles.push_back(path);
+
+			std::vector<uint8_t> data;
+			if (ret < 0 || !ReadFile(path, data))
+			{
+				if (ret != AVERROR_ENCODER_NOT_FOUND)
+				{
+					failures++;
+				}
+				char error[AV_ERROR_MAX_STRING_SIZE] = {};
+				av_strerror(ret, error, sizeof(error));
+				fprintf(stderr, "%s: skipped, could not generate %s (%s)\n", benchmarkCase.name, spec.name, error);
+				generatedMedia[benchmarkCase.media] = std::vector<uint8_t>();
+				continue;
+			}
+			media = generatedMedia.insert(std::make_pair(std::string(benchmarkCase.media), data)).first;
+		}
+
+		if (media->second.empty())
+		{
+			fprintf(stderr, "%s: skipped, %s is not available\n", benchmarkCase.name, benchmarkCase.media);
+			continue;
+		}
+
+		BenchmarkResult result;
+		int ret = 0;
+		for (int i = 0; i < options.iterations && ret >= 0; i++)
+		{
+			ret = RunCase(benchmarkCase, media->second, result);
+		}
+
+		if (ret < 0 || result.samples == 0)
+		{
+			fprintf(stderr, "%s: failed\n", benchmarkCase.name);
+			failures++;
+			continue;
+		}
+
+		PrintResult(benchmarkCase, result, options);
+	}
+
+	if (!options.tracePath.empty())
+	{
+		PipelineTrace::Stop();
+		std::ofstream trace(options.tracePath, std::ios::binary);
+		trace << PipelineTrace::GetJson();
+		if (!trace)
+		{
+			fprintf(stderr, "Could not write the trace to %s\n", options.tracePath.c_str());
+			failures++;
+		}
+		else if (PipelineTrace::GetDroppedEventCount() > 0)
+		{
+			fprintf(stderr, "%lld trace events did not fit in the buffers\n", (long long)PipelineTrace::GetDroppedEventCount());
+		}
+	}
+
+	if (!options.keepMedia)
+	{
+		for (const std::string& path : generatedFiles)
+		{
+			unlink(path.c_str());
+		}
+		rmdir(folder);
+	}
+
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,574 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "BenchmarkSampleProviders.h"
+#include "FFmpegCompat.h"
+#include "PipelineTrace.h"
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+}
+
+using namespace FFmpegInterop;
+using namespace FFmpegInteropBenchmark;
+
+// Minimum duration for uncompressed audio samples (50 ms)
+const int64_t MINAUDIOSAMPLEDURATION = 500000;
+
+FFmpegReader::FFmpegReader(AVFormatContext* avFormatCtx)
+	: m_pAvFormatCtx(avFormatCtx)
+	, m_streamIndex(AVERROR_STREAM_NOT_FOUND)
+	, m_pSampleProvider(nullptr)
+{
+}
+
+int FFmpegReader::ReadPacket()
+{
+	AVPacket avPacket;
+	av_init_packet(&avPacket);
+	avPacket.data = NULL;
+	avPacket.size = 0;
+
+	TraceSpan span("read");
+	int ret = av_read_frame(m_pAvFormatCtx, &avPacket);
+	span.SetStream(avPacket.stream_index, avPacket.pts);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	if (avPacket.stream_index == m_streamIndex && m_pSampleProvider != nullptr)
+	{
+		m_pSampleProvider->QueuePacket(avPacket);
+	}
+	else
+	{
+		av_packet_unref(&avPacket);
+	}
+
+	return ret;
+}
+
+void FFmpegReader::SetStream(int streamIndex, MediaSampleProvider* sampleProvider)
+{
+	m_streamIndex = streamIndex;
+	m_pSampleProvider = sampleProvider;
+	sampleProvider->SetCurrentStreamIndex(streamIndex);
+
+	for (unsigned int i = 0; i < m_pAvFormatCtx->nb_streams; i++)
+	{
+		m_pAvFormatCtx->streams[i]->discard = (int)i == streamIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+	}
+}
+
+MediaSampleProvider::MediaSampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx)
+	: m_pReader(reader)
+	, m_pAvFormatCtx(avFormatCtx)
+	, m_pAvCodecCtx(avCodecCtx)
+	, m_streamIndex(AVERROR_STREAM_NOT_FOUND)
+	, m_startOffset(AV_NOPTS_VALUE)
+	, m_nextFramePts(0)
+	, m_isEnabled(true)
+	, m_isAllocated(false)
+	, m_isDiscontinuous(false)
+{
+}
+
+MediaSampleProvider::~MediaSampleProvider()
+{
+	Flush();
+}
+
+HRESULT MediaSampleProvider::AllocateResources()
+{
+	return S_OK;
+}
+
+HRESULT MediaSampleProvider::EnsureResourcesAllocated()
+{
+	HRESULT hr = S_OK;
+	if (!m_isAllocated)
+	{
+		hr = AllocateResources();
+		m_isAllocated = SUCCEEDED(hr);
+	}
+	return hr;
+}
+
+void MediaSampleProvider::SetCurrentStreamIndex(int streamIndex)
+{
+	m_streamIndex = streamIndex;
+}
+
+bool MediaSampleProvider::GetNextSample(MediaStreamSample* sample)
+{
+	HRESULT hr = S_OK;
+	bool hasSample = false;
+	TraceSpan span("sample", m_streamIndex);
+
+	if (m_isEnabled && FAILED(EnsureResourcesAllocated()))
+	{
+		DisableStream();
+	}
+
+	if (m_isEnabled)
+	{
+		DataWriter dataWriter;
+
+		int64_t pts = 0;
+		int64_t dur = 0;
+
+		hr = GetNextPacket(dataWriter, pts, dur, true);
+
+		if (hr == S_OK)
+		{
+			sample->buffer = dataWriter.DetachBuffer();
+			sample->timestamp = pts;
+			sample->duration = dur;
+			sample->discontinuous = m_isDiscontinuous;
+			m_isDiscontinuous = false;
+			hasSample = true;
+			span.SetStream(m_streamIndex, pts);
+		}
+		else
+		{
+			DisableStream();
+		}
+	}
+
+	return hasSample;
+}
+
+HRESULT MediaSampleProvider::WriteAVPacketToStream(DataWriter& dataWriter, AVPacket* avPacket)
+{
+	dataWriter.Write(avPacket->data, avPacket->size);
+	return S_OK;
+}
+
+HRESULT MediaSampleProvider::DecodeAVPacket(DataWriter& dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration)
+{
+	if (avPacket != nullptr)
+	{
+		frameDuration = avPacket->duration;
+		if (avPacket->pts != AV_NOPTS_VALUE)
+		{
+			framePts = avPacket->pts;
+			m_nextFramePts = framePts + frameDuration;
+		}
+		else
+		{
+			framePts = m_nextFramePts;
+			m_nextFramePts += frameDuration;
+		}
+	}
+	return S_OK;
+}
+
+void MediaSampleProvider::QueuePacket(AVPacket packet)
+{
+	if (m_isEnabled)
+	{
+		m_packetQueue.push_back(packet);
+		PipelineTrace::AddCounter("queued packets", m_streamIndex, (int64_t)m_packetQueue.size());
+	}
+	else
+	{
+		av_packet_unref(&packet);
+	}
+}
+
+AVPacket MediaSampleProvider::PopPacket()
+{
+	AVPacket avPacket;
+	av_init_packet(&avPacket);
+	avPacket.data = NULL;
+	avPacket.size = 0;
+
+	if (!m_packetQueue.empty())
+	{
+		avPacket = m_packetQueue.front();
+		m_packetQueue.erase(m_packetQueue.begin());
+		PipelineTrace::AddCounter("queued packets", m_streamIndex, (int64_t)m_packetQueue.size());
+	}
+
+	return avPacket;
+}
+
+HRESULT MediaSampleProvider::GetNextPacket(DataWriter& writer, int64_t& pts, int64_t& dur, bool allowSkip)
+{
+	HRESULT hr = S_OK;
+
+	AVPacket avPacket;
+	av_init_packet(&avPacket);
+	avPacket.data = NULL;
+	avPacket.size = 0;
+
+	bool frameComplete = false;
+	int64_t framePts = 0, frameDuration = 0;
+	int errorCount = 0;
+
+	while (SUCCEEDED(hr) && !frameComplete)
+	{
+		while (m_packetQueue.empty())
+		{
+			if (m_pReader->ReadPacket() < 0)
+			{
+				hr = E_FAIL;
+				break;
+			}
+		}
+
+		if (!m_packetQueue.empty())
+		{
+			avPacket = PopPacket();
+			framePts = avPacket.pts;
+			frameDuration = avPacket.duration;
+
+			hr = DecodeAVPacket(writer, &avPacket, framePts, frameDuration);
+			frameComplete = (hr == S_OK);
+
+			if (!frameComplete)
+			{
+				m_isDiscontinuous = true;
+				if (allowSkip && errorCount++ < 10)
+				{
+					hr = S_OK;
+				}
+			}
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = WriteAVPacketToStream(writer, &avPacket);
+
+		if (m_startOffset == AV_NOPTS_VALUE)
+		{
+			m_startOffset = framePts < 0 ? 0 : framePts;
+		}
+
+		pts = int64_t(av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * 10000000 * (framePts - m_startOffset));
+		dur = int64_t(av_q2d(m_pAvFormatCtx->streams[m_streamIndex]->time_base) * 10000000 * frameDuration);
+	}
+
+	av_packet_unref(&avPacket);
+
+	return hr;
+}
+
+void MediaSampleProvider::Flush()
+{
+	while (!m_packetQueue.empty())
+	{
+		AVPacket avPacket = PopPacket();
+		av_packet_unref(&avPacket);
+	}
+	m_isDiscontinuous = true;
+}
+
+void MediaSampleProvider::DisableStream()
+{
+	Flush();
+	m_isEnabled = false;
+}
+
+H264AVCSampleProvider::H264AVCSampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx)
+	: MediaSampleProvider(reader, avFormatCtx, avCodecCtx)
+{
+}
+
+HRESULT H264AVCSampleProvider::WriteAVPacketToStream(DataWriter& dataWriter, AVPacket* avPacket)
+{
+	HRESULT hr = S_OK;
+	if (avPacket->flags & AV_PKT_FLAG_KEY)
+	{
+		hr = WriteAVCParameterSets(dataWriter, m_pAvCodecCtx);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = WriteAVCPacket(dataWriter, avPacket);
+	}
+
+	return hr;
+}
+
+H264SampleProvider::H264SampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx)
+	: MediaSampleProvider(reader, avFormatCtx, avCodecCtx)
+{
+}
+
+HRESULT H264SampleProvider::WriteAVPacketToStream(DataWriter& dataWriter, AVPacket* avPacket)
+{
+	HRESULT hr = S_OK;
+	if (avPacket->flags & AV_PKT_FLAG_KEY)
+	{
+		hr = WriteAnnexBParameterSets(dataWriter, m_pAvCodecCtx);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = MediaSampleProvider::WriteAVPacketToStream(dataWriter, avPacket);
+	}
+
+	return hr;
+}
+
+UncompressedSampleProvider::UncompressedSampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx)
+	: MediaSampleProvider(reader, avFormatCtx, avCodecCtx)
+	, m_pAvFrame(nullptr)
+{
+}
+
+HRESULT UncompressedSampleProvider::AllocateResources()
+{
+	HRESULT hr = MediaSampleProvider::AllocateResources();
+	if (SUCCEEDED(hr) && !avcodec_is_open(m_pAvCodecCtx))
+	{
+		if (avcodec_open2(m_pAvCodecCtx, m_pAvCodecCtx->codec, NULL) < 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+	return hr;
+}
+
+void UncompressedSampleProvider::Flush()
+{
+	MediaSampleProvider::Flush();
+	if (avcodec_is_open(m_pAvCodecCtx))
+	{
+		avcodec_flush_buffers(m_pAvCodecCtx);
+	}
+}
+
+HRESULT UncompressedSampleProvider::ProcessDecodedFrame(DataWriter& dataWriter)
+{
+	return S_OK;
+}
+
+HRESULT UncompressedSampleProvider::GetFrameFromFFmpegDecoder(AVPacket* avPacket)
+{
+	TraceSpan span("decode", m_streamIndex, avPacket != nullptr ? avPacket->pts : AV_NOPTS_VALUE);
+	return DecodeNextFrame(m_pAvCodecCtx, avPacket, false, &m_pAvFrame);
+}
+
+HRESULT UncompressedSampleProvider::DecodeAVPacket(DataWriter& dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration)
+{
+	HRESULT hr = S_OK;
+	bool fGotFrame = false;
+	AVPacket* pPacket = avPacket;
+
+	while (SUCCEEDED(hr))
+	{
+		hr = GetFrameFromFFmpegDecoder(pPacket);
+		pPacket = nullptr;
+		if (SUCCEEDED(hr))
+		{
+			if (hr == S_FALSE)
+			{
+				if (fGotFrame)
+				{
+					hr = S_OK;
+				}
+				break;
+			}
+			else if (m_pAvFrame->pts != AV_NOPTS_VALUE)
+			{
+				framePts = m_pAvFrame->pts;
+				frameDuration = GetFrameDuration(m_pAvFrame);
+			}
+			fGotFrame = true;
+
+			hr = ProcessDecodedFrame(dataWriter);
+		}
+	}
+
+	return hr;
+}
+
+UncompressedVideoSampleProvider::UncompressedVideoSampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx)
+	: UncompressedSampleProvider(reader, avFormatCtx, avCodecCtx)
+	, m_pSwsCtx(nullptr)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		m_rgVideoBufferLineSize[i] = 0;
+		m_rgVideoBufferData[i] = nullptr;
+	}
+}
+
+UncompressedVideoSampleProvider::~UncompressedVideoSampleProvider()
+{
+	av_frame_free(&m_pAvFrame);
+	av_freep(m_rgVideoBufferData);
+	sws_freeContext(m_pSwsCtx);
+}
+
+HRESULT UncompressedVideoSampleProvider::AllocateResources()
+{
+	HRESULT hr = UncompressedSampleProvider::AllocateResources();
+	if (SUCCEEDED(hr))
+	{
+		m_pSwsCtx = sws_getContext(m_pAvCodecCtx->width, m_pAvCodecCtx->height, m_pAvCodecCtx->pix_fmt,
+			m_pAvCodecCtx->width, m_pAvCodecCtx->height, AV_PIX_FMT_NV12, SWS_BICUBIC, NULL, NULL, NULL);
+		if (m_pSwsCtx == nullptr)
+		{
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		if (av_image_alloc(m_rgVideoBufferData, m_rgVideoBufferLineSize, m_pAvCodecCtx->width, m_pAvCodecCtx->height, AV_PIX_FMT_NV12, 1) < 0)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	return hr;
+}
+
+HRESULT UncompressedVideoSampleProvider::WriteAVPacketToStream(DataWriter& dataWriter, AVPacket* avPacket)
+{
+	HRESULT hr = S_OK;
+	{
+		TraceSpan span("convert", m_streamIndex, m_pAvFrame->pts);
+		hr = WriteNV12Frame(dataWriter, m_pSwsCtx, m_pAvFrame, m_pAvCodecCtx->height, m_rgVideoBufferData, m_rgVideoBufferLineSize);
+	}
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	av_frame_free(&m_pAvFrame);
+
+	return S_OK;
+}
+
+UncompressedAudioSampleProvider::UncompressedAudioSampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx)
+	: UncompressedSampleProvider(reader, avFormatCtx, avCodecCtx)
+	, m_pSwrCtx(nullptr)
+	, m_outChannels(0)
+{
+}
+
+UncompressedAudioSampleProvider::~UncompressedAudioSampleProvider()
+{
+	av_frame_free(&m_pAvFrame);
+	swr_free(&m_pSwrCtx);
+}
+
+HRESULT UncompressedAudioSampleProvider::AllocateResources()
+{
+	HRESULT hr = UncompressedSampleProvider::AllocateResources();
+	if (SUCCEEDED(hr))
+	{
+		m_outChannels = GetChannelCount(m_pAvCodecCtx);
+		m_pSwrCtx = CreateResampler(m_outChannels, m_pAvCodecCtx->sample_fmt, m_pAvCodecCtx->sample_rate,
+			m_outChannels, AV_SAMPLE_FMT_S16, m_pAvCodecCtx->sample_rate);
+		if (!m_pSwrCtx)
+		{
+			hr = E_FAIL;
+		}
+	}
+
+	return hr;
+}
+
+HRESULT UncompressedAudioSampleProvider::WriteAVPacketToStream(DataWriter& dataWriter, AVPacket* avPacket)
+{
+	return S_OK;
+}
+
+HRESULT UncompressedAudioSampleProvider::ProcessDecodedFrame(DataWriter& dataWriter)
+{
+	HRESULT hr = S_OK;
+	{
+		TraceSpan span("convert", m_streamIndex, m_pAvFrame->pts);
+		hr = WriteS16Samples(dataWriter, m_pSwrCtx, m_pAvFrame, m_outChannels);
+	}
+	av_frame_free(&m_pAvFrame);
+
+	return hr;
+}
+
+bool UncompressedAudioSampleProvider::GetNextSample(MediaStreamSample* sample)
+{
+	HRESULT hr = EnsureResourcesAllocated();
+	TraceSpan span("sample", m_streamIndex);
+	DataWriter dataWriter;
+
+	int64_t finalPts = -1;
+	int64_t finalDur = 0;
+	bool isFirstPacket = true;
+	bool isDiscontinuous = m_isDiscontinuous;
+
+	while (SUCCEEDED(hr) && finalDur < MINAUDIOSAMPLEDURATION)
+	{
+		int64_t pts = 0;
+		int64_t dur = 0;
+
+		hr = GetNextPacket(dataWriter, pts, dur, isFirstPacket);
+		if (isFirstPacket)
+		{
+			isDiscontinuous = m_isDiscontinuous;
+		}
+		isFirstPacket = false;
+
+		if (SUCCEEDED(hr))
+		{
+			if (finalPts == -1)
+			{
+				finalPts = pts;
+			}
+			finalDur += dur;
+		}
+	}
+
+	if (finalDur > 0)
+	{
+		sample->buffer = dataWriter.DetachBuffer();
+		sample->timestamp = finalPts;
+		sample->duration = finalDur;
+		sample->discontinuous = isDiscontinuous;
+		span.SetStream(m_streamIndex, finalPts);
+		if (SUCCEEDED(hr))
+		{
+			m_isDiscontinuous = false;
+		}
+		return true;
+	}
+
+	DisableStream();
+	return false;
+}
+
+MediaSampleProvider* FFmpegInteropBenchmark::CreateSampleProvider(SampleProviderKind kind, FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx)
+{
+	switch (kind)
+	{
+	case SampleProviderKind::Passthrough: return new MediaSampleProvider(reader, avFormatCtx, avCodecCtx);
+	case SampleProviderKind::H264AVC: return new H264AVCSampleProvider(reader, avFormatCtx, avCodecCtx);
+	case SampleProviderKind::H264: return new H264SampleProvider(reader, avFormatCtx, avCodecCtx);
+	case SampleProviderKind::UncompressedVideo: return new UncompressedVideoSampleProvider(reader, avFormatCtx, avCodecCtx);
+	case SampleProviderKind::UncompressedAudio: return new UncompressedAudioSampleProvider(reader, avFormatCtx, avCodecCtx);
+	}
+	return nullptr;
+}
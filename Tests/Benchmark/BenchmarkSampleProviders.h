@@ -0,0 +1,193 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include "pch.h"
+#include "SamplePayload.h"
+#include <vector>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
+}
+
+// The providers below drive the same packet and frame code as the library, SamplePayload.cpp, through the same
+// queueing and timestamp logic. Only the WinRT types are replaced by the stand-ins of this file.
+
+namespace FFmpegInteropBenchmark
+{
+	// Stand-in for Windows::Storage::Streams::DataWriter, the bytes written become the buffer of the sample
+	class DataWriter : public FFmpegInterop::SampleBuffer
+	{
+	public:
+		void Write(const uint8_t* data, size_t size) override
+		{
+			m_buffer.insert(m_buffer.end(), data, data + size);
+		}
+
+		std::vector<uint8_t> DetachBuffer()
+		{
+			std::vector<uint8_t> buffer;
+			buffer.swap(m_buffer);
+			return buffer;
+		}
+
+	private:
+		std::vector<uint8_t> m_buffer;
+	};
+
+	// Stand-in for Windows::Media::Core::MediaStreamSample, times in 100ns units
+	struct MediaStreamSample
+	{
+		std::vector<uint8_t> buffer;
+		int64_t timestamp;
+		int64_t duration;
+		bool discontinuous;
+	};
+
+	// Sample providers of the library, one per path a stream can take through the MSS
+	enum class SampleProviderKind
+	{
+		Passthrough,
+		H264AVC,
+		H264,
+		UncompressedVideo,
+		UncompressedAudio
+	};
+
+	class MediaSampleProvider;
+
+	// Same as FFmpegReader, for a single stream
+	class FFmpegReader
+	{
+	public:
+		explicit FFmpegReader(AVFormatContext* avFormatCtx);
+
+		int ReadPacket();
+		void SetStream(int streamIndex, MediaSampleProvider* sampleProvider);
+
+	private:
+		AVFormatContext* m_pAvFormatCtx;
+		int m_streamIndex;
+		MediaSampleProvider* m_pSampleProvider;
+	};
+
+	class MediaSampleProvider
+	{
+	public:
+		MediaSampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx);
+		virtual ~MediaSampleProvider();
+
+		// Returns false once the stream has ended
+		virtual bool GetNextSample(MediaStreamSample* sample);
+		virtual void Flush();
+		void SetCurrentStreamIndex(int streamIndex);
+		void QueuePacket(AVPacket packet);
+
+	protected:
+		virtual HRESULT AllocateResources();
+		HRESULT EnsureResourcesAllocated();
+		virtual HRESULT WriteAVPacketToStream(DataWriter& dataWriter, AVPacket* avPacket);
+		virtual HRESULT DecodeAVPacket(DataWriter& dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration);
+		HRESULT GetNextPacket(DataWriter& writer, int64_t& pts, int64_t& dur, bool allowSkip);
+		AVPacket PopPacket();
+		void DisableStream();
+
+		std::vector<AVPacket> m_packetQueue;
+		FFmpegReader* m_pReader;
+		AVFormatContext* m_pAvFormatCtx;
+		AVCodecContext* m_pAvCodecCtx;
+		int m_streamIndex;
+		int64_t m_startOffset;
+		int64_t m_nextFramePts;
+		bool m_isEnabled;
+		bool m_isAllocated;
+		bool m_isDiscontinuous;
+	};
+
+	class H264AVCSampleProvider : public MediaSampleProvider
+	{
+	public:
+		H264AVCSampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx);
+
+	protected:
+		HRESULT WriteAVPacketToStream(DataWriter& dataWriter, AVPacket* avPacket) override;
+	};
+
+	class H264SampleProvider : public MediaSampleProvider
+	{
+	public:
+		H264SampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx);
+
+	protected:
+		HRESULT WriteAVPacketToStream(DataWriter& dataWriter, AVPacket* avPacket) override;
+	};
+
+	class UncompressedSampleProvider : public MediaSampleProvider
+	{
+	public:
+		UncompressedSampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx);
+		void Flush() override;
+
+	protected:
+		HRESULT AllocateResources() override;
+		HRESULT DecodeAVPacket(DataWriter& dataWriter, AVPacket* avPacket, int64_t& framePts, int64_t& frameDuration) override;
+		virtual HRESULT ProcessDecodedFrame(DataWriter& dataWriter);
+		HRESULT GetFrameFromFFmpegDecoder(AVPacket* avPacket);
+
+		AVFrame* m_pAvFrame;
+	};
+
+	class UncompressedVideoSampleProvider : public UncompressedSampleProvider
+	{
+	public:
+		UncompressedVideoSampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx);
+		~UncompressedVideoSampleProvider() override;
+
+	protected:
+		HRESULT AllocateResources() override;
+		HRESULT WriteAVPacketToStream(DataWriter& dataWriter, AVPacket* avPacket) override;
+
+	private:
+		SwsContext* m_pSwsCtx;
+		int m_rgVideoBufferLineSize[4];
+		uint8_t* m_rgVideoBufferData[4];
+	};
+
+	class UncompressedAudioSampleProvider : public UncompressedSampleProvider
+	{
+	public:
+		UncompressedAudioSampleProvider(FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx);
+		~UncompressedAudioSampleProvider() override;
+
+		bool GetNextSample(MediaStreamSample* sample) override;
+
+	protected:
+		HRESULT AllocateResources() override;
+		HRESULT WriteAVPacketToStream(DataWriter& dataWriter, AVPacket* avPacket) override;
+		HRESULT ProcessDecodedFrame(DataWriter& dataWriter) override;
+
+	private:
+		SwrContext* m_pSwrCtx;
+		int m_outChannels;
+	};
+
+	MediaSampleProvider* CreateSampleProvider(SampleProviderKind kind, FFmpegReader* reader, AVFormatContext* avFormatCtx, AVCodecContext* avCodecCtx);
+}
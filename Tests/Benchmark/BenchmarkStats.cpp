@@ -0,0 +1,187 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "BenchmarkStats.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <errno.h>
+#include <new>
+
+using namespace FFmpegInteropBenchmark;
+
+static std::atomic<bool> isCounting(false);
+static std::atomic<uint64_t> allocationCount(0);
+static std::atomic<uint64_t> allocationBytes(0);
+
+static inline void CountAllocation(size_t size)
+{
+	if (isCounting.load(std::memory_order_relaxed))
+	{
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+		allocationBytes.fetch_add(size, std::memory_order_relaxed);
+	}
+}
+
+#if defined(__GLIBC__)
+
+// Forward to the allocator of glibc under its internal names, which stay exported for exactly this purpose. The
+// harness binary defines the public ones, so the FFmpeg libraries end up calling these too.
+extern "C"
+{
+	void* __libc_malloc(size_t size);
+	void* __libc_calloc(size_t count, size_t size);
+	void* __libc_realloc(void* ptr, size_t size);
+	void* __libc_memalign(size_t alignment, size_t size);
+	void __libc_free(void* ptr);
+
+	void* malloc(size_t size) noexcept
+	{
+		CountAllocation(size);
+		return __libc_malloc(size);
+	}
+
+	void* calloc(size_t count, size_t size) noexcept
+	{
+		CountAllocation(count * size);
+		return __libc_calloc(count, size);
+	}
+
+	void* realloc(void* ptr, size_t size) noexcept
+	{
+		CountAllocation(size);
+		return __libc_realloc(ptr, size);
+	}
+
+	void free(void* ptr) noexcept
+	{
+		__libc_free(ptr);
+	}
+
+	int posix_memalign(void** ptr, size_t alignment, size_t size) noexcept
+	{
+		CountAllocation(size);
+		void* allocated = __libc_memalign(alignment, size);
+		if (allocated == nullptr && size > 0)
+		{
+			return ENOMEM;
+		}
+		*ptr = allocated;
+		return 0;
+	}
+
+	void* aligned_alloc(size_t alignment, size_t size) noexcept
+	{
+		CountAllocation(size);
+		return __libc_memalign(alignment, size);
+	}
+
+	void* memalign(size_t alignment, size_t size) noexcept
+	{
+		CountAllocation(size);
+		return __libc_memalign(alignment, size);
+	}
+}
+
+bool FFmpegInteropBenchmark::IsCountingLibraryAllocations()
+{
+	return true;
+}
+
+#else
+
+void* operator new(size_t size)
+{
+	CountAllocation(size);
+	void* ptr = malloc(size > 0 ? size : 1);
+	if (ptr == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+
+bool FFmpegInteropBenchmark::IsCountingLibraryAllocations()
+{
+	return false;
+}
+
+#endif
+
+void FFmpegInteropBenchmark::StartCountingAllocations()
+{
+	allocationCount = 0;
+	allocationBytes = 0;
+	isCounting = true;
+}
+
+AllocationCounts FFmpegInteropBenchmark::StopCountingAllocations()
+{
+	isCounting = false;
+	AllocationCounts counts = { allocationCount.load(), allocationBytes.load() };
+	return counts;
+}
+
+void LatencyRecorder::Add(int64_t latency)
+{
+	m_latencies.push_back(latency);
+	m_isSorted = false;
+}
+
+void LatencyRecorder::Clear()
+{
+	m_latencies.clear();
+	m_isSorted = true;
+}
+
+size_t LatencyRecorder::GetCount() const
+{
+	return m_latencies.size();
+}
+
+int64_t LatencyRecorder::GetPercentile(double p)
+{
+	if (m_latencies.empty())
+	{
+		return 0;
+	}
+
+	if (!m_isSorted)
+	{
+		std::sort(m_latencies.begin(), m_latencies.end());
+		m_isSorted = true;
+	}
+
+	size_t rank = (size_t)std::ceil(p * m_latencies.size());
+	return m_latencies[rank > 0 ? rank - 1 : 0];
+}
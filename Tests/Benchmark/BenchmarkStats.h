@@ -0,0 +1,53 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace FFmpegInteropBenchmark
+{
+	struct AllocationCounts
+	{
+		uint64_t count;
+		uint64_t bytes;
+	};
+
+	// Count the heap allocations made from now on, on every thread. With glibc the allocator itself is replaced so
+	// the allocations of FFmpeg count too, elsewhere only operator new is seen.
+	void StartCountingAllocations();
+	AllocationCounts StopCountingAllocations();
+	bool IsCountingLibraryAllocations();
+
+	// Time taken by each sample, in nanoseconds
+	class LatencyRecorder
+	{
+	public:
+		void Add(int64_t latency);
+		void Clear();
+		size_t GetCount() const;
+
+		// p in [0, 1], nearest rank
+		int64_t GetPercentile(double p);
+
+	private:
+		std::vector<int64_t> m_latencies;
+		bool m_isSorted = true;
+	};
+}
@@ -0,0 +1,84 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+}
+
+// The library is built against the FFmpeg of its submodule, Linux distributions ship anything from 4.x on. Only
+// the channel layout API changed in a way the harness runs into.
+#define BENCHMARK_HAS_CH_LAYOUT (LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 24, 100))
+
+namespace FFmpegInteropBenchmark
+{
+	inline int GetChannelCount(const AVCodecContext* avCodecCtx)
+	{
+#if BENCHMARK_HAS_CH_LAYOUT
+		return avCodecCtx->ch_layout.nb_channels;
+#else
+		return avCodecCtx->channels;
+#endif
+	}
+
+	inline int64_t GetFrameDuration(const AVFrame* avFrame)
+	{
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 30, 100)
+		return avFrame->duration;
+#else
+		return avFrame->pkt_duration;
+#endif
+	}
+
+	// Give an encoder the default layout for the channel count
+	inline void SetDefaultChannelLayout(AVCodecContext* avCodecCtx, int channels)
+	{
+#if BENCHMARK_HAS_CH_LAYOUT
+		av_channel_layout_default(&avCodecCtx->ch_layout, channels);
+#else
+		avCodecCtx->channels = channels;
+		avCodecCtx->channel_layout = av_get_default_channel_layout(channels);
+#endif
+	}
+
+	// Resampler between the default channel layouts of the channel counts, UncompressedAudioSampleProvider only
+	// differs for decoders which report an unusual layout
+	inline SwrContext* CreateResampler(int inChannels, AVSampleFormat inFormat, int inSampleRate, int outChannels, AVSampleFormat outFormat, int outSampleRate)
+	{
+		SwrContext* swrCtx = nullptr;
+#if BENCHMARK_HAS_CH_LAYOUT
+		AVChannelLayout inLayout;
+		AVChannelLayout outLayout;
+		av_channel_layout_default(&inLayout, inChannels);
+		av_channel_layout_default(&outLayout, outChannels);
+		swr_alloc_set_opts2(&swrCtx, &outLayout, outFormat, outSampleRate, &inLayout, inFormat, inSampleRate, 0, NULL);
+#else
+		swrCtx = swr_alloc_set_opts(NULL, av_get_default_channel_layout(outChannels), outFormat, outSampleRate,
+			av_get_default_channel_layout(inChannels), inFormat, inSampleRate, 0, NULL);
+#endif
+		if (swrCtx != nullptr && swr_init(swrCtx) < 0)
+		{
+			swr_free(&swrCtx);
+		}
+		return swrCtx;
+	}
+}
@@ -0,0 +1,388 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#include "SyntheticMedia.h"
+#include "FFmpegCompat.h"
+#include <cmath>
+
+extern "C"
+{
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+using namespace FFmpegInteropBenchmark;
+
+const int FRAMERATE = 30;
+const int SAMPLERATE = 48000;
+const int CHANNELS = 2;
+const double PI = 3.14159265358979323846;
+
+// Encoder of one stream, with the frame it fills and its own clock
+struct OutputStream
+{
+	AVStream* avStream = nullptr;
+	AVCodecContext* avCodecCtx = nullptr;
+	AVFrame* avFrame = nullptr;
+	AVFrame* patternFrame = nullptr;
+	SwsContext* swsCtx = nullptr;
+	int64_t nextPts = 0;
+	double phase = 0.0;
+
+	~OutputStream()
+	{
+		avcodec_free_context(&avCodecCtx);
+		av_frame_free(&avFrame);
+		av_frame_free(&patternFrame);
+		sws_freeContext(swsCtx);
+	}
+};
+
+// First encoder of the list this FFmpeg build has, which also takes the pixel format if one is given
+static const AVCodec* FindEncoder(const std::vector<const char*>& names, const char* pixelFormat)
+{
+	AVPixelFormat requested = pixelFormat != nullptr ? av_get_pix_fmt(pixelFormat) : AV_PIX_FMT_NONE;
+	for (const char* name : names)
+	{
+		const AVCodec* avCodec = avcodec_find_encoder_by_name(name);
+		if (avCodec == nullptr)
+		{
+			continue;
+		}
+
+		bool hasPixelFormat = requested == AV_PIX_FMT_NONE || avCodec->pix_fmts == nullptr;
+		for (const AVPixelFormat* format = avCodec->pix_fmts; format != nullptr && *format != AV_PIX_FMT_NONE; format++)
+		{
+			hasPixelFormat |= *format == requested;
+		}
+
+		if (hasPixelFormat)
+		{
+			return avCodec;
+		}
+	}
+	return nullptr;
+}
+
+static AVFrame* AllocVideoFrame(AVPixelFormat format, int width, int height)
+{
+	AVFrame* avFrame = av_frame_alloc();
+	if (avFrame != nullptr)
+	{
+		avFrame->format = format;
+		avFrame->width = width;
+		avFrame->height = height;
+		if (av_frame_get_buffer(avFrame, 32) < 0)
+		{
+			av_frame_free(&avFrame);
+		}
+	}
+	return avFrame;
+}
+
+static int OpenStream(AVFormatContext* avFormatCtx, const AVCodec* avCodec, OutputStream& stream)
+{
+	stream.avStream = avformat_new_stream(avFormatCtx, NULL);
+	if (stream.avStream == nullptr)
+	{
+		return AVERROR(ENOMEM);
+	}
+
+	// Containers such as MP4 want the parameter sets in the header, which makes H.264 come out as AVCC
+	if (avFormatCtx->oformat->flags & AVFMT_GLOBALHEADER)
+	{
+		stream.avCodecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	}
+
+	int ret = avcodec_open2(stream.avCodecCtx, avCodec, NULL);
+	if (ret >= 0)
+	{
+		stream.avStream->time_base = stream.avCodecCtx->time_base;
+		ret = avcodec_parameters_from_context(stream.avStream->codecpar, stream.avCodecCtx);
+	}
+	return ret;
+}
+
+static int OpenVideoStream(AVFormatContext* avFormatCtx, const AVCodec* avCodec, const char* pixelFormat, int width, int height, OutputStream& stream)
+{
+	stream.avCodecCtx = avcodec_alloc_context3(avCodec);
+	if (stream.avCodecCtx == nullptr)
+	{
+		return AVERROR(ENOMEM);
+	}
+
+	AVCodecContext* avCodecCtx = stream.avCodecCtx;
+	avCodecCtx->width = width;
+	avCodecCtx->height = height;
+	avCodecCtx->time_base = av_make_q(1, FRAMERATE);
+	avCodecCtx->framerate = av_make_q(FRAMERATE, 1);
+	avCodecCtx->bit_rate = 4000000;
+
+	// A keyframe every second and B-frames, like typical downloaded media
+	avCodecCtx->gop_size = FRAMERATE;
+	avCodecCtx->max_b_frames = 2;
+
+	avCodecCtx->pix_fmt = av_get_pix_fmt(pixelFormat);
+
+	// Fast presets keep the set up short, the decoders are what gets measured
+	if (avCodecCtx->priv_data != nullptr)
+	{
+		av_opt_set(avCodecCtx->priv_data, "preset", avCodec->id == AV_CODEC_ID_HEVC ? "ultrafast" : "veryfast", 0);
+		av_opt_set(avCodecCtx->priv_data, "x265-params", "log-level=error", 0);
+	}
+
+	int ret = OpenStream(avFormatCtx, avCodec, stream);
+
+	if (ret >= 0)
+	{
+		stream.avFrame = AllocVideoFrame(avCodecCtx->pix_fmt, width, height);
+		stream.patternFrame = AllocVideoFrame(AV_PIX_FMT_YUV420P, width, height);
+		stream.swsCtx = sws_getContext(width, height, AV_PIX_FMT_YUV420P, width, height, avCodecCtx->pix_fmt, SWS_POINT, NULL, NULL, NULL);
+		if (stream.avFrame == nullptr || stream.patternFrame == nullptr || stream.swsCtx == nullptr)
+		{
+			ret = AVERROR(ENOMEM);
+		}
+	}
+
+	return ret;
+}
+
+static int OpenAudioStream(AVFormatContext* avFormatCtx, const AVCodec* avCodec, OutputStream& stream)
+{
+	stream.avCodecCtx = avcodec_alloc_context3(avCodec);
+	if (stream.avCodecCtx == nullptr)
+	{
+		return AVERROR(ENOMEM);
+	}
+
+	AVCodecContext* avCodecCtx = stream.avCodecCtx;
+	avCodecCtx->sample_rate = SAMPLERATE;
+	avCodecCtx->sample_fmt = avCodec->sample_fmts != nullptr ? avCodec->sample_fmts[0] : AV_SAMPLE_FMT_S16;
+	avCodecCtx->time_base = av_make_q(1, SAMPLERATE);
+	avCodecCtx->bit_rate = 128000;
+	SetDefaultChannelLayout(avCodecCtx, CHANNELS);
+
+	int ret = OpenStream(avFormatCtx, avCodec, stream);
+
+	if (ret >= 0)
+	{
+		stream.avFrame = av_frame_alloc();
+		if (stream.avFrame == nullptr)
+		{
+			return AVERROR(ENOMEM);
+		}
+
+		// PCM encoders take any frame size
+		stream.avFrame->nb_samples = avCodecCtx->frame_size > 0 ? avCodecCtx->frame_size : 1024;
+		stream.avFrame->format = avCodecCtx->sample_fmt;
+		stream.avFrame->sample_rate = SAMPLERATE;
+#if BENCHMARK_HAS_CH_LAYOUT
+		av_channel_layout_copy(&stream.avFrame->ch_layout, &avCodecCtx->ch_layout);
+#else
+		stream.avFrame->channels = avCodecCtx->channels;
+		stream.avFrame->channel_layout = avCodecCtx->channel_layout;
+#endif
+		ret = av_frame_get_buffer(stream.avFrame, 0);
+	}
+
+	return ret;
+}
+
+// Diagonal gradients moving over the picture, with some texture so the encoders have work to do
+static int FillVideoFrame(OutputStream& stream)
+{
+	int ret = av_frame_make_writable(stream.avFrame);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	AVFrame* pattern = stream.patternFrame;
+	int frame = (int)stream.nextPts;
+	for (int y = 0; y < pattern->height; y++)
+	{
+		uint8_t* line = pattern->data[0] + y * pattern->linesize[0];
+		for (int x = 0; x < pattern->width; x++)
+		{
+			line[x] = (uint8_t)(x + 2 * y + 4 * frame + ((x * y + frame) & 31));
+		}
+	}
+	for (int y = 0; y < pattern->height / 2; y++)
+	{
+		uint8_t* u = pattern->data[1] + y * pattern->linesize[1];
+		uint8_t* v = pattern->data[2] + y * pattern->linesize[2];
+		for (int x = 0; x < pattern->width / 2; x++)
+		{
+			u[x] = (uint8_t)(96 + ((x + frame) & 63));
+			v[x] = (uint8_t)(96 + ((y + 2 * frame) & 63));
+		}
+	}
+
+	sws_scale(stream.swsCtx, pattern->data, pattern->linesize, 0, pattern->height, stream.avFrame->data, stream.avFrame->linesize);
+	stream.avFrame->pts = stream.nextPts++;
+	return 0;
+}
+
+static void WriteSample(AVFrame* avFrame, int channel, int index, double value)
+{
+	AVSampleFormat format = (AVSampleFormat)avFrame->format;
+	bool isPlanar = av_sample_fmt_is_planar(format) != 0;
+	uint8_t* plane = avFrame->extended_data[isPlanar ? channel : 0];
+	int position = isPlanar ? index : index * CHANNELS + channel;
+
+	switch (av_get_packed_sample_fmt(format))
+	{
+	case AV_SAMPLE_FMT_U8: ((uint8_t*)plane)[position] = (uint8_t)(128 + value * 127); break;
+	case AV_SAMPLE_FMT_S16: ((int16_t*)plane)[position] = (int16_t)(value * 32767); break;
+	case AV_SAMPLE_FMT_S32: ((int32_t*)plane)[position] = (int32_t)(value * 2147483647.0); break;
+	case AV_SAMPLE_FMT_FLT: ((float*)plane)[position] = (float)value; break;
+	case AV_SAMPLE_FMT_DBL: ((double*)plane)[position] = value; break;
+	default: break;
+	}
+}
+
+// A sine sweeping from 100 Hz up by 400 Hz per second, the right channel half a period behind the left one
+static int FillAudioFrame(OutputStream& stream)
+{
+	int ret = av_frame_make_writable(stream.avFrame);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	for (int i = 0; i < stream.avFrame->nb_samples; i++)
+	{
+		double time = (double)(stream.nextPts + i) / SAMPLERATE;
+		stream.phase += 2 * PI * (100.0 + 400.0 * std::fmod(time, 10.0)) / SAMPLERATE;
+		WriteSample(stream.avFrame, 0, i, 0.5 * std::sin(stream.phase));
+		WriteSample(stream.avFrame, 1, i, 0.5 * std::sin(stream.phase + PI));
+	}
+
+	stream.avFrame->pts = stream.nextPts;
+	stream.nextPts += stream.avFrame->nb_samples;
+	return 0;
+}
+
+// Encode the frame, or drain the encoder when avFrame is nullptr, and mux what comes out
+static int EncodeFrame(AVFormatContext* avFormatCtx, OutputStream& stream, AVFrame* avFrame)
+{
+	int ret = avcodec_send_frame(stream.avCodecCtx, avFrame);
+	AVPacket* avPacket = av_packet_alloc();
+	if (avPacket == nullptr)
+	{
+		return AVERROR(ENOMEM);
+	}
+
+	while (ret >= 0)
+	{
+		ret = avcodec_receive_packet(stream.avCodecCtx, avPacket);
+		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+		{
+			ret = 0;
+			break;
+		}
+		else if (ret >= 0)
+		{
+			av_packet_rescale_ts(avPacket, stream.avCodecCtx->time_base, stream.avStream->time_base);
+			avPacket->stream_index = stream.avStream->index;
+			ret = av_interleaved_write_frame(avFormatCtx, avPacket);
+		}
+	}
+
+	av_packet_free(&avPacket);
+	return ret;
+}
+
+int FFmpegInteropBenchmark::GenerateSyntheticMedia(const SyntheticMediaSpec& spec, int seconds, int width, int height, const std::string& path)
+{
+	const AVCodec* videoCodec = FindEncoder(spec.videoEncoders, spec.pixelFormat);
+	const AVCodec* audioCodec = FindEncoder(spec.audioEncoders, nullptr);
+	if ((!spec.videoEncoders.empty() && videoCodec == nullptr) || (!spec.audioEncoders.empty() && audioCodec == nullptr))
+	{
+		return AVERROR_ENCODER_NOT_FOUND;
+	}
+
+	AVFormatContext* avFormatCtx = nullptr;
+	int ret = avformat_alloc_output_context2(&avFormatCtx, NULL, spec.muxer, path.c_str());
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	// Declared after the context, so they are freed before it
+	{
+		OutputStream video;
+		OutputStream audio;
+
+		if (ret >= 0 && videoCodec != nullptr)
+		{
+			ret = OpenVideoStream(avFormatCtx, videoCodec, spec.pixelFormat, width, height, video);
+		}
+		if (ret >= 0 && audioCodec != nullptr)
+		{
+			ret = OpenAudioStream(avFormatCtx, audioCodec, audio);
+		}
+		if (ret >= 0 && !(avFormatCtx->oformat->flags & AVFMT_NOFILE))
+		{
+			ret = avio_open(&avFormatCtx->pb, path.c_str(), AVIO_FLAG_WRITE);
+		}
+		if (ret >= 0)
+		{
+			ret = avformat_write_header(avFormatCtx, NULL);
+		}
+
+		// Interleave the streams by always encoding the one which is behind
+		bool isVideoDone = videoCodec == nullptr;
+		bool isAudioDone = audioCodec == nullptr;
+		while (ret >= 0 && (!isVideoDone || !isAudioDone))
+		{
+			bool isVideoNext = !isVideoDone && (isAudioDone
+				|| av_compare_ts(video.nextPts, video.avCodecCtx->time_base, audio.nextPts, audio.avCodecCtx->time_base) <= 0);
+			OutputStream& stream = isVideoNext ? video : audio;
+			bool& isDone = isVideoNext ? isVideoDone : isAudioDone;
+
+			if (av_compare_ts(stream.nextPts, stream.avCodecCtx->time_base, seconds, av_make_q(1, 1)) >= 0)
+			{
+				ret = EncodeFrame(avFormatCtx, stream, nullptr);
+				isDone = true;
+			}
+			else
+			{
+				ret = isVideoNext ? FillVideoFrame(stream) : FillAudioFrame(stream);
+				if (ret >= 0)
+				{
+					ret = EncodeFrame(avFormatCtx, stream, stream.avFrame);
+				}
+			}
+		}
+
+		if (ret >= 0)
+		{
+			ret = av_write_trailer(avFormatCtx);
+		}
+	}
+
+	if (avFormatCtx->pb != nullptr && !(avFormatCtx->oformat->flags & AVFMT_NOFILE))
+	{
+		avio_closep(&avFormatCtx->pb);
+	}
+	avformat_free_context(avFormatCtx);
+
+	return ret;
+}
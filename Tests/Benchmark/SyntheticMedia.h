@@ -0,0 +1,42 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+#include <string>
+#include <vector>
+
+namespace FFmpegInteropBenchmark
+{
+	// A media file encoded by the harness itself, so every run measures the same content without test assets
+	struct SyntheticMediaSpec
+	{
+		const char* name;
+		const char* muxer;
+		const char* extension;
+
+		// Encoders tried in order, the first one this FFmpeg build has, with the pixel format, wins. Empty for no
+		// stream of that kind.
+		std::vector<const char*> videoEncoders;
+		const char* pixelFormat;
+		std::vector<const char*> audioEncoders;
+	};
+
+	// Encode seconds of a moving test pattern and a sine sweep into path. Returns AVERROR_ENCODER_NOT_FOUND when
+	// none of the encoders is available, which skips the cases using this media.
+	int GenerateSyntheticMedia(const SyntheticMediaSpec& spec, int seconds, int width, int height, const std::string& path);
+}
@@ -0,0 +1,40 @@
+//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+#pragma once
+
+// Stands in for the precompiled header of the library projects, so the plain C++ sources of the library
+// (PipelineTrace.cpp, SamplePayload.cpp, ...) build here as they are
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int32_t HRESULT;
+const HRESULT S_OK = 0;
+const HRESULT S_FALSE = 1;
+const HRESULT E_FAIL = (HRESULT)0x80004005;
+const HRESULT E_OUTOFMEMORY = (HRESULT)0x8007000E;
+const HRESULT E_UNEXPECTED = (HRESULT)0x8000FFFF;
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+#define _ASSERT(x) assert(x)
+#define DebugMessage(x)
@@ -0,0 +1,98 @@
+﻿//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+using FFmpegInterop;
+using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
+using System;
+using System.Linq;
+using System.Threading.Tasks;
+using Windows.Storage;
+using Windows.Storage.Streams;
+
+namespace UnitTest.Windows
+{
+    [TestClass]
+    public class TestAudioWaveform
+    {
+        [TestMethod]
+        public async Task AudioWaveform_Stream()
+        {
+            Uri uri = new Uri("ms-appx:///silence with album art.mp3");
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+            IRandomAccessStream stream = await file.OpenAsync(FileAccessMode.Read);
+
+            AudioWaveform waveform = await AudioWaveform.CreateFromStreamAsync(stream, 200, null);
+            Assert.IsNotNull(waveform);
+            Assert.AreEqual(200, waveform.BucketCount);
+            Assert.IsTrue(waveform.Duration.Ticks > 0);
+            Assert.AreEqual(waveform.Duration.Ticks / 200, waveform.BucketDuration.Ticks);
+
+            float[] minimums = waveform.GetMinimums();
+            float[] maximums = waveform.GetMaximums();
+            float[] rms = waveform.GetRms();
+            Assert.AreEqual(200, minimums.Length);
+            Assert.AreEqual(200, maximums.Length);
+            Assert.AreEqual(200, rms.Length);
+
+            // The file is silent
+            Assert.IsTrue(minimums.All(value => value <= 0 && value > -0.01f));
+            Assert.IsTrue(maximums.All(value => value >= 0 && value < 0.01f));
+            Assert.IsTrue(rms.All(value => value >= 0 && value < 0.01f));
+
+            float[] peaks = waveform.GetPeaks();
+            Assert.AreEqual(600, peaks.Length);
+            Assert.AreEqual(maximums[100], peaks[301]);
+        }
+
+        [TestMethod]
+        public async Task AudioWaveform_Sine()
+        {
+            // The audio is a 440 Hz sine with an amplitude of 1/8
+            Uri uri = new Uri("ms-appx:///two audio tracks.mp4");
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+            IRandomAccessStream stream = await file.OpenAsync(FileAccessMode.Read);
+
+            AudioWaveform waveform = await AudioWaveform.CreateFromStreamAsync(stream, 100, null);
+            Assert.IsNotNull(waveform);
+
+            float[] minimums = waveform.GetMinimums();
+            float[] maximums = waveform.GetMaximums();
+            float[] rms = waveform.GetRms();
+
+            // Every bucket holds 44 periods, so each one sees the peaks of the sine and its RMS of amplitude / sqrt(2).
+            // The first and last two are left out, the encoder doesn't keep the edges clean.
+            for (int i = 2; i < 98; i++)
+            {
+                Assert.AreEqual(-0.125f, minimums[i], 0.015f);
+                Assert.AreEqual(0.125f, maximums[i], 0.015f);
+                Assert.AreEqual(0.0884f, rms[i], 0.005f);
+            }
+        }
+
+        [TestMethod]
+        public async Task AudioWaveform_NoAudio()
+        {
+            Uri uri = new Uri("ms-appx:///test.txt");
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+            IRandomAccessStream stream = await file.OpenAsync(FileAccessMode.Read);
+
+            AudioWaveform waveform = await AudioWaveform.CreateFromStreamAsync(stream, 200, null);
+            Assert.IsNull(waveform);
+        }
+    }
+}
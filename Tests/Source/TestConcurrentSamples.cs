@@ -0,0 +1,132 @@
+﻿//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+using FFmpegInterop;
+using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Threading.Tasks;
+using Windows.Media.Core;
+using Windows.Storage;
+using Windows.Storage.Streams;
+
+namespace UnitTest.Windows
+{
+    [TestClass]
+    public class TestConcurrentSamples
+    {
+        const int SamplesPerRequest = 20;
+        const int Rounds = 10;
+
+        // Timestamps are rounded to TimeSpan units on each sample, and the media may end a little before its duration
+        static readonly TimeSpan TimestampTolerance = TimeSpan.FromMilliseconds(1);
+        static readonly TimeSpan EndTolerance = TimeSpan.FromSeconds(1);
+
+        // Timestamp and duration of the samples a request got, and whether it came back empty
+        private class PulledSamples
+        {
+            public List<Tuple<TimeSpan, TimeSpan>> Samples = new List<Tuple<TimeSpan, TimeSpan>>();
+            public bool IsEnded;
+        }
+
+        // Pulls samples of one stream until it comes back empty
+        private static PulledSamples PullSamples(FFmpegInteropMSS FFmpegMSS, IMediaStreamDescriptor descriptor)
+        {
+            PulledSamples pulled = new PulledSamples();
+            TimeSpan previous = TimeSpan.MinValue;
+            for (int i = 0; i < SamplesPerRequest; i++)
+            {
+                MediaStreamSample sample = FFmpegMSS.GetNextSample(descriptor);
+                if (sample == null)
+                {
+                    pulled.IsEnded = true;
+                    break;
+                }
+
+                // Packets of the stream must neither be lost nor handed to the other one
+                Assert.IsTrue(sample.Buffer.Length > 0);
+                Assert.IsTrue(sample.Timestamp >= previous);
+                previous = sample.Timestamp;
+                pulled.Samples.Add(Tuple.Create(sample.Timestamp, sample.Duration));
+            }
+
+            return pulled;
+        }
+
+        // Each sample starts where the one before it ended, whichever request and round handed it out, and the
+        // stream only comes back empty once it reached the duration of the media
+        private static void AssertContinuous(FFmpegInteropMSS FFmpegMSS, List<PulledSamples> requests)
+        {
+            List<Tuple<TimeSpan, TimeSpan>> ordered = requests.SelectMany(pulled => pulled.Samples).OrderBy(sample => sample.Item1).ToList();
+            Assert.IsTrue(ordered.Count > 0);
+            for (int i = 1; i < ordered.Count; i++)
+            {
+                TimeSpan expected = ordered[i - 1].Item1 + ordered[i - 1].Item2;
+                TimeSpan gap = ordered[i].Item1 - expected;
+                Assert.IsTrue(gap.Duration() <= TimestampTolerance, "Sample at " + ordered[i].Item1 + " expected at " + expected);
+            }
+
+            if (requests.Any(pulled => pulled.IsEnded))
+            {
+                TimeSpan end = ordered[ordered.Count - 1].Item1 + ordered[ordered.Count - 1].Item2;
+                Assert.IsTrue(end >= FFmpegMSS.Duration - EndTolerance, "No sample after " + end);
+            }
+        }
+
+        [TestMethod]
+        public async Task GetNextSample_Audio_And_Video_Concurrently()
+        {
+            Uri uri = new Uri(Constants.DownloadUriSource);
+            StorageFile file = await StorageFile.CreateStreamedFileFromUriAsync(Constants.DownloadStreamedFileName, uri, null);
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+
+            // Decode both streams so every request does real work on its own thread
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, true, true);
+            Assert.IsNotNull(FFmpegMSS);
+            Assert.IsNotNull(FFmpegMSS.AudioDescriptor);
+            Assert.IsNotNull(FFmpegMSS.VideoDescriptor);
+
+            List<PulledSamples> audioRequests = new List<PulledSamples>();
+            List<PulledSamples> videoRequests = new List<PulledSamples>();
+            for (int round = 0; round < Rounds; round++)
+            {
+                // Several requests per stream at once, they take turns on the stream but not across streams
+                Task<PulledSamples>[] tasks =
+                {
+                    Task.Run(() => PullSamples(FFmpegMSS, FFmpegMSS.AudioDescriptor)),
+                    Task.Run(() => PullSamples(FFmpegMSS, FFmpegMSS.VideoDescriptor)),
+                    Task.Run(() => PullSamples(FFmpegMSS, FFmpegMSS.VideoDescriptor))
+                };
+                PulledSamples[] results = await Task.WhenAll(tasks);
+                audioRequests.Add(results[0]);
+                videoRequests.Add(results[1]);
+                videoRequests.Add(results[2]);
+            }
+
+            AssertContinuous(FFmpegMSS, audioRequests);
+            AssertContinuous(FFmpegMSS, videoRequests);
+
+            MediaPipelineStatistics statistics = FFmpegMSS.Statistics;
+            Assert.AreEqual(audioRequests.Sum(pulled => pulled.Samples.Count), statistics.Audio.Samples);
+            Assert.AreEqual(videoRequests.Sum(pulled => pulled.Samples.Count), statistics.Video.Samples);
+            Assert.AreEqual(0, statistics.Audio.DisabledStreams);
+            Assert.AreEqual(0, statistics.Video.DisabledStreams);
+        }
+    }
+}
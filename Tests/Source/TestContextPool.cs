@@ -0,0 +1,213 @@
+﻿//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+using FFmpegInterop;
+using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Runtime.InteropServices.WindowsRuntime;
+using System.Threading.Tasks;
+using Windows.Media.Core;
+using Windows.Media.MediaProperties;
+using Windows.Storage;
+using Windows.Storage.Streams;
+
+namespace UnitTest.Windows
+{
+    [TestClass]
+    public class TestContextPool
+    {
+        const int Iterations = 10;
+
+        // Opens the media and decodes its first sample, returns the elapsed time
+        private async Task<TimeSpan> OpenAndDecodeFirstSample(StorageFile file)
+        {
+            var streams = new List<IRandomAccessStream>();
+            streams.Add(await file.OpenAsync(FileAccessMode.Read));
+
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            using (FFmpegInteropPlaylist playlist = FFmpegInteropPlaylist.CreateFromStreams(streams, null))
+            {
+                // The playlist decodes the first sample of its first item while being created
+                stopwatch.Stop();
+                Assert.IsNotNull(playlist);
+            }
+
+            return stopwatch.Elapsed;
+        }
+
+        [TestMethod]
+        public async Task ContextPool_Cold_Versus_Warm()
+        {
+            var uri = new Uri("ms-appx:///silence with album art.mp3");
+            var file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+
+            TimeSpan cold = TimeSpan.Zero;
+            TimeSpan warm = TimeSpan.Zero;
+            for (int i = 0; i < Iterations; i++)
+            {
+                // Cold: every context has to be set up again
+                FFmpegInteropMSS.ClearContextPool();
+                long decoders = FFmpegInteropMSS.ReusedDecoderCount;
+                cold += await OpenAndDecodeFirstSample(file);
+                Assert.AreEqual(decoders, FFmpegInteropMSS.ReusedDecoderCount);
+
+                // Warm: the decoder and resampler released by the previous run are reused
+                warm += await OpenAndDecodeFirstSample(file);
+                Assert.IsTrue(FFmpegInteropMSS.ReusedDecoderCount > decoders);
+            }
+
+            Debug.WriteLine("Open and first sample, cold pool: {0:F2} ms, warm pool: {1:F2} ms",
+                cold.TotalMilliseconds / Iterations, warm.TotalMilliseconds / Iterations);
+            FFmpegInteropMSS.ClearContextPool();
+        }
+
+        // Opens the media and extracts a thumbnail of its first frame, returns the elapsed time
+        private async Task<TimeSpan> OpenAndExtractFirstFrame(StorageFile file)
+        {
+            IRandomAccessStream stream = await file.OpenAsync(FileAccessMode.Read);
+
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            using (FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(stream, false, false))
+            {
+                Assert.IsNotNull(FFmpegMSS);
+                MediaThumbnailData thumbnail = FFmpegMSS.ExtractVideoFrame(TimeSpan.Zero, 64, 48, VideoFrameFormat.Bgra8);
+                stopwatch.Stop();
+                Assert.IsNotNull(thumbnail);
+            }
+
+            return stopwatch.Elapsed;
+        }
+
+        [TestMethod]
+        public async Task ContextPool_Video_Cold_Versus_Warm()
+        {
+            Uri uri = new Uri("ms-appx:///two audio tracks.mp4");
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+
+            TimeSpan cold = TimeSpan.Zero;
+            TimeSpan warm = TimeSpan.Zero;
+            for (int i = 0; i < Iterations; i++)
+            {
+                // Cold: the keyframe decoder and the scaler have to be set up
+                FFmpegInteropMSS.ClearContextPool();
+                long decoders = FFmpegInteropMSS.ReusedDecoderCount;
+                long scalers = FFmpegInteropMSS.ReusedScalerCount;
+                cold += await OpenAndExtractFirstFrame(file);
+                Assert.AreEqual(decoders, FFmpegInteropMSS.ReusedDecoderCount);
+                Assert.AreEqual(scalers, FFmpegInteropMSS.ReusedScalerCount);
+
+                // Warm: the thumbnail of the next media with the same format borrows both of them
+                warm += await OpenAndExtractFirstFrame(file);
+                Assert.AreEqual(decoders + 1, FFmpegInteropMSS.ReusedDecoderCount);
+                Assert.AreEqual(scalers + 1, FFmpegInteropMSS.ReusedScalerCount);
+            }
+
+            Debug.WriteLine("Open and first video frame, cold pool: {0:F2} ms, warm pool: {1:F2} ms",
+                cold.TotalMilliseconds / Iterations, warm.TotalMilliseconds / Iterations);
+            FFmpegInteropMSS.ClearContextPool();
+        }
+
+        // Decodes the audio of the media to PCM, returns its encoding properties and checks the samples match them
+        private async Task<AudioEncodingProperties> DecodeAudio(StorageFile file)
+        {
+            IRandomAccessStream stream = await file.OpenAsync(FileAccessMode.Read);
+            using (FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(stream, true, false))
+            {
+                Assert.IsNotNull(FFmpegMSS);
+                AudioEncodingProperties encodingProperties = FFmpegMSS.AudioDescriptor.EncodingProperties;
+
+                long bytes = 0;
+                TimeSpan duration = TimeSpan.Zero;
+                for (int i = 0; i < 50; i++)
+                {
+                    MediaStreamSample sample = FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor);
+                    Assert.IsNotNull(sample);
+                    bytes += sample.Buffer.Length;
+                    duration += sample.Duration;
+                }
+
+                // 16 bit PCM in the sample rate and channels the descriptor announces
+                double expectedBytes = duration.TotalSeconds * encodingProperties.SampleRate * encodingProperties.ChannelCount * 2;
+                Assert.AreEqual(expectedBytes, bytes, expectedBytes * 0.01);
+                return encodingProperties;
+            }
+        }
+
+        [TestMethod]
+        public async Task ContextPool_Warm_Decoder_Keeps_Stream_Format()
+        {
+            Uri uri = new Uri("ms-appx:///two audio tracks.mp4");
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+
+            // The second media gets the decoder the first one opened, the descriptor mustn't change with it
+            FFmpegInteropMSS.ClearContextPool();
+            AudioEncodingProperties cold = await DecodeAudio(file);
+            AudioEncodingProperties warm = await DecodeAudio(file);
+            Assert.AreEqual(cold.SampleRate, warm.SampleRate);
+            Assert.AreEqual(cold.ChannelCount, warm.ChannelCount);
+            FFmpegInteropMSS.ClearContextPool();
+        }
+
+        // Plays the second item of a playlist, which gets resampled to the format of the first, and returns the
+        // start of its audio. More of it is played after that so the resampler is left with history.
+        private async Task<byte[]> PlayResampledItem(StorageFile first, StorageFile second)
+        {
+            List<IRandomAccessStream> streams = new List<IRandomAccessStream>();
+            streams.Add(await first.OpenAsync(FileAccessMode.Read));
+            streams.Add(await second.OpenAsync(FileAccessMode.Read));
+
+            List<byte> start = new List<byte>();
+            using (FFmpegInteropPlaylist playlist = FFmpegInteropPlaylist.CreateFromStreams(streams, null))
+            {
+                Assert.IsNotNull(playlist);
+
+                int resampledCount = 0;
+                MediaStreamSample sample;
+                while (resampledCount < 50 && (sample = playlist.GetNextSample()) != null)
+                {
+                    if (playlist.CurrentIndex == 1 && resampledCount++ < 10)
+                    {
+                        start.AddRange(sample.Buffer.ToArray());
+                    }
+                }
+                Assert.AreEqual(50, resampledCount);
+            }
+
+            return start.ToArray();
+        }
+
+        [TestMethod]
+        public async Task ContextPool_Warm_Resampler_Starts_Clean()
+        {
+            // The silence is played at 44.1 kHz, the tone after it is resampled from 22.05 kHz
+            StorageFile silence = await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///silence with album art.mp3"));
+            StorageFile tone = await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///two audio tracks.mp4"));
+
+            // The second run borrows the resampler the first one left in the middle of the tone. Nothing of it may
+            // show in the output.
+            FFmpegInteropMSS.ClearContextPool();
+            byte[] cold = await PlayResampledItem(silence, tone);
+            byte[] warm = await PlayResampledItem(silence, tone);
+            Assert.IsTrue(cold.Length > 0);
+            CollectionAssert.AreEqual(cold, warm);
+            FFmpegInteropMSS.ClearContextPool();
+        }
+    }
+}
@@ -241,5 +241,306 @@ namespace UnitTest.Windows
             Assert.IsNull(OriginalFFmpegMSS);
             Assert.IsNull(Originalmss);
         }
+
+        [TestMethod]
+        public async Task CreateFromStream_Audio_Descriptors()
+        {
+            Uri uri = new Uri(Constants.DownloadUriSource);
+            Assert.IsNotNull(uri);
+
+            StorageFile file = await StorageFile.CreateStreamedFileFromUriAsync(Constants.DownloadStreamedFileName, uri, null);
+            Assert.IsNotNull(file);
+
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+            Assert.IsNotNull(readStream);
+
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, false, false);
+            Assert.IsNotNull(FFmpegMSS);
+
+            // Every audio stream is exposed, the default one being selected
+            Assert.AreEqual(1, FFmpegMSS.AudioDescriptors.Count);
+            Assert.AreEqual(FFmpegMSS.AudioDescriptor, FFmpegMSS.AudioDescriptors[0]);
+        }
+
+        [TestMethod]
+        public async Task CreateFromStream_AudioOnly_Off_Without_Seek()
+        {
+            Uri uri = new Uri("ms-appx:///two audio tracks.mp4");
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, true, true);
+            Assert.IsNotNull(FFmpegMSS);
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+
+            // Video ends as soon as it is turned off
+            FFmpegMSS.AudioOnly = true;
+            Assert.IsNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+
+            // Turning it back on without a seek leaves video ended, nothing is queued for it meanwhile
+            FFmpegMSS.AudioOnly = false;
+            for (int i = 0; i < 50; i++)
+            {
+                Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor));
+            }
+            Assert.IsNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+
+            MediaPipelineStatistics statistics = FFmpegMSS.Statistics;
+            Assert.AreEqual(0, statistics.Video.QueuedPackets);
+            Assert.AreEqual(0, statistics.Video.DisabledStreams);
+        }
+
+        [TestMethod]
+        public async Task CreateFromStream_AudioOnly_Config_Stays_On()
+        {
+            Uri uri = new Uri("ms-appx:///two audio tracks.mp4");
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+
+            FFmpegInteropConfig config = new FFmpegInteropConfig();
+            config.AudioOnly = true;
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, config);
+            Assert.IsNotNull(FFmpegMSS);
+            Assert.IsNull(FFmpegMSS.VideoDescriptor);
+            Assert.IsTrue(FFmpegMSS.AudioOnly);
+
+            // No video stream was set up to resume, so the switch can't be turned off
+            FFmpegMSS.AudioOnly = false;
+            Assert.IsTrue(FFmpegMSS.AudioOnly);
+            FFmpegMSS.Seek(TimeSpan.FromSeconds(2));
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor));
+            Assert.IsNull(FFmpegMSS.VideoDescriptor);
+        }
+
+        [TestMethod]
+        public async Task CreateFromStream_Switch_Audio_Stream()
+        {
+            Uri uri = new Uri("ms-appx:///two audio tracks.mp4");
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, true, true);
+            Assert.IsNotNull(FFmpegMSS);
+            Assert.AreEqual(2, FFmpegMSS.AudioDescriptors.Count);
+            Assert.AreEqual(FFmpegMSS.AudioDescriptors[0], FFmpegMSS.AudioDescriptor);
+
+            // Play 2 seconds of audio while the video runs ahead to 6 seconds, so the demuxer is well past the audio
+            TimeSpan audioEnd = TimeSpan.Zero;
+            while (audioEnd < TimeSpan.FromSeconds(2))
+            {
+                MediaStreamSample audioSample = FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor);
+                Assert.IsNotNull(audioSample);
+                audioEnd = audioSample.Timestamp + audioSample.Duration;
+            }
+
+            MediaStreamSample videoSample;
+            do
+            {
+                videoSample = FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor);
+                Assert.IsNotNull(videoSample);
+            } while (videoSample.Timestamp < TimeSpan.FromSeconds(6));
+
+            FFmpegMSS.SwitchAudioStream(FFmpegMSS.AudioDescriptors[1]);
+            Assert.AreEqual(FFmpegMSS.AudioDescriptors[1], FFmpegMSS.AudioDescriptor);
+
+            // The new stream carries on where the played audio ends, not at the demuxer position
+            MediaStreamSample switchedSample = FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor);
+            Assert.IsNotNull(switchedSample);
+            Assert.IsTrue((switchedSample.Timestamp - audioEnd).Duration() < TimeSpan.FromMilliseconds(100));
+
+            // Video neither repeats nor skips frames
+            MediaStreamSample nextVideoSample = FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor);
+            Assert.IsNotNull(nextVideoSample);
+            Assert.IsTrue(nextVideoSample.Timestamp > videoSample.Timestamp);
+            Assert.IsTrue(nextVideoSample.Timestamp - videoSample.Timestamp <= TimeSpan.FromMilliseconds(80));
+            Assert.AreEqual(0, FFmpegMSS.Statistics.Audio.DisabledStreams);
+        }
+
+        [TestMethod]
+        public async Task CreateFromStream_Open_Timings()
+        {
+            Uri uri = new Uri(Constants.DownloadUriSource);
+            Assert.IsNotNull(uri);
+
+            StorageFile file = await StorageFile.CreateStreamedFileFromUriAsync(Constants.DownloadStreamedFileName, uri, null);
+            Assert.IsNotNull(file);
+
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+            Assert.IsNotNull(readStream);
+
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, false, false);
+            Assert.IsNotNull(FFmpegMSS);
+
+            // Every open phase is measured, the decoders are only set up once playback starts
+            MediaOpenTimings timings = FFmpegMSS.OpenTimings;
+            Assert.IsNotNull(timings);
+            Assert.IsTrue(timings.OpenInput.Ticks > 0);
+            Assert.IsTrue(timings.FindStreamInfo.Ticks > 0);
+            Assert.AreEqual(0, timings.DecoderSetup.Ticks);
+            Assert.IsTrue(timings.Total >= timings.OpenInput + timings.FindStreamInfo);
+        }
+
+        [TestMethod]
+        public async Task CreateFromStream_Statistics()
+        {
+            Uri uri = new Uri(Constants.DownloadUriSource);
+            Assert.IsNotNull(uri);
+
+            StorageFile file = await StorageFile.CreateStreamedFileFromUriAsync(Constants.DownloadStreamedFileName, uri, null);
+            Assert.IsNotNull(file);
+
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+            Assert.IsNotNull(readStream);
+
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, false, false);
+            Assert.IsNotNull(FFmpegMSS);
+
+            // Opening reads the stream, samples are only produced once playback starts
+            MediaPipelineStatistics statistics = FFmpegMSS.Statistics;
+            Assert.IsNotNull(statistics);
+            Assert.IsTrue(statistics.ReadCalls > 0);
+            Assert.IsTrue(statistics.BytesRead > 0);
+            Assert.IsTrue(statistics.BytesRead <= (long)readStream.Size);
+            Assert.AreEqual(0, statistics.Audio.Samples);
+            Assert.AreEqual(0, statistics.Video.Samples);
+            Assert.AreEqual(0, statistics.Video.DecodeTime.Ticks);
+            Assert.AreEqual(0, statistics.Audio.DisabledStreams);
+            Assert.AreEqual(0, statistics.Seeks);
+            Assert.AreEqual(0, statistics.BufferedSeeks);
+
+            // Every call returns a new snapshot
+            Assert.AreNotSame(statistics, FFmpegMSS.Statistics);
+        }
+
+        [TestMethod]
+        public async Task CreateFromStream_Latencies()
+        {
+            Uri uri = new Uri(Constants.DownloadUriSource);
+            Assert.IsNotNull(uri);
+
+            StorageFile file = await StorageFile.CreateStreamedFileFromUriAsync(Constants.DownloadStreamedFileName, uri, null);
+            Assert.IsNotNull(file);
+
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+            Assert.IsNotNull(readStream);
+
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, false, false);
+            Assert.IsNotNull(FFmpegMSS);
+
+            // Opening reads the stream, no sample has been requested yet
+            LatencyDistribution ioWait = FFmpegMSS.GetLatencyDistribution(LatencyMetric.IoWait);
+            Assert.IsTrue(ioWait.Count > 0);
+            Assert.IsTrue(ioWait.GetPercentile(50) <= ioWait.GetPercentile(99));
+            Assert.IsTrue(ioWait.GetPercentile(99) <= ioWait.Maximum);
+            Assert.IsTrue(ioWait.Mean <= ioWait.Maximum);
+            Assert.AreEqual(0, FFmpegMSS.GetLatencyDistribution(LatencyMetric.VideoSampleRequest).Count);
+            Assert.AreEqual(0, FFmpegMSS.GetLatencyDistribution(LatencyMetric.SeekToFirstSample).Count);
+
+            FFmpegMSS.ResetLatencies();
+            Assert.AreEqual(0, FFmpegMSS.GetLatencyDistribution(LatencyMetric.IoWait).Count);
+            Assert.AreEqual(TimeSpan.Zero, FFmpegMSS.GetLatencyDistribution(LatencyMetric.IoWait).GetPercentile(99));
+        }
+
+        [TestMethod]
+        public async Task CreateFromStream_Config_Program()
+        {
+            Uri uri = new Uri(Constants.DownloadUriSource);
+            Assert.IsNotNull(uri);
+
+            StorageFile file = await StorageFile.CreateStreamedFileFromUriAsync(Constants.DownloadStreamedFileName, uri, null);
+            Assert.IsNotNull(file);
+
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+            Assert.IsNotNull(readStream);
+
+            // CreateFFmpegInteropMSSFromStream should return null when the requested program doesn't exist
+            FFmpegInteropConfig config = new FFmpegInteropConfig();
+            config.ProgramId = 1234;
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, config);
+            Assert.IsNull(FFmpegMSS);
+
+            // The default configuration plays the default streams
+            readStream.Seek(0);
+            FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, new FFmpegInteropConfig());
+            Assert.IsNotNull(FFmpegMSS);
+            Assert.AreEqual(0, FFmpegMSS.Programs.Count);
+
+            MediaStreamSource mss = FFmpegMSS.GetMediaStreamSource();
+            Assert.IsNotNull(mss);
+        }
+
+        [TestMethod]
+        public async Task CreateFromStream_Config_Program_Multiple()
+        {
+            // Program 1 holds 320x240 video with 44.1 kHz stereo audio, program 2 160x120 video with 22.05 kHz mono audio
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///two programs.ts"));
+            int[] programIds = { 1, 2 };
+            uint[] widths = { 320, 160 };
+            uint[] sampleRates = { 44100, 22050 };
+            uint[] channelCounts = { 2, 1 };
+
+            for (int i = 0; i < programIds.Length; i++)
+            {
+                FFmpegInteropConfig config = new FFmpegInteropConfig();
+                config.ForceAudioDecode = true;
+                config.ForceVideoDecode = true;
+                config.ProgramId = programIds[i];
+                FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(await file.OpenAsync(FileAccessMode.Read), config);
+                Assert.IsNotNull(FFmpegMSS);
+                Assert.AreEqual(2, FFmpegMSS.Programs.Count);
+                Assert.AreEqual(1, FFmpegMSS.Programs[0].Id);
+                Assert.AreEqual(2, FFmpegMSS.Programs[1].Id);
+                Assert.AreEqual(2u, FFmpegMSS.Programs[i].StreamCount);
+
+                // Only the streams of the program are picked, the audio of the other one isn't even offered
+                Assert.AreEqual(widths[i], FFmpegMSS.VideoDescriptor.EncodingProperties.Width);
+                Assert.AreEqual(sampleRates[i], FFmpegMSS.AudioDescriptor.EncodingProperties.SampleRate);
+                Assert.AreEqual(channelCounts[i], FFmpegMSS.AudioDescriptor.EncodingProperties.ChannelCount);
+                Assert.AreEqual(1, FFmpegMSS.AudioDescriptors.Count);
+
+                // The other program is discarded by the demuxer, the reader never gets to see a packet of it. Packets
+                // buffered while probing the streams come out regardless, the seek flushes them.
+                FFmpegMSS.Seek(TimeSpan.FromSeconds(1.5));
+                Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+                Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor));
+                MediaPipelineStatistics before = FFmpegMSS.Statistics;
+                for (int sample = 0; sample < 25; sample++)
+                {
+                    Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+                    Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor));
+                }
+                MediaPipelineStatistics after = FFmpegMSS.Statistics;
+                Assert.IsTrue(after.PacketsDemuxed - before.PacketsDemuxed >= 25);
+                Assert.AreEqual(before.PacketsDropped, after.PacketsDropped);
+            }
+        }
+
+        [TestMethod]
+        public async Task CreateFromStream_Config_DurationScan()
+        {
+            Uri uri = new Uri(Constants.DownloadUriSource);
+            Assert.IsNotNull(uri);
+
+            StorageFile file = await StorageFile.CreateStreamedFileFromUriAsync(Constants.DownloadStreamedFileName, uri, null);
+            Assert.IsNotNull(file);
+
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+            Assert.IsNotNull(readStream);
+
+            FFmpegInteropMSS headerMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, new FFmpegInteropConfig());
+            Assert.IsNotNull(headerMSS);
+
+            // The scanned duration of a file with a correct header matches the header, and the media stays seekable
+            readStream.Seek(0);
+            FFmpegInteropConfig config = new FFmpegInteropConfig();
+            config.DurationScan = DurationScanMode.Full;
+            FFmpegInteropMSS scannedMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, config);
+            Assert.IsNotNull(scannedMSS);
+            Assert.IsTrue(Math.Abs((scannedMSS.Duration - headerMSS.Duration).TotalMilliseconds) < 100);
+
+            MediaStreamSource mss = scannedMSS.GetMediaStreamSource();
+            Assert.IsNotNull(mss);
+            Assert.IsTrue(mss.CanSeek);
+        }
     }
 }
@@ -17,6 +17,8 @@
 //*****************************************************************************
 
 using FFmpegInterop;
+using System;
+using System.Threading.Tasks;
 using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
 using Windows.Foundation.Collections;
 using Windows.Media.Core;
@@ -106,6 +108,23 @@ namespace UnitTest.Windows
             Assert.AreEqual(Constants.StreamingUriLength, mss.Duration.TotalMilliseconds);
         }
 
+        [TestMethod]
+        public void CreateFromUri_IoWait()
+        {
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromUri(Constants.StreamingUriSource, false, false);
+            Assert.IsNotNull(FFmpegMSS);
+            FFmpegMSS.ResetLatencies();
+
+            // Without a stream to time, the packet reads of the demuxer are recorded
+            for (int i = 0; i < 10; i++)
+            {
+                Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+            }
+            LatencyDistribution ioWait = FFmpegMSS.GetLatencyDistribution(LatencyMetric.IoWait);
+            Assert.IsTrue(ioWait.Count >= 10);
+            Assert.IsTrue(ioWait.GetPercentile(99) <= ioWait.Maximum);
+        }
+
         [TestMethod]
         public void CreateFromUri_Force_Audio_Video()
         {
@@ -152,6 +171,25 @@ namespace UnitTest.Windows
             Assert.AreEqual(Constants.StreamingUriLength, mss.Duration.TotalMilliseconds);
         }
 
+        [TestMethod]
+        public async Task CreateFromUriAsync_Default()
+        {
+            // CreateFFmpegInteropMSSFromUriAsync should return valid FFmpegInteropMSS object which generates valid MediaStreamSource object
+            FFmpegInteropConfig config = new FFmpegInteropConfig();
+            config.OpenTimeout = TimeSpan.FromSeconds(30);
+            config.ReadTimeout = TimeSpan.FromSeconds(10);
+            FFmpegInteropMSS FFmpegMSS = await FFmpegInteropMSS.CreateFFmpegInteropMSSFromUriAsync(Constants.StreamingUriSource, config);
+            Assert.IsNotNull(FFmpegMSS);
+
+            MediaStreamSource mss = FFmpegMSS.GetMediaStreamSource();
+            Assert.IsNotNull(mss);
+            Assert.AreEqual(Constants.StreamingUriLength, mss.Duration.TotalMilliseconds);
+
+            // CreateFFmpegInteropMSSFromUriAsync should return null when given bad uri
+            FFmpegMSS = await FFmpegInteropMSS.CreateFFmpegInteropMSSFromUriAsync("http://This.is.a.bad.uri", config);
+            Assert.IsNull(FFmpegMSS);
+        }
+
         [TestMethod]
         public void CreateFromUri_Destructor()
         {
@@ -19,10 +19,13 @@
 using FFmpegInterop;
 using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
 using System;
+using System.Collections.Generic;
 using System.IO;
+using System.Linq;
 using System.Runtime.InteropServices.WindowsRuntime;
 using System.Threading.Tasks;
 using Windows.Graphics.Imaging;
+using Windows.Media.Core;
 using Windows.Storage;
 using Windows.Storage.Streams;
 
@@ -56,5 +59,199 @@ namespace UnitTest.Windows
                 Assert.IsNotNull(bitmap);
             }
         }
+
+        [TestMethod]
+        public async Task GetVideoFrameFromMedia()
+        {
+            Uri uri = new Uri(Constants.DownloadUriSource);
+            StorageFile file = await StorageFile.CreateStreamedFileFromUriAsync(Constants.DownloadStreamedFileName, uri, null);
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, false, false);
+            Assert.IsNotNull(FFmpegMSS);
+
+            // Encoded frame, the height follows the aspect ratio of the video
+            var thumbnailData = FFmpegMSS.ExtractVideoFrame(TimeSpan.FromSeconds(10), 160, 0, VideoFrameFormat.Jpeg);
+            Assert.IsNotNull(thumbnailData);
+            Assert.AreEqual(160u, thumbnailData.Width);
+            Assert.AreNotEqual(0u, thumbnailData.Height);
+
+            using (IRandomAccessStream thumbnailstream = thumbnailData.Buffer.AsStream().AsRandomAccessStream())
+            {
+                BitmapDecoder decoder = await BitmapDecoder.CreateAsync(thumbnailstream);
+                Assert.AreEqual(160u, decoder.PixelWidth);
+            }
+
+            // Raw frame
+            thumbnailData = FFmpegMSS.ExtractVideoFrame(TimeSpan.FromSeconds(20), 64, 64, VideoFrameFormat.Bgra8);
+            Assert.IsNotNull(thumbnailData);
+            Assert.AreEqual(64u * 64u * 4u, thumbnailData.Buffer.Length);
+        }
+
+        [TestMethod]
+        public async Task StepFramesOfMedia()
+        {
+            Uri uri = new Uri(Constants.DownloadUriSource);
+            StorageFile file = await StorageFile.CreateStreamedFileFromUriAsync(Constants.DownloadStreamedFileName, uri, null);
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, false, false);
+            Assert.IsNotNull(FFmpegMSS);
+
+            SteppedVideoFrame frame = FFmpegMSS.StepToFrame(TimeSpan.FromSeconds(10), 64, 64, VideoFrameFormat.Bgra8);
+            Assert.IsNotNull(frame);
+            Assert.IsTrue(frame.Position <= TimeSpan.FromSeconds(10));
+            Assert.AreEqual(64u * 64u * 4u, frame.Image.Buffer.Length);
+
+            // Step forward across a few GOPs, then back to where it started
+            var positions = new List<TimeSpan>();
+            positions.Add(frame.Position);
+            for (int i = 0; i < 100; i++)
+            {
+                frame = FFmpegMSS.StepForward(64, 64, VideoFrameFormat.Bgra8);
+                Assert.IsNotNull(frame);
+                Assert.IsTrue(frame.Position > positions[positions.Count - 1]);
+                positions.Add(frame.Position);
+            }
+
+            for (int i = positions.Count - 2; i >= 0; i--)
+            {
+                frame = FFmpegMSS.StepBackward(64, 64, VideoFrameFormat.Bgra8);
+                Assert.IsNotNull(frame);
+                Assert.AreEqual(positions[i], frame.Position);
+            }
+
+            // Nothing before the first frame
+            Assert.IsNotNull(FFmpegMSS.StepToFrame(TimeSpan.Zero, 64, 64, VideoFrameFormat.Bgra8));
+            Assert.IsNull(FFmpegMSS.StepBackward(64, 64, VideoFrameFormat.Bgra8));
+        }
+
+        [TestMethod]
+        public async Task StepFramesOfGopLargerThanCache()
+        {
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///two audio tracks.mp4"));
+            FFmpegInteropConfig config = new FFmpegInteropConfig();
+            config.FrameStepCacheSize = 1;
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(await file.OpenAsync(FileAccessMode.Read), config);
+            FFmpegInteropMSS reference = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(await file.OpenAsync(FileAccessMode.Read), new FFmpegInteropConfig());
+            Assert.IsNotNull(FFmpegMSS);
+            Assert.IsNotNull(reference);
+
+            // No GOP fits, each step decodes up to the frame it goes to and keeps only that one and the next.
+            // Across the keyframe at 2 s and back the same frames come out as with the whole GOPs cached.
+            double[] positions = { 1.88, 1.92, 1.96, 2.0, 2.04, 2.0, 1.96, 1.92, 1.88 };
+            for (int i = 0; i < positions.Length; i++)
+            {
+                SteppedVideoFrame frame;
+                SteppedVideoFrame referenceFrame;
+                if (i == 0)
+                {
+                    frame = FFmpegMSS.StepToFrame(TimeSpan.FromSeconds(1.9), 64, 64, VideoFrameFormat.Bgra8);
+                    referenceFrame = reference.StepToFrame(TimeSpan.FromSeconds(1.9), 64, 64, VideoFrameFormat.Bgra8);
+                }
+                else if (positions[i] > positions[i - 1])
+                {
+                    frame = FFmpegMSS.StepForward(64, 64, VideoFrameFormat.Bgra8);
+                    referenceFrame = reference.StepForward(64, 64, VideoFrameFormat.Bgra8);
+                }
+                else
+                {
+                    frame = FFmpegMSS.StepBackward(64, 64, VideoFrameFormat.Bgra8);
+                    referenceFrame = reference.StepBackward(64, 64, VideoFrameFormat.Bgra8);
+                }
+
+                Assert.IsNotNull(frame);
+                Assert.AreEqual(TimeSpan.FromSeconds(positions[i]), frame.Position);
+                Assert.AreEqual(referenceFrame.Position, frame.Position);
+                Assert.IsTrue(referenceFrame.Image.Buffer.ToArray().SequenceEqual(frame.Image.Buffer.ToArray()));
+            }
+        }
+
+        [TestMethod]
+        public async Task PlaybackResumesAtSteppedFrame()
+        {
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///two audio tracks.mp4"));
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+
+            FFmpegInteropConfig config = new FFmpegInteropConfig();
+            config.ForceVideoDecode = true;
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, config);
+            Assert.IsNotNull(FFmpegMSS);
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor));
+
+            // 25 fps, the frame shown at 5.5 s starts at 5.48 s
+            SteppedVideoFrame frame = FFmpegMSS.StepToFrame(TimeSpan.FromSeconds(5.5), 64, 64, VideoFrameFormat.Bgra8);
+            Assert.IsNotNull(frame);
+            Assert.AreEqual(TimeSpan.FromSeconds(5.48), frame.Position);
+            frame = FFmpegMSS.StepForward(64, 64, VideoFrameFormat.Bgra8);
+            frame = FFmpegMSS.StepForward(64, 64, VideoFrameFormat.Bgra8);
+            Assert.AreEqual(TimeSpan.FromSeconds(5.56), frame.Position);
+
+            // Playback goes on from the frame stepped to, with audio from there too
+            MediaStreamSample videoSample = FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor);
+            Assert.IsNotNull(videoSample);
+            Assert.AreEqual(frame.Position, videoSample.Timestamp);
+            MediaStreamSample nextVideoSample = FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor);
+            Assert.AreEqual(TimeSpan.FromSeconds(5.6), nextVideoSample.Timestamp);
+
+            MediaStreamSample audioSample = FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor);
+            Assert.IsNotNull(audioSample);
+            Assert.IsTrue(audioSample.Timestamp <= frame.Position);
+            Assert.IsTrue(audioSample.Timestamp > frame.Position - TimeSpan.FromSeconds(0.5));
+        }
+
+        [TestMethod]
+        public async Task PlaybackResumesAfterExtractVideoFrame()
+        {
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///two audio tracks.mp4"));
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+
+            FFmpegInteropConfig config = new FFmpegInteropConfig();
+            config.ForceVideoDecode = true;
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, config);
+            Assert.IsNotNull(FFmpegMSS);
+
+            MediaStreamSample videoSample = null;
+            for (int i = 0; i < 10; i++)
+            {
+                videoSample = FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor);
+                Assert.IsNotNull(videoSample);
+            }
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor));
+
+            Assert.IsNotNull(FFmpegMSS.ExtractVideoFrame(TimeSpan.FromSeconds(8), 64, 64, VideoFrameFormat.Bgra8));
+
+            // The next sample follows the last one handed out, not the frame extracted
+            MediaStreamSample nextVideoSample = FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor);
+            Assert.IsNotNull(nextVideoSample);
+            Assert.AreEqual(videoSample.Timestamp + videoSample.Duration, nextVideoSample.Timestamp);
+
+            MediaStreamSample audioSample = FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor);
+            Assert.IsNotNull(audioSample);
+            Assert.IsTrue(audioSample.Timestamp < TimeSpan.FromSeconds(1));
+        }
+
+        [TestMethod]
+        public async Task ExtractVideoFrameWithoutPlayback()
+        {
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///two audio tracks.mp4"));
+
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(await file.OpenAsync(FileAccessMode.Read), new FFmpegInteropConfig());
+            Assert.IsNotNull(FFmpegMSS);
+            MediaThumbnailData expected = FFmpegMSS.ExtractVideoFrame(TimeSpan.FromSeconds(5.5), 64, 0, VideoFrameFormat.Bgra8);
+            Assert.IsNotNull(expected);
+
+            // Only the container is opened, the frame is the same as through an instance
+            MediaThumbnailData thumbnailData = MediaMetadataProbe.ExtractVideoFrameFromStream(await file.OpenAsync(FileAccessMode.Read), TimeSpan.FromSeconds(5.5), 64, 0, VideoFrameFormat.Bgra8, new FFmpegInteropConfig());
+            Assert.IsNotNull(thumbnailData);
+            Assert.AreEqual(expected.Width, thumbnailData.Width);
+            Assert.AreEqual(expected.Height, thumbnailData.Height);
+            Assert.IsTrue(expected.Buffer.ToArray().SequenceEqual(thumbnailData.Buffer.ToArray()));
+
+            // No video to take a frame from
+            StorageFile audioFile = await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///silence with album art.mp3"));
+            Assert.IsNull(MediaMetadataProbe.ExtractVideoFrameFromStream(await audioFile.OpenAsync(FileAccessMode.Read), TimeSpan.Zero, 64, 64, VideoFrameFormat.Bgra8, null));
+        }
     }
 }
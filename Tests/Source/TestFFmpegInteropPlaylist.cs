@@ -0,0 +1,109 @@
+﻿//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+using FFmpegInterop;
+using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
+using System;
+using System.Collections.Generic;
+using System.Threading.Tasks;
+using Windows.Media.Core;
+using Windows.Storage;
+using Windows.Storage.Streams;
+
+namespace UnitTest.Windows
+{
+    [TestClass]
+    public class TestFFmpegInteropPlaylist
+    {
+        [TestMethod]
+        public void CreatePlaylist_Empty()
+        {
+            // A playlist without any playable item should return null
+            FFmpegInteropPlaylist playlist = FFmpegInteropPlaylist.CreateFromUris(new List<string>(), null);
+            Assert.IsNull(playlist);
+
+            playlist = FFmpegInteropPlaylist.CreateFromUris(new List<string> { string.Empty }, null);
+            Assert.IsNull(playlist);
+        }
+
+        [TestMethod]
+        public async Task CreatePlaylist_FromStreams()
+        {
+            var uri = new Uri("ms-appx:///silence with album art.mp3");
+            var file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+            var streams = new List<IRandomAccessStream>();
+            streams.Add(await file.OpenAsync(FileAccessMode.Read));
+            streams.Add(await file.OpenAsync(FileAccessMode.Read));
+
+            FFmpegInteropPlaylist playlist = FFmpegInteropPlaylist.CreateFromStreams(streams, null);
+            Assert.IsNotNull(playlist);
+            Assert.AreEqual(2u, playlist.ItemCount);
+            Assert.AreEqual(0, playlist.CurrentIndex);
+
+            MediaStreamSource mss = playlist.GetMediaStreamSource();
+            Assert.IsNotNull(mss);
+
+            // The playlist plays continuously, it can't seek
+            Assert.AreEqual(false, mss.CanSeek);
+        }
+
+        [TestMethod]
+        public async Task PlayPlaylist_Advances_Through_Items()
+        {
+            Uri uri = new Uri("ms-appx:///silence with album art.mp3");
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+            List<IRandomAccessStream> streams = new List<IRandomAccessStream>();
+            streams.Add(await file.OpenAsync(FileAccessMode.Read));
+            streams.Add(await file.OpenAsync(FileAccessMode.Read));
+
+            FFmpegInteropPlaylist playlist = FFmpegInteropPlaylist.CreateFromStreams(streams, null);
+            Assert.IsNotNull(playlist);
+
+            // The second item gets opened in the background while the first one plays
+            for (int i = 0; i < 100 && !playlist.IsNextItemReady; i++)
+            {
+                await Task.Delay(50);
+            }
+            Assert.IsTrue(playlist.IsNextItemReady);
+
+            int[] sampleCounts = new int[2];
+            TimeSpan sampleEnd = TimeSpan.Zero;
+            MediaStreamSample sample;
+            while ((sample = playlist.GetNextSample()) != null)
+            {
+                int index = playlist.CurrentIndex;
+                Assert.IsTrue(index == 0 || index == 1);
+                sampleCounts[index]++;
+
+                // The items play back to back on a single timeline
+                Assert.IsTrue(Math.Abs((sample.Timestamp - sampleEnd).TotalMilliseconds) < 1);
+                sampleEnd = sample.Timestamp + sample.Duration;
+
+                // There is no item after the last one to prepare
+                if (index == 1)
+                {
+                    Assert.IsFalse(playlist.IsNextItemReady);
+                }
+            }
+
+            Assert.IsTrue(sampleCounts[0] > 0);
+            Assert.AreEqual(sampleCounts[0], sampleCounts[1]);
+            Assert.AreEqual(-1, playlist.CurrentIndex);
+        }
+    }
+}
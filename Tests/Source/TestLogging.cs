@@ -0,0 +1,215 @@
+﻿//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+using FFmpegInterop;
+using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
+using System;
+using System.Collections.Generic;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace UnitTest.Windows
+{
+    [TestClass]
+    public class TestLogging
+    {
+        // Keeps the messages it receives, optionally holding up the log thread on the first one holding blockToken
+        private class RecordingLogProvider : ILogProvider
+        {
+            private readonly List<string> messages = new List<string>();
+            private readonly string blockToken;
+            public readonly ManualResetEventSlim Blocked = new ManualResetEventSlim(false);
+            public readonly ManualResetEventSlim Release = new ManualResetEventSlim(false);
+
+            public RecordingLogProvider(string blockToken = null)
+            {
+                this.blockToken = blockToken;
+            }
+
+            public void Log(LogLevel level, string message)
+            {
+                lock (messages)
+                {
+                    messages.Add(message);
+                }
+
+                if (blockToken != null && message.Contains(blockToken) && !Blocked.IsSet)
+                {
+                    Blocked.Set();
+                    Release.Wait();
+                }
+            }
+
+            public List<string> Messages
+            {
+                get
+                {
+                    lock (messages)
+                    {
+                        return new List<string>(messages);
+                    }
+                }
+            }
+
+            // Waits for a message holding the text, the log provider is called on a thread of its own
+            public async Task<bool> WaitForMessage(string text)
+            {
+                for (int i = 0; i < 100; i++)
+                {
+                    foreach (string message in Messages)
+                    {
+                        if (message.Contains(text))
+                        {
+                            return true;
+                        }
+                    }
+                    await Task.Delay(50);
+                }
+                return false;
+            }
+
+            public int CountMessages(string text)
+            {
+                int count = 0;
+                foreach (string message in Messages)
+                {
+                    if (message.Contains(text))
+                    {
+                        count++;
+                    }
+                }
+                return count;
+            }
+        }
+
+        [TestCleanup]
+        public void Cleanup()
+        {
+            FFmpegInteropLogging.SetLogLevel(LogLevel.Info);
+            FFmpegInteropLogging.SetLogProvider(null);
+        }
+
+        [TestMethod]
+        public async Task Logging_Filters_By_Level()
+        {
+            RecordingLogProvider provider = new RecordingLogProvider();
+            FFmpegInteropLogging.SetLogProvider(provider);
+            FFmpegInteropLogging.SetLogLevel(LogLevel.Warning);
+
+            string token = Guid.NewGuid().ToString();
+            FFmpegInteropLogging.Log(LogLevel.Info, "info " + token);
+            FFmpegInteropLogging.Log(LogLevel.Verbose, "verbose " + token);
+            FFmpegInteropLogging.Log(LogLevel.Warning, "warning " + token);
+            FFmpegInteropLogging.Log(LogLevel.Error, "error " + token);
+
+            // Messages arrive in order, once the last one is there the filtered ones would have been too
+            Assert.IsTrue(await provider.WaitForMessage("error " + token));
+            Assert.AreEqual(1, provider.CountMessages("warning " + token));
+            Assert.AreEqual(0, provider.CountMessages("info " + token));
+            Assert.AreEqual(0, provider.CountMessages("verbose " + token));
+        }
+
+        [TestMethod]
+        public async Task Logging_Collapses_Repeated_Messages()
+        {
+            RecordingLogProvider provider = new RecordingLogProvider();
+            FFmpegInteropLogging.SetLogProvider(provider);
+
+            string token = Guid.NewGuid().ToString();
+            for (int i = 0; i < 50; i++)
+            {
+                FFmpegInteropLogging.Log(LogLevel.Warning, "repeated " + token);
+            }
+            FFmpegInteropLogging.Log(LogLevel.Warning, "last " + token);
+
+            // The first one goes through, the other 49 are only counted until a different message comes along
+            Assert.IsTrue(await provider.WaitForMessage("last " + token));
+            Assert.AreEqual(1, provider.CountMessages("repeated " + token));
+            Assert.AreEqual(1, provider.CountMessages("Last message repeated 49 times"));
+
+            List<string> messages = provider.Messages;
+            int repeatedIndex = messages.FindIndex(m => m.Contains("repeated " + token));
+            int summaryIndex = messages.FindIndex(m => m.Contains("Last message repeated 49 times"));
+            int lastIndex = messages.FindIndex(m => m.Contains("last " + token));
+            Assert.IsTrue(repeatedIndex < summaryIndex && summaryIndex < lastIndex);
+        }
+
+        [TestMethod]
+        public async Task Logging_Counts_Dropped_Messages()
+        {
+            string token = Guid.NewGuid().ToString();
+            RecordingLogProvider provider = new RecordingLogProvider("block " + token);
+            FFmpegInteropLogging.SetLogProvider(provider);
+            long droppedBefore = FFmpegInteropLogging.DroppedMessageCount;
+
+            // Hold up the log thread, so nothing leaves the queue of 512 messages
+            const int MessageCount = 1100;
+            try
+            {
+                FFmpegInteropLogging.Log(LogLevel.Warning, "block " + token);
+                Assert.IsTrue(provider.Blocked.Wait(TimeSpan.FromSeconds(5)));
+
+                for (int i = 0; i < MessageCount; i++)
+                {
+                    FFmpegInteropLogging.Log(LogLevel.Warning, "message " + i + " " + token);
+                }
+                Assert.IsTrue(FFmpegInteropLogging.DroppedMessageCount - droppedBefore >= MessageCount - 512);
+            }
+            finally
+            {
+                provider.Release.Set();
+            }
+
+            // The queued ones still arrive, followed by a note about the ones which didn't fit
+            Assert.IsTrue(await provider.WaitForMessage("log messages dropped"));
+            Assert.AreEqual(1, provider.CountMessages("message 0 " + token));
+            Assert.AreEqual(0, provider.CountMessages("message " + (MessageCount - 1) + " " + token));
+        }
+
+        [TestMethod]
+        public async Task Logging_Survives_Replacing_The_Provider()
+        {
+            string token = Guid.NewGuid().ToString();
+            RecordingLogProvider provider = new RecordingLogProvider();
+
+            // The log thread keeps sending lines while the provider is swapped and cleared under it
+            using (CancellationTokenSource cts = new CancellationTokenSource())
+            {
+                Task logger = Task.Run(() =>
+                {
+                    for (int i = 0; !cts.IsCancellationRequested; i++)
+                    {
+                        FFmpegInteropLogging.Log(LogLevel.Warning, "message " + i + " " + token);
+                    }
+                });
+
+                for (int i = 0; i < 1000; i++)
+                {
+                    FFmpegInteropLogging.SetLogProvider(i % 2 == 0 ? new RecordingLogProvider() : null);
+                }
+                FFmpegInteropLogging.SetLogProvider(provider);
+                cts.Cancel();
+                await logger;
+            }
+
+            // The provider set last gets the lines from then on
+            FFmpegInteropLogging.Log(LogLevel.Warning, "last " + token);
+            Assert.IsTrue(await provider.WaitForMessage("last " + token));
+        }
+    }
+}
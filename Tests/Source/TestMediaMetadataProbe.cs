@@ -0,0 +1,69 @@
+﻿//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+using FFmpegInterop;
+using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Threading.Tasks;
+using Windows.Storage;
+
+namespace UnitTest.Windows
+{
+    [TestClass]
+    public class TestMediaMetadataProbe
+    {
+        [TestMethod]
+        public async Task ProbeStream_Audio_With_Cover_Art()
+        {
+            var uri = new Uri("ms-appx:///silence with album art.mp3");
+            var file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+            var stream = await file.OpenAsync(FileAccessMode.Read);
+
+            MediaMetadata metadata = MediaMetadataProbe.ProbeStream(stream, null);
+            Assert.IsNotNull(metadata);
+            Assert.AreEqual("mp3", metadata.FormatName);
+            Assert.IsTrue(metadata.Duration.Ticks > 0);
+
+            MediaStreamMetadata audio = metadata.Streams.First(s => s.Kind == MediaStreamKind.Audio);
+            Assert.AreEqual("mp3", audio.CodecName);
+            Assert.IsTrue(audio.SampleRate > 0);
+            Assert.IsTrue(audio.Channels > 0);
+
+            Assert.IsNotNull(metadata.CoverArt);
+            Assert.IsTrue(metadata.CoverArt.Buffer.Length > 0);
+        }
+
+        [TestMethod]
+        public async Task ProbeFiles_Keeps_Order_And_Skips_Invalid()
+        {
+            var files = new List<IStorageFile>();
+            files.Add(await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///silence with album art.mp3")));
+            files.Add(await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///test.txt")));
+            files.Add(await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///silence with album art.mp3")));
+
+            var results = await MediaMetadataProbe.ProbeFilesAsync(files, 2, TimeSpan.FromSeconds(10));
+            Assert.AreEqual(3, results.Count);
+            Assert.IsNotNull(results[0]);
+            Assert.IsNull(results[1]);
+            Assert.IsNotNull(results[2]);
+            Assert.AreEqual(results[0].Duration, results[2].Duration);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+﻿//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+using FFmpegInterop;
+using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
+using System;
+using System.Linq;
+using System.Threading.Tasks;
+using Windows.Storage;
+
+namespace UnitTest.Windows
+{
+    [TestClass]
+    public class TestPacketIndex
+    {
+        [TestMethod]
+        public async Task PacketIndex_Audio_Stream()
+        {
+            var uri = new Uri("ms-appx:///silence with album art.mp3");
+            var file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+            var stream = await file.OpenAsync(FileAccessMode.Read);
+
+            PacketIndex packetIndex = await PacketIndex.CreateFromStreamAsync(stream, null);
+            Assert.IsNotNull(packetIndex);
+
+            PacketTable audio = packetIndex.Streams.First(s => s.Kind == MediaStreamKind.Audio);
+            Assert.IsTrue(audio.Count > 0);
+
+            // Every column holds one value per packet
+            Assert.AreEqual(audio.Count, (uint)audio.GetPresentationTimestamps().Length);
+            Assert.AreEqual(audio.Count, (uint)audio.GetDecodeTimestamps().Length);
+            Assert.AreEqual(audio.Count, (uint)audio.GetFlags().Length);
+            Assert.AreEqual(audio.Count, (uint)audio.GetPositions().Length);
+
+            int[] sizes = audio.GetSizes();
+            Assert.AreEqual(audio.Count, (uint)sizes.Length);
+            Assert.IsTrue(sizes.All(size => size > 0));
+            Assert.IsTrue((ulong)sizes.Sum() <= stream.Size);
+
+            // Positions only grow in a plain audio file
+            long[] positions = audio.GetPositions();
+            for (int i = 1; i < positions.Length; i++)
+            {
+                Assert.IsTrue(positions[i] > positions[i - 1]);
+            }
+
+            double[] bitrates = audio.GetBitrates(TimeSpan.FromSeconds(1));
+            Assert.IsTrue(bitrates.Length > 0);
+            Assert.IsTrue(bitrates[0] > 0);
+
+            // Every MP3 frame is a keyframe
+            GopStatistics gops = audio.GetGopStatistics();
+            Assert.AreEqual((int)audio.Count, gops.GopCount);
+            Assert.AreEqual(1, gops.MaxPackets);
+        }
+    }
+}
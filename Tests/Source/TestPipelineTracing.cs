@@ -0,0 +1,73 @@
+﻿//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+using FFmpegInterop;
+using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
+using System;
+using System.Collections.Generic;
+using System.Threading.Tasks;
+using Windows.Data.Json;
+using Windows.Storage;
+using Windows.Storage.Streams;
+
+namespace UnitTest.Windows
+{
+    [TestClass]
+    public class TestPipelineTracing
+    {
+        [TestMethod]
+        public async Task PipelineTracing_Records_Spans()
+        {
+            var uri = new Uri("ms-appx:///silence with album art.mp3");
+            var file = await StorageFile.GetFileFromApplicationUriAsync(uri);
+            var streams = new List<IRandomAccessStream>();
+            streams.Add(await file.OpenAsync(FileAccessMode.Read));
+
+            PipelineTracing.Start(10000);
+            Assert.IsTrue(PipelineTracing.IsEnabled);
+
+            // The playlist decodes the first sample of its first item while being created
+            using (FFmpegInteropPlaylist playlist = FFmpegInteropPlaylist.CreateFromStreams(streams, null))
+            {
+                Assert.IsNotNull(playlist);
+            }
+
+            PipelineTracing.Stop();
+            Assert.IsFalse(PipelineTracing.IsEnabled);
+            Assert.AreEqual(0, PipelineTracing.DroppedEventCount);
+
+            // The trace is valid JSON holding the spans of the pipeline
+            JsonObject trace = JsonObject.Parse(PipelineTracing.GetTraceJson());
+            JsonArray events = trace.GetNamedArray("traceEvents");
+            var names = new HashSet<string>();
+            foreach (IJsonValue value in events)
+            {
+                names.Add(value.GetObject().GetNamedString("name"));
+            }
+            Assert.IsTrue(names.Contains("read"));
+            Assert.IsTrue(names.Contains("decode"));
+            Assert.IsTrue(names.Contains("sample"));
+
+            // A new trace starts empty
+            PipelineTracing.Start(10000);
+            PipelineTracing.Stop();
+            trace = JsonObject.Parse(PipelineTracing.GetTraceJson());
+            Assert.AreEqual(0u, trace.GetNamedArray("traceEvents").Count);
+        }
+    }
+}
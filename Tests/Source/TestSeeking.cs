@@ -0,0 +1,162 @@
+﻿//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+using FFmpegInterop;
+using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
+using System;
+using System.Linq;
+using System.Runtime.InteropServices.WindowsRuntime;
+using System.Threading;
+using System.Threading.Tasks;
+using Windows.Media.Core;
+using Windows.Storage;
+using Windows.Storage.Streams;
+
+namespace UnitTest.Windows
+{
+    [TestClass]
+    public class TestSeeking
+    {
+        // 160x120 at 25 fps with a keyframe every second, decoded to NV12
+        private async Task<FFmpegInteropMSS> OpenDecodedVideo(TimeSpan scrubbingInterval)
+        {
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///two audio tracks.mp4"));
+            IRandomAccessStream stream = await file.OpenAsync(FileAccessMode.Read);
+
+            FFmpegInteropConfig config = new FFmpegInteropConfig();
+            config.ForceVideoDecode = true;
+            config.ScrubbingInterval = scrubbingInterval;
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(stream, config);
+            Assert.IsNotNull(FFmpegMSS);
+            return FFmpegMSS;
+        }
+
+        [TestMethod]
+        public async Task Seek_Coalesces_Requests()
+        {
+            FFmpegInteropMSS FFmpegMSS = await OpenDecodedVideo(TimeSpan.Zero);
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+            long seeks = FFmpegMSS.Statistics.Seeks;
+
+            // Only the last position is read from, the ones replaced before the next sample request never are
+            Assert.AreEqual(TimeSpan.FromSeconds(2), FFmpegMSS.Seek(TimeSpan.FromSeconds(2)));
+            Assert.AreEqual(TimeSpan.FromSeconds(5), FFmpegMSS.Seek(TimeSpan.FromSeconds(5)));
+            Assert.AreEqual(TimeSpan.FromSeconds(8), FFmpegMSS.Seek(TimeSpan.FromSeconds(8)));
+
+            MediaStreamSample sample = FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor);
+            Assert.IsNotNull(sample);
+            Assert.AreEqual(seeks + 1, FFmpegMSS.Statistics.Seeks);
+
+            // Frames before the position aren't handed out, the first one is the frame shown at the position
+            Assert.AreEqual(TimeSpan.FromSeconds(8), sample.Timestamp);
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor));
+        }
+
+        [TestMethod]
+        public async Task Seek_Shows_KeyFrame_Preview_While_Scrubbing()
+        {
+            FFmpegInteropMSS FFmpegMSS = await OpenDecodedVideo(TimeSpan.FromSeconds(10));
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+
+            // The second seek follows the first within the scrubbing interval
+            FFmpegMSS.Seek(TimeSpan.FromSeconds(2));
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+            FFmpegMSS.Seek(TimeSpan.FromSeconds(7.5));
+
+            // The keyframe at 7 s is shown at 7.5 s right away, then the frames are decoded up to 7.5 s again. The one
+            // showing there starts at 7.48 s, before the preview, and comes right after it instead.
+            MediaStreamSample[] samples = new MediaStreamSample[10];
+            for (int i = 0; i < samples.Length; i++)
+            {
+                samples[i] = FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor);
+                Assert.IsNotNull(samples[i]);
+            }
+            Assert.AreEqual(TimeSpan.FromSeconds(7.5), samples[0].Timestamp);
+            for (int i = 1; i < samples.Length; i++)
+            {
+                Assert.IsTrue(samples[i].Timestamp > samples[i - 1].Timestamp);
+            }
+            Assert.IsTrue(samples[1].Timestamp < TimeSpan.FromSeconds(7.52));
+            Assert.AreEqual(TimeSpan.FromSeconds(7.52), samples[2].Timestamp);
+
+            // Without scrubbing the same frames come out of a plain seek, so the decoding after the preview is intact
+            FFmpegInteropMSS reference = await OpenDecodedVideo(TimeSpan.Zero);
+            Assert.IsNotNull(reference.GetNextSample(reference.VideoDescriptor));
+            reference.Seek(TimeSpan.FromSeconds(7));
+            MediaStreamSample keyFrame = reference.GetNextSample(reference.VideoDescriptor);
+            Assert.AreEqual(TimeSpan.FromSeconds(7), keyFrame.Timestamp);
+            Assert.IsTrue(keyFrame.Buffer.ToArray().SequenceEqual(samples[0].Buffer.ToArray()));
+
+            reference.Seek(TimeSpan.FromSeconds(7.5));
+            for (int i = 1; i < samples.Length; i++)
+            {
+                MediaStreamSample frame = reference.GetNextSample(reference.VideoDescriptor);
+                Assert.IsNotNull(frame);
+                Assert.IsTrue(frame.Buffer.ToArray().SequenceEqual(samples[i].Buffer.ToArray()));
+            }
+        }
+
+        // Only the end of the media ends a stream, a request abandoned for a seek starts over from the new position
+        private void PullUntilStopped(FFmpegInteropMSS FFmpegMSS, IMediaStreamDescriptor descriptor, CancellationToken stop)
+        {
+            TimeSpan end = TimeSpan.Zero;
+            while (!stop.IsCancellationRequested)
+            {
+                MediaStreamSample sample = FFmpegMSS.GetNextSample(descriptor);
+                if (sample == null)
+                {
+                    // Stays at the end until the next seek
+                    Assert.IsTrue(end >= TimeSpan.FromSeconds(9.9), "Stream ended at " + end);
+                }
+                else
+                {
+                    end = sample.Timestamp + sample.Duration;
+                }
+            }
+        }
+
+        [TestMethod]
+        public async Task Seek_During_Sample_Requests_Keeps_Streams_Enabled()
+        {
+            FFmpegInteropMSS FFmpegMSS = await OpenDecodedVideo(TimeSpan.FromMilliseconds(300));
+
+            // Seeks abort the reads of the requests running meanwhile, which start over from the new position. Audio
+            // and video are requested from threads of their own like the pipeline does, so the request of one stream
+            // may carry out the seek which the request of the other was abandoned for.
+            CancellationTokenSource stop = new CancellationTokenSource();
+            Task videoRequests = Task.Run(() => PullUntilStopped(FFmpegMSS, FFmpegMSS.VideoDescriptor, stop.Token));
+            Task audioRequests = Task.Run(() => PullUntilStopped(FFmpegMSS, FFmpegMSS.AudioDescriptor, stop.Token));
+
+            Random random = new Random(1);
+            for (int i = 0; i < 500; i++)
+            {
+                FFmpegMSS.Seek(TimeSpan.FromMilliseconds(random.Next(9000)));
+                await Task.Delay(random.Next(3));
+            }
+            stop.Cancel();
+            await videoRequests;
+            await audioRequests;
+
+            Assert.AreEqual(0, FFmpegMSS.Statistics.Audio.DisabledStreams);
+            Assert.AreEqual(0, FFmpegMSS.Statistics.Video.DisabledStreams);
+            FFmpegMSS.Seek(TimeSpan.FromSeconds(1));
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor));
+        }
+    }
+}
@@ -0,0 +1,101 @@
+﻿//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+using FFmpegInterop;
+using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
+using System;
+using System.Diagnostics;
+using System.IO;
+using System.Runtime.InteropServices.WindowsRuntime;
+using System.Threading.Tasks;
+using Windows.Graphics.Imaging;
+using Windows.Storage;
+using Windows.Storage.Streams;
+
+namespace UnitTest.Windows
+{
+    [TestClass]
+    public class TestSpriteSheet
+    {
+        // Benchmark media, a 2 hour 1080p video copied to the local folder of the test app
+        const string BenchmarkFileName = "sprite sheet benchmark 1080p.mp4";
+        const int BenchmarkTileCount = 100;
+
+        [TestMethod]
+        public async Task ExtractSpriteSheet()
+        {
+            Uri uri = new Uri(Constants.DownloadUriSource);
+            StorageFile file = await StorageFile.CreateStreamedFileFromUriAsync(Constants.DownloadStreamedFileName, uri, null);
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, false, false);
+            Assert.IsNotNull(FFmpegMSS);
+
+            SpriteSheet spriteSheet = await FFmpegMSS.ExtractSpriteSheetAsync(10, 5, 160, 0, VideoFrameFormat.Jpeg);
+            Assert.IsNotNull(spriteSheet);
+            Assert.AreEqual(5, spriteSheet.Columns);
+            Assert.AreEqual(2, spriteSheet.Rows);
+            Assert.AreEqual(160, spriteSheet.TileWidth);
+            Assert.AreEqual(10, spriteSheet.Positions.Count);
+
+            // The tiles follow the media from start to end
+            for (int i = 1; i < spriteSheet.Positions.Count; i++)
+            {
+                Assert.IsTrue(spriteSheet.Positions[i] >= spriteSheet.Positions[i - 1]);
+            }
+
+            using (IRandomAccessStream imageStream = spriteSheet.Image.Buffer.AsStream().AsRandomAccessStream())
+            {
+                BitmapDecoder decoder = await BitmapDecoder.CreateAsync(imageStream);
+                Assert.AreEqual((uint)(5 * spriteSheet.TileWidth), decoder.PixelWidth);
+                Assert.AreEqual((uint)(2 * spriteSheet.TileHeight), decoder.PixelHeight);
+            }
+        }
+
+        [TestMethod]
+        public async Task SpriteSheet_Benchmark_Versus_Single_Frames()
+        {
+            IStorageItem item = await ApplicationData.Current.LocalFolder.TryGetItemAsync(BenchmarkFileName);
+            if (item == null)
+            {
+                Assert.Inconclusive("Copy a 2 hour 1080p video named \"{0}\" to {1} to run the benchmark", BenchmarkFileName, ApplicationData.Current.LocalFolder.Path);
+            }
+
+            StorageFile file = (StorageFile)item;
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(await file.OpenAsync(FileAccessMode.Read), false, false);
+            Assert.IsNotNull(FFmpegMSS);
+
+            // One frame at a time, every call seeks and sets up a decoder again
+            Stopwatch stopwatch = Stopwatch.StartNew();
+            for (int i = 0; i < BenchmarkTileCount; i++)
+            {
+                TimeSpan position = TimeSpan.FromTicks(FFmpegMSS.Duration.Ticks * (2 * i + 1) / (2 * BenchmarkTileCount));
+                Assert.IsNotNull(FFmpegMSS.ExtractVideoFrame(position, 160, 90, VideoFrameFormat.Bgra8));
+            }
+            TimeSpan singleFrames = stopwatch.Elapsed;
+
+            stopwatch.Restart();
+            SpriteSheet spriteSheet = await FFmpegMSS.ExtractSpriteSheetAsync(BenchmarkTileCount, 10, 160, 90, VideoFrameFormat.Bgra8);
+            TimeSpan batch = stopwatch.Elapsed;
+            Assert.IsNotNull(spriteSheet);
+
+            Debug.WriteLine("{0} frames of {1}, single frames: {2:F0} ms, sprite sheet: {3:F0} ms",
+                BenchmarkTileCount, FFmpegMSS.Duration, singleFrames.TotalMilliseconds, batch.TotalMilliseconds);
+        }
+    }
+}
@@ -0,0 +1,149 @@
+﻿//*****************************************************************************
+//
+//	Copyright 2017 Microsoft Corporation
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http ://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+//
+//*****************************************************************************
+
+using FFmpegInterop;
+using Microsoft.VisualStudio.TestPlatform.UnitTestFramework;
+using System;
+using System.Threading.Tasks;
+using Windows.Media.Core;
+using Windows.Storage;
+using Windows.Storage.Streams;
+
+namespace UnitTest.Windows
+{
+    [TestClass]
+    public class TestTrickPlay
+    {
+        // 160x120 at 25 fps with a keyframe every second, 10 s long, decoded to NV12
+        private async Task<FFmpegInteropMSS> OpenDecodedVideo(string fileName)
+        {
+            StorageFile file = await StorageFile.GetFileFromApplicationUriAsync(new Uri("ms-appx:///" + fileName));
+            IRandomAccessStream stream = await file.OpenAsync(FileAccessMode.Read);
+
+            FFmpegInteropConfig config = new FFmpegInteropConfig();
+            config.ForceVideoDecode = true;
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(stream, config);
+            Assert.IsNotNull(FFmpegMSS);
+
+            // Timestamps are only known relative to the first sample
+            Assert.IsNotNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+            return FFmpegMSS;
+        }
+
+        // Read the keyframes of trick play up to the end of the stream, checking each one is shown at its time
+        private void AssertKeyFrames(FFmpegInteropMSS FFmpegMSS, double[] positions, TimeSpan outputStart, double rate)
+        {
+            foreach (double position in positions)
+            {
+                MediaStreamSample sample = FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor);
+                Assert.IsNotNull(sample);
+
+                // Only keyframes are read, the one shown last is the position to carry on from
+                TimeSpan source = TimeSpan.FromSeconds(position);
+                Assert.AreEqual(source, FFmpegMSS.TrickPlayPosition);
+
+                // Shown after the previous one by the time it takes to get there at the rate
+                long distance = Math.Abs(source.Ticks - TimeSpan.FromSeconds(positions[0]).Ticks);
+                Assert.AreEqual(outputStart + TimeSpan.FromTicks((long)(distance / Math.Abs(rate))), sample.Timestamp);
+                Assert.AreEqual(TimeSpan.FromMilliseconds(100), sample.Duration);
+                Assert.IsTrue(sample.Discontinuous);
+            }
+            Assert.IsNull(FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor));
+        }
+
+        [TestMethod]
+        public async Task TrickPlay_Fast_Forward_Shows_KeyFrames()
+        {
+            FFmpegInteropMSS FFmpegMSS = await OpenDecodedVideo("two audio tracks.mp4");
+
+            // 1.6 s apart in the media, the keyframes at or after 2, 3.6, 5.6 and 7.6 s. There is none after 9.6 s.
+            FFmpegMSS.TrickPlayRate = 16.0;
+            Assert.AreEqual(TimeSpan.FromSeconds(2), FFmpegMSS.Seek(TimeSpan.FromSeconds(2)));
+            Assert.IsNull(FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor));
+            AssertKeyFrames(FFmpegMSS, new double[] { 2, 4, 6, 8 }, TimeSpan.FromSeconds(2), 16.0);
+        }
+
+        [TestMethod]
+        public async Task TrickPlay_Rewind_Shows_KeyFrames_In_Reverse()
+        {
+            FFmpegInteropMSS FFmpegMSS = await OpenDecodedVideo("two audio tracks.mp4");
+
+            // Rewinding from 9.5 s takes 0.59375 s to the start, the samples end at the duration of 10 s. The keyframes
+            // are the ones at or before 9.5, 7.4, 5.4, 3.4 and 1.4 s, there is none before -0.6 s.
+            FFmpegMSS.TrickPlayRate = -16.0;
+            TimeSpan outputStart = TimeSpan.FromTicks(94062500);
+            Assert.AreEqual(outputStart, FFmpegMSS.Seek(TimeSpan.FromSeconds(9.5)));
+            Assert.IsNull(FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor));
+            AssertKeyFrames(FFmpegMSS, new double[] { 9, 7, 5, 3, 1 }, outputStart, -16.0);
+        }
+
+        [TestMethod]
+        public async Task TrickPlay_Step_Follows_Rate()
+        {
+            // Steps of 0.2 s are shorter than the keyframe interval, every keyframe is shown
+            FFmpegInteropMSS FFmpegMSS = await OpenDecodedVideo("two audio tracks.mp4");
+            FFmpegMSS.TrickPlayRate = 2.0;
+            Assert.AreEqual(TimeSpan.Zero, FFmpegMSS.Seek(TimeSpan.Zero));
+            AssertKeyFrames(FFmpegMSS, new double[] { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }, TimeSpan.Zero, 2.0);
+
+            // Steps of 3.2 s skip the keyframes in between
+            FFmpegMSS = await OpenDecodedVideo("two audio tracks.mp4");
+            FFmpegMSS.TrickPlayRate = 32.0;
+            Assert.AreEqual(TimeSpan.Zero, FFmpegMSS.Seek(TimeSpan.Zero));
+            AssertKeyFrames(FFmpegMSS, new double[] { 0, 4, 8 }, TimeSpan.Zero, 32.0);
+        }
+
+        [TestMethod]
+        public async Task TrickPlay_Reads_Past_Index_Built_While_Reading()
+        {
+            // Without cues the demuxer only knows the keyframes it has read, the ones further on are still found
+            FFmpegInteropMSS FFmpegMSS = await OpenDecodedVideo("no cues.mkv");
+            FFmpegMSS.TrickPlayRate = 16.0;
+            Assert.AreEqual(TimeSpan.FromSeconds(2), FFmpegMSS.Seek(TimeSpan.FromSeconds(2)));
+            AssertKeyFrames(FFmpegMSS, new double[] { 2, 4, 6, 8 }, TimeSpan.FromSeconds(2), 16.0);
+        }
+
+        [TestMethod]
+        public async Task TrickPlayRate_Takes_Effect_With_Seek()
+        {
+            Uri uri = new Uri(Constants.DownloadUriSource);
+            StorageFile file = await StorageFile.CreateStreamedFileFromUriAsync(Constants.DownloadStreamedFileName, uri, null);
+            IRandomAccessStream readStream = await file.OpenAsync(FileAccessMode.Read);
+
+            FFmpegInteropMSS FFmpegMSS = FFmpegInteropMSS.CreateFFmpegInteropMSSFromStream(readStream, false, false);
+            Assert.IsNotNull(FFmpegMSS);
+            Assert.AreEqual(1.0, FFmpegMSS.TrickPlayRate);
+
+            // Fast forward and rewind, anything from 0 to 1 plays normally
+            FFmpegMSS.TrickPlayRate = 8.0;
+            Assert.AreEqual(8.0, FFmpegMSS.TrickPlayRate);
+            FFmpegMSS.TrickPlayRate = -4.0;
+            Assert.AreEqual(-4.0, FFmpegMSS.TrickPlayRate);
+            FFmpegMSS.TrickPlayRate = 0.5;
+            Assert.AreEqual(1.0, FFmpegMSS.TrickPlayRate);
+
+            // Without a seek the rate isn't applied, audio and video keep coming at normal rate
+            FFmpegMSS.TrickPlayRate = 16.0;
+            MediaStreamSample audioSample = FFmpegMSS.GetNextSample(FFmpegMSS.AudioDescriptor);
+            MediaStreamSample videoSample = FFmpegMSS.GetNextSample(FFmpegMSS.VideoDescriptor);
+            Assert.IsNotNull(audioSample);
+            Assert.IsNotNull(videoSample);
+            Assert.AreEqual(TimeSpan.Zero, FFmpegMSS.TrickPlayPosition);
+        }
+    }
+}